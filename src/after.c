@@ -36,10 +36,16 @@
 #include "rules.h"
 #include "after.h"
 #include "ipc.h"
-
-pthread_mutex_t After2_Mutex=PTHREAD_MUTEX_INITIALIZER;
+#include "ipc-index.h"
+#include "ipc-lock.h"
+#include "ipc-wheel.h"
+#include "util-time.h"
+#include "util-track.h"
 
 struct _After2_IPC *After2_IPC;
+struct _Sagan_IPC_Message *After2_Message;
+struct _Sagan_IPC_Index *After2_Index;
+struct _Sagan_IPC_Wheel *After2_Wheel;
 
 struct _SaganCounters *counters;
 struct RuleBody *RuleBody;
@@ -51,33 +57,29 @@ struct _Sagan_IPC_Counters *counters_ipc;
 bool After2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_dst,  uint32_t dst_port, char *username, char *syslog_message )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
     int i;
 
     uint64_t after_oldtime;
     uint64_t current_time;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
     char src_tmp[MAXIP] = { 0 };
     char dst_tmp[MAXIP] = { 0 };
     char username_tmp[MAX_USERNAME_SIZE] = { 0 };
     uint32_t dst_port_tmp = 0;
     uint32_t src_port_tmp = 0;
 
-    char hash_string[128] = { 0 };
     char debug_string[64] = { 0 };
 
-    uint32_t hash;
+    struct _Sagan_Track_Key key;
+
+    uint64_t hash;
+    uint32_t stripe;
+
+    bool all = false;
 
     bool after_log_flag = true;
 
-    current_time = atol(timet);
+    current_time = Return_Epoch();
     username_tmp[0] = '\0';
 
     if ( RuleBody[rule_position].After.after2_method_src == true )
@@ -105,126 +107,166 @@ bool After2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_dst,
             dst_port_tmp = dst_port;
         }
 
-    snprintf(hash_string, sizeof(hash_string), "%s|%d|%s|%d|%s", src_tmp, src_port_tmp, dst_tmp, dst_port_tmp, username_tmp);
+    hash = Track_Key(&key, src_tmp, src_port_tmp, dst_tmp, dst_port_tmp, username_tmp);
+
+    /* One probe of the shared index instead of a walk over every entry.
+       Updating an entry only needs its stripe.  Adding one changes the
+       index,  so that takes the whole table and looks again */
 
-    hash = Djb2_Hash( hash_string );
+    stripe = (uint32_t)( hash >> 32 ) ^ (uint32_t)hash ^ (uint32_t)RuleBody[rule_position].s_sid;
 
-    for (i = 0; i < counters_ipc->after2_count; i++ )
+    IPC_Lock(AFTER2, stripe);
+
+    i = IPC_Index_Find(After2_Index, RuleBody[rule_position].s_sid, RuleBody[rule_position].s_rev, hash);
+
+    if ( i < 0 )
         {
+            IPC_Unlock(AFTER2, stripe);
+            IPC_Lock_All(AFTER2);
 
-            if ( hash == After2_IPC[i].hash && After2_IPC[i].sid == RuleBody[rule_position].s_sid &&
-                    After2_IPC[i].rev == RuleBody[rule_position].s_rev )
-                {
+            all = true;
+            i = IPC_Index_Find(After2_Index, RuleBody[rule_position].s_sid, RuleBody[rule_position].s_rev, hash);
+        }
 
+    /* The index only has the 64 bit hash.  If another tuple got there
+       first,  the new one takes the entry over and starts from scratch */
 
-                    File_Lock(config->shm_after2);
-                    pthread_mutex_lock(&After2_Mutex);
+    if ( i >= 0 && ( memcmp(&After2_IPC[i].key, &key, sizeof(key)) || strcmp(After2_IPC[i].username, username_tmp) ) )
+        {
 
-                    After2_IPC[i].count++;
+            After2_IPC[i].key = key;
+            After2_IPC[i].count = 0;
+            After2_IPC[i].utime = current_time;
 
-                    after_oldtime = current_time - After2_IPC[i].utime;
+            strlcpy(After2_IPC[i].ip_src, src_tmp, sizeof(After2_IPC[i].ip_src));
+            strlcpy(After2_IPC[i].ip_dst, dst_tmp, sizeof(After2_IPC[i].ip_dst));
+            strlcpy(After2_IPC[i].username, username_tmp, sizeof(After2_IPC[i].username));
 
-                    strlcpy(After2_IPC[i].syslog_message, syslog_message, sizeof(After2_IPC[i].syslog_message));
-                    strlcpy(After2_IPC[i].signature_msg, RuleBody[rule_position].s_msg, sizeof(After2_IPC[i].signature_msg));
+            After2_IPC[i].src_port = src_port_tmp;
+            After2_IPC[i].dst_port = dst_port_tmp;
 
-                    /* Reset counter if it's expired */
+        }
 
-                    if ( after_oldtime > RuleBody[rule_position].After.after2_seconds || After2_IPC[i].count == 0 )
-                        {
-                            After2_IPC[i].count=1;
-                            After2_IPC[i].utime = current_time;
-                            after_log_flag = true;
-                        }
+    if ( i >= 0 )
+        {
 
+            After2_IPC[i].count++;
 
-                    if ( RuleBody[rule_position].After.after2_count < After2_IPC[i].count )
-                        {
+            after_oldtime = current_time - After2_IPC[i].utime;
 
-                            After2_IPC[i].utime = current_time;
-                            after_log_flag = false;
+            strlcpy(After2_Message[i].syslog_message, syslog_message, sizeof(After2_Message[i].syslog_message));
+            strlcpy(After2_Message[i].signature_msg, RuleBody[rule_position].s_msg, sizeof(After2_Message[i].signature_msg));
+
+            /* Reset counter if it's expired */
+
+            if ( after_oldtime > RuleBody[rule_position].After.after2_seconds || After2_IPC[i].count == 0 )
+                {
+                    After2_IPC[i].count=1;
+                    After2_IPC[i].utime = current_time;
+                    after_log_flag = true;
+                }
 
-                            if ( debug->debuglimits )
-                                {
 
-                                    if ( After2_IPC[i].after2_method_src == true )
-                                        {
-                                            strlcat(debug_string, "by_src ", sizeof(debug_string));
-                                        }
+            if ( RuleBody[rule_position].After.after2_count < After2_IPC[i].count )
+                {
 
-                                    if ( After2_IPC[i].after2_method_dst == true )
-                                        {
-                                            strlcat(debug_string, "by_dst ", sizeof(debug_string));
-                                        }
+                    After2_IPC[i].utime = current_time;
+                    after_log_flag = false;
 
-                                    if ( After2_IPC[i].after2_method_username == true )
-                                        {
-                                            strlcat(debug_string, "by_username ", sizeof(debug_string));
-                                        }
+                    if ( debug->debuglimits )
+                        {
 
-                                    if ( After2_IPC[i].after2_method_srcport == true )
-                                        {
-                                            strlcat(debug_string, "by_srcport ", sizeof(debug_string));
-                                        }
+                            if ( After2_IPC[i].after2_method_src == true )
+                                {
+                                    strlcat(debug_string, "by_src ", sizeof(debug_string));
+                                }
 
-                                    if ( After2_IPC[i].after2_method_dstport == true )
-                                        {
-                                            strlcat(debug_string, "by_dstport ", sizeof(debug_string));
-                                        }
+                            if ( After2_IPC[i].after2_method_dst == true )
+                                {
+                                    strlcat(debug_string, "by_dst ", sizeof(debug_string));
+                                }
 
-                                    Sagan_Log(NORMAL, "After SID %" PRIu64 ". Tracking by %s[%d: Hash: %lu]", After2_IPC[i].sid, debug_string, i, hash);
+                            if ( After2_IPC[i].after2_method_username == true )
+                                {
+                                    strlcat(debug_string, "by_username ", sizeof(debug_string));
+                                }
 
+                            if ( After2_IPC[i].after2_method_srcport == true )
+                                {
+                                    strlcat(debug_string, "by_srcport ", sizeof(debug_string));
                                 }
 
-                            counters->after_total++;
+                            if ( After2_IPC[i].after2_method_dstport == true )
+                                {
+                                    strlcat(debug_string, "by_dstport ", sizeof(debug_string));
+                                }
+
+                            Sagan_Log(NORMAL, "After SID %" PRIu64 ". Tracking by %s[%d: Hash: %lu]", After2_IPC[i].sid, debug_string, i, hash);
+
                         }
 
-                    pthread_mutex_unlock(&After2_Mutex);
-                    File_Unlock(config->shm_after2);
+                    __atomic_add_fetch(&counters->after_total, 1, __ATOMIC_SEQ_CST);
+                }
 
-                    return(after_log_flag);
+            if ( all == true )
+                {
+                    IPC_Unlock_All(AFTER2);
+                }
+            else
+                {
+                    IPC_Unlock(AFTER2, stripe);
                 }
 
+            return(after_log_flag);
         }
 
 
-    /* If not found add it to the array */
+    /* Not found.  Drop the few entries that have come due on the expiry
+       wheel,  then add it.  If it's still full,  drop everything that has
+       expired */
+
+    Expire_IPC_After2(current_time, IPC_WHEEL_RECLAIM);
 
-    if ( Clean_IPC_Object(AFTER2) == 0 )
+    if ( counters_ipc->after2_count < config->max_after2 || Clean_IPC_After2() == 0 )
         {
 
-            File_Lock(config->shm_after2);
-            pthread_mutex_lock(&After2_Mutex);
+            i = counters_ipc->after2_count;
+
+            After2_IPC[i].hash = hash;
+            After2_IPC[i].key = key;
 
-            After2_IPC[counters_ipc->after2_count].hash = hash;
+            After2_IPC[i].count = 1;
+            After2_IPC[i].utime = current_time;
+            After2_IPC[i].expire = RuleBody[rule_position].After.after2_seconds;
+            After2_IPC[i].sid = RuleBody[rule_position].s_sid;
+            After2_IPC[i].rev = RuleBody[rule_position].s_rev;
+            After2_IPC[i].target_count =RuleBody[rule_position].After.after2_count;
 
-            After2_IPC[counters_ipc->after2_count].count = 1;
-            After2_IPC[counters_ipc->after2_count].utime = current_time;
-            After2_IPC[counters_ipc->after2_count].expire = RuleBody[rule_position].After.after2_seconds;
-            After2_IPC[counters_ipc->after2_count].sid = RuleBody[rule_position].s_sid;
-            After2_IPC[counters_ipc->after2_count].rev = RuleBody[rule_position].s_rev;
-            After2_IPC[counters_ipc->after2_count].target_count =RuleBody[rule_position].After.after2_count;
+            After2_IPC[i].after2_method_src = RuleBody[rule_position].After.after2_method_src;
+            After2_IPC[i].after2_method_dst = RuleBody[rule_position].After.after2_method_dst;
+            After2_IPC[i].after2_method_username = RuleBody[rule_position].After.after2_method_username;
 
-            After2_IPC[counters_ipc->after2_count].after2_method_src = RuleBody[rule_position].After.after2_method_src;
-            After2_IPC[counters_ipc->after2_count].after2_method_dst = RuleBody[rule_position].After.after2_method_dst;
-            After2_IPC[counters_ipc->after2_count].after2_method_username = RuleBody[rule_position].After.after2_method_username;
+            strlcpy(After2_IPC[i].ip_src, src_tmp, sizeof(After2_IPC[i].ip_src));
+            After2_IPC[i].src_port = src_port_tmp;
 
-            strlcpy(After2_IPC[counters_ipc->after2_count].ip_src, src_tmp, sizeof(After2_IPC[counters_ipc->after2_count].ip_src));
-            After2_IPC[counters_ipc->after2_count].src_port = src_port_tmp;
+            strlcpy(After2_IPC[i].ip_dst, dst_tmp, sizeof(After2_IPC[i].ip_dst));
+            After2_IPC[i].dst_port = dst_port_tmp;
 
-            strlcpy(After2_IPC[counters_ipc->after2_count].ip_dst, dst_tmp, sizeof(After2_IPC[counters_ipc->after2_count].ip_dst));
-            After2_IPC[counters_ipc->after2_count].dst_port = dst_port_tmp;
+            strlcpy(After2_IPC[i].username, username_tmp, sizeof(After2_IPC[i].username));
 
-            strlcpy(After2_IPC[counters_ipc->after2_count].username, username_tmp, sizeof(After2_IPC[counters_ipc->after2_count].username));
+            strlcpy(After2_Message[i].syslog_message, syslog_message, sizeof(After2_Message[i].syslog_message));
+            strlcpy(After2_Message[i].signature_msg, RuleBody[rule_position].s_msg, sizeof(After2_Message[i].signature_msg));
 
-            strlcpy(After2_IPC[counters_ipc->after2_count].syslog_message, syslog_message, sizeof(After2_IPC[counters_ipc->after2_count].syslog_message));
-            strlcpy(After2_IPC[counters_ipc->after2_count].signature_msg, RuleBody[rule_position].s_msg, sizeof(After2_IPC[counters_ipc->after2_count].signature_msg));
+            IPC_Index_Insert(After2_Index, After2_IPC[i].sid, After2_IPC[i].rev, hash, i);
+
+            IPC_Wheel_Add(After2_Wheel, i, current_time + RuleBody[rule_position].After.after2_seconds + 1);
 
             counters_ipc->after2_count++;
 
-            pthread_mutex_unlock(&After2_Mutex);
-            File_Unlock(config->shm_after2);
         }
 
+    IPC_Unlock_All(AFTER2);
+
     return(true);
 }
 
@@ -0,0 +1,742 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* batch-queue.c
+ *
+ * Hands batches of log lines from the reader(s) to the Processor() threads.
+ *
+ * A fixed pool of batch buffers is allocated at start up.  Empty buffers
+ * sit in the "free" ring,  filled buffers in the "work" ring.  The reader
+ * packs lines into a buffer's "slab" and queues the pointer,  the processor
+ * thread works on that same buffer and hands it back when done.  Lines are
+ * copied one time (into the slab) and no lock is taken unless a thread
+ * actually has to sleep.
+ *
+ * Slabs start at "batch-size" * BATCH_SLAB_LINE_SIZE bytes and only grow
+ * when longer lines show up,  so memory follows the real line lengths
+ * rather than MAX_SYSLOGMSG for every line.
+ *
+ * When "queue-depth" batches are already waiting,  "queue-backpressure"
+ * decides what happens:  "block" waits for a processor thread,
+ * "drop-oldest" discards the oldest waiting batch and "drop-newest"
+ * discards the batch being queued.  Dropped lines are counted.
+ *
+ * The Bluedot thread also queues batches with no lines of their own.  They
+ * carry lines to run a deferred rule on again,  see Batch_Queue_Push().
+ *
+ * For an ordered replay (--ordered) every batch gets a sequence number when
+ * it is queued.  Batches are still processed in parallel,  but output for a
+ * batch waits in Batch_Queue_Order_Wait() until every earlier batch is
+ * finished.  That only holds with a single reader,  which replay makes sure
+ * of.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "batch-queue.h"
+
+#ifdef WITH_BLUEDOT
+#include "processors/bluedot.h"
+#endif
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+
+bool death;
+
+static struct _Sagan_Batch_Ring BatchWork;
+static struct _Sagan_Batch_Ring BatchFree;
+
+static int batch_queue_depth = 0;
+static uint64_t batch_queued = 0;		/* Batches waiting in the work ring */
+static uint64_t batch_in_flight = 0;		/* Batches queued or being processed */
+
+/* Only used when a thread has nothing to do and needs to sleep */
+
+static pthread_mutex_t BatchQueueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t BatchQueueWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t BatchQueueSpace = PTHREAD_COND_INITIALIZER;
+
+static pthread_cond_t BatchQueueDrain = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t BatchQueueOrder = PTHREAD_COND_INITIALIZER;
+
+static int waiting_processors = 0;
+static int waiting_readers = 0;
+static int waiting_drain = 0;
+
+/* Ordered replay */
+
+static bool batch_ordered = false;
+static uint64_t batch_sequence = 0;		/* Next sequence to hand out */
+static uint64_t batch_completed = 0;		/* Every batch below this is done */
+static bool *batch_done = NULL;			/* BATCH_ORDER_WINDOW ring */
+
+static __thread bool batch_current_flag = false;
+static __thread uint64_t batch_current = 0;	/* Batch this thread is working on */
+
+/****************************************************************************
+ * Batch_Ring_Init / Push / Pop - Lock free ring primitives.  "size" is
+ * rounded up to a power of two.
+ ****************************************************************************/
+
+static void Batch_Ring_Init( struct _Sagan_Batch_Ring *ring, uint64_t size )
+{
+
+    uint64_t i;
+    uint64_t ring_size = 1;
+
+    while ( ring_size < size )
+        {
+            ring_size = ring_size << 1;
+        }
+
+    ring->cells = malloc( ring_size * sizeof(_Sagan_Batch_Ring_Cell) );
+
+    if ( ring->cells == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for batch queue ring. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < ring_size; i++ )
+        {
+            ring->cells[i].sequence = i;
+            ring->cells[i].batch = NULL;
+        }
+
+    ring->mask = ring_size - 1;
+    ring->enqueue_pos = 0;
+    ring->dequeue_pos = 0;
+
+}
+
+static bool Batch_Ring_Push( struct _Sagan_Batch_Ring *ring, struct _Sagan_Pass_Syslog *batch )
+{
+
+    struct _Sagan_Batch_Ring_Cell *cell = NULL;
+    uint64_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    int64_t diff;
+
+    for (;;)
+        {
+
+            cell = &ring->cells[ pos & ring->mask ];
+            diff = (int64_t)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (int64_t)pos;
+
+            if ( diff == 0 )
+                {
+                    if ( __atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+                        {
+                            break;
+                        }
+                }
+            else if ( diff < 0 )
+                {
+                    return(false);	/* Full */
+                }
+            else
+                {
+                    pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+                }
+        }
+
+    cell->batch = batch;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    return(true);
+}
+
+static struct _Sagan_Pass_Syslog *Batch_Ring_Pop( struct _Sagan_Batch_Ring *ring )
+{
+
+    struct _Sagan_Batch_Ring_Cell *cell = NULL;
+    struct _Sagan_Pass_Syslog *batch = NULL;
+    uint64_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    int64_t diff;
+
+    for (;;)
+        {
+
+            cell = &ring->cells[ pos & ring->mask ];
+            diff = (int64_t)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (int64_t)(pos + 1);
+
+            if ( diff == 0 )
+                {
+                    if ( __atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+                        {
+                            break;
+                        }
+                }
+            else if ( diff < 0 )
+                {
+                    return(NULL);	/* Empty */
+                }
+            else
+                {
+                    pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+                }
+        }
+
+    batch = cell->batch;
+    __atomic_store_n(&cell->sequence, pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+    return(batch);
+}
+
+static uint64_t Batch_Queue_Usec( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+static void Batch_Queue_Max( uint64_t *max, uint64_t value )
+{
+
+    uint64_t current = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+    while ( value > current &&
+            !__atomic_compare_exchange_n(max, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+
+}
+
+/* Wake sleeping processor/reader threads,  but only if there are any */
+
+static void Batch_Queue_Signal( int *waiting, pthread_cond_t *cond )
+{
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if ( __atomic_load_n(waiting, __ATOMIC_SEQ_CST) > 0 )
+        {
+            pthread_mutex_lock(&BatchQueueMutex);
+            pthread_cond_broadcast(cond);
+            pthread_mutex_unlock(&BatchQueueMutex);
+        }
+}
+
+/****************************************************************************
+ * Batch_Queue_Init - Allocates the batch pool.  "readers" is the number of
+ * threads that will call Batch_Queue_Put(),  each of which always holds
+ * one buffer.
+ ****************************************************************************/
+
+void Batch_Queue_Init( int readers )
+{
+
+    struct _Sagan_Pass_Syslog *batch = NULL;
+
+    int total;
+    int i;
+
+    batch_queue_depth = config->batch_queue_depth > 0 ? config->batch_queue_depth : config->max_processor_threads;
+
+    /* Enough buffers for a full queue,  one per busy processor thread and
+       one per reader.  With that, a free buffer is always on its way back */
+
+    total = batch_queue_depth + config->max_processor_threads + readers;
+
+    Batch_Ring_Init(&BatchWork, total);
+    Batch_Ring_Init(&BatchFree, total);
+
+    for ( i = 0; i < total; i++ )
+        {
+
+            batch = malloc(sizeof(struct _Sagan_Pass_Syslog));
+
+            if ( batch == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for batch queue buffers. Abort!", __FILE__, __LINE__);
+                }
+
+            memset(batch, 0, sizeof(struct _Sagan_Pass_Syslog));
+
+            batch->slab_size = (size_t)config->max_batch * BATCH_SLAB_LINE_SIZE;
+            batch->slab = malloc(batch->slab_size);
+
+            if ( batch->slab == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for batch queue slab. Abort!", __FILE__, __LINE__);
+                }
+
+            (void)Batch_Ring_Push(&BatchFree, batch);
+        }
+
+    if ( config->sagan_replay_ordered == true )
+        {
+
+            batch_done = calloc(BATCH_ORDER_WINDOW, sizeof(bool));
+
+            if ( batch_done == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for batch order window. Abort!", __FILE__, __LINE__);
+                }
+
+            batch_ordered = true;
+        }
+
+    Sagan_Log(NORMAL, "Batch queue depth: %d (%s), %d buffer(s).", batch_queue_depth,
+              config->batch_queue_backpressure == BATCH_QUEUE_BLOCK ? "block" :
+              config->batch_queue_backpressure == BATCH_QUEUE_DROP_OLDEST ? "drop-oldest" : "drop-newest", total);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Get - Returns an empty buffer for a reader to fill
+ ****************************************************************************/
+
+struct _Sagan_Pass_Syslog *Batch_Queue_Get( void )
+{
+
+    struct _Sagan_Pass_Syslog *batch = Batch_Ring_Pop(&BatchFree);
+
+    if ( batch == NULL )
+        {
+
+            /* All buffers are out.  One is being released right now */
+
+            pthread_mutex_lock(&BatchQueueMutex);
+            __atomic_add_fetch(&waiting_readers, 1, __ATOMIC_SEQ_CST);
+
+            while ( ( batch = Batch_Ring_Pop(&BatchFree) ) == NULL )
+                {
+                    pthread_cond_wait(&BatchQueueSpace, &BatchQueueMutex);
+                }
+
+            __atomic_sub_fetch(&waiting_readers, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&BatchQueueMutex);
+        }
+
+    batch->count = 0;
+    batch->slab_used = 0;
+
+    return(batch);
+}
+
+/****************************************************************************
+ * Batch_Queue_Add - Appends a line to a batch the caller is filling.  Lines
+ * are cut at MAX_SYSLOGMSG - 1 bytes,  like the rest of Sagan expects.
+ ****************************************************************************/
+
+void Batch_Queue_Add( struct _Sagan_Pass_Syslog *batch, const char *line, size_t length )
+{
+
+    size_t needed;
+    size_t new_size;
+    char *new_slab = NULL;
+
+    if ( length > MAX_SYSLOGMSG - 1 )
+        {
+            length = MAX_SYSLOGMSG - 1;
+        }
+
+    needed = batch->slab_used + length + 1;
+
+    if ( needed > batch->slab_size )
+        {
+
+            new_size = batch->slab_size;
+
+            while ( new_size < needed )
+                {
+                    new_size = new_size * 2;
+                }
+
+            new_slab = realloc(batch->slab, new_size);
+
+            if ( new_slab == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for batch queue slab. Abort!", __FILE__, __LINE__);
+                }
+
+            batch->slab = new_slab;
+            batch->slab_size = new_size;
+        }
+
+    memcpy(batch->slab + batch->slab_used, line, length);
+    batch->slab[ batch->slab_used + length ] = '\0';
+
+    batch->line[ batch->count ] = (uint32_t)batch->slab_used;
+    batch->slab_used = needed;
+    batch->count++;
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Enqueue - Hands a batch,  already counted in "batch_queued",
+ * to the processor threads
+ ****************************************************************************/
+
+static void Batch_Queue_Enqueue( struct _Sagan_Pass_Syslog *batch )
+{
+
+    batch->enqueue_usec = Batch_Queue_Usec();
+    batch->sequence = __atomic_fetch_add(&batch_sequence, 1, __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&batch_in_flight, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&counters->queue_enqueued, 1, __ATOMIC_SEQ_CST);
+
+    /* The ring holds every buffer in the pool,  so this can't fail */
+
+    (void)Batch_Ring_Push(&BatchWork, batch);
+
+    Batch_Queue_Signal(&waiting_processors, &BatchQueueWork);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Put - Queues a filled batch for the processor threads and
+ * returns the next buffer the reader should fill.  With "drop-newest",
+ * that can be the same (now empty) buffer.
+ ****************************************************************************/
+
+struct _Sagan_Pass_Syslog *Batch_Queue_Put( struct _Sagan_Pass_Syslog *batch )
+{
+
+    struct _Sagan_Pass_Syslog *oldest = NULL;
+    uint64_t depth;
+
+    if ( batch->count == 0 )
+        {
+            return(batch);
+        }
+
+    for (;;)
+        {
+
+            depth = __atomic_add_fetch(&batch_queued, 1, __ATOMIC_SEQ_CST);
+
+            if ( depth <= (uint64_t)batch_queue_depth )
+                {
+                    break;
+                }
+
+            __atomic_sub_fetch(&batch_queued, 1, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&counters->queue_full, 1, __ATOMIC_SEQ_CST);
+
+            if ( config->batch_queue_backpressure == BATCH_QUEUE_DROP_NEWEST )
+                {
+                    __atomic_add_fetch(&counters->queue_dropped, batch->count, __ATOMIC_SEQ_CST);
+                    batch->count = 0;
+                    batch->slab_used = 0;
+                    return(batch);
+                }
+
+            if ( config->batch_queue_backpressure == BATCH_QUEUE_DROP_OLDEST )
+                {
+
+                    oldest = Batch_Ring_Pop(&BatchWork);
+
+                    if ( oldest != NULL )
+                        {
+                            __atomic_sub_fetch(&batch_queued, 1, __ATOMIC_SEQ_CST);
+                            __atomic_add_fetch(&counters->queue_dropped, oldest->count, __ATOMIC_SEQ_CST);
+
+                            Batch_Queue_Release(oldest);
+                        }
+
+                    continue;
+                }
+
+            /* BATCH_QUEUE_BLOCK */
+
+            pthread_mutex_lock(&BatchQueueMutex);
+            __atomic_add_fetch(&waiting_readers, 1, __ATOMIC_SEQ_CST);
+
+            while ( __atomic_load_n(&batch_queued, __ATOMIC_SEQ_CST) >= (uint64_t)batch_queue_depth && death == false )
+                {
+                    pthread_cond_wait(&BatchQueueSpace, &BatchQueueMutex);
+                }
+
+            __atomic_sub_fetch(&waiting_readers, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&BatchQueueMutex);
+
+            if ( death == true )
+                {
+                    batch->count = 0;
+                    batch->slab_used = 0;
+                    return(batch);
+                }
+        }
+
+    Batch_Queue_Max(&counters->queue_depth_max, depth);
+
+    Batch_Queue_Enqueue(batch);
+
+    return( Batch_Queue_Get() );
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Try_Get - Like Batch_Queue_Get(),  but returns NULL rather
+ * than wait when every buffer is out.  For threads that can't block.
+ ****************************************************************************/
+
+struct _Sagan_Pass_Syslog *Batch_Queue_Try_Get( void )
+{
+
+    struct _Sagan_Pass_Syslog *batch = Batch_Ring_Pop(&BatchFree);
+
+    if ( batch != NULL )
+        {
+            batch->count = 0;
+            batch->slab_used = 0;
+        }
+
+    return(batch);
+}
+
+/****************************************************************************
+ * Batch_Queue_Push - Queues a batch from Batch_Queue_Try_Get() without
+ * back pressure and without handing out another buffer.  Used by the
+ * Bluedot thread to give deferred lines back to the processor threads.
+ ****************************************************************************/
+
+void Batch_Queue_Push( struct _Sagan_Pass_Syslog *batch )
+{
+
+    Batch_Queue_Max(&counters->queue_depth_max, __atomic_add_fetch(&batch_queued, 1, __ATOMIC_SEQ_CST));
+
+    Batch_Queue_Enqueue(batch);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Take - Called by Processor().  Sleeps until there is a batch
+ * to work on.  Returns NULL on shutdown.
+ ****************************************************************************/
+
+struct _Sagan_Pass_Syslog *Batch_Queue_Take( void )
+{
+
+    struct _Sagan_Pass_Syslog *batch = Batch_Ring_Pop(&BatchWork);
+    uint64_t wait;
+
+    if ( batch == NULL )
+        {
+
+            pthread_mutex_lock(&BatchQueueMutex);
+            __atomic_add_fetch(&waiting_processors, 1, __ATOMIC_SEQ_CST);
+
+            while ( ( batch = Batch_Ring_Pop(&BatchWork) ) == NULL && death == false )
+                {
+                    pthread_cond_wait(&BatchQueueWork, &BatchQueueMutex);
+                }
+
+            __atomic_sub_fetch(&waiting_processors, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&BatchQueueMutex);
+
+            if ( batch == NULL )
+                {
+                    return(NULL);
+                }
+        }
+
+    __atomic_sub_fetch(&batch_queued, 1, __ATOMIC_SEQ_CST);
+
+    wait = Batch_Queue_Usec() - batch->enqueue_usec;
+
+    __atomic_add_fetch(&counters->queue_dequeued, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&counters->queue_wait_usec, wait, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&counters->events_processed, batch->count, __ATOMIC_SEQ_CST);
+    Batch_Queue_Max(&counters->queue_wait_usec_max, wait);
+
+    Batch_Queue_Signal(&waiting_readers, &BatchQueueSpace);
+
+    if ( batch_ordered == true )
+        {
+            batch_current = batch->sequence;
+            batch_current_flag = true;
+        }
+
+    return(batch);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Order_Done - Marks a batch finished and moves the "completed"
+ * mark past every batch that is now done.  A batch too far ahead of the
+ * oldest unfinished one waits for room in the window.  The oldest never
+ * waits,  so this always makes progress.
+ ****************************************************************************/
+
+static void Batch_Queue_Order_Done( uint64_t sequence )
+{
+
+    pthread_mutex_lock(&BatchQueueMutex);
+
+    while ( sequence >= batch_completed + BATCH_ORDER_WINDOW )
+        {
+            pthread_cond_wait(&BatchQueueOrder, &BatchQueueMutex);
+        }
+
+    batch_done[ sequence % BATCH_ORDER_WINDOW ] = true;
+
+    while ( batch_done[ batch_completed % BATCH_ORDER_WINDOW ] == true )
+        {
+            batch_done[ batch_completed % BATCH_ORDER_WINDOW ] = false;
+            __atomic_add_fetch(&batch_completed, 1, __ATOMIC_SEQ_CST);
+        }
+
+    pthread_cond_broadcast(&BatchQueueOrder);
+    pthread_mutex_unlock(&BatchQueueMutex);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Order_Wait - Called before output.  With an ordered replay,
+ * waits until every batch queued before ours is finished.  Otherwise (or
+ * outside a processor thread) it returns right away.
+ ****************************************************************************/
+
+void Batch_Queue_Order_Wait( void )
+{
+
+    if ( batch_ordered == false || batch_current_flag == false )
+        {
+            return;
+        }
+
+    if ( __atomic_load_n(&batch_completed, __ATOMIC_SEQ_CST) >= batch_current )
+        {
+            return;
+        }
+
+    pthread_mutex_lock(&BatchQueueMutex);
+
+    while ( __atomic_load_n(&batch_completed, __ATOMIC_SEQ_CST) < batch_current )
+        {
+            pthread_cond_wait(&BatchQueueOrder, &BatchQueueMutex);
+        }
+
+    pthread_mutex_unlock(&BatchQueueMutex);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Release - Processor() is done with "batch" (or it was
+ * dropped).  The buffer goes back to the free pool.
+ ****************************************************************************/
+
+void Batch_Queue_Release( struct _Sagan_Pass_Syslog *batch )
+{
+
+    if ( batch_ordered == true )
+        {
+            Batch_Queue_Order_Done( batch->sequence );
+            batch_current_flag = false;
+        }
+
+#ifdef WITH_BLUEDOT
+
+    /* Deferred Bluedot lines that were dropped ("drop-oldest") rather
+       than run */
+
+    if ( batch->deferred != NULL )
+        {
+            Sagan_Bluedot_Deferred_Free( batch->deferred );
+            batch->deferred = NULL;
+        }
+
+#endif
+
+    batch->count = 0;
+    batch->slab_used = 0;
+
+    (void)Batch_Ring_Push(&BatchFree, batch);
+
+    if ( __atomic_sub_fetch(&batch_in_flight, 1, __ATOMIC_SEQ_CST) == 0 )
+        {
+            Batch_Queue_Signal(&waiting_drain, &BatchQueueDrain);
+        }
+
+    Batch_Queue_Signal(&waiting_readers, &BatchQueueSpace);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Wake - Wakes up everything sleeping on the queue.  Used on
+ * shutdown after "death" is set.
+ ****************************************************************************/
+
+void Batch_Queue_Wake( void )
+{
+
+    pthread_mutex_lock(&BatchQueueMutex);
+    pthread_cond_broadcast(&BatchQueueWork);
+    pthread_cond_broadcast(&BatchQueueSpace);
+    pthread_mutex_unlock(&BatchQueueMutex);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Drained - True when nothing is queued or being processed
+ ****************************************************************************/
+
+bool Batch_Queue_Drained( void )
+{
+    return( __atomic_load_n(&batch_in_flight, __ATOMIC_SEQ_CST) == 0 );
+}
+
+/****************************************************************************
+ * Batch_Queue_Wait_Drained - Sleeps until nothing is queued or being
+ * processed.  Readers must be done queueing.
+ ****************************************************************************/
+
+void Batch_Queue_Wait_Drained( void )
+{
+
+    pthread_mutex_lock(&BatchQueueMutex);
+    __atomic_add_fetch(&waiting_drain, 1, __ATOMIC_SEQ_CST);
+
+    while ( __atomic_load_n(&batch_in_flight, __ATOMIC_SEQ_CST) != 0 )
+        {
+            pthread_cond_wait(&BatchQueueDrain, &BatchQueueMutex);
+        }
+
+    __atomic_sub_fetch(&waiting_drain, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&BatchQueueMutex);
+
+}
+
+/****************************************************************************
+ * Batch_Queue_Depth - Batches currently waiting on a processor thread
+ ****************************************************************************/
+
+uint64_t Batch_Queue_Depth( void )
+{
+    return( __atomic_load_n(&batch_queued, __ATOMIC_SEQ_CST) );
+}
@@ -0,0 +1,72 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+/* What the reader does when "queue-depth" batches are already waiting */
+
+#define BATCH_QUEUE_BLOCK		0	/* Wait for a processor thread */
+#define BATCH_QUEUE_DROP_OLDEST		1	/* Throw away the oldest waiting batch */
+#define BATCH_QUEUE_DROP_NEWEST		2	/* Throw away the batch being queued */
+
+/* Ordered replay: how far ahead of the oldest unfinished batch others
+   may finish */
+
+#define BATCH_ORDER_WINDOW		4096
+
+/* Line "i" of a batch */
+
+#define BATCH_LINE(batch, i)	( (batch)->slab + (batch)->line[(i)] )
+
+void Batch_Queue_Init( int );
+void Batch_Queue_Add( struct _Sagan_Pass_Syslog *, const char *, size_t );
+struct _Sagan_Pass_Syslog *Batch_Queue_Get( void );
+struct _Sagan_Pass_Syslog *Batch_Queue_Put( struct _Sagan_Pass_Syslog * );
+struct _Sagan_Pass_Syslog *Batch_Queue_Try_Get( void );
+void Batch_Queue_Push( struct _Sagan_Pass_Syslog * );
+struct _Sagan_Pass_Syslog *Batch_Queue_Take( void );
+void Batch_Queue_Release( struct _Sagan_Pass_Syslog * );
+void Batch_Queue_Wake( void );
+bool Batch_Queue_Drained( void );
+void Batch_Queue_Wait_Drained( void );
+void Batch_Queue_Order_Wait( void );
+uint64_t Batch_Queue_Depth( void );
+
+/* Bounded multi-producer/multi-consumer ring of batch pointers.  Each cell
+   carries a sequence number so producers and consumers only ever CAS their
+   own position (Vyukov style).  No locks are taken to move a batch */
+
+typedef struct _Sagan_Batch_Ring_Cell _Sagan_Batch_Ring_Cell;
+struct _Sagan_Batch_Ring_Cell
+{
+    uint64_t sequence;
+    struct _Sagan_Pass_Syslog *batch;
+};
+
+typedef struct _Sagan_Batch_Ring _Sagan_Batch_Ring;
+struct _Sagan_Batch_Ring
+{
+    uint64_t enqueue_pos __attribute__ ((aligned (64)));
+    uint64_t dequeue_pos __attribute__ ((aligned (64)));
+    uint64_t mask __attribute__ ((aligned (64)));
+    _Sagan_Batch_Ring_Cell *cells;
+};
@@ -46,6 +46,7 @@
 #include "protocol-map.h"
 #include "references.h"
 #include "parsers/parsers.h"
+#include "batch-queue.h"
 
 /* Processors */
 
@@ -213,6 +214,8 @@ void Load_YAML_Config( char *yaml_file )
             config->max_xbits = DEFAULT_IPC_XBITS;
 
             config->max_batch = DEFAULT_SYSLOG_BATCH;
+            config->batch_queue_depth = 0;
+            config->batch_queue_backpressure = BATCH_QUEUE_DROP_NEWEST;
 
             config->pp_sagan_track_clients = TRACK_TIME;
 
@@ -240,6 +243,12 @@ void Load_YAML_Config( char *yaml_file )
 
 #endif
 
+#ifdef HAVE_LIBMAXMINDDB
+
+            config->geoip2_cache_size = GEOIP_CACHE_DEFAULT;
+
+#endif
+
 #ifdef WITH_BLUEDOT
 
             /* Bluedot defaults */
@@ -255,11 +264,20 @@ void Load_YAML_Config( char *yaml_file )
             config->bluedot_hash_max_cache = BLUEDOT_HASH_DEFAULT;
             config->bluedot_url_max_cache = BLUEDOT_URL_DEFAULT;
             config->bluedot_filename_max_cache = BLUEDOT_FILENAME_DEFAULT;
+            config->bluedot_ja3_max_cache = BLUEDOT_JA3_DEFAULT;
 
             config->bluedot_ip_queue = BLUEDOT_IP_QUEUE_DEFAULT;
             config->bluedot_hash_queue = BLUEDOT_HASH_QUEUE_DEFAULT;
             config->bluedot_url_queue = BLUEDOT_URL_QUEUE_DEFAULT;
             config->bluedot_filename_queue = BLUEDOT_FILENAME_QUEUE_DEFAULT;
+            config->bluedot_ja3_queue = BLUEDOT_JA3_QUEUE_DEFAULT;
+
+            config->bluedot_port = BLUEDOT_PORT_DEFAULT;
+            config->bluedot_defer = false;
+            config->bluedot_wait = BLUEDOT_WAIT_DEFAULT;
+            config->bluedot_max_connections = BLUEDOT_MAX_CONNECTIONS_DEFAULT;
+            config->bluedot_http_timeout = BLUEDOT_HTTP_TIMEOUT_DEFAULT;
+            config->bluedot_max_deferred = BLUEDOT_MAX_DEFERRED_DEFAULT;
 
 #endif
 
@@ -290,9 +308,11 @@ void Load_YAML_Config( char *yaml_file )
 #ifdef HAVE_LIBHIREDIS
 
 #define DEFAULT_REDIS_MAX_WRITER_THREADS 10
+#define DEFAULT_REDIS_READER_CACHE_TTL 2
 
             config->redis_password[0] = '\0';
             config->redis_max_writer_threads = DEFAULT_REDIS_MAX_WRITER_THREADS;
+            config->redis_reader_cache_ttl = DEFAULT_REDIS_READER_CACHE_TTL;
 
 #endif
 
@@ -900,6 +920,50 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if (!strcmp(last_pass, "queue-depth"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            config->batch_queue_depth = atoi(tmp);
+
+                                            if ( config->batch_queue_depth < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'queue-depth' is invalid. Abort!", __FILE__, __LINE__);
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "queue-backpressure"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if (!strcmp(tmp, "block"))
+                                                {
+                                                    config->batch_queue_backpressure = BATCH_QUEUE_BLOCK;
+                                                }
+
+                                            else if (!strcmp(tmp, "drop-oldest"))
+                                                {
+                                                    config->batch_queue_backpressure = BATCH_QUEUE_DROP_OLDEST;
+                                                }
+
+                                            else if (!strcmp(tmp, "drop-newest"))
+                                                {
+                                                    config->batch_queue_backpressure = BATCH_QUEUE_DROP_NEWEST;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'queue-backpressure' is invalid. Valid values are \"block\", \"drop-oldest\" and \"drop-newest\". Abort!", __FILE__, __LINE__);
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "inputs"))
+                                        {
+                                            Var_To_Value(value, config->sagan_inputs, sizeof(config->sagan_inputs));
+                                        }
+
                                     else if (!strcmp(last_pass, "xbit-storage"))
                                         {
 
@@ -1105,6 +1169,19 @@ void Load_YAML_Config( char *yaml_file )
 
                                                 }
 
+                                            if (!strcmp(last_pass, "reader_cache_ttl"))
+                                                {
+
+                                                    Var_To_Value(value, tmp, sizeof(tmp));
+                                                    config->redis_reader_cache_ttl = atoi(tmp);
+
+                                                    if ( config->redis_reader_cache_ttl < 0 )
+                                                        {
+                                                            Sagan_Log(ERROR, "[%s, line %d] sagan-core|redis-server - Redis 'reader_cache_ttl' is negative.  Abort!", __FILE__, __LINE__);
+                                                        }
+
+                                                }
+
                                         }
 
                                 } /* if sub_type == YAML_SAGAN_CORE_REDIS */
@@ -1180,7 +1257,11 @@ void Load_YAML_Config( char *yaml_file )
 
                                                     if ( geoip_tmpmask == NULL )
                                                         {
-                                                            geoip_mask = 32;
+                                                            geoip_mask = strchr(geoip_iprange, ':') ? 128 : 32;
+                                                        }
+                                                    else
+                                                        {
+                                                            geoip_mask = atoi(geoip_tmpmask);
                                                         }
 
                                                     GeoIP_Skip = (_Sagan_GeoIP_Skip *) realloc(GeoIP_Skip, (counters->geoip_skip_count+1) * sizeof(_Sagan_GeoIP_Skip));
@@ -1191,8 +1272,7 @@ void Load_YAML_Config( char *yaml_file )
                                                         }
 
                                                     memset(&GeoIP_Skip[counters->geoip_skip_count], 0, sizeof(_Sagan_GeoIP_Skip));
-
-                                                    geoip_mask = atoi(geoip_tmpmask);
+                                                    memset(geoip_maskbits, 0, sizeof(geoip_maskbits));
 
                                                     if ( geoip_mask == 0 || !Mask2Bit(geoip_mask, geoip_maskbits))
                                                         {
@@ -1202,6 +1282,7 @@ void Load_YAML_Config( char *yaml_file )
 
                                                     memcpy(GeoIP_Skip[counters->geoip_skip_count].range.ipbits, geoip_ipbits, sizeof(geoip_ipbits));
                                                     memcpy(GeoIP_Skip[counters->geoip_skip_count].range.maskbits, geoip_maskbits, sizeof(geoip_maskbits));
+                                                    GeoIP_Skip[counters->geoip_skip_count].prefix = geoip_mask;
 
                                                     __atomic_add_fetch(&counters->geoip_skip_count, 1, __ATOMIC_SEQ_CST);
 
@@ -1211,6 +1292,20 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    if (!strcmp(last_pass, "lookup_cache") && config->have_geoip2 == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if ( atoi(tmp) < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] GeoIP 'lookup_cache' is invalid. Abort!", __FILE__, __LINE__);
+                                                }
+
+                                            config->geoip2_cache_size = atoi(tmp);
+
+                                        }
+
                                 } /* if sub_type == YAML_SAGAN_CORE_GEOIP */
 #endif
 
@@ -1758,6 +1853,76 @@ void Load_YAML_Config( char *yaml_file )
                                             config->bluedot_dns_ttl = atoi(tmp);
                                         }
 
+                                    else if (!strcmp(last_pass, "port") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_port = atoi(tmp);
+
+                                            if ( config->bluedot_port <= 0 || config->bluedot_port > 65535 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'port' is invalid. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "miss-policy") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if ( !strcasecmp(tmp, "wait") )
+                                                {
+                                                    config->bluedot_defer = false;
+                                                }
+
+                                            else if ( !strcasecmp(tmp, "defer") )
+                                                {
+                                                    config->bluedot_defer = true;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'miss-policy' has to be 'wait' or 'defer'. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "miss-wait") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_wait = atoi(tmp);
+
+                                            if ( config->bluedot_wait < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'miss-wait' can't be negative. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "max-connections") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_max_connections = atoi(tmp);
+
+                                            if ( config->bluedot_max_connections <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'max-connections' has to be a non-zero value. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "http-timeout") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_http_timeout = atoi(tmp);
+
+                                            if ( config->bluedot_http_timeout <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'http-timeout' has to be a non-zero value. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "max-deferred") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_max_deferred = atoi(tmp);
+                                        }
+
                                     if (!strcmp(last_pass, "skip_networks") && config->bluedot_flag == true )
                                         {
 
@@ -22,6 +22,12 @@
  * flexbit-mmap.c - Functions used for tracking events over multiple log
  * lines.
  *
+ * Flexbits live in a shared mmap() table.  Each one is linked on three
+ * hash chains (name, source address and destination address) kept in the
+ * same object,  so "isset",  "isnotset",  "unset" and "set" only look at
+ * flexbits that share the name or an address with the event instead of
+ * the whole table.  Chains always point from newer to older entries.
+ *
  */
 
 #ifdef HAVE_CONFIG_H
@@ -29,18 +35,23 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <inttypes.h>
 #include <sys/mman.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "ipc.h"
+#include "ipc-lock.h"
+#include "ipc-wheel.h"
 #include "flexbit-mmap.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "parsers/parsers.h"
 
 struct _SaganCounters *counters;
@@ -48,1447 +59,684 @@ struct RuleBody *RuleBody;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
 
-pthread_mutex_t Flexbit_Mutex=PTHREAD_MUTEX_INITIALIZER;
-
 struct _Sagan_IPC_Counters *counters_ipc;
 struct _Sagan_IPC_Flexbit *flexbit_ipc;
+struct _Sagan_IPC_Flexbit_Index *Flexbit_Index;
+struct _Sagan_IPC_Wheel *Flexbit_Wheel;
 
-/*****************************************************************************
- * Flexbit_Condition - Used for testing "isset" & "isnotset".  Full
- * rule condition is tested here and returned.
- *****************************************************************************/
-
-bool Flexbit_Condition_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port )
-{
+static const char *flexbit_direction_name[] = { "none", "both", "by_src", "by_dst", "reverse", "src_xbitdst", "dst_xbitsrc",
+                                                "both_p", "by_src_p", "by_dst_p", "reverse_p", "src_xbitdst_p", "dst_xbitsrc_p"
+                                              };
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+/* What a rule's direction asks of a stored flexbit.  NULL/-1 == any */
 
-    int i;
-    int a;
+typedef struct _Sagan_Flexbit_Filter _Sagan_Flexbit_Filter;
+struct _Sagan_Flexbit_Filter
+{
+    const char *name;
+    uint32_t name_hash;
+    const unsigned char *ip_src;
+    const unsigned char *ip_dst;
+    int src_port;
+    int dst_port;
+};
 
-    int flexbit_total_match = 0;
-    bool flexbit_match = 0;
+/*****************************************************************************
+ * Flexbit_IP_Hash - Hash of the address bits for the src/dst chains
+ *****************************************************************************/
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+static uint32_t Flexbit_IP_Hash( const unsigned char *ip )
+{
 
-    Flexbit_Cleanup_MMAP();
+    uint32_t hash = 2166136261U;
+    int i = 0;
 
-    for (i = 0; i < RuleBody[rule_position].Flexbit.flexbit_count; i++)
+    for ( i = 0; i < MAXIPBIT; i++ )
         {
+            hash = ( hash ^ ip[i] ) * 16777619U;
+        }
 
-            /*******************
-             *      ISSET      *
-             *******************/
-
-            if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 3 )
-                {
-
-
-                    if ( debug->debugflexbit )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Condition \"isset\" found in rule.", __FILE__, __LINE__);
-                        }
-
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-
-                            if ( !memcmp(RuleBody[rule_position].Flexbit.flexbit_name[i], flexbit_ipc[a].flexbit_name, sizeof(RuleBody[rule_position].Flexbit.flexbit_name[i])) &&
-                                    flexbit_ipc[a].flexbit_state == true )
-                                {
-
-                                    /* direction: by_src - most common check */
-
-                                    if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 2 &&
-                                            !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"by_src\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, flexbit_ipc[a].ip_src);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
+    return(hash);
 
-                                    /* direction: none */
+}
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 0 )
+/*****************************************************************************
+ * Flexbit_Head - Bucket head for a chain
+ *****************************************************************************/
 
-                                        {
+static uint32_t *Flexbit_Head( int chain, uint32_t hash )
+{
+    return( &Flexbit_Index->heads[ (size_t)chain * Flexbit_Index->size + ( hash & ( Flexbit_Index->size - 1 ) ) ] );
+}
 
-                                            if ( debug->debugflexbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"none\"). (any -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-                                                }
+/*****************************************************************************
+ * Flexbit_Link - Puts entry "a" on its three chains.  Caller holds the
+ * flexbit lock.  The entry is complete before it becomes reachable so
+ * lookups don't need the lock.
+ *****************************************************************************/
 
-                                            flexbit_total_match++;
+static void Flexbit_Link( int a )
+{
 
-                                        }
+    uint32_t *head = NULL;
+    uint32_t hash[FLEXBIT_CHAINS];
+    int chain = 0;
 
-                                    /* direction: both */
+    hash[FLEXBIT_CHAIN_NAME] = flexbit_ipc[a].flexbit_name_hash;
+    hash[FLEXBIT_CHAIN_SRC] = Flexbit_IP_Hash(flexbit_ipc[a].ip_src);
+    hash[FLEXBIT_CHAIN_DST] = Flexbit_IP_Hash(flexbit_ipc[a].ip_dst);
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 1 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
+    for ( chain = 0; chain < FLEXBIT_CHAINS; chain++ )
+        {
+            head = Flexbit_Head(chain, hash[chain]);
+            flexbit_ipc[a].flexbit_next[chain] = *head;
+            __atomic_store_n(head, a + 1, __ATOMIC_RELEASE);
+        }
 
-                                        {
+}
 
-                                            if ( debug->debugflexbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"both\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-                                                }
+/*****************************************************************************
+ * Flexbit_Relink - Points whatever links to entry "from" on each of
+ * "hash"'s chains at "to" instead (0 unlinks it).  Caller holds the
+ * flexbit lock.
+ *****************************************************************************/
 
-                                            flexbit_total_match++;
+static void Flexbit_Relink( uint32_t *hash, int from, uint32_t to )
+{
 
-                                        }
+    uint32_t *p = NULL;
+    int chain = 0;
 
-                                    /* direction: by_dst */
+    for ( chain = 0; chain < FLEXBIT_CHAINS; chain++ )
+        {
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 3 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
+            for ( p = Flexbit_Head(chain, hash[chain]); *p != 0 && *p != (uint32_t)from + 1; p = &flexbit_ipc[*p - 1].flexbit_next[chain] );
 
-                                        {
+            if ( *p != 0 )
+                {
+                    __atomic_store_n(p, to == 0 ? flexbit_ipc[from].flexbit_next[chain] : to, __ATOMIC_RELEASE);
+                }
+        }
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"by_dst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
+}
 
-                                            flexbit_total_match++;
+/*****************************************************************************
+ * Flexbit_Remove_MMAP - Drops flexbit "a".  The last flexbit is moved into
+ * the hole (copied first,  then relinked) so lookups walking the chains
+ * without the lock never land on a half moved entry.  "a" must already
+ * be off the expiry wheel.  Caller holds IPC_Lock_All(FLEXBIT).
+ *****************************************************************************/
 
-                                        }
+void Flexbit_Remove_MMAP( int a )
+{
 
-                                    /* direction: reverse */
+    uint32_t hash[FLEXBIT_CHAINS];
+    int last = counters_ipc->flexbit_count - 1;
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 4 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
+    hash[FLEXBIT_CHAIN_NAME] = flexbit_ipc[a].flexbit_name_hash;
+    hash[FLEXBIT_CHAIN_SRC] = Flexbit_IP_Hash(flexbit_ipc[a].ip_src);
+    hash[FLEXBIT_CHAIN_DST] = Flexbit_IP_Hash(flexbit_ipc[a].ip_dst);
 
-                                        {
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"reverse\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-                                                }
+    Flexbit_Relink(hash, a, 0);
 
-                                            flexbit_total_match++;
+    if ( a != last )
+        {
 
-                                        }
+            hash[FLEXBIT_CHAIN_NAME] = flexbit_ipc[last].flexbit_name_hash;
+            hash[FLEXBIT_CHAIN_SRC] = Flexbit_IP_Hash(flexbit_ipc[last].ip_src);
+            hash[FLEXBIT_CHAIN_DST] = Flexbit_IP_Hash(flexbit_ipc[last].ip_dst);
 
-                                    /* direction: src_xbitdst */
+            memcpy(&flexbit_ipc[a], &flexbit_ipc[last], sizeof(struct _Sagan_IPC_Flexbit));
+            Flexbit_Relink(hash, last, a + 1);
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 5 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
+            IPC_Wheel_Move(Flexbit_Wheel, last, a);
+        }
 
-                                        {
+    counters_ipc->flexbit_count--;
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"src_xbitdst\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
+}
 
-                                            flexbit_total_match++;
+/*****************************************************************************
+ * Flexbit_Index_Bytes_MMAP - Size of the index for "max" flexbits
+ *****************************************************************************/
 
-                                        }
+size_t Flexbit_Index_Bytes_MMAP( int max )
+{
 
-                                    /* direction: dst_xbitsrc */
+    uint32_t size = 16;
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 6 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) )
+    while ( size < (uint32_t)max )
+        {
+            size <<= 1;
+        }
 
-                                        {
+    return( sizeof(struct _Sagan_IPC_Flexbit_Index) + ( (size_t)size * FLEXBIT_CHAINS * sizeof(uint32_t) ) );
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"dst_xbitsrc\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
+}
 
-                                            flexbit_total_match++;
+/*****************************************************************************
+ * Flexbit_Index_Rebuild_MMAP - Relinks every flexbit.  Used on a new
+ * object and a resized one.  Caller holds the flexbit lock.
+ *****************************************************************************/
 
-                                        }
+void Flexbit_Index_Rebuild_MMAP( void )
+{
 
-                                    /* direction: both_p */
+    size_t bytes = Flexbit_Index_Bytes_MMAP(config->max_flexbits);
+    int a = 0;
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 7 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].src_port == src_port &&
-                                              flexbit_ipc[a].dst_port == dst_port )
+    memset(Flexbit_Index, 0, bytes);
+    Flexbit_Index->size = ( bytes - sizeof(struct _Sagan_IPC_Flexbit_Index) ) / ( FLEXBIT_CHAINS * sizeof(uint32_t) );
 
-                                        {
+    for ( a = 0; a < counters_ipc->flexbit_count; a++ )
+        {
+            flexbit_ipc[a].flexbit_name_hash = Djb2_Hash(flexbit_ipc[a].flexbit_name);
+            Flexbit_Link(a);
+        }
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"both_p\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-                                                }
+}
 
-                                            flexbit_total_match++;
+/*****************************************************************************
+ * Flexbit_Filter - Translates a rule's direction into what a stored
+ * flexbit has to look like
+ *****************************************************************************/
 
-                                        }
+static void Flexbit_Filter( struct _Sagan_Flexbit_Filter *filter, int direction, char *flexbit_name, char *ip_src, char *ip_dst, int src_port, int dst_port )
+{
 
-                                    /* direction: by_src_p */
+    const unsigned char *src = (const unsigned char *)ip_src;
+    const unsigned char *dst = (const unsigned char *)ip_dst;
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 8 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == src_port )
+    memset(filter, 0, sizeof(struct _Sagan_Flexbit_Filter));
 
-                                        {
+    filter->name = flexbit_name;
+    filter->name_hash = Djb2_Hash(flexbit_name);
+    filter->src_port = -1;
+    filter->dst_port = -1;
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"by_src_p\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
+    switch ( direction )
+        {
 
-                                            flexbit_total_match++;
+        case 1:				/* both */
+            filter->ip_src = src;
+            filter->ip_dst = dst;
+            break;
+
+        case 2:				/* by_src */
+            filter->ip_src = src;
+            break;
+
+        case 3:				/* by_dst */
+            filter->ip_dst = dst;
+            break;
+
+        case 4:				/* reverse */
+            filter->ip_src = dst;
+            filter->ip_dst = src;
+            break;
+
+        case 5:				/* src_xbitdst */
+            filter->ip_dst = src;
+            break;
+
+        case 6:				/* dst_xbitsrc */
+            filter->ip_src = dst;
+            break;
+
+        case 7:				/* both_p */
+            filter->ip_src = src;
+            filter->ip_dst = dst;
+            filter->src_port = src_port;
+            filter->dst_port = dst_port;
+            break;
+
+        case 8:				/* by_src_p */
+            filter->ip_src = src;
+            filter->src_port = src_port;
+            break;
+
+        case 9:				/* by_dst_p */
+            filter->ip_dst = dst;
+            filter->dst_port = dst_port;
+            break;
+
+        case 10:			/* reverse_p */
+            filter->ip_src = dst;
+            filter->ip_dst = src;
+            filter->src_port = dst_port;
+            filter->dst_port = src_port;
+            break;
+
+        case 11:			/* src_xbitdst_p */
+            filter->ip_dst = src;
+            filter->dst_port = src_port;
+            break;
+
+        case 12:			/* dst_xbitsrc_p */
+            filter->ip_src = dst;
+            filter->src_port = dst_port;
+            break;
 
-                                        }
+        }
 
-                                    /* direction: by_dst_p */
+}
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 9 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst))  &&
-                                              flexbit_ipc[a].dst_port == dst_port )
+/*****************************************************************************
+ * Flexbit_First - First entry (+ 1) of the shortest chain that can hold
+ * matches for "filter"
+ *****************************************************************************/
 
-                                        {
+static uint32_t Flexbit_First( struct _Sagan_Flexbit_Filter *filter, int *chain )
+{
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"by_dst_p\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
+    uint32_t hash = 0;
 
-                                            flexbit_total_match++;
+    if ( filter->ip_src != NULL )
+        {
+            *chain = FLEXBIT_CHAIN_SRC;
+            hash = Flexbit_IP_Hash(filter->ip_src);
+        }
+    else if ( filter->ip_dst != NULL )
+        {
+            *chain = FLEXBIT_CHAIN_DST;
+            hash = Flexbit_IP_Hash(filter->ip_dst);
+        }
+    else
+        {
+            *chain = FLEXBIT_CHAIN_NAME;
+            hash = filter->name_hash;
+        }
 
-                                        }
+    return( __atomic_load_n(Flexbit_Head(*chain, hash), __ATOMIC_ACQUIRE) );
 
-                                    /* direction: reverse_p */
+}
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 10 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].src_port == dst_port &&
-                                              flexbit_ipc[a].dst_port == src_port )
+/*****************************************************************************
+ * Flexbit_Match - Does flexbit "a" satisfy "filter"?
+ *****************************************************************************/
 
+static bool Flexbit_Match( int a, struct _Sagan_Flexbit_Filter *filter )
+{
 
-                                        {
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"reverse_p\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-                                                }
+    struct _Sagan_IPC_Flexbit *f = &flexbit_ipc[a];
 
-                                            flexbit_total_match++;
+    if ( f->flexbit_name_hash != filter->name_hash || strcmp(f->flexbit_name, filter->name) )
+        {
+            return(false);
+        }
 
-                                        }
+    if ( filter->ip_src != NULL && memcmp(f->ip_src, filter->ip_src, sizeof(f->ip_src)) )
+        {
+            return(false);
+        }
 
-                                    /* direction: src_xbitdst_p */
+    if ( filter->ip_dst != NULL && memcmp(f->ip_dst, filter->ip_dst, sizeof(f->ip_dst)) )
+        {
+            return(false);
+        }
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 11 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].dst_port == src_port )
+    if ( filter->src_port != -1 && f->src_port != filter->src_port )
+        {
+            return(false);
+        }
 
-                                        {
+    if ( filter->dst_port != -1 && f->dst_port != filter->dst_port )
+        {
+            return(false);
+        }
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"src_xbitdst_p\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
+    return(true);
 
-                                            flexbit_total_match++;
+}
 
-                                        }
+/*****************************************************************************
+ * Flexbit_Condition - Used for testing "isset" & "isnotset".  Full
+ * rule condition is tested here and returned.
+ *****************************************************************************/
 
-                                    /* direction: dst_xbitsrc_p */
+bool Flexbit_Condition_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port )
+{
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 12 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == dst_port )
+    struct _Sagan_Flexbit_Filter filter;
 
-                                        {
+    uint64_t now = Return_Epoch();
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"dst_xbitsrc_p\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
+    uint32_t a = 0;
+    int chain = 0;
+    int i;
 
-                                            flexbit_total_match++;
+    int flexbit_total_match = 0;
+    bool flexbit_match = 0;
 
-                                        }
+    for (i = 0; i < RuleBody[rule_position].Flexbit.flexbit_count; i++)
+        {
 
-                                } /* End of strcmp flexbit_name & flexbit_state = 1 */
+            if ( RuleBody[rule_position].Flexbit.flexbit_type[i] != 3 && RuleBody[rule_position].Flexbit.flexbit_type[i] != 4 )
+                {
+                    continue;
+                }
 
-                        } /* End of "for a" */
+            if ( debug->debugflexbit )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Condition \"%s\" found in rule.", __FILE__, __LINE__, RuleBody[rule_position].Flexbit.flexbit_type[i] == 3 ? "isset" : "isnotset");
+                }
 
-                } /* End "if" flexbit_type == 3 (ISSET) */
+            Flexbit_Filter(&filter, RuleBody[rule_position].Flexbit.flexbit_direction[i], RuleBody[rule_position].Flexbit.flexbit_name[i], ip_src, ip_dst, src_port, dst_port);
 
-            /*******************
-            *    ISNOTSET     *
-            *******************/
+            flexbit_match = false;
 
-            if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 4 )
+            for ( a = Flexbit_First(&filter, &chain); a != 0; a = flexbit_ipc[a - 1].flexbit_next[chain] )
                 {
 
+                    if ( flexbit_ipc[a - 1].flexbit_state == false || now >= flexbit_ipc[a - 1].flexbit_expire ||
+                            Flexbit_Match(a - 1, &filter) == false )
+                        {
+                            continue;
+                        }
 
                     if ( debug->debugflexbit )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Condition \"isnotset\" found in rule.", __FILE__, __LINE__);
+                            Sagan_Log(DEBUG, "[%s, line %d] \"%s\" flexbit \"%s\" is set (direction: \"%s\").", __FILE__, __LINE__,
+                                      RuleBody[rule_position].Flexbit.flexbit_type[i] == 3 ? "isset" : "isnotset",
+                                      flexbit_ipc[a - 1].flexbit_name, flexbit_direction_name[ RuleBody[rule_position].Flexbit.flexbit_direction[i] % 13 ]);
                         }
 
-                    flexbit_match = false;
+                    flexbit_match = true;
 
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-                            if ( !memcmp(RuleBody[rule_position].Flexbit.flexbit_name[i], flexbit_ipc[a].flexbit_name, sizeof(RuleBody[rule_position].Flexbit.flexbit_name[i])) )
-                                {
+                    /* Every matching flexbit counts toward "isset" */
 
-                                    /* direction: none */
+                    if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 3 )
+                        {
+                            flexbit_total_match++;
+                        }
+                    else
+                        {
+                            break;
+                        }
 
-                                    if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 0 )
-                                        {
+                }
 
-                                            if ( flexbit_ipc[a].flexbit_state == true )
-                                                {
-                                                    if ( debug->debugflexbit )
-                                                        {
-                                                            Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"none\"). (any -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
+            /* flexbit wasn't found for isnotset */
 
-                                                        }
+            if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 4 && flexbit_match == false )
+                {
+                    flexbit_total_match++;
+                }
 
-                                                    flexbit_match = true;
-                                                }
-                                        }
+        } /* for (i = 0; i < RuleBody[rule_position].xbit_count; i++) */
 
-                                    /* direction: both */
 
-                                    if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 1 )
-                                        {
+    if ( flexbit_total_match == RuleBody[rule_position].Flexbit.flexbit_condition_count )
+        {
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_src\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
+            if ( debug->debugflexbit )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Got %d flexbits & needed %d. Got corrent number of flexbits, return true!", __FILE__, __LINE__, flexbit_total_match, RuleBody[rule_position].Flexbit.flexbit_condition_count );
+                }
 
-                                                                }
+            return(true);
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+        }
 
-                                    /* direction: by_src */
+    if ( debug->debugflexbit )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Got %d flexbits, needed %d", __FILE__, __LINE__, flexbit_total_match, RuleBody[rule_position].Flexbit.flexbit_condition_count );
+        }
 
-                                    if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 2 )
-                                        {
+    return(false);
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_src\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
+}  /* End of Xbit_Condition(); */
 
-                                                                }
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+/*****************************************************************************
+ * Flexbit_Count - Used to determine how many flexbits have been set based on a
+ * source or destination address.  This is useful for identification of
+ * distributed attacks.
+ *****************************************************************************/
 
-                                    /* direction: by_dst */
+bool Flexbit_Count_MMAP( int rule_position, char *ip_src, char *ip_dst )
+{
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 3 )
-                                        {
+    const unsigned char *ip = NULL;
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_dst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
+    uint32_t a = 0;
+    uint32_t i = 0;
+    uint32_t counter = 0;
 
-                                                                }
+    int chain = 0;
+    int direction = 0;
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+    for (i = 0; i < RuleBody[rule_position].Flexbit.flexbit_count_count; i++)
+        {
 
-                                    /* direction: reverse */
+            direction = RuleBody[rule_position].Flexbit.flexbit_direction[i];
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 4 )
-                                        {
+            if ( direction == 2 )
+                {
+                    chain = FLEXBIT_CHAIN_SRC;
+                    ip = (const unsigned char *)ip_src;
+                }
+            else if ( direction == 3 )
+                {
+                    chain = FLEXBIT_CHAIN_DST;
+                    ip = (const unsigned char *)ip_dst;
+                }
+            else
+                {
+                    continue;
+                }
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"reverse\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
+            /* Any flexbit name counts,  only the address has to match */
 
-                                                                }
+            for ( a = __atomic_load_n(Flexbit_Head(chain, Flexbit_IP_Hash(ip)), __ATOMIC_ACQUIRE); a != 0; a = flexbit_ipc[a - 1].flexbit_next[chain] )
+                {
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+                    if ( memcmp(chain == FLEXBIT_CHAIN_SRC ? flexbit_ipc[a - 1].ip_src : flexbit_ipc[a - 1].ip_dst, ip, MAXIPBIT) )
+                        {
+                            continue;
+                        }
 
-                                    /* direciton: src_xbitdst */
+                    counter++;
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 5 )
-                                        {
+                    if ( RuleBody[rule_position].Flexbit.flexbit_count_gt_lt[i] == 0 &&
+                            counter > RuleBody[rule_position].Flexbit.flexbit_count_counter[i] )
+                        {
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"src_xbitdst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
+                            if ( debug->debugflexbit)
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit count '%s' threshold reached for flexbit '%s'.", __FILE__, __LINE__, flexbit_direction_name[direction], flexbit_ipc[a - 1].flexbit_name);
+                                }
 
-                                                                }
+                            return(true);
+                        }
+                }
+        }
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+    if ( debug->debugflexbit)
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Xbit count threshold NOT reached for flexbit.", __FILE__, __LINE__);
+        }
 
-                                    /* direction: dst_xbitsrc */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 6 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"src_xbitdst\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
+    return(false);
+}
 
-                                                                }
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+/*****************************************************************************
+ * Flexbit_Set - Used to "set" & "unset" flexbit.  All rule "set" and
+ * "unset" happen here.
+ *****************************************************************************/
 
-                                    /* direction: both_p */
+void Flexbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port, char *syslog_message )
+{
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 7 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                                    flexbit_ipc[a].src_port == src_port &&
-                                                    flexbit_ipc[a].dst_port == dst_port )
+    struct _Sagan_Flexbit_Filter filter;
 
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"src_xbitdst\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
+    uint64_t now = Return_Epoch();
 
-                                                                }
+    uint32_t a = 0;
+    int chain = 0;
+    int i = 0;
+    int type = 0;
+    int timeout = 0;
+    int set_src_port = 0;
+    int set_dst_port = 0;
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+    bool flexbit_unset_match = 0;
 
-                                    /* direction: by_src_p */
+    for (i = 0; i < RuleBody[rule_position].Flexbit.flexbit_count; i++)
+        {
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 8 )
-                                        {
+            type = RuleBody[rule_position].Flexbit.flexbit_type[i];
+            timeout = RuleBody[rule_position].Flexbit.flexbit_timeout[i];
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    flexbit_ipc[a].src_port == src_port )
+            /*******************
+             *      UNSET      *
+             *******************/
 
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_src_p\"). (%s:%d -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, src_port);
+            if ( type == 2 )
+                {
 
-                                                                }
+                    Flexbit_Filter(&filter, RuleBody[rule_position].Flexbit.flexbit_direction[i], RuleBody[rule_position].Flexbit.flexbit_name[i], ip_src, ip_dst, src_port, dst_port);
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+                    flexbit_unset_match = 0;
 
-                                    /* direction: by_dst_p */
+                    /* Flexbits are not striped.  An "unset" can match many
+                       flexbits (any source or destination,  depending on the
+                       direction),  and a new flexbit goes on the name,  source
+                       and destination chains and the expiry wheel at once.
+                       No one stripe covers all of that.  Lookups don't lock */
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 9 )
-                                        {
+                    IPC_Lock_All(FLEXBIT);
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                                    flexbit_ipc[a].dst_port == dst_port )
+                    for ( a = Flexbit_First(&filter, &chain); a != 0; a = flexbit_ipc[a - 1].flexbit_next[chain] )
+                        {
 
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_dst_p\"). (any -> %s:%d)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, dst_port);
+                            if ( Flexbit_Match(a - 1, &filter) == false )
+                                {
+                                    continue;
+                                }
 
-                                                                }
+                            if ( debug->debugflexbit)
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"%s\").", __FILE__, __LINE__, flexbit_ipc[a - 1].flexbit_name, flexbit_direction_name[ RuleBody[rule_position].Flexbit.flexbit_direction[i] % 13 ]);
+                                }
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+                            flexbit_ipc[a - 1].flexbit_state = false;
+                            flexbit_unset_match = 1;
 
-                                    /* direction: reverse_p */
+                        }
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 10 )
-                                        {
+                    IPC_Unlock_All(FLEXBIT);
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                                    flexbit_ipc[a].src_port == dst_port &&
-                                                    flexbit_ipc[a].dst_port == src_port)
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"reverse_p\"). (%s:%d -> %s:%d)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, dst_port, ip_dst, src_port);
+                    if ( debug->debugflexbit && flexbit_unset_match == 0 )
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] No flexbit found to \"unset\" for %s.", __FILE__, __LINE__, RuleBody[rule_position].Flexbit.flexbit_name[i]);
+                        }
 
-                                                                }
+                    continue;
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+                }
 
-                                    /* direction: src_xbitdst_p */
+            /*************************************************
+             *  SET, SET_SRCPORT, SET_DSTPORT and SET_PORTS  *
+             *************************************************/
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 11 )
-                                        {
+            if ( type != 1 && type != 5 && type != 6 && type != 7 )
+                {
+                    continue;
+                }
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                                    flexbit_ipc[a].dst_port == src_port )
+            set_src_port = ( type == 5 || type == 7 ) ? src_port : config->default_port;
+            set_dst_port = ( type == 6 || type == 7 ) ? dst_port : config->default_port;
 
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"src_xbitdst_p\"). (any -> %s:%d)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, src_port);
+            /* Exact flexbit (name, both addresses and ports) */
 
-                                                                }
+            Flexbit_Filter(&filter, 7, RuleBody[rule_position].Flexbit.flexbit_name[i], ip_src, ip_dst, set_src_port, set_dst_port);
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+            IPC_Lock_All(FLEXBIT);
 
-                                    /* direction: dst_xbitsrc_p */
+            /* Drop the few flexbits that have come due on the expiry wheel */
 
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 12 )
-                                        {
+            Expire_IPC_Flexbit(now, IPC_WHEEL_RECLAIM);
 
+            for ( a = Flexbit_First(&filter, &chain); a != 0; a = flexbit_ipc[a - 1].flexbit_next[chain] )
+                {
+                    if ( Flexbit_Match(a - 1, &filter) == true )
+                        {
+                            break;
+                        }
+                }
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    flexbit_ipc[a].src_port == dst_port )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"dst_xbitsrc_p\"). (%s:%d-> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, dst_port);
+            /* Do we have the flexbit already in memory?  If so,  update the information */
 
-                                                                }
+            if ( a != 0 )
+                {
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+                    flexbit_ipc[a - 1].flexbit_date = now;
+                    flexbit_ipc[a - 1].flexbit_expire = now + timeout;
 
-                                } /* if memcmp(RuleBody[rule_position].xbit_name[i] */
-                        } /* for a = 0 */
+                    IPC_Wheel_Remove(Flexbit_Wheel, a - 1);
+                    IPC_Wheel_Add(Flexbit_Wheel, a - 1, flexbit_ipc[a - 1].flexbit_expire + flexbit_ipc[a - 1].expire);
+                    flexbit_ipc[a - 1].flexbit_state = true;
+                    strlcpy(flexbit_ipc[a - 1].syslog_message, syslog_message, sizeof(flexbit_ipc[a - 1].syslog_message));
 
-                    /* flexbit wasn't found for isnotset */
+                    if ( type == 1 )
+                        {
+                            strlcpy(flexbit_ipc[a - 1].signature_msg, RuleBody[rule_position].s_msg, sizeof(flexbit_ipc[a - 1].signature_msg));
+                            flexbit_ipc[a - 1].sid = RuleBody[rule_position].s_sid;
+                        }
 
-                    if ( flexbit_match == false )
+                    if ( debug->debugflexbit)
                         {
-                            flexbit_total_match++;
+                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set\" for flexbit \"%s\". Nex expire time is %" PRIu64 " (%d) [ %d -> %d ]", __FILE__, __LINE__, a - 1, RuleBody[rule_position].Flexbit.flexbit_name[i], flexbit_ipc[a - 1].flexbit_expire, timeout, flexbit_ipc[a - 1].src_port, flexbit_ipc[a - 1].dst_port);
                         }
 
-                } /* RuleBody[rule_position].Flexbit.flexbit_type[i] == 4 */
+                }
 
-        } /* for (i = 0; i < RuleBody[rule_position].xbit_count; i++) */
+            /* If the flexbit isn't in memory,  create it.  If the table is full,  drop what has expired first */
 
+            else if ( counters_ipc->flexbit_count < config->max_flexbits || Clean_IPC_Flexbit() == 0 )
+                {
 
-    if ( flexbit_total_match == RuleBody[rule_position].Flexbit.flexbit_condition_count )
-        {
+                    a = counters_ipc->flexbit_count;
 
-            if ( debug->debugflexbit )
-                {
-                    Sagan_Log(DEBUG, "[%s, line %d] Got %d flexbits & needed %d. Got corrent number of flexbits, return true!", __FILE__, __LINE__, flexbit_total_match, RuleBody[rule_position].Flexbit.flexbit_condition_count );
-                }
+                    memset(&flexbit_ipc[a], 0, sizeof(struct _Sagan_IPC_Flexbit));
 
-            return(true);
+                    memcpy(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src));
+                    memcpy(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst));
 
-        }
-    else
-        {
+                    flexbit_ipc[a].src_port = set_src_port;
+                    flexbit_ipc[a].dst_port = set_dst_port;
+                    flexbit_ipc[a].flexbit_date = now;
+                    flexbit_ipc[a].flexbit_expire = now + timeout;
+                    flexbit_ipc[a].flexbit_state = true;
+                    flexbit_ipc[a].expire = timeout;
 
-            if ( debug->debugflexbit )
-                {
-                    Sagan_Log(DEBUG, "[%s, line %d] Got %d flexbits, needed %d", __FILE__, __LINE__, flexbit_total_match, RuleBody[rule_position].Flexbit.flexbit_condition_count );
-                }
+                    strlcpy(flexbit_ipc[a].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i], sizeof(flexbit_ipc[a].flexbit_name));
+                    flexbit_ipc[a].flexbit_name_hash = filter.name_hash;
 
-            return(false);
+                    strlcpy(flexbit_ipc[a].signature_msg, RuleBody[rule_position].s_msg, sizeof(flexbit_ipc[a].signature_msg));
+                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
+                    flexbit_ipc[a].sid = RuleBody[rule_position].s_sid;
 
-        }
+                    Flexbit_Link(a);
+                    IPC_Wheel_Add(Flexbit_Wheel, a, flexbit_ipc[a].flexbit_expire + flexbit_ipc[a].expire);
 
-    Sagan_Log(WARN, "Shouldn't make it this far in Xbit_Condition()!\n");
+                    if ( debug->debugflexbit)
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] [%d] Created flexbit \"%s\" via \"set, set_srcport, set_dstport, or set_ports\" [%d -> %d]", __FILE__, __LINE__, a, flexbit_ipc[a].flexbit_name, set_src_port, set_dst_port);
+                        }
 
-}  /* End of Xbit_Condition(); */
+                    File_Lock(config->shm_counters);
 
+                    counters_ipc->flexbit_count++;
 
-/*****************************************************************************
- * Flexbit_Count - Used to determine how many flexbits have been set based on a
- * source or destination address.  This is useful for identification of
- * distributed attacks.
- *****************************************************************************/
+                    File_Unlock(config->shm_counters);
 
-bool Flexbit_Count_MMAP( int rule_position, char *ip_src, char *ip_dst )
-{
+                }
 
-    uint32_t a = 0;
-    uint32_t i = 0;
-    uint32_t counter = 0;
-
-    for (i = 0; i < RuleBody[rule_position].Flexbit.flexbit_count_count; i++)
-        {
-
-            for (a = 0; a < counters_ipc->flexbit_count; a++)
-                {
-
-                    if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 2 &&
-                            !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) )
-                        {
-
-                            counter++;
-
-                            if ( RuleBody[rule_position].Flexbit.flexbit_count_gt_lt[i] == 0 )
-                                {
-
-                                    if ( counter > RuleBody[rule_position].Flexbit.flexbit_count_counter[i] )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit count 'by_src' threshold reached for flexbit '%s'.", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-                                                }
-
-
-                                            return(true);
-                                        }
-                                }
-                        }
-
-                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 3 &&
-                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                        {
-
-                            counter++;
-
-                            if ( RuleBody[rule_position].Flexbit.flexbit_count_gt_lt[i] == 0 )
-                                {
-
-                                    if ( counter > RuleBody[rule_position].Flexbit.flexbit_count_counter[i] )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit count 'by_dst' threshold reached for flexbit '%s'.", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-                                                }
-
-                                            return(true);
-                                        }
-                                }
-                        }
-                }
-        }
-
-    if ( debug->debugflexbit)
-        {
-            Sagan_Log(DEBUG, "[%s, line %d] Xbit count threshold NOT reached for flexbit.", __FILE__, __LINE__);
-        }
-
-    return(false);
-}
-
-
-/*****************************************************************************
- * Flexbit_Set - Used to "set" & "unset" flexbit.  All rule "set" and
- * "unset" happen here.
- *****************************************************************************/
-
-void Flexbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port, char *syslog_message )
-{
-
-    int i = 0;
-    int a = 0;
-
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
-    bool flexbit_match = false;
-    bool flexbit_unset_match = 0;
-
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
-    struct _Sagan_Flexbit_Track *flexbit_track;
-
-    flexbit_track = malloc(sizeof(_Sagan_Flexbit_Track));
-
-    if ( flexbit_track  == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(flexbit_track, 0, sizeof(_Sagan_Flexbit_Track));
-
-    int flexbit_track_count = 0;
-
-    Flexbit_Cleanup_MMAP();
-
-    for (i = 0; i < RuleBody[rule_position].Flexbit.flexbit_count; i++)
-        {
-
-            /*******************
-             *      UNSET      *
-             *******************/
-
-            if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 2 )
-                {
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-
-                            if ( !strcmp(flexbit_ipc[a].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i] ))
-                                {
-
-                                    /* direction: none */
-
-                                    if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 0 )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"none\"). (any -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-                                                }
-
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-
-                                    /* direction: both */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 1 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"both\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: by_src */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 2 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"by_src\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-
-                                    /* direction: by_dst */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 3 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"by_dst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: reverse */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 4 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"reverse\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: src_xbitdst */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 5 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"src_xbitdst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: dst_xbitsrc */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 6 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"dst_xbitsrc\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: both_p */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 7 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].src_port == src_port &&
-                                              flexbit_ipc[a].dst_port == dst_port )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"both_p\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: by_src_p */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 8 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == src_port )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"by_src_p\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-
-                                    /* direction: by_dst_p */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 9 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].dst_port == dst_port )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"by_dst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: reverse_p */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 10 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == dst_port &&
-                                              flexbit_ipc[a].dst_port == src_port )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"reverse_p\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: src_xbitdst_p */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 11 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].dst_port == src_port )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"src_xbitdst_p\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: dst_xbitsrc_p */
-
-                                    else if ( RuleBody[rule_position].Flexbit.flexbit_direction[i] == 12 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == dst_port )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"dst_xbitsrc_p\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                }
-                        }
-
-                    if ( debug->debugflexbit && flexbit_unset_match == 0 )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] No flexbit found to \"unset\" for %s.", __FILE__, __LINE__, RuleBody[rule_position].Flexbit.flexbit_name[i]);
-                        }
-
-                } /* if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 2 ) */
-
-            /*******************
-             *      SET        *
-            *******************/
-
-            else if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 1 )
-                {
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-
-                            /* Do we have the flexbit already in memory?  If so,  update the information */
-
-                            if (!strcmp(flexbit_ipc[a].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i]) &&
-                                    !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                    flexbit_ipc[a].src_port == config->default_port &&
-                                    flexbit_ipc[a].dst_port == config->default_port )
-                                {
-
-
-                                    File_Lock(config->shm_flexbit);
-                                    pthread_mutex_lock(&Flexbit_Mutex);
-
-                                    flexbit_ipc[a].flexbit_date = atol(timet);
-                                    flexbit_ipc[a].flexbit_expire = atol(timet) + RuleBody[rule_position].Flexbit.flexbit_timeout[i];
-                                    flexbit_ipc[a].flexbit_state = true;
-                                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
-                                    strlcpy(flexbit_ipc[a].signature_msg, RuleBody[rule_position].s_msg, sizeof(flexbit_ipc[a].signature_msg));
-                                    flexbit_ipc[a].sid = RuleBody[rule_position].s_sid;
-
-
-                                    if ( debug->debugflexbit)
-                                        {
-
-                                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set\" for flexbit \"%s\". Nex expire time is %d (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, RuleBody[rule_position].Flexbit.flexbit_name[i], flexbit_ipc[i].flexbit_expire, RuleBody[rule_position].Flexbit.flexbit_timeout[i], flexbit_ipc[a].ip_src, flexbit_ipc[a].src_port, flexbit_ipc[a].ip_dst, flexbit_ipc[a].dst_port);
-
-                                        }
-
-                                    pthread_mutex_unlock(&Flexbit_Mutex);
-                                    File_Unlock(config->shm_flexbit);
-
-                                    flexbit_match = true;
-                                }
-
-                        }
-
-
-                    /* If the flexbit isn't in memory,  store it to be created later */
-
-                    if ( flexbit_match == false )
-                        {
-
-                            flexbit_track = ( _Sagan_Flexbit_Track * ) realloc(flexbit_track, (flexbit_track_count+1) * sizeof(_Sagan_Flexbit_Track));
-
-                            if ( flexbit_track == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-                                }
-
-                            memset(&flexbit_track[flexbit_track_count], 0, sizeof(_Sagan_Flexbit_Track));
-
-                            strlcpy(flexbit_track[flexbit_track_count].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i], sizeof(flexbit_track[flexbit_track_count].flexbit_name));
-                            strlcpy(flexbit_ipc[flexbit_track_count].syslog_message, syslog_message, sizeof(flexbit_ipc[flexbit_track_count].syslog_message));
-                            strlcpy(flexbit_ipc[flexbit_track_count].signature_msg, RuleBody[rule_position].s_msg, sizeof(flexbit_ipc[flexbit_track_count].signature_msg));
-                            flexbit_ipc[flexbit_track_count].sid = RuleBody[rule_position].s_sid;
-
-                            flexbit_track[flexbit_track_count].flexbit_timeout = RuleBody[rule_position].Flexbit.flexbit_timeout[i];
-                            flexbit_track[flexbit_track_count].flexbit_srcport = config->default_port;
-                            flexbit_track[flexbit_track_count].flexbit_dstport = config->default_port;
-                            flexbit_track_count++;
-
-                        }
-
-                } /* if flexbit_type == 1 */
-
-            /***************************
-             *      SET_SRCPORT        *
-            ****************************/
-
-            else if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 5 )
-                {
-
-                    flexbit_match = false;
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-
-                            /* Do we have the flexbit already in memory?  If so,  update the information */
-
-                            if (!strcmp(flexbit_ipc[a].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i]) &&
-                                    !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                    flexbit_ipc[a].src_port == src_port &&
-                                    flexbit_ipc[a].dst_port == config->default_port )
-                                {
-
-                                    File_Lock(config->shm_flexbit);
-                                    pthread_mutex_lock(&Flexbit_Mutex);
-
-                                    flexbit_ipc[a].flexbit_date = atol(timet);
-                                    flexbit_ipc[a].flexbit_expire = atol(timet) + RuleBody[rule_position].Flexbit.flexbit_timeout[i];
-                                    flexbit_ipc[a].flexbit_state = true;
-                                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
-
-                                    if ( debug->debugflexbit)
-                                        {
-
-                                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set_srcport\" for flexbit \"%s\". Nex expire time is %d (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, RuleBody[rule_position].Flexbit.flexbit_name[i], flexbit_ipc[i].flexbit_expire, RuleBody[rule_position].Flexbit.flexbit_timeout[i], flexbit_ipc[a].ip_src, flexbit_ipc[a].src_port, flexbit_ipc[a].ip_dst, flexbit_ipc[a].dst_port);
-
-                                        }
-
-                                    pthread_mutex_unlock(&Flexbit_Mutex);
-                                    File_Unlock(config->shm_flexbit);
-
-                                    flexbit_match = true;
-                                }
-
-                        }
-
-
-                    /* If the flexbit isn't in memory,  store it to be created later */
-
-                    if ( flexbit_match == false )
-                        {
-
-                            flexbit_track = ( _Sagan_Flexbit_Track * ) realloc(flexbit_track, (flexbit_track_count+1) * sizeof(_Sagan_Flexbit_Track));
-
-                            if ( flexbit_track == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-                                }
-
-                            memset(&flexbit_track[flexbit_track_count], 0, sizeof(_Sagan_Flexbit_Track));
-
-                            strlcpy(flexbit_track[flexbit_track_count].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i], sizeof(flexbit_track[flexbit_track_count].flexbit_name));
-                            strlcpy(flexbit_ipc[flexbit_track_count].syslog_message, syslog_message, sizeof(flexbit_ipc[flexbit_track_count].syslog_message));
-                            flexbit_track[flexbit_track_count].flexbit_timeout = RuleBody[rule_position].Flexbit.flexbit_timeout[i];
-                            flexbit_track[flexbit_track_count].flexbit_srcport = src_port;
-                            flexbit_track[flexbit_track_count].flexbit_dstport = config->default_port;
-                            flexbit_track_count++;
-
-                        }
-
-                } /* if flexbit_type == 5 */
-
-            /***************************
-             *      SET_DSTPORT        *
-            ****************************/
-
-            else if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 6 )
-                {
-
-                    flexbit_match = false;
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-
-                            /* Do we have the flexbit already in memory?  If so,  update the information */
-
-                            if (!strcmp(flexbit_ipc[a].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i]) &&
-                                    !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                    flexbit_ipc[a].src_port == config->default_port &&
-                                    flexbit_ipc[a].dst_port == dst_port )
-                                {
-
-                                    File_Lock(config->shm_flexbit);
-                                    pthread_mutex_lock(&Flexbit_Mutex);
-
-                                    flexbit_ipc[a].flexbit_date = atol(timet);
-                                    flexbit_ipc[a].flexbit_expire = atol(timet) + RuleBody[rule_position].Flexbit.flexbit_timeout[i];
-                                    flexbit_ipc[a].flexbit_state = true;
-                                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
-
-                                    if ( debug->debugflexbit)
-                                        {
-
-                                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set_dstport\" for flexbit \"%s\". Nex expire time is %d (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, RuleBody[rule_position].Flexbit.flexbit_name[i], flexbit_ipc[i].flexbit_expire, RuleBody[rule_position].Flexbit.flexbit_timeout[i], flexbit_ipc[a].ip_src, flexbit_ipc[a].src_port, flexbit_ipc[a].ip_dst, flexbit_ipc[a].dst_port);
-
-                                        }
-
-                                    pthread_mutex_unlock(&Flexbit_Mutex);
-                                    File_Unlock(config->shm_flexbit);
-
-                                    flexbit_match = true;
-                                }
-
-                        }
-
-
-                    /* If the flexbit isn't in memory,  store it to be created later */
-
-                    if ( flexbit_match == false )
-                        {
-
-                            flexbit_track = ( _Sagan_Flexbit_Track * ) realloc(flexbit_track, (flexbit_track_count+1) * sizeof(_Sagan_Flexbit_Track));
-
-                            if ( flexbit_track == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-                                }
-
-                            memset(&flexbit_track[flexbit_track_count], 0, sizeof(_Sagan_Flexbit_Track));
-
-                            strlcpy(flexbit_track[flexbit_track_count].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i], sizeof(flexbit_track[flexbit_track_count].flexbit_name));
-                            strlcpy(flexbit_ipc[flexbit_track_count].syslog_message, syslog_message, sizeof(flexbit_ipc[flexbit_track_count].syslog_message));
-                            flexbit_track[flexbit_track_count].flexbit_timeout = RuleBody[rule_position].Flexbit.flexbit_timeout[i];
-                            flexbit_track[flexbit_track_count].flexbit_srcport = config->default_port;
-                            flexbit_track[flexbit_track_count].flexbit_dstport = dst_port;
-                            flexbit_track_count++;
-
-                        }
-
-                } /* if flexbit_type == 6 */
-
-            /*************************
-             *      SET_PORTS        *
-            **************************/
-
-            else if ( RuleBody[rule_position].Flexbit.flexbit_type[i] == 7 )
-                {
-
-                    flexbit_match = false;
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-
-                            /* Do we have the flexbit already in memory?  If so,  update the information */
-
-                            if (!strcmp(flexbit_ipc[a].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i]) &&
-                                    !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                    flexbit_ipc[a].src_port == src_port &&
-                                    flexbit_ipc[a].dst_port == dst_port )
-                                {
-
-                                    File_Lock(config->shm_flexbit);
-                                    pthread_mutex_lock(&Flexbit_Mutex);
-
-                                    flexbit_ipc[a].flexbit_date = atol(timet);
-                                    flexbit_ipc[a].flexbit_expire = atol(timet) + RuleBody[rule_position].Flexbit.flexbit_timeout[i];
-                                    flexbit_ipc[a].flexbit_state = true;
-                                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
-
-                                    if ( debug->debugflexbit)
-                                        {
-
-                                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set_ports\" for flexbit \"%s\". Nex expire time is %d (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, RuleBody[rule_position].Flexbit.flexbit_name[i], flexbit_ipc[i].flexbit_expire, RuleBody[rule_position].Flexbit.flexbit_timeout[i], flexbit_ipc[a].ip_src, flexbit_ipc[a].src_port, flexbit_ipc[a].ip_dst, flexbit_ipc[a].dst_port);
-
-                                        }
-
-                                    pthread_mutex_unlock(&Flexbit_Mutex);
-                                    File_Unlock(config->shm_flexbit);
-
-                                    flexbit_match = true;
-                                }
-
-                        }
-
-
-                    /* If the flexbit isn't in memory,  store it to be created later */
-
-                    if ( flexbit_match == false )
-                        {
-
-                            flexbit_track = ( _Sagan_Flexbit_Track * ) realloc(flexbit_track, (flexbit_track_count+1) * sizeof(_Sagan_Flexbit_Track));
-
-                            if ( flexbit_track == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-                                }
-
-                            memset(&flexbit_track[flexbit_track_count], 0, sizeof(_Sagan_Flexbit_Track));
-
-                            strlcpy(flexbit_track[flexbit_track_count].flexbit_name, RuleBody[rule_position].Flexbit.flexbit_name[i], sizeof(flexbit_track[flexbit_track_count].flexbit_name));
-                            strlcpy(flexbit_ipc[flexbit_track_count].syslog_message, syslog_message, sizeof(flexbit_ipc[flexbit_track_count].syslog_message));
-                            strlcpy(flexbit_ipc[flexbit_track_count].signature_msg, RuleBody[rule_position].s_msg, sizeof(flexbit_ipc[flexbit_track_count].signature_msg));
-                            flexbit_ipc[flexbit_track_count].sid = RuleBody[rule_position].s_sid;
-
-                            flexbit_track[flexbit_track_count].flexbit_timeout = RuleBody[rule_position].Flexbit.flexbit_timeout[i];
-                            flexbit_track[flexbit_track_count].flexbit_srcport = src_port;
-                            flexbit_track[flexbit_track_count].flexbit_dstport = dst_port;
-                            flexbit_track_count++;
-
-                        }
-
-                } /* if flexbit_type == 7 */
+            IPC_Unlock_All(FLEXBIT);
 
         } /* Out of for i loop */
 
-    /* Do we have any flexbits in memory that need to be created?  */
-
-    if ( flexbit_track_count != 0 )
-        {
-
-            for (i = 0; i < flexbit_track_count; i++)
-                {
-
-                    if ( Clean_IPC_Object(FLEXBIT) == 0 )
-                        {
-
-                            File_Lock(config->shm_flexbit);
-                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                            memcpy(flexbit_ipc[counters_ipc->flexbit_count].ip_src, ip_src, sizeof(flexbit_ipc[counters_ipc->flexbit_count].ip_src));
-                            memcpy(flexbit_ipc[counters_ipc->flexbit_count].ip_dst, ip_dst, sizeof(flexbit_ipc[counters_ipc->flexbit_count].ip_dst));
-
-                            flexbit_ipc[counters_ipc->flexbit_count].src_port = flexbit_track[i].flexbit_srcport;
-                            flexbit_ipc[counters_ipc->flexbit_count].dst_port = flexbit_track[i].flexbit_dstport;
-                            flexbit_ipc[counters_ipc->flexbit_count].flexbit_date = atol(timet);
-                            flexbit_ipc[counters_ipc->flexbit_count].flexbit_expire = atol(timet) + flexbit_track[i].flexbit_timeout;
-                            flexbit_ipc[counters_ipc->flexbit_count].flexbit_state = true;
-                            flexbit_ipc[counters_ipc->flexbit_count].expire = flexbit_track[i].flexbit_timeout;
-
-                            strlcpy(flexbit_ipc[counters_ipc->flexbit_count].flexbit_name, flexbit_track[i].flexbit_name, sizeof(flexbit_ipc[counters_ipc->flexbit_count].flexbit_name));
-                            strlcpy(flexbit_ipc[counters_ipc->flexbit_count].signature_msg, RuleBody[rule_position].s_msg, sizeof(flexbit_ipc[counters_ipc->flexbit_count].signature_msg));
-                            strlcpy(flexbit_ipc[counters_ipc->flexbit_count].syslog_message, syslog_message, sizeof(flexbit_ipc[counters_ipc->flexbit_count].syslog_message));
-                            flexbit_ipc[counters_ipc->flexbit_count].sid = RuleBody[rule_position].s_sid;
-
-
-                            if ( debug->debugflexbit)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] [%d] Created flexbit \"%s\" via \"set, set_srcport, set_dstport, or set_ports\" [%s:%d -> %s:%d]", __FILE__, __LINE__, counters_ipc->flexbit_count, flexbit_ipc[counters_ipc->flexbit_count].flexbit_name, ip_src, flexbit_track[i].flexbit_srcport, ip_dst, flexbit_track[i].flexbit_dstport);
-                                }
-
-                            File_Lock(config->shm_counters);
-
-                            counters_ipc->flexbit_count++;
-
-                            File_Unlock(config->shm_counters);
-                            File_Unlock(config->shm_flexbit);
-
-                            pthread_mutex_unlock(&Flexbit_Mutex);
-
-                        }
-                }
-        }
-
-    free(flexbit_track);
-
 } /* End of Xbit_Set */
-
-/*****************************************************************************
- * Xbit_Cleanup - Find "expired" flexbits and toggle the "state"
- * to "off"
- *****************************************************************************/
-
-void Flexbit_Cleanup_MMAP(void)
-{
-
-    int i = 0;
-
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
-    for (i=0; i<counters_ipc->flexbit_count; i++)
-        {
-
-            if (  flexbit_ipc[i].flexbit_state == true && atol(timet) >= flexbit_ipc[i].flexbit_expire )
-                {
-                    if (debug->debugflexbit)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Setting flexbit %s to \"expired\" state.", __FILE__, __LINE__, flexbit_ipc[i].flexbit_name);
-                        }
-                    flexbit_ipc[i].flexbit_state = false;
-                }
-        }
-
-}
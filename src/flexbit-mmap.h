@@ -25,9 +25,19 @@
 #include "sagan-defs.h"
 
 bool Flexbit_Condition_MMAP ( int, char *, char *, int, int );
-void Flexbit_Cleanup_MMAP( void );
 void Flexbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port, char *syslog_message );
 bool Flexbit_Count_MMAP( int rule_position, char *ip_src, char *ip_dst );
+size_t Flexbit_Index_Bytes_MMAP( int );
+void Flexbit_Index_Rebuild_MMAP( void );
+void Flexbit_Remove_MMAP( int );
+
+/* Every flexbit is on three hash chains: by name,  by source and by
+   destination address.  Lookups walk the shortest one that applies */
+
+#define FLEXBIT_CHAIN_NAME	0
+#define FLEXBIT_CHAIN_SRC	1
+#define FLEXBIT_CHAIN_DST	2
+#define FLEXBIT_CHAINS		3
 
 typedef struct _Sagan_Flexbit_Track _Sagan_Flexbit_Track;
 struct _Sagan_Flexbit_Track
@@ -42,7 +52,9 @@ typedef struct _Sagan_IPC_Flexbit _Sagan_IPC_Flexbit;
 struct _Sagan_IPC_Flexbit
 {
     char flexbit_name[64];
-    bool flexbit_state;
+    uint32_t flexbit_name_hash;
+    uint32_t flexbit_next[FLEXBIT_CHAINS];	/* Entry + 1,  0 == end of chain */
+    bool flexbit_state;			/* false once "unset",  past flexbit_expire it is unset too */
     unsigned char ip_src[MAXIPBIT];
     unsigned char ip_dst[MAXIPBIT];
     int src_port;
@@ -57,4 +69,12 @@ struct _Sagan_IPC_Flexbit
 
 };
 
+/* Lives in the flexbit object right after the entries */
 
+typedef struct _Sagan_IPC_Flexbit_Index _Sagan_IPC_Flexbit_Index;
+struct _Sagan_IPC_Flexbit_Index
+{
+    uint32_t size;				/* Buckets per chain,  power of two */
+    uint32_t reserved;
+    uint32_t heads[];				/* FLEXBIT_CHAINS * size,  entry + 1 */
+};
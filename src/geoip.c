@@ -37,11 +37,14 @@
 #ifdef HAVE_LIBMAXMINDDB
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <maxminddb.h>
 #include <pthread.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -55,6 +58,356 @@ struct _SaganDebug *debug;
 struct _SaganCounters *counters;
 struct _Sagan_GeoIP_Skip *GeoIP_Skip;
 
+struct _Sagan_GeoIP_Skip_Trie *GeoIP_Skip_Trie = NULL;
+
+/* Bumped every time the database is (re)opened.  Thread caches that
+   were filled from an older database notice and start over */
+
+uint32_t GeoIP2_Generation = 0;
+
+static __thread struct _Sagan_GeoIP_Cache GeoIP2_Cache;
+
+/*****************************************************************************
+ * GeoIP2_Build_Skip_Trie - Turns the 'skip_networks' list into a binary
+ * prefix trie and swaps it in for the lookup threads.
+ ****************************************************************************/
+
+static void GeoIP2_Build_Skip_Trie( void )
+{
+
+    struct _Sagan_GeoIP_Skip_Trie *trie = NULL;
+    struct _Sagan_GeoIP_Skip_Trie *old = NULL;
+
+    uint32_t node = 0;
+    int bit = 0;
+    int i = 0;
+    int b = 0;
+
+    trie = malloc(sizeof(_Sagan_GeoIP_Skip_Trie));
+
+    if ( trie == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the GeoIP skip trie. Abort!", __FILE__, __LINE__);
+        }
+
+    trie->size = 64;
+    trie->count = 1;
+    trie->node = calloc(trie->size, sizeof(_Sagan_GeoIP_Skip_Node));
+
+    if ( trie->node == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the GeoIP skip trie. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < counters->geoip_skip_count; i++ )
+        {
+
+            node = 0;
+
+            for ( b = 0; b < GeoIP_Skip[i].prefix && trie->node[node].skip == false; b++ )
+                {
+
+                    bit = ( GeoIP_Skip[i].range.ipbits[b / 8] >> ( 7 - b % 8 ) ) & 1;
+
+                    if ( trie->node[node].child[bit] == 0 )
+                        {
+
+                            if ( trie->count == trie->size )
+                                {
+
+                                    trie->size = trie->size * 2;
+                                    trie->node = realloc(trie->node, trie->size * sizeof(_Sagan_GeoIP_Skip_Node));
+
+                                    if ( trie->node == NULL )
+                                        {
+                                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for the GeoIP skip trie. Abort!", __FILE__, __LINE__);
+                                        }
+
+                                    memset(&trie->node[trie->count], 0, ( trie->size - trie->count ) * sizeof(_Sagan_GeoIP_Skip_Node));
+                                }
+
+                            trie->node[node].child[bit] = trie->count;
+                            trie->count++;
+                        }
+
+                    node = trie->node[node].child[bit];
+                }
+
+            /* Anything below a skipped prefix is covered already */
+
+            trie->node[node].skip = true;
+            memset(trie->node[node].child, 0, sizeof(trie->node[node].child));
+
+        }
+
+    /* Lookups take no lock.  This runs at start up or during a reload,
+       when no processor thread is walking the old trie */
+
+    old = __atomic_exchange_n(&GeoIP_Skip_Trie, trie, __ATOMIC_SEQ_CST);
+
+    if ( old != NULL )
+        {
+            free(old->node);
+            free(old);
+        }
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Skip_Search - Walks the skip trie one address bit at a time
+ ****************************************************************************/
+
+static bool GeoIP2_Skip_Search( unsigned char *ip_bits )
+{
+
+    struct _Sagan_GeoIP_Skip_Trie *trie = __atomic_load_n(&GeoIP_Skip_Trie, __ATOMIC_ACQUIRE);
+
+    uint32_t node = 0;
+    int b = 0;
+
+    if ( trie == NULL )
+        {
+            return(false);
+        }
+
+    for ( b = 0; b < MAXIPBIT * 8; b++ )
+        {
+
+            if ( trie->node[node].skip == true )
+                {
+                    return(true);
+                }
+
+            node = trie->node[node].child[ ( ip_bits[b / 8] >> ( 7 - b % 8 ) ) & 1 ];
+
+            if ( node == 0 )
+                {
+                    return(false);
+                }
+        }
+
+    return(trie->node[node].skip);
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Hash - FNV-1a over the address and family
+ ****************************************************************************/
+
+static uint32_t GeoIP2_Cache_Hash( unsigned char *ip_bits, bool ipv6 )
+{
+
+    uint32_t hash = 2166136261U;
+    int i = 0;
+
+    for ( i = 0; i < MAXIPBIT; i++ )
+        {
+            hash = ( hash ^ ip_bits[i] ) * 16777619U;
+        }
+
+    return( ( hash ^ ipv6 ) * 16777619U );
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Reset - (Re)sizes and empties this thread's cache
+ ****************************************************************************/
+
+static void GeoIP2_Cache_Reset( uint32_t generation )
+{
+
+    struct _Sagan_GeoIP_Cache *cache = &GeoIP2_Cache;
+    uint32_t buckets = 1;
+
+    if ( cache->size != config->geoip2_cache_size )
+        {
+
+            free(cache->entry);
+            free(cache->bucket);
+
+            cache->entry = NULL;
+            cache->bucket = NULL;
+            cache->size = config->geoip2_cache_size;
+
+            if ( cache->size != 0 )
+                {
+
+                    while ( buckets < cache->size )
+                        {
+                            buckets = buckets * 2;
+                        }
+
+                    cache->mask = buckets - 1;
+                    cache->entry = malloc(cache->size * sizeof(_Sagan_GeoIP_Cache_Entry));
+                    cache->bucket = malloc(buckets * sizeof(uint32_t));
+
+                    if ( cache->entry == NULL || cache->bucket == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the GeoIP cache. Abort!", __FILE__, __LINE__);
+                        }
+                }
+        }
+
+    if ( cache->size != 0 )
+        {
+            memset(cache->bucket, 0xff, ( cache->mask + 1 ) * sizeof(uint32_t));
+        }
+
+    cache->used = 0;
+    cache->lru_head = GEOIP_CACHE_NONE;
+    cache->lru_tail = GEOIP_CACHE_NONE;
+    cache->generation = generation;
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Unlink - Takes an entry off the LRU list
+ ****************************************************************************/
+
+static void GeoIP2_Cache_Unlink( struct _Sagan_GeoIP_Cache *cache, uint32_t idx )
+{
+
+    _Sagan_GeoIP_Cache_Entry *entry = &cache->entry[idx];
+
+    if ( entry->lru_prev != GEOIP_CACHE_NONE )
+        {
+            cache->entry[entry->lru_prev].lru_next = entry->lru_next;
+        }
+    else
+        {
+            cache->lru_head = entry->lru_next;
+        }
+
+    if ( entry->lru_next != GEOIP_CACHE_NONE )
+        {
+            cache->entry[entry->lru_next].lru_prev = entry->lru_prev;
+        }
+    else
+        {
+            cache->lru_tail = entry->lru_prev;
+        }
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Link - Puts an entry at the head (most recent) of the LRU
+ ****************************************************************************/
+
+static void GeoIP2_Cache_Link( struct _Sagan_GeoIP_Cache *cache, uint32_t idx )
+{
+
+    _Sagan_GeoIP_Cache_Entry *entry = &cache->entry[idx];
+
+    entry->lru_prev = GEOIP_CACHE_NONE;
+    entry->lru_next = cache->lru_head;
+
+    if ( cache->lru_head != GEOIP_CACHE_NONE )
+        {
+            cache->entry[cache->lru_head].lru_prev = idx;
+        }
+    else
+        {
+            cache->lru_tail = idx;
+        }
+
+    cache->lru_head = idx;
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Get - Returns true and copies out the country code if the
+ * address is in this thread's cache.
+ ****************************************************************************/
+
+static bool GeoIP2_Cache_Get( unsigned char *ip_bits, bool ipv6, uint32_t hash, char *country )
+{
+
+    struct _Sagan_GeoIP_Cache *cache = &GeoIP2_Cache;
+    uint32_t generation = __atomic_load_n(&GeoIP2_Generation, __ATOMIC_ACQUIRE);
+    uint32_t idx = 0;
+
+    if ( cache->generation != generation || cache->size != config->geoip2_cache_size )
+        {
+            GeoIP2_Cache_Reset(generation);
+        }
+
+    if ( cache->size == 0 )
+        {
+            return(false);
+        }
+
+    for ( idx = cache->bucket[hash & cache->mask]; idx != GEOIP_CACHE_NONE; idx = cache->entry[idx].next )
+        {
+
+            if ( cache->entry[idx].ipv6 == ipv6 && !memcmp(cache->entry[idx].ipbits, ip_bits, MAXIPBIT) )
+                {
+
+                    if ( cache->lru_head != idx )
+                        {
+                            GeoIP2_Cache_Unlink(cache, idx);
+                            GeoIP2_Cache_Link(cache, idx);
+                        }
+
+                    memcpy(country, cache->entry[idx].country, 3);
+                    return(true);
+                }
+        }
+
+    return(false);
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Add - Stores a country code,  evicting the least recently
+ * used entry when the cache is full.
+ ****************************************************************************/
+
+static void GeoIP2_Cache_Add( unsigned char *ip_bits, bool ipv6, uint32_t hash, char *country )
+{
+
+    struct _Sagan_GeoIP_Cache *cache = &GeoIP2_Cache;
+    uint32_t *link = NULL;
+    uint32_t idx = 0;
+
+    if ( cache->size == 0 )
+        {
+            return;
+        }
+
+    if ( cache->used < cache->size )
+        {
+            idx = cache->used;
+            cache->used++;
+        }
+    else
+        {
+
+            idx = cache->lru_tail;
+            GeoIP2_Cache_Unlink(cache, idx);
+
+            /* Take the old entry off its hash chain */
+
+            link = &cache->bucket[ GeoIP2_Cache_Hash(cache->entry[idx].ipbits, cache->entry[idx].ipv6) & cache->mask ];
+
+            while ( *link != idx )
+                {
+                    link = &cache->entry[*link].next;
+                }
+
+            *link = cache->entry[idx].next;
+        }
+
+    memcpy(cache->entry[idx].ipbits, ip_bits, MAXIPBIT);
+    memcpy(cache->entry[idx].country, country, 3);
+    cache->entry[idx].ipv6 = ipv6;
+
+    cache->entry[idx].next = cache->bucket[hash & cache->mask];
+    cache->bucket[hash & cache->mask] = idx;
+
+    GeoIP2_Cache_Link(cache, idx);
+
+}
+
 void Open_GeoIP2_Database( void )
 {
 
@@ -83,33 +436,108 @@ void Open_GeoIP2_Database( void )
             Sagan_Log(ERROR, "Error loading Maxmind GeoIP data (%s).  Are you trying to load an older, non-GeoIP database?", config->geoip2_country_file);
         }
 
+    /* 'skip_networks' have just been (re)read from the configuration */
+
+    GeoIP2_Build_Skip_Trie();
+
+    __atomic_add_fetch(&GeoIP2_Generation, 1, __ATOMIC_SEQ_CST);
+
 }
 
 /*****************************************************************************
- * GeoIP2_Lookup_Country - Looks up the country and determines if
- * it is in/out of HOME_COUNTRY
+ * GeoIP2_Lookup_Database - Looks up the country code for an address in
+ * the Maxmind database.  An address that is not in the database gets an
+ * empty country code.  Returns false on lookup errors.
  ****************************************************************************/
 
-int GeoIP2_Lookup_Country( char *ipaddr, int rule_position )
+static bool GeoIP2_Lookup_Database( char *ipaddr, unsigned char *ip_bits, bool ipv6, char *country )
 {
 
-    int gai_error;
     int mmdb_error;
     int res;
 
+    struct sockaddr_storage addr;
+    struct sockaddr_in *addr4 = (struct sockaddr_in *)&addr;
+    struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&addr;
+
+    memset(&addr, 0, sizeof(addr));
+
+    /* IP2Bit() keeps IPv4 in the first four bytes */
+
+    if ( ipv6 == true )
+        {
+            addr6->sin6_family = AF_INET6;
+            memcpy(&addr6->sin6_addr, ip_bits, sizeof(addr6->sin6_addr));
+        }
+    else
+        {
+            addr4->sin_family = AF_INET;
+            memcpy(&addr4->sin_addr, ip_bits, sizeof(addr4->sin_addr));
+        }
+
+    MMDB_lookup_result_s result = MMDB_lookup_sockaddr(&config->geoip2, (struct sockaddr *)&addr, &mmdb_error);
+    MMDB_entry_data_s entry_data;
+
+    if ( mmdb_error != MMDB_SUCCESS )
+        {
+            Sagan_Log(WARN, "MMDB_lookup_sockaddr failure (%s) for %s.", MMDB_strerror(mmdb_error), ipaddr);
+            return(false);
+        }
+
+    country[0] = '\0';
+
+    if ( result.found_entry == false )
+        {
+            return(true);
+        }
+
+    res = MMDB_get_value(&result.entry, &entry_data, "country", "iso_code", NULL);
+
+    if (res != MMDB_SUCCESS)
+        {
+            Sagan_Log(WARN, "Country code MMDB_get_value failure (%s) for %s.", MMDB_strerror(res), ipaddr);
+            return(false);
+        }
+
+    if ( entry_data.has_data && entry_data.type == MMDB_DATA_TYPE_UTF8_STRING && entry_data.data_size == 2 )
+        {
+            memcpy(country, entry_data.utf8_string, 2);
+            country[2] = '\0';
+        }
+
+    return(true);
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Lookup_Country - Looks up the country and determines if
+ * it is in/out of HOME_COUNTRY.  ip_bits is the address as already
+ * converted by IP2Bit().
+ ****************************************************************************/
+
+int GeoIP2_Lookup_Country( char *ipaddr, unsigned char *ip_bits, int rule_position )
+{
+
     char *ptmp = NULL;
     char *tok = NULL;
 
-    char country[2];
+    char country[3];
     char tmp[1024];
 
     unsigned char ip_convert[MAXIPBIT] = { 0 };
 
-    int i = 0;
+    bool ipv6 = ( strchr(ipaddr, ':') != NULL );
+    uint32_t hash = 0;
 
-    IP2Bit(ipaddr, ip_convert);
+    /* Some engine paths set the address without converting it */
+
+    if ( !memcmp(ip_bits, ip_convert, MAXIPBIT) )
+        {
+            IP2Bit(ipaddr, ip_convert);
+            ip_bits = ip_convert;
+        }
 
-    if ( is_notroutable(ip_convert) )
+    if ( is_notroutable(ip_bits) )
         {
             if (debug->debuggeoip2)
                 {
@@ -119,41 +547,38 @@ int GeoIP2_Lookup_Country( char *ipaddr, int rule_position )
             return(GEOIP_SKIP);
         }
 
-    for ( i = 0; i < counters->geoip_skip_count; i++ )
+    if ( GeoIP2_Skip_Search(ip_bits) )
         {
 
-            if ( is_inrange(ip_convert, (unsigned char *)&GeoIP_Skip[i].range, 1) )
+            if (debug->debuggeoip2)
                 {
-
-                    if (debug->debuggeoip2)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] IP address %s is in GeoIP 'skip_networks'. Skipping lookup.", __FILE__, __LINE__, ipaddr);
-                        }
-
-                    return(GEOIP_SKIP);
+                    Sagan_Log(DEBUG, "[%s, line %d] IP address %s is in GeoIP 'skip_networks'. Skipping lookup.", __FILE__, __LINE__, ipaddr);
                 }
 
+            return(GEOIP_SKIP);
         }
 
-    MMDB_lookup_result_s result = MMDB_lookup_string(&config->geoip2, ipaddr, &gai_error, &mmdb_error);
-    MMDB_entry_data_s entry_data;
-
-    res = MMDB_get_value(&result.entry, &entry_data, "country", "iso_code", NULL);
-
     __atomic_add_fetch(&counters->geoip2_lookup, 1, __ATOMIC_SEQ_CST);
 
-    if (res != MMDB_SUCCESS)
-        {
+    hash = GeoIP2_Cache_Hash(ip_bits, ipv6);
 
-            Sagan_Log(WARN, "Country code MMDB_get_value failure (%s) for %s.", MMDB_strerror(res), ipaddr);
-	
-            __atomic_add_fetch(&counters->geoip2_error, 1, __ATOMIC_SEQ_CST);
+    if ( GeoIP2_Cache_Get(ip_bits, ipv6, hash, country) )
+        {
+            __atomic_add_fetch(&counters->geoip2_cache_hit, 1, __ATOMIC_SEQ_CST);
+        }
+    else
+        {
 
-            return(GEOIP_SKIP);
+            if ( GeoIP2_Lookup_Database(ipaddr, ip_bits, ipv6, country) == false )
+                {
+                    __atomic_add_fetch(&counters->geoip2_error, 1, __ATOMIC_SEQ_CST);
+                    return(GEOIP_SKIP);
+                }
 
+            GeoIP2_Cache_Add(ip_bits, ipv6, hash, country);
         }
 
-    if ( !entry_data.has_data || entry_data.type != MMDB_DATA_TYPE_UTF8_STRING )
+    if ( country[0] == '\0' )
         {
 
             if ( debug->debuggeoip2 )
@@ -164,7 +589,6 @@ int GeoIP2_Lookup_Country( char *ipaddr, int rule_position )
             return(GEOIP_SKIP);
         }
 
-    strlcpy(country, entry_data.utf8_string, 3);
     strlcpy(tmp, RuleBody[rule_position].GeoIP.geoip2_country_codes, sizeof(tmp));
 
     if (debug->debuggeoip2)
@@ -33,8 +33,10 @@
 #define GEOIP_HIT	1
 #define GEOIP_SKIP	2
 
+#define GEOIP_CACHE_NONE	0xffffffff
+
 void Open_GeoIP2_Database( void );
-int GeoIP2_Lookup_Country( char *ipaddr, int rule_position );
+int GeoIP2_Lookup_Country( char *ipaddr, unsigned char *ip_bits, int rule_position );
 
 typedef struct _Sagan_GeoIP_Skip _Sagan_GeoIP_Skip;
 struct _Sagan_GeoIP_Skip
@@ -46,6 +48,55 @@ struct _Sagan_GeoIP_Skip
         unsigned char maskbits[MAXIPBIT];
     } range;
 
+    int prefix;
+
+};
+
+/* 'skip_networks' as a binary prefix trie.  Node 0 is the root,  a child
+   of 0 means "no child". */
+
+typedef struct _Sagan_GeoIP_Skip_Node _Sagan_GeoIP_Skip_Node;
+struct _Sagan_GeoIP_Skip_Node
+{
+    uint32_t child[2];
+    bool skip;
+};
+
+typedef struct _Sagan_GeoIP_Skip_Trie _Sagan_GeoIP_Skip_Trie;
+struct _Sagan_GeoIP_Skip_Trie
+{
+    _Sagan_GeoIP_Skip_Node *node;
+    uint32_t count;
+    uint32_t size;
+};
+
+/* Per-thread country code cache.  An empty country means the address is
+   not in the GeoIP database. */
+
+typedef struct _Sagan_GeoIP_Cache_Entry _Sagan_GeoIP_Cache_Entry;
+struct _Sagan_GeoIP_Cache_Entry
+{
+    unsigned char ipbits[MAXIPBIT];
+    bool ipv6;
+    char country[3];
+
+    uint32_t next;		/* Hash chain */
+    uint32_t lru_prev;
+    uint32_t lru_next;
+};
+
+typedef struct _Sagan_GeoIP_Cache _Sagan_GeoIP_Cache;
+struct _Sagan_GeoIP_Cache
+{
+    _Sagan_GeoIP_Cache_Entry *entry;
+    uint32_t *bucket;
+
+    uint32_t size;
+    uint32_t mask;
+    uint32_t used;
+    uint32_t lru_head;		/* Most recently used */
+    uint32_t lru_tail;		/* Least recently used */
+    uint32_t generation;
 };
 
 #endif
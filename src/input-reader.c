@@ -0,0 +1,270 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* input-reader.c
+ *
+ * Reads the FIFO/file in large blocks with read(2) instead of fgets() on a
+ * stdio stream.  Lines are found with memchr() (vectorized by libc) and
+ * returned as pointers into the read buffer,  with the \n replaced by a NULL.
+ * The caller copies the line straight into a batch slab.
+ *
+ * Lines that span two reads are kept by moving the unfinished tail to the
+ * front of the buffer before the next read.  Lines longer than
+ * MAX_SYSLOGMSG - 1 are cut at that length and the rest of the line is
+ * skipped (fgets() used to hand the rest back as a new,  broken "line").
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "input-reader.h"
+
+/****************************************************************************
+ * Input_Reader_Init - "size" is the read block size.  It is never less
+ * than a few maximum size lines.
+ ****************************************************************************/
+
+void Input_Reader_Init( struct _Sagan_Input_Reader *reader, int fd, size_t size )
+{
+
+    memset(reader, 0, sizeof(struct _Sagan_Input_Reader));
+
+    if ( size < MAX_SYSLOGMSG * 4 )
+        {
+            size = MAX_SYSLOGMSG * 4;
+        }
+
+    reader->buffer = malloc(size + 1);
+
+    if ( reader->buffer == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the input reader. Abort!", __FILE__, __LINE__);
+        }
+
+    reader->fd = fd;
+    reader->size = size;
+
+}
+
+void Input_Reader_Free( struct _Sagan_Input_Reader *reader )
+{
+
+    free(reader->buffer);
+    reader->buffer = NULL;
+
+}
+
+/****************************************************************************
+ * Input_Reader_Next - Returns the next line (and its length) from data
+ * already read or NULL if more data is needed.  The pointer is valid until
+ * the next call.
+ ****************************************************************************/
+
+char *Input_Reader_Next( struct _Sagan_Input_Reader *reader, size_t *length )
+{
+
+    char *line = NULL;
+    char *newline = NULL;
+
+    size_t available;
+
+    for (;;)
+        {
+
+            available = reader->end - reader->start;
+
+            newline = memchr(reader->buffer + reader->start + reader->scanned, '\n', available - reader->scanned);
+
+            if ( newline != NULL )
+                {
+
+                    line = reader->buffer + reader->start;
+                    *newline = '\0';
+
+                    reader->start = ( newline - reader->buffer ) + 1;
+                    reader->scanned = 0;
+
+                    if ( reader->discard == true )
+                        {
+                            reader->discard = false;	/* End of the over long line */
+                            continue;
+                        }
+
+                    *length = newline - line;
+
+                    if ( *length > MAX_SYSLOGMSG - 1 )
+                        {
+                            reader->truncated++;
+                            *length = MAX_SYSLOGMSG - 1;
+                            line[*length] = '\0';
+                        }
+
+                    return(line);
+                }
+
+            break;
+        }
+
+    reader->scanned = available;
+
+    /* No \n yet.  If a line is already too long, hand out what we
+       have and skip the rest of it */
+
+    if ( reader->discard == true )
+        {
+            reader->start = reader->end;
+            reader->scanned = 0;
+        }
+
+    else if ( available >= MAX_SYSLOGMSG - 1 )
+        {
+
+            line = reader->buffer + reader->start;
+            *length = MAX_SYSLOGMSG - 1;
+
+            reader->truncated++;
+            reader->discard = true;
+            reader->start = reader->end;
+            reader->scanned = 0;
+
+            /* Safe,  the byte is part of the piece we skip */
+
+            line[*length] = '\0';
+
+            return(line);
+        }
+
+    /* Move the unfinished line to the front to make room for the next read */
+
+    if ( reader->start > 0 )
+        {
+
+            available = reader->end - reader->start;
+
+            if ( available > 0 )
+                {
+                    memmove(reader->buffer, reader->buffer + reader->start, available);
+                }
+
+            reader->start = 0;
+            reader->end = available;
+        }
+
+    return(NULL);
+
+}
+
+/****************************************************************************
+ * Input_Reader_Fill - One read(2) into the free part of the buffer.  Only
+ * call after Input_Reader_Next() has returned NULL.  Returns what read(2)
+ * returned.
+ ****************************************************************************/
+
+ssize_t Input_Reader_Fill( struct _Sagan_Input_Reader *reader )
+{
+
+    ssize_t rc;
+
+    rc = read(reader->fd, reader->buffer + reader->end, reader->size - reader->end);
+
+    if ( rc > 0 )
+        {
+            reader->end += rc;
+        }
+
+    return(rc);
+
+}
+
+/****************************************************************************
+ * Input_Reader_Rest - At EOF,  a last line without a \n still counts.
+ * Returns it (or NULL) and resets the reader.
+ ****************************************************************************/
+
+char *Input_Reader_Rest( struct _Sagan_Input_Reader *reader, size_t *length )
+{
+
+    char *line = NULL;
+
+    if ( reader->end > reader->start && reader->discard == false )
+        {
+
+            line = reader->buffer + reader->start;
+            *length = reader->end - reader->start;
+            line[*length] = '\0';
+
+        }
+
+    reader->start = reader->end = reader->scanned = 0;
+    reader->discard = false;
+
+    return(line);
+
+}
+
+/****************************************************************************
+ * Input_Reader_Line - Returns the next line (and its length) or NULL when
+ * the writer has gone away (EOF) or on a read error.  Blocks in read(2).
+ * The pointer is valid until the next call.
+ ****************************************************************************/
+
+char *Input_Reader_Line( struct _Sagan_Input_Reader *reader, size_t *length )
+{
+
+    char *line = NULL;
+    ssize_t rc;
+
+    for (;;)
+        {
+
+            line = Input_Reader_Next(reader, length);
+
+            if ( line != NULL )
+                {
+                    return(line);
+                }
+
+            rc = Input_Reader_Fill(reader);
+
+            if ( rc < 0 && errno == EINTR )
+                {
+                    continue;
+                }
+
+            if ( rc <= 0 )
+                {
+                    return(Input_Reader_Rest(reader, length));
+                }
+
+        }
+
+}
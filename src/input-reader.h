@@ -0,0 +1,46 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+/* Block reader for the FIFO/file input.  Data is pulled in with read(2)
+   and lines are handed out in place,  NULL terminated,  without copying */
+
+typedef struct _Sagan_Input_Reader _Sagan_Input_Reader;
+struct _Sagan_Input_Reader
+{
+    int fd;
+    char *buffer;
+    size_t size;		/* Usable bytes in "buffer" (one more is allocated) */
+    size_t start;		/* First byte not handed out yet */
+    size_t end;			/* End of data read so far */
+    size_t scanned;		/* Bytes after "start" known to have no \n */
+    bool discard;		/* Skipping the rest of an over long line */
+    uint64_t truncated;		/* Lines cut at MAX_SYSLOGMSG - 1 */
+};
+
+void Input_Reader_Init( struct _Sagan_Input_Reader *, int, size_t );
+void Input_Reader_Free( struct _Sagan_Input_Reader * );
+char *Input_Reader_Next( struct _Sagan_Input_Reader *, size_t * );
+ssize_t Input_Reader_Fill( struct _Sagan_Input_Reader * );
+char *Input_Reader_Rest( struct _Sagan_Input_Reader *, size_t * );
+char *Input_Reader_Line( struct _Sagan_Input_Reader *, size_t * );
@@ -0,0 +1,777 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* input-source.c
+ *
+ * Reader threads for every configured input.  Input 0 is the classic
+ * syslog FIFO (or the file given with -F) and is read by the main thread.
+ * Entries in sagan:core "inputs" get a thread each:
+ *
+ *   fifo:<path>         Named pipe.  Created if it doesn't exist and re-opened
+ *                       when the writer goes away.
+ *   file:<path>         Read once,  start to finish.
+ *   unix-stream:<path>  Listening UNIX socket,  one line per \n.  Up to
+ *                       MAX_INPUT_CLIENTS writers at once.
+ *   unix-dgram:<path>   UNIX datagram socket (rsyslog omuxsock,  logger -u).
+ *                       A datagram holds one or more lines.
+ *
+ * Each input keeps its own batch and hands it to the shared batch queue,
+ * so the processor threads don't care where a line came from.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "ignore-list.h"
+#include "batch-queue.h"
+#include "input-reader.h"
+#include "input-source.h"
+#include "parsers/parsers.h"
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+
+struct _Sagan_Ignorelist *SaganIgnorelist;
+
+struct _Sagan_Input_Source *SaganInputSource = NULL;
+
+/* Reader threads for inputs 1 and up,  see Input_Source_Join() */
+
+static pthread_t *input_source_threads = NULL;
+
+/****************************************************************************
+ * Input_Source_Add - Adds an input to the list.
+ ****************************************************************************/
+
+static void Input_Source_Add( int type, const char *path )
+{
+
+    int i = 0;
+
+    if ( path[0] == '\0' )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] An input has no path. Abort!", __FILE__, __LINE__);
+        }
+
+    for (i = 0; i < counters->input_source_count; i++)
+        {
+
+            if ( !strcmp(SaganInputSource[i].path, path) )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Input '%s' is configured more than once. Abort!", __FILE__, __LINE__, path);
+                }
+        }
+
+    SaganInputSource = (_Sagan_Input_Source *) realloc(SaganInputSource, (counters->input_source_count+1) * sizeof(_Sagan_Input_Source));
+
+    if ( SaganInputSource == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for SaganInputSource. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(&SaganInputSource[counters->input_source_count], 0, sizeof(_Sagan_Input_Source));
+
+    SaganInputSource[counters->input_source_count].type = type;
+    strlcpy(SaganInputSource[counters->input_source_count].path, path, sizeof(SaganInputSource[counters->input_source_count].path));
+    SaganInputSource[counters->input_source_count].shard = -1;
+
+    counters->input_source_count++;
+
+}
+
+/****************************************************************************
+ * Input_Source_Init - Builds the input list.  The FIFO/file comes first,
+ * then anything from sagan:core "inputs" ("type:path,type:path,...").
+ ****************************************************************************/
+
+void Input_Source_Init( void )
+{
+
+    char tmp[CONFBUF] = { 0 };
+    char *entry = NULL;
+    char *path = NULL;
+    char *tok = NULL;
+
+    int type = 0;
+
+    Input_Source_Add( config->sagan_is_file == true ? INPUT_SOURCE_FILE : INPUT_SOURCE_FIFO, config->sagan_fifo );
+
+    strlcpy(tmp, config->sagan_inputs, sizeof(tmp));
+
+    entry = strtok_r(tmp, ",", &tok);
+
+    while ( entry != NULL )
+        {
+
+            Remove_Spaces(entry);
+
+            if ( entry[0] == '\0' )
+                {
+                    entry = strtok_r(NULL, ",", &tok);
+                    continue;
+                }
+
+            path = strchr(entry, ':');
+
+            if ( path == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'inputs' entry '%s' should look like \"type:path\". Abort!", __FILE__, __LINE__, entry);
+                }
+
+            *path++ = '\0';
+
+            if ( !strcmp(entry, "fifo") )
+                {
+                    type = INPUT_SOURCE_FIFO;
+                }
+
+            else if ( !strcmp(entry, "file") )
+                {
+                    type = INPUT_SOURCE_FILE;
+                }
+
+            else if ( !strcmp(entry, "unix-stream") )
+                {
+                    type = INPUT_SOURCE_UNIX_STREAM;
+                }
+
+            else if ( !strcmp(entry, "unix-dgram") )
+                {
+                    type = INPUT_SOURCE_UNIX_DGRAM;
+                }
+
+            else
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'inputs' type '%s' is invalid. Valid types are \"fifo\", \"file\", \"unix-stream\" and \"unix-dgram\". Abort!", __FILE__, __LINE__, entry);
+                }
+
+            Input_Source_Add( type, path );
+
+            entry = strtok_r(NULL, ",", &tok);
+        }
+
+}
+
+/****************************************************************************
+ * Input_Source_Line - One line from any input.  Applies the "ignore list"
+ * and adds the line to the input's batch.
+ ****************************************************************************/
+
+void Input_Source_Line( struct _Sagan_Input_Source *source, char *line, size_t length )
+{
+
+    int i = 0;
+
+    __atomic_add_fetch(&counters->events_received, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&source->received, 1, __ATOMIC_SEQ_CST);
+
+    if (debug->debugsyslog)
+        {
+            if ( source->shard == -1 )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] [%s] [batch position %d] Raw log: %s",  __FILE__, __LINE__, source->path, source->batch->count, line);
+                }
+            else
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] [%s] [shard %d] [batch position %d] Raw log: %s",  __FILE__, __LINE__, source->path, source->shard, source->batch->count, line);
+                }
+        }
+
+    /* Check for "drop" to save CPU from "ignore list" */
+
+    if ( config->sagan_droplist_flag )
+        {
+
+            for (i = 0; i < counters->droplist_count; i++)
+                {
+
+                    if (Sagan_strstr(line, SaganIgnorelist[i].ignore_string))
+                        {
+                            __atomic_add_fetch(&counters->ignore_count, 1, __ATOMIC_SEQ_CST);
+                            __atomic_add_fetch(&source->ignored, 1, __ATOMIC_SEQ_CST);
+                            return;
+                        }
+                }
+        }
+
+    Batch_Queue_Add( source->batch, line, length );
+
+    /* Has our batch count been reached?  Hand it to the processor threads
+       and get an empty one back */
+
+    if ( source->batch->count >= config->max_batch )
+        {
+            source->batch = Batch_Queue_Put( source->batch );
+        }
+
+}
+
+/****************************************************************************
+ * Input_Source_Split - Hands out every line in a block of data (a
+ * datagram).  "data" must have room for a NULL at data[length].
+ ****************************************************************************/
+
+static void Input_Source_Split( struct _Sagan_Input_Source *source, char *data, size_t length )
+{
+
+    char *line = data;
+    char *end = data + length;
+    char *newline = NULL;
+
+    size_t line_length = 0;
+
+    *end = '\0';
+
+    while ( line < end )
+        {
+
+            newline = memchr(line, '\n', end - line);
+
+            if ( newline == NULL )
+                {
+                    newline = end;
+                }
+
+            *newline = '\0';
+
+            line_length = newline - line;
+
+            if ( line_length > MAX_SYSLOGMSG - 1 )
+                {
+                    __atomic_add_fetch(&source->truncated, 1, __ATOMIC_SEQ_CST);
+                    line_length = MAX_SYSLOGMSG - 1;
+                    line[line_length] = '\0';
+                }
+
+            if ( line_length > 0 )
+                {
+                    Input_Source_Line( source, line, line_length );
+                }
+
+            line = newline + 1;
+        }
+
+}
+
+/****************************************************************************
+ * Input_Source_Read - Reads a FIFO or file.  FIFOs are read forever,  for a
+ * file this returns at EOF with the last partial batch queued.
+ ****************************************************************************/
+
+void Input_Source_Read( struct _Sagan_Input_Source *source )
+{
+
+    struct _Sagan_Input_Reader reader;
+    char *line = NULL;
+    size_t length = 0;
+
+    bool fifoerr = false;
+    int fd = -1;
+
+    const char *kind = source->type == INPUT_SOURCE_FILE ? "FILE" : "FIFO";
+
+    Sagan_Log(NORMAL, "Attempting to open syslog %s (%s).", kind, source->path);
+
+    if (( fd = open(source->path, O_RDONLY )) == -1 )
+        {
+
+            if ( source->type == INPUT_SOURCE_FIFO )
+                {
+
+                    /* try to create it */
+
+                    Sagan_Log(NORMAL, "Fifo not found, creating it (%s).", source->path);
+
+                    if (mkfifo(source->path, 0700) == -1)
+                        {
+                            Sagan_Log(ERROR, "Could not create FIFO '%s'. Abort!", source->path);
+                        }
+
+                    fd = open(source->path, O_RDONLY);
+
+                    if ( fd == -1 )
+                        {
+                            Sagan_Log(ERROR, "Error opening %s. Abort!", source->path);
+                        }
+
+                }
+            else
+                {
+
+                    Sagan_Log(ERROR, "Could not open file '%s'. Abort!", source->path);
+                }
+
+        }
+
+    if ( source->type == INPUT_SOURCE_FIFO )
+        {
+            Sagan_Log(NORMAL, "Successfully opened FIFO (%s).", source->path);
+
+#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
+
+            Set_Pipe_Size(fd);
+
+#endif
+
+        }
+    else
+        {
+            Sagan_Log(NORMAL, "Successfully opened FILE (%s) and processing events.....", source->path);
+        }
+
+    /* Read in blocks the size of the pipe (or larger) */
+
+#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
+    Input_Reader_Init(&reader, fd, config->sagan_fifo_size != 0 ? config->sagan_fifo_size : MAX_FIFO_SIZE);
+#else
+    Input_Reader_Init(&reader, fd, MAX_FIFO_SIZE);
+#endif
+
+    while(true)
+        {
+
+            while( ( line = Input_Reader_Line(&reader, &length) ) != NULL )
+                {
+
+                    /* If the FIFO was in a error state,  let user know the FIFO writer has resumed */
+
+                    if ( fifoerr == true )
+                        {
+
+                            Sagan_Log(NORMAL, "FIFO writer has restarted (%s). Processing events.", source->path);
+
+#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
+
+                            Set_Pipe_Size(fd);
+
+#endif
+                            fifoerr = false;
+                        }
+
+                    Input_Source_Line( source, line, length );
+
+                }
+
+            /* read() has returned EOF/error,  likely due to the FIFO writer leaving.
+               Don't leave a partial batch sitting around */
+
+            source->batch = Batch_Queue_Put( source->batch );
+
+            __atomic_store_n(&source->truncated, reader.truncated, __ATOMIC_SEQ_CST);
+
+            if ( source->type == INPUT_SOURCE_FILE )
+                {
+
+                    Input_Reader_Free(&reader);
+                    close(fd);
+
+                    return;
+                }
+
+            if ( fifoerr == false )
+                {
+                    Sagan_Log(WARN, "FIFO writer closed (%s).  Waiting for FIFO writer to restart....", source->path);
+                    fifoerr = true; 			/* Set flag so our Input_Reader_Line() loop knows */
+                }
+
+            sleep(1);		/* So we don't eat 100% CPU */
+
+        }
+
+}
+
+/****************************************************************************
+ * Input_Source_Bind - Creates and binds a UNIX socket at the input's path.
+ * A socket left over from an earlier run is removed first.  Anything else
+ * at that path is left alone.
+ ****************************************************************************/
+
+static int Input_Source_Bind( struct _Sagan_Input_Source *source, int socket_type )
+{
+
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd = -1;
+
+    if ( strlen(source->path) >= sizeof(addr.sun_path) )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] UNIX socket path '%s' is too long. Abort!", __FILE__, __LINE__, source->path);
+        }
+
+    fd = socket(AF_UNIX, socket_type, 0);
+
+    if ( fd == -1 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Cannot create UNIX socket for %s [%s]. Abort!", __FILE__, __LINE__, source->path, strerror(errno));
+        }
+
+    if ( lstat(source->path, &st) == 0 )
+        {
+
+            if ( !S_ISSOCK(st.st_mode) )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] %s exists and is not a UNIX socket, not removing it. Abort!", __FILE__, __LINE__, source->path);
+                }
+
+            unlink(source->path);
+        }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, source->path, sizeof(addr.sun_path));
+
+    if ( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Cannot bind UNIX socket %s [%s]. Abort!", __FILE__, __LINE__, source->path, strerror(errno));
+        }
+
+    return(fd);
+
+}
+
+/****************************************************************************
+ * Input_Source_Unix_Dgram - Reads datagrams forever.  A partial batch is
+ * queued whenever the socket has been quiet for a second.
+ ****************************************************************************/
+
+static void Input_Source_Unix_Dgram( struct _Sagan_Input_Source *source )
+{
+
+    struct pollfd pfd;
+    char *buffer = NULL;
+
+    int fd = -1;
+    int rcvbuf = MAX_FIFO_SIZE;
+    int rc = 0;
+
+    ssize_t length = 0;
+
+    fd = Input_Source_Bind( source, SOCK_DGRAM );
+
+    /* Best effort.  A small receive buffer drops datagrams during bursts */
+
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    buffer = malloc(MAX_SYSLOGMSG * 4 + 1);
+
+    if ( buffer == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the datagram buffer. Abort!", __FILE__, __LINE__);
+        }
+
+    Sagan_Log(NORMAL, "Listening for syslog datagrams on %s.", source->path);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while(true)
+        {
+
+            rc = poll(&pfd, 1, 1000);
+
+            if ( rc == 0 )
+                {
+                    source->batch = Batch_Queue_Put( source->batch );
+                    continue;
+                }
+
+            if ( rc < 0 )
+                {
+
+                    if ( errno != EINTR )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] poll() failed on %s [%s].", __FILE__, __LINE__, source->path, strerror(errno));
+                            sleep(1);
+                        }
+
+                    continue;
+                }
+
+            length = recv(fd, buffer, MAX_SYSLOGMSG * 4, 0);
+
+            if ( length > 0 )
+                {
+                    Input_Source_Split( source, buffer, length );
+                }
+
+        }
+
+}
+
+/****************************************************************************
+ * Input_Source_Unix_Stream - Accepts writers and reads all of them from
+ * one thread with poll().  A partial batch is queued whenever every
+ * writer has been quiet for a second.
+ ****************************************************************************/
+
+static void Input_Source_Unix_Stream( struct _Sagan_Input_Source *source )
+{
+
+    struct pollfd pfd[MAX_INPUT_CLIENTS + 1];
+    struct _Sagan_Input_Reader *client = NULL;
+
+    char *line = NULL;
+    size_t length = 0;
+
+    int fd = -1;
+    int client_fd = -1;
+    int clients = 0;
+    int rc = 0;
+    int i = 0;
+
+    ssize_t read_rc = 0;
+
+    fd = Input_Source_Bind( source, SOCK_STREAM );
+
+    if ( listen(fd, 16) == -1 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Cannot listen on UNIX socket %s [%s]. Abort!", __FILE__, __LINE__, source->path, strerror(errno));
+        }
+
+    /* Slot 0 of "client" is unused so it lines up with "pfd" */
+
+    client = calloc(MAX_INPUT_CLIENTS + 1, sizeof(_Sagan_Input_Reader));
+
+    if ( client == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for UNIX socket clients. Abort!", __FILE__, __LINE__);
+        }
+
+    Sagan_Log(NORMAL, "Listening for syslog connections on %s.", source->path);
+
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+
+    while(true)
+        {
+
+            rc = poll(pfd, clients + 1, 1000);
+
+            if ( rc == 0 )
+                {
+                    source->batch = Batch_Queue_Put( source->batch );
+                    continue;
+                }
+
+            if ( rc < 0 )
+                {
+
+                    if ( errno != EINTR )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] poll() failed on %s [%s].", __FILE__, __LINE__, source->path, strerror(errno));
+                            sleep(1);
+                        }
+
+                    continue;
+                }
+
+            /* Walk the writers backwards so the last one can be moved into
+               the slot of one that has gone away */
+
+            for (i = clients; i > 0; i--)
+                {
+
+                    if ( pfd[i].revents == 0 )
+                        {
+                            continue;
+                        }
+
+                    read_rc = Input_Reader_Fill(&client[i]);
+
+                    if ( read_rc < 0 && ( errno == EINTR || errno == EAGAIN ) )
+                        {
+                            continue;
+                        }
+
+                    if ( read_rc > 0 )
+                        {
+
+                            while ( ( line = Input_Reader_Next(&client[i], &length) ) != NULL )
+                                {
+                                    Input_Source_Line( source, line, length );
+                                }
+
+                            continue;
+                        }
+
+                    /* Writer has gone away */
+
+                    if ( ( line = Input_Reader_Rest(&client[i], &length) ) != NULL )
+                        {
+                            Input_Source_Line( source, line, length );
+                        }
+
+                    __atomic_add_fetch(&source->truncated, client[i].truncated, __ATOMIC_SEQ_CST);
+
+                    close(pfd[i].fd);
+                    Input_Reader_Free(&client[i]);
+
+                    pfd[i] = pfd[clients];
+                    client[i] = client[clients];
+                    clients--;
+
+                }
+
+            if ( pfd[0].revents & POLLIN )
+                {
+
+                    client_fd = accept(fd, NULL, NULL);
+
+                    if ( client_fd != -1 )
+                        {
+
+                            if ( clients == MAX_INPUT_CLIENTS )
+                                {
+                                    Sagan_Log(WARN, "[%s, line %d] Too many writers on %s (max %d). Connection refused.", __FILE__, __LINE__, source->path, MAX_INPUT_CLIENTS);
+                                    close(client_fd);
+                                }
+                            else
+                                {
+                                    clients++;
+                                    pfd[clients].fd = client_fd;
+                                    pfd[clients].events = POLLIN;
+                                    pfd[clients].revents = 0;
+                                    Input_Reader_Init(&client[clients], client_fd, MAX_SYSLOGMSG * 4);
+                                }
+                        }
+                }
+
+        }
+
+}
+
+/****************************************************************************
+ * Input_Source_Thread - Reader thread for inputs other than input 0.
+ ****************************************************************************/
+
+void *Input_Source_Thread( void *data )
+{
+
+    struct _Sagan_Input_Source *source = (struct _Sagan_Input_Source *)data;
+
+#ifdef HAVE_SYS_PRCTL_H
+    (void)SetThreadName("SaganInput");
+#endif
+
+    switch ( source->type )
+        {
+
+        case INPUT_SOURCE_FIFO:
+        case INPUT_SOURCE_FILE:
+
+            Input_Source_Read( source );
+            Sagan_Log(NORMAL, "Finished reading FILE (%s).", source->path);
+            break;
+
+        case INPUT_SOURCE_UNIX_STREAM:
+
+            Input_Source_Unix_Stream( source );
+            break;
+
+        case INPUT_SOURCE_UNIX_DGRAM:
+
+            Input_Source_Unix_Dgram( source );
+            break;
+
+        }
+
+    pthread_exit(NULL);
+
+}
+
+/****************************************************************************
+ * Input_Source_Start - Gives every input a batch and starts the reader
+ * threads for all but input 0,  which the caller reads itself.  The batch
+ * queue must be set up for counters->input_source_count readers first.
+ ****************************************************************************/
+
+void Input_Source_Start( void )
+{
+
+    int rc = 0;
+    int i = 0;
+
+    for (i = 0; i < counters->input_source_count; i++)
+        {
+            SaganInputSource[i].batch = Batch_Queue_Get();
+        }
+
+    input_source_threads = calloc(counters->input_source_count, sizeof(pthread_t));
+
+    if ( input_source_threads == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for input threads. Abort!", __FILE__, __LINE__);
+        }
+
+    for (i = 1; i < counters->input_source_count; i++)
+        {
+
+            rc = pthread_create( &input_source_threads[i], NULL, Input_Source_Thread, &SaganInputSource[i] );
+
+            if ( rc != 0 )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Could not pthread_create() for input %s [error: %d]. Abort!", __FILE__, __LINE__, SaganInputSource[i].path, rc);
+                }
+        }
+
+}
+
+/****************************************************************************
+ * Input_Source_Join - Waits for the reader threads of inputs 1 and up.
+ * Only file inputs ever finish,  FIFOs and sockets are read until a
+ * signal ends Sagan.
+ ****************************************************************************/
+
+void Input_Source_Join( void )
+{
+
+    int i = 0;
+
+    for (i = 1; i < counters->input_source_count; i++)
+        {
+            pthread_join( input_source_threads[i], NULL );
+        }
+
+}
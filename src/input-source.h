@@ -0,0 +1,52 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+/* Where log lines come from.  The FIFO (or -F file) is always input 0,
+   "inputs" in sagan.yaml adds more.  Every input has its own reader thread
+   and its own batch,  all feeding the same batch queue */
+
+#define INPUT_SOURCE_FIFO		0
+#define INPUT_SOURCE_FILE		1
+#define INPUT_SOURCE_UNIX_STREAM	2
+#define INPUT_SOURCE_UNIX_DGRAM		3
+
+typedef struct _Sagan_Input_Source _Sagan_Input_Source;
+struct _Sagan_Input_Source
+{
+    int type;
+    char path[MAXPATH];
+    int shard;				/* -F replay shard,  -1 if not one */
+    struct _Sagan_Pass_Syslog *batch;
+
+    uint64_t received;
+    uint64_t ignored;
+    uint64_t truncated;
+};
+
+void Input_Source_Init( void );
+void Input_Source_Start( void );
+void Input_Source_Join( void );
+void Input_Source_Line( struct _Sagan_Input_Source *, char *, size_t );
+void Input_Source_Read( struct _Sagan_Input_Source * );
+void *Input_Source_Thread( void * );
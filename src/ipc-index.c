@@ -0,0 +1,208 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* ipc-index.c
+ *
+ * Linear probing hash index keyed by (id, rev, tracking hash) for the
+ * threshold2,  after2 and xbit shared memory tables.  The table is at most
+ * half full,  so a lookup touches one or two 24 byte slots instead of
+ * walking every entry.  Deletes shift the following slots back,  so there
+ * are no tombstones and expiry can be done in place.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sagan.h"
+#include "ipc-index.h"
+
+/****************************************************************************
+ * IPC_Index_Home - Preferred slot for a key
+ ****************************************************************************/
+
+static uint32_t IPC_Index_Home( struct _Sagan_IPC_Index *index, uint64_t id, uint32_t rev, uint64_t hash )
+{
+
+    uint64_t h = ( id * 0x9E3779B97F4A7C15ULL ) ^ ( (uint64_t)rev << 32 ) ^ hash;
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+
+    return( (uint32_t)h & ( index->size - 1 ) );
+
+}
+
+/****************************************************************************
+ * IPC_Index_Slot - Returns the slot holding a key,  or the empty slot
+ * where it would go
+ ****************************************************************************/
+
+static uint32_t IPC_Index_Slot( struct _Sagan_IPC_Index *index, uint64_t id, uint32_t rev, uint64_t hash )
+{
+
+    uint32_t mask = index->size - 1;
+    uint32_t s = IPC_Index_Home(index, id, rev, hash);
+
+    while ( index->slots[s].position != 0 )
+        {
+
+            if ( index->slots[s].hash == hash && index->slots[s].id == id && index->slots[s].rev == rev )
+                {
+                    return(s);
+                }
+
+            s = ( s + 1 ) & mask;
+        }
+
+    return(s);
+
+}
+
+/****************************************************************************
+ * IPC_Index_Bytes - Size of the index for a table of "max" entries
+ ****************************************************************************/
+
+size_t IPC_Index_Bytes( int max )
+{
+
+    uint32_t size = 16;
+
+    while ( size < (uint32_t)max * 2 )
+        {
+            size <<= 1;
+        }
+
+    return( sizeof(struct _Sagan_IPC_Index) + ( (size_t)size * sizeof(struct _Sagan_IPC_Index_Slot) ) );
+
+}
+
+/****************************************************************************
+ * IPC_Index_Init - Empties the index.  Used for new objects and when the
+ * table size changed since the object was written
+ ****************************************************************************/
+
+void IPC_Index_Init( struct _Sagan_IPC_Index *index, int max )
+{
+
+    size_t bytes = IPC_Index_Bytes(max);
+
+    memset(index, 0, bytes);
+    index->size = ( bytes - sizeof(struct _Sagan_IPC_Index) ) / sizeof(struct _Sagan_IPC_Index_Slot);
+
+}
+
+/****************************************************************************
+ * IPC_Index_Find - Returns the entry for a key or -1
+ ****************************************************************************/
+
+int IPC_Index_Find( struct _Sagan_IPC_Index *index, uint64_t id, uint32_t rev, uint64_t hash )
+{
+
+    uint32_t s = IPC_Index_Slot(index, id, rev, hash);
+
+    return( (int)index->slots[s].position - 1 );
+
+}
+
+/****************************************************************************
+ * IPC_Index_Insert - Adds a key.  The caller has already checked it isn't
+ * there and that the table has room
+ ****************************************************************************/
+
+void IPC_Index_Insert( struct _Sagan_IPC_Index *index, uint64_t id, uint32_t rev, uint64_t hash, int entry )
+{
+
+    uint32_t s = IPC_Index_Slot(index, id, rev, hash);
+
+    index->slots[s].id = id;
+    index->slots[s].rev = rev;
+    index->slots[s].hash = hash;
+    index->slots[s].position = entry + 1;
+
+    index->count++;
+
+}
+
+/****************************************************************************
+ * IPC_Index_Move - An entry was moved to a new position in the table
+ ****************************************************************************/
+
+void IPC_Index_Move( struct _Sagan_IPC_Index *index, uint64_t id, uint32_t rev, uint64_t hash, int entry )
+{
+
+    uint32_t s = IPC_Index_Slot(index, id, rev, hash);
+
+    if ( index->slots[s].position != 0 )
+        {
+            index->slots[s].position = entry + 1;
+        }
+
+}
+
+/****************************************************************************
+ * IPC_Index_Delete - Removes a key and shifts the rest of its probe run
+ * back so lookups never need tombstones
+ ****************************************************************************/
+
+void IPC_Index_Delete( struct _Sagan_IPC_Index *index, uint64_t id, uint32_t rev, uint64_t hash )
+{
+
+    uint32_t mask = index->size - 1;
+    uint32_t hole = IPC_Index_Slot(index, id, rev, hash);
+    uint32_t s = hole;
+    uint32_t home = 0;
+
+    if ( index->slots[hole].position == 0 )
+        {
+            return;
+        }
+
+    for ( ;; )
+        {
+
+            s = ( s + 1 ) & mask;
+
+            if ( index->slots[s].position == 0 )
+                {
+                    break;
+                }
+
+            home = IPC_Index_Home(index, index->slots[s].id, index->slots[s].rev, index->slots[s].hash);
+
+            /* Move it back if its home isn't between the hole and where it is now */
+
+            if ( ( ( s - home ) & mask ) >= ( ( s - hole ) & mask ) )
+                {
+                    index->slots[hole] = index->slots[s];
+                    hole = s;
+                }
+        }
+
+    index->slots[hole].position = 0;
+    index->count--;
+
+}
@@ -0,0 +1,52 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+/* Open addressing index over a shared memory table (threshold2,  after2,
+   xbit).  It lives in the same mmap() file as the entries it points to,
+   so every Sagan process sharing the file shares the index.  Callers hold
+   the table's File_Lock()/mutex for every call */
+
+typedef struct _Sagan_IPC_Index_Slot _Sagan_IPC_Index_Slot;
+struct _Sagan_IPC_Index_Slot
+{
+    uint64_t id;			/* Signature id,  or xbit name hash */
+    uint64_t hash;			/* Tracking hash */
+    uint32_t rev;
+    uint32_t position;			/* Entry + 1,  0 == empty */
+};
+
+typedef struct _Sagan_IPC_Index _Sagan_IPC_Index;
+struct _Sagan_IPC_Index
+{
+    uint32_t size;			/* Slots,  power of two */
+    uint32_t count;
+    _Sagan_IPC_Index_Slot slots[];
+};
+
+size_t IPC_Index_Bytes( int );
+void IPC_Index_Init( struct _Sagan_IPC_Index *, int );
+int IPC_Index_Find( struct _Sagan_IPC_Index *, uint64_t, uint32_t, uint64_t );
+void IPC_Index_Insert( struct _Sagan_IPC_Index *, uint64_t, uint32_t, uint64_t, int );
+void IPC_Index_Move( struct _Sagan_IPC_Index *, uint64_t, uint32_t, uint64_t, int );
+void IPC_Index_Delete( struct _Sagan_IPC_Index *, uint64_t, uint32_t, uint64_t );
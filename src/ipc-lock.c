@@ -0,0 +1,191 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* ipc-lock.c
+ *
+ * Locks for the shared threshold2,  after2,  flexbit,  xbit and
+ * track-clients tables.  Every table has IPC_LOCK_STRIPES process shared,
+ * robust mutexes stored in the counters object,  so they work between
+ * Sagan processes sharing the same IPC directory.  Work on one entry
+ * takes the stripe its key hashes to.  Anything that changes the shape of
+ * a table (insert,  delete,  compaction,  index rebuild) takes every
+ * stripe,  in order.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "ipc-lock.h"
+
+struct _SaganCounters *counters;
+struct _Sagan_IPC_Counters *counters_ipc;
+
+static const char *ipc_lock_name[IPC_LOCK_TABLES] = { "after2", "threshold2", "flexbit", "xbit", "track-clients" };
+
+/*****************************************************************************
+ * IPC_Lock_Init - Sets up the mutexes in a new counters object.  A reloaded
+ * object already has them.
+ *****************************************************************************/
+
+void IPC_Lock_Init( bool new_counters )
+{
+
+    pthread_mutexattr_t attr;
+
+    int t = 0;
+    int s = 0;
+
+    if ( new_counters == false )
+        {
+            return;
+        }
+
+    if ( pthread_mutexattr_init(&attr) != 0 ||
+            pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+            pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Cannot set up shared memory lock attributes. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( t = 0; t < IPC_LOCK_TABLES; t++ )
+        {
+
+            /* Flexbits are reached through several chains,  so every change
+               needs the whole table (see Flexbit_Set_MMAP()).  Lookups don't
+               lock at all */
+
+            counters_ipc->locks[t].stripes = t == FLEXBIT ? 1 : IPC_LOCK_STRIPES;
+
+            for ( s = 0; s < counters_ipc->locks[t].stripes; s++ )
+                {
+
+                    if ( pthread_mutex_init(&counters_ipc->locks[t].stripe[s].mutex, &attr) != 0 )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Cannot initialize %s lock. Abort!", __FILE__, __LINE__, ipc_lock_name[t]);
+                        }
+                }
+        }
+
+    pthread_mutexattr_destroy(&attr);
+
+}
+
+/*****************************************************************************
+ * IPC_Lock_Mutex - Takes one mutex.  Only a contended lock is timed.  If
+ * another Sagan process died holding it,  the lock is recovered (the table
+ * data is best effort anyway).
+ *****************************************************************************/
+
+static void IPC_Lock_Mutex( int table, pthread_mutex_t *mutex )
+{
+
+    struct timespec start;
+    struct timespec end;
+
+    int rc = pthread_mutex_trylock(mutex);
+
+    if ( rc == EBUSY )
+        {
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            rc = pthread_mutex_lock(mutex);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            __atomic_add_fetch(&counters->ipc_lock_wait_usec[table], ( end.tv_sec - start.tv_sec ) * 1000000 + ( end.tv_nsec - start.tv_nsec ) / 1000, __ATOMIC_SEQ_CST);
+
+        }
+
+    if ( rc == EOWNERDEAD )
+        {
+            Sagan_Log(WARN, "[%s, line %d] A Sagan process exited while holding the %s lock. Recovering.", __FILE__, __LINE__, ipc_lock_name[table]);
+            pthread_mutex_consistent(mutex);
+        }
+
+    else if ( rc != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Cannot get %s lock. [%s]", __FILE__, __LINE__, ipc_lock_name[table], strerror(rc));
+        }
+
+}
+
+/*****************************************************************************
+ * IPC_Lock/IPC_Unlock - The stripe "hash" falls in.  Use the same hash the
+ * table is keyed by.
+ *****************************************************************************/
+
+void IPC_Lock( int table, uint32_t hash )
+{
+
+    struct _Sagan_IPC_Lock *lock = &counters_ipc->locks[table];
+
+    IPC_Lock_Mutex(table, &lock->stripe[ hash % lock->stripes ].mutex);
+
+}
+
+void IPC_Unlock( int table, uint32_t hash )
+{
+
+    struct _Sagan_IPC_Lock *lock = &counters_ipc->locks[table];
+
+    pthread_mutex_unlock(&lock->stripe[ hash % lock->stripes ].mutex);
+
+}
+
+/*****************************************************************************
+ * IPC_Lock_All/IPC_Unlock_All - Every stripe of a table.  The caller must
+ * not hold one of its stripes already.
+ *****************************************************************************/
+
+void IPC_Lock_All( int table )
+{
+
+    struct _Sagan_IPC_Lock *lock = &counters_ipc->locks[table];
+    int s = 0;
+
+    for ( s = 0; s < lock->stripes; s++ )
+        {
+            IPC_Lock_Mutex(table, &lock->stripe[s].mutex);
+        }
+
+}
+
+void IPC_Unlock_All( int table )
+{
+
+    struct _Sagan_IPC_Lock *lock = &counters_ipc->locks[table];
+    int s = 0;
+
+    for ( s = lock->stripes - 1; s >= 0; s-- )
+        {
+            pthread_mutex_unlock(&lock->stripe[s].mutex);
+        }
+
+}
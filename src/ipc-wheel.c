@@ -0,0 +1,207 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* ipc-wheel.c
+ *
+ * Hashed timing wheel for expiring shared memory entries.  Each entry is
+ * on the list of the second it is due (modulo IPC_WHEEL_SLOTS).  Sweeping
+ * only looks at the slots that came due since the last sweep,  so expired
+ * entries are dropped a few at a time as new ones are added instead of in
+ * one pass over the whole table when it fills up.
+ *
+ * Refreshing an entry (a new event for a threshold,  an xbit being set
+ * again) happens under its stripe lock and does not touch the wheel.  The
+ * entry is left where it was and when its old slot comes due the owner
+ * checks the real expire time and puts it back further along.  Anything
+ * that brings an expire time forward has to take the table lock and move
+ * the entry,  so no entry is ever scheduled later than it expires.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sagan.h"
+#include "ipc-wheel.h"
+
+/****************************************************************************
+ * IPC_Wheel_Head - List head for a second
+ ****************************************************************************/
+
+static uint32_t *IPC_Wheel_Head( struct _Sagan_IPC_Wheel *wheel, uint64_t when )
+{
+    return( &wheel->slots[ when & ( IPC_WHEEL_SLOTS - 1 ) ] );
+}
+
+/****************************************************************************
+ * IPC_Wheel_Bytes - Size of the wheel for a table of "max" entries
+ ****************************************************************************/
+
+size_t IPC_Wheel_Bytes( int max )
+{
+    return( sizeof(struct _Sagan_IPC_Wheel) + ( (size_t)max * sizeof(struct _Sagan_IPC_Wheel_Link) ) );
+}
+
+/****************************************************************************
+ * IPC_Wheel_Init - Empties the wheel
+ ****************************************************************************/
+
+void IPC_Wheel_Init( struct _Sagan_IPC_Wheel *wheel, int max, uint64_t now )
+{
+
+    memset(wheel, 0, IPC_Wheel_Bytes(max));
+    wheel->tick = now;
+
+}
+
+/****************************************************************************
+ * IPC_Wheel_Add - Schedules "entry" to be looked at once "when" has
+ * passed.  Anything already due goes in the next slot to be swept.
+ ****************************************************************************/
+
+void IPC_Wheel_Add( struct _Sagan_IPC_Wheel *wheel, int entry, uint64_t when )
+{
+
+    uint32_t *head = NULL;
+
+    if ( when < wheel->tick )
+        {
+            when = wheel->tick;
+        }
+
+    head = IPC_Wheel_Head(wheel, when);
+
+    wheel->links[entry].when = when;
+    wheel->links[entry].prev = 0;
+    wheel->links[entry].next = *head;
+
+    if ( *head != 0 )
+        {
+            wheel->links[*head - 1].prev = entry + 1;
+        }
+
+    *head = entry + 1;
+
+}
+
+/****************************************************************************
+ * IPC_Wheel_Remove - Takes "entry" off the wheel
+ ****************************************************************************/
+
+void IPC_Wheel_Remove( struct _Sagan_IPC_Wheel *wheel, int entry )
+{
+
+    struct _Sagan_IPC_Wheel_Link *link = &wheel->links[entry];
+
+    if ( link->prev != 0 )
+        {
+            wheel->links[link->prev - 1].next = link->next;
+        }
+    else
+        {
+            *IPC_Wheel_Head(wheel, link->when) = link->next;
+        }
+
+    if ( link->next != 0 )
+        {
+            wheel->links[link->next - 1].prev = link->prev;
+        }
+
+}
+
+/****************************************************************************
+ * IPC_Wheel_Move - The entry at "from" was moved to "to" in the table.
+ * "to" must already be off the wheel.
+ ****************************************************************************/
+
+void IPC_Wheel_Move( struct _Sagan_IPC_Wheel *wheel, int from, int to )
+{
+
+    struct _Sagan_IPC_Wheel_Link *link = &wheel->links[to];
+
+    *link = wheel->links[from];
+
+    if ( link->prev != 0 )
+        {
+            wheel->links[link->prev - 1].next = to + 1;
+        }
+    else
+        {
+            *IPC_Wheel_Head(wheel, link->when) = to + 1;
+        }
+
+    if ( link->next != 0 )
+        {
+            wheel->links[link->next - 1].prev = to + 1;
+        }
+
+}
+
+/****************************************************************************
+ * IPC_Wheel_Next - Takes the next entry scheduled at or before "now" off
+ * the wheel and returns it,  or -1 if nothing is due.  Entries further
+ * than IPC_WHEEL_SLOTS seconds out share a slot with ones that are due
+ * and are skipped until their turn comes around.
+ ****************************************************************************/
+
+int IPC_Wheel_Next( struct _Sagan_IPC_Wheel *wheel, uint64_t now )
+{
+
+    uint32_t e = 0;
+
+    /* After a long idle stretch every slot is due,  sweep each once */
+
+    if ( now >= wheel->tick + IPC_WHEEL_SLOTS )
+        {
+            wheel->tick = now - IPC_WHEEL_SLOTS + 1;
+        }
+
+    while ( wheel->tick <= now )
+        {
+
+            for ( e = *IPC_Wheel_Head(wheel, wheel->tick); e != 0; e = wheel->links[e - 1].next )
+                {
+
+                    if ( wheel->links[e - 1].when <= now )
+                        {
+                            IPC_Wheel_Remove(wheel, e - 1);
+                            return( (int)e - 1 );
+                        }
+
+                }
+
+            /* Entries can still be added for the current second */
+
+            if ( wheel->tick == now )
+                {
+                    break;
+                }
+
+            wheel->tick++;
+        }
+
+    return(-1);
+
+}
@@ -0,0 +1,53 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+/* Hashed timing wheel over a shared memory table (threshold2,  after2,
+   flexbit,  xbit).  Like the index,  it lives in the table's mmap() file
+   and callers hold IPC_Lock_All() for every call */
+
+#define IPC_WHEEL_SLOTS		1024		/* One second each,  power of two */
+#define IPC_WHEEL_RECLAIM	4		/* Expired entries dropped per insert */
+
+typedef struct _Sagan_IPC_Wheel_Link _Sagan_IPC_Wheel_Link;
+struct _Sagan_IPC_Wheel_Link
+{
+    uint64_t when;			/* Second the entry was scheduled for */
+    uint32_t prev;			/* Entry + 1,  0 == slot head */
+    uint32_t next;			/* Entry + 1,  0 == end of slot */
+};
+
+typedef struct _Sagan_IPC_Wheel _Sagan_IPC_Wheel;
+struct _Sagan_IPC_Wheel
+{
+    uint64_t tick;			/* Oldest second not yet swept */
+    uint32_t slots[IPC_WHEEL_SLOTS];	/* Entry + 1,  0 == empty */
+    _Sagan_IPC_Wheel_Link links[];	/* One per table entry */
+};
+
+size_t IPC_Wheel_Bytes( int );
+void IPC_Wheel_Init( struct _Sagan_IPC_Wheel *, int, uint64_t );
+void IPC_Wheel_Add( struct _Sagan_IPC_Wheel *, int, uint64_t );
+void IPC_Wheel_Remove( struct _Sagan_IPC_Wheel *, int );
+void IPC_Wheel_Move( struct _Sagan_IPC_Wheel *, int, int );
+int IPC_Wheel_Next( struct _Sagan_IPC_Wheel *, uint64_t );
@@ -42,6 +42,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <limits.h>
 
 #include "version.h"
 #include "sagan.h"
@@ -49,6 +50,9 @@
 #include "sagan-config.h"
 #include "util-time.h"
 #include "ipc.h"
+#include "ipc-index.h"
+#include "ipc-lock.h"
+#include "ipc-wheel.h"
 #include "flexbit-mmap.h"
 #include "xbit-mmap.h"
 
@@ -58,373 +62,441 @@ struct _Sagan_IPC_Counters *counters_ipc;
 
 struct _SaganConfig *config;
 
-pthread_mutex_t After2_Mutex;
-pthread_mutex_t Thresh2_Mutex;
-pthread_mutex_t Flexbit_Mutex;
-pthread_mutex_t Xbit_Mutex;
-
 struct _After2_IPC *After2_IPC;
 struct _Threshold2_IPC *Threshold2_IPC;
+struct _Sagan_IPC_Message *After2_Message;
+struct _Sagan_IPC_Message *Threshold2_Message;
+struct _Sagan_IPC_Index *After2_Index;
+struct _Sagan_IPC_Index *Threshold2_Index;
 struct _Sagan_Track_Clients_IPC *SaganTrackClients_ipc;
+struct _Sagan_IPC_Index *Track_Clients_Index;
 struct _Sagan_IPC_Flexbit *flexbit_ipc;
+struct _Sagan_IPC_Flexbit_Index *Flexbit_Index;
 struct _Sagan_IPC_Xbit *Xbit_IPC;
+struct _Sagan_IPC_Message *Xbit_Message;
+struct _Sagan_IPC_Index *Xbit_Index;
+struct _Sagan_IPC_Wheel *After2_Wheel;
+struct _Sagan_IPC_Wheel *Threshold2_Wheel;
+struct _Sagan_IPC_Wheel *Flexbit_Wheel;
+struct _Sagan_IPC_Wheel *Xbit_Wheel;
 
 struct _SaganDebug *debug;
 
 /*****************************************************************************
- * Clean_IPC_Object - If the max IPC is hit,  we attempt to "clean" out
- * any stale IPC entries.
+ * Expire_IPC_Threshold2 - Drops up to "limit" threshold2 entries that the
+ * wheel has due.  An entry is only dropped once a new event would reset
+ * it anyway (more than "expire" seconds since utime).  Entries that saw
+ * events since they were scheduled go back on the wheel.  The last entry
+ * is moved into each hole,  so the table stays dense for saganpeek.
+ * Returns how many were dropped.  Caller holds IPC_Lock_All(THRESHOLD2).
  *****************************************************************************/
 
-bool Clean_IPC_Object( int type )
+int Expire_IPC_Threshold2( uint64_t utime, int limit )
 {
 
-    if ( type == AFTER2 && config->max_after2 < counters_ipc->after2_count )
+    int i = 0;
+    int last = 0;
+    int dropped = 0;
+
+    while ( dropped < limit && ( i = IPC_Wheel_Next(Threshold2_Wheel, utime) ) != -1 )
         {
 
-            time_t t;
-            struct tm *now;
+            if ( utime <= Threshold2_IPC[i].utime + Threshold2_IPC[i].expire )
+                {
+                    IPC_Wheel_Add(Threshold2_Wheel, i, Threshold2_IPC[i].utime + Threshold2_IPC[i].expire + 1);
+                    continue;
+                }
 
-            int i;
-            int utime = 0;
-            int new_count = 0;
-            int old_count = 0;
+            if ( debug->debugipc )
+                {
+                    Sagan_Log(DEBUG, "[%s, %d line] Threshold2_IPC : Dropping %lu.", __FILE__, __LINE__, Threshold2_IPC[i].hash);
+                }
 
-            char timet[20];
+            IPC_Index_Delete(Threshold2_Index, Threshold2_IPC[i].sid, 0, Threshold2_IPC[i].hash);
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            last = counters_ipc->thresh2_count - 1;
 
-            if ( debug->debugipc )
+            if ( i != last )
                 {
-                    Sagan_Log(DEBUG, "[%s, %d line] Cleaning IPC data. Type: %d", __FILE__, __LINE__, type);
+                    Threshold2_IPC[i] = Threshold2_IPC[last];
+                    memcpy(&Threshold2_Message[i], &Threshold2_Message[last], sizeof(struct _Sagan_IPC_Message));
+                    IPC_Index_Move(Threshold2_Index, Threshold2_IPC[i].sid, 0, Threshold2_IPC[i].hash, i);
+                    IPC_Wheel_Move(Threshold2_Wheel, last, i);
                 }
 
-            File_Lock(config->shm_after2);
-            pthread_mutex_lock(&After2_Mutex);
+            counters_ipc->thresh2_count--;
+            dropped++;
+
+        }
 
-            struct _After2_IPC *Temp_After2_IPC;
-            Temp_After2_IPC = malloc(sizeof(struct _After2_IPC) * config->max_after2);
-            memset(Temp_After2_IPC, 0, sizeof(sizeof(struct _After2_IPC) * config->max_after2));
+    return(dropped);
 
-            old_count = counters_ipc->after2_count;
+}
 
-            for (i = 0; i < counters_ipc->after2_count; i++)
-                {
+/*****************************************************************************
+ * Clean_IPC_Threshold2 - The table is full,  drop everything that has
+ * expired.  Caller holds IPC_Lock_All(THRESHOLD2).
+ *****************************************************************************/
 
-                    if ( (utime - After2_IPC[i].utime) < After2_IPC[i].expire )
-                        {
+bool Clean_IPC_Threshold2( void )
+{
 
-                            if ( debug->debugipc )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, %d line] After2_IPC : Keeping %lu.", __FILE__, __LINE__, After2_IPC[i].hash);
-                                }
+    int old_count = counters_ipc->thresh2_count;
 
-                            Temp_After2_IPC[new_count].hash = After2_IPC[i].hash;
-                            Temp_After2_IPC[new_count].count = After2_IPC[i].count;
-                            Temp_After2_IPC[new_count].utime = After2_IPC[i].utime;
-                            Temp_After2_IPC[new_count].expire = After2_IPC[i].expire;
-                            Temp_After2_IPC[new_count].sid = After2_IPC[i].sid;
-                            new_count++;
+    if ( Expire_IPC_Threshold2(Return_Epoch(), INT_MAX) == 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Could not clean Threshold2_IPC.  Nothing to remove!", __FILE__, __LINE__);
+            return(1);
+        }
 
-                        }
-                }
+    Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for Threshold2_IPC", __FILE__, __LINE__, counters_ipc->thresh2_count, old_count);
+    return(0);
 
+}
 
-            if ( new_count > 0 )
-                {
-                    for ( i = 0; i < new_count; i++ )
-                        {
-                            After2_IPC[i].hash = Temp_After2_IPC[i].hash;
-                            After2_IPC[i].count = Temp_After2_IPC[i].count;
-                            After2_IPC[i].utime = Temp_After2_IPC[i].utime;
-                            After2_IPC[i].expire = Temp_After2_IPC[i].expire;
-                            After2_IPC[i].sid =  Temp_After2_IPC[i].sid;
-                        }
+/*****************************************************************************
+ * Expire_IPC_After2 - Same as Expire_IPC_Threshold2() for after2.  Caller
+ * holds IPC_Lock_All(AFTER2).
+ *****************************************************************************/
+
+int Expire_IPC_After2( uint64_t utime, int limit )
+{
+
+    int i = 0;
+    int last = 0;
+    int dropped = 0;
 
-                    counters_ipc->after2_count = new_count;
+    while ( dropped < limit && ( i = IPC_Wheel_Next(After2_Wheel, utime) ) != -1 )
+        {
 
+            if ( utime <= After2_IPC[i].utime + After2_IPC[i].expire )
+                {
+                    IPC_Wheel_Add(After2_Wheel, i, After2_IPC[i].utime + After2_IPC[i].expire + 1);
+                    continue;
                 }
-            else
+
+            if ( debug->debugipc )
                 {
+                    Sagan_Log(DEBUG, "[%s, %d line] After2_IPC : Dropping %lu.", __FILE__, __LINE__, After2_IPC[i].hash);
+                }
+
+            IPC_Index_Delete(After2_Index, After2_IPC[i].sid, After2_IPC[i].rev, After2_IPC[i].hash);
 
-                    Sagan_Log(WARN, "[%s, line %d] Could not clean After2_IPC.  Nothing to remove!", __FILE__, __LINE__);
-                    free(Temp_After2_IPC);
-                    pthread_mutex_unlock(&After2_Mutex);
-                    File_Unlock(config->shm_after2);
-                    return(1);
+            last = counters_ipc->after2_count - 1;
 
+            if ( i != last )
+                {
+                    After2_IPC[i] = After2_IPC[last];
+                    memcpy(&After2_Message[i], &After2_Message[last], sizeof(struct _Sagan_IPC_Message));
+                    IPC_Index_Move(After2_Index, After2_IPC[i].sid, After2_IPC[i].rev, After2_IPC[i].hash, i);
+                    IPC_Wheel_Move(After2_Wheel, last, i);
                 }
 
-            Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for After2_IPC", __FILE__, __LINE__, new_count, old_count);
-            free(Temp_After2_IPC);
+            counters_ipc->after2_count--;
+            dropped++;
 
-            pthread_mutex_unlock(&After2_Mutex);
-            File_Unlock(config->shm_after2);
-            return(0);
         }
 
-    /* Threshold2 */
+    return(dropped);
 
-    else if ( type == THRESHOLD2 && config->max_threshold2 < counters_ipc->thresh2_count )
-        {
+}
+
+/*****************************************************************************
+ * Clean_IPC_After2 - Same as Clean_IPC_Threshold2() for after2.  Caller
+ * holds IPC_Lock_All(AFTER2).
+ *****************************************************************************/
 
-            time_t t;
-            struct tm *now;
+bool Clean_IPC_After2( void )
+{
+
+    int old_count = counters_ipc->after2_count;
 
-            int i;
-            int utime = 0;
-            int new_count = 0;
-            int old_count = 0;
+    if ( Expire_IPC_After2(Return_Epoch(), INT_MAX) == 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Could not clean After2_IPC.  Nothing to remove!", __FILE__, __LINE__);
+            return(1);
+        }
 
-            char timet[20];
+    Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for After2_IPC", __FILE__, __LINE__, counters_ipc->after2_count, old_count);
+    return(0);
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+}
 
-            new_count = 0;
-            old_count = 0;
+/*****************************************************************************
+ * Expire_IPC_Flexbit - Drops up to "limit" flexbits that expired more than
+ * their timeout ago.  Caller holds IPC_Lock_All(FLEXBIT).
+ *****************************************************************************/
 
-            File_Lock(config->shm_thresh2);
-            pthread_mutex_lock(&Thresh2_Mutex);
+int Expire_IPC_Flexbit( uint64_t utime, int limit )
+{
 
-            struct _Threshold2_IPC *Temp_Threshold2_IPC;
-            Temp_Threshold2_IPC = malloc(sizeof(struct _Threshold2_IPC) * config->max_threshold2);
+    int i = 0;
+    int dropped = 0;
 
-            memset(Temp_Threshold2_IPC, 0, sizeof(sizeof(struct _Threshold2_IPC) * config->max_threshold2));
+    while ( dropped < limit && ( i = IPC_Wheel_Next(Flexbit_Wheel, utime) ) != -1 )
+        {
 
-            old_count = counters_ipc->thresh2_count;
+            if ( utime < flexbit_ipc[i].flexbit_expire + flexbit_ipc[i].expire )
+                {
+                    IPC_Wheel_Add(Flexbit_Wheel, i, flexbit_ipc[i].flexbit_expire + flexbit_ipc[i].expire);
+                    continue;
+                }
 
-            for (i = 0; i < counters_ipc->thresh2_count; i++)
+            if ( debug->debugipc )
                 {
-                    if ( (utime - Threshold2_IPC[i].utime) < Threshold2_IPC[i].expire )
-                        {
+                    Sagan_Log(DEBUG, "[%s, %d line] Flexbit_IPC : Dropping \"%s\".", __FILE__, __LINE__, flexbit_ipc[i].flexbit_name);
+                }
 
-                            if ( debug->debugipc )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, %d line] Threshold2_IPC : Keeping %lu.", __FILE__, __LINE__, Threshold2_IPC[i].hash);
-                                }
+            Flexbit_Remove_MMAP(i);
+            dropped++;
 
-                            Temp_Threshold2_IPC[new_count].hash = Threshold2_IPC[i].hash;
-                            Temp_Threshold2_IPC[new_count].count = Threshold2_IPC[i].count;
-                            Temp_Threshold2_IPC[new_count].utime = Threshold2_IPC[i].utime;
-                            Temp_Threshold2_IPC[new_count].expire = Threshold2_IPC[i].expire;
-                            Temp_Threshold2_IPC[new_count].sid = Threshold2_IPC[i].sid;
+        }
 
-                            new_count++;
+    return(dropped);
 
-                        }
-                }
+}
 
-            if ( new_count > 0 )
-                {
-                    for ( i = 0; i < new_count; i++ )
-                        {
-                            Threshold2_IPC[i].hash = Temp_Threshold2_IPC[i].hash;
-                            Threshold2_IPC[i].count = Temp_Threshold2_IPC[i].count;
-                            Threshold2_IPC[i].utime = Temp_Threshold2_IPC[i].utime;
-                            Threshold2_IPC[i].expire = Temp_Threshold2_IPC[i].expire;
-                            Threshold2_IPC[i].sid =  Temp_Threshold2_IPC[i].sid;
-                        }
+/*****************************************************************************
+ * Clean_IPC_Flexbit - Same as Clean_IPC_Threshold2() for flexbits.
+ * Caller holds IPC_Lock_All(FLEXBIT).
+ *****************************************************************************/
+
+bool Clean_IPC_Flexbit( void )
+{
 
-                    counters_ipc->thresh2_count = new_count;
+    int old_count = counters_ipc->flexbit_count;
 
-                }
-            else
-                {
+    if ( Expire_IPC_Flexbit(Return_Epoch(), INT_MAX) == 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Could not clean _Sagan_IPC_Flexbit.  Nothing to remove!", __FILE__, __LINE__);
+            return(1);
+        }
+
+    Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for _Sagan_IPC_Flexbit.", __FILE__, __LINE__, counters_ipc->flexbit_count, old_count);
+    return(0);
+
+}
 
-                    Sagan_Log(WARN, "[%s, line %d] Could not clean Threshold2_IPC.  Nothing to remove!", __FILE__, __LINE__);
-                    free(Temp_Threshold2_IPC);
-                    pthread_mutex_unlock(&Thresh2_Mutex);
-                    File_Unlock(config->shm_thresh2);
-                    return(1);
+/*****************************************************************************
+ * Expire_IPC_Xbit - Drops up to "limit" expired xbits.  Caller holds
+ * IPC_Lock_All(XBIT).
+ *****************************************************************************/
+
+int Expire_IPC_Xbit( uint64_t utime, int limit )
+{
+
+    int i = 0;
+    int dropped = 0;
+
+    while ( dropped < limit && ( i = IPC_Wheel_Next(Xbit_Wheel, utime) ) != -1 )
+        {
+
+            if ( utime < Xbit_IPC[i].xbit_expire )
+                {
+                    IPC_Wheel_Add(Xbit_Wheel, i, Xbit_IPC[i].xbit_expire);
+                    continue;
                 }
 
-            Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for Threshold2_IPC", __FILE__, __LINE__, new_count, old_count);
-            free(Temp_Threshold2_IPC);
+            if ( debug->debugxbit )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Reclaiming expired xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[i].xbit_name, i, Xbit_IPC[i].xbit_hash);
+                }
 
-            pthread_mutex_unlock(&Thresh2_Mutex);
-            File_Unlock(config->shm_thresh2);
-            return(0);
+            Xbit_Remove_MMAP(i);
+            dropped++;
 
         }
 
-    /* Flexbit_IPC */
+    return(dropped);
 
-    else if ( type == FLEXBIT && config->max_flexbits < counters_ipc->flexbit_count )
-        {
+}
+
+/*****************************************************************************
+ * Clean_IPC_Xbit - Same as Clean_IPC_Threshold2() for xbits.  Caller holds
+ * IPC_Lock_All(XBIT).
+ *****************************************************************************/
+
+bool Clean_IPC_Xbit( void )
+{
+
+    int old_count = counters_ipc->xbit_count;
 
-            time_t t;
-            struct tm *now;
+    if ( Expire_IPC_Xbit(Return_Epoch(), INT_MAX) == 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Could not clean _Sagan_IPC_Xbit.  Nothing to remove!", __FILE__, __LINE__);
+            return(1);
+        }
 
-            int i;
-            int utime = 0;
-            int new_count = 0;
-            int old_count = 0;
+    Sagan_Log(NORMAL, "[%s, line %d] Kept %d xbits out of %d for _Sagan_IPC_Xbit.", __FILE__, __LINE__, counters_ipc->xbit_count, old_count);
+    return(0);
 
-            char timet[20];
+}
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+/*****************************************************************************
+ * IPC_Index_Rebuild - Re-indexes a threshold2/after2/xbit/track clients
+ * object and reschedules its expiry wheel.  Used when the object is new or
+ * was written with a different max size (the message,  index and wheel
+ * parts moved)
+ *****************************************************************************/
 
-            new_count = 0;
-            old_count = 0;
+static void IPC_Index_Rebuild( int type )
+{
 
-            File_Lock(config->shm_flexbit);
-            pthread_mutex_lock(&Flexbit_Mutex);
+    uint64_t now = Return_Epoch();
+    int i = 0;
 
-            struct _Sagan_IPC_Flexbit *temp_flexbit_ipc;
-            temp_flexbit_ipc = malloc(sizeof(struct _Sagan_IPC_Flexbit) * config->max_flexbits);
+    if ( type == THRESHOLD2 )
+        {
 
-            memset(temp_flexbit_ipc, 0, sizeof(sizeof(struct _Sagan_IPC_Flexbit) * config->max_flexbits));
+            if ( counters_ipc->thresh2_count > config->max_threshold2 )
+                {
+                    counters_ipc->thresh2_count = config->max_threshold2;
+                }
 
-            old_count = counters_ipc->flexbit_count;
+            memset(Threshold2_Message, 0, sizeof(struct _Sagan_IPC_Message) * config->max_threshold2);
+            IPC_Index_Init(Threshold2_Index, config->max_threshold2);
+            IPC_Wheel_Init(Threshold2_Wheel, config->max_threshold2, now);
 
-            for (i = 0; i < counters_ipc->flexbit_count; i++)
+            for ( i = 0; i < counters_ipc->thresh2_count; i++ )
                 {
-                    if ( (utime - flexbit_ipc[i].flexbit_expire) < flexbit_ipc[i].expire )
-                        {
+                    IPC_Index_Insert(Threshold2_Index, Threshold2_IPC[i].sid, 0, Threshold2_IPC[i].hash, i);
+                    IPC_Wheel_Add(Threshold2_Wheel, i, Threshold2_IPC[i].utime + Threshold2_IPC[i].expire + 1);
+                }
+
+            counters_ipc->thresh2_max = config->max_threshold2;
 
-                            if ( debug->debugipc )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, %d line] Flexbit_IPC : Keeping [0x%.08X%.08X%.08X%.08X -> 0x%.08X%.08X%.08X%.08X].", __FILE__, __LINE__,
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_src)[0]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_src)[1]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_src)[2]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_src)[3]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_dst)[0]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_dst)[1]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_dst)[2]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_dst)[3]));
-                                }
+        }
 
-                            temp_flexbit_ipc[new_count].flexbit_state = flexbit_ipc[i].flexbit_state;
-                            memcpy(temp_flexbit_ipc[new_count].ip_src, flexbit_ipc[i].ip_src, sizeof(flexbit_ipc[i].ip_src));
-                            memcpy(temp_flexbit_ipc[new_count].ip_dst, flexbit_ipc[i].ip_dst, sizeof(flexbit_ipc[i].ip_dst));
-                            temp_flexbit_ipc[new_count].flexbit_expire = flexbit_ipc[i].flexbit_expire;
-                            temp_flexbit_ipc[new_count].expire = flexbit_ipc[i].expire;
-                            strlcpy(temp_flexbit_ipc[new_count].flexbit_name, flexbit_ipc[i].flexbit_name, sizeof(temp_flexbit_ipc[new_count].flexbit_name));
+    else if ( type == AFTER2 )
+        {
 
-                            new_count++;
-                        }
+            if ( counters_ipc->after2_count > config->max_after2 )
+                {
+                    counters_ipc->after2_count = config->max_after2;
                 }
 
-            if ( new_count > 0 )
+            memset(After2_Message, 0, sizeof(struct _Sagan_IPC_Message) * config->max_after2);
+            IPC_Index_Init(After2_Index, config->max_after2);
+            IPC_Wheel_Init(After2_Wheel, config->max_after2, now);
+
+            for ( i = 0; i < counters_ipc->after2_count; i++ )
                 {
-                    for ( i = 0; i < new_count; i++ )
-                        {
-                            flexbit_ipc[i].flexbit_state = temp_flexbit_ipc[i].flexbit_state;
-                            memcpy(temp_flexbit_ipc[i].ip_src, temp_flexbit_ipc[i].ip_src, sizeof(temp_flexbit_ipc[i].ip_src));
-                            memcpy(temp_flexbit_ipc[i].ip_dst, temp_flexbit_ipc[i].ip_dst, sizeof(temp_flexbit_ipc[i].ip_dst));
-                            flexbit_ipc[i].flexbit_expire = temp_flexbit_ipc[i].flexbit_expire;
-                            flexbit_ipc[i].expire = temp_flexbit_ipc[i].expire;
-                            strlcpy(flexbit_ipc[i].flexbit_name, temp_flexbit_ipc[i].flexbit_name, sizeof(flexbit_ipc[i].flexbit_name));
-                        }
+                    IPC_Index_Insert(After2_Index, After2_IPC[i].sid, After2_IPC[i].rev, After2_IPC[i].hash, i);
+                    IPC_Wheel_Add(After2_Wheel, i, After2_IPC[i].utime + After2_IPC[i].expire + 1);
+                }
+
+            counters_ipc->after2_max = config->max_after2;
+
+        }
 
-                    counters_ipc->flexbit_count = new_count;
+    else if ( type == XBIT )
+        {
 
+            if ( counters_ipc->xbit_count > config->max_xbits )
+                {
+                    counters_ipc->xbit_count = config->max_xbits;
                 }
-            else
+
+            memset(Xbit_Message, 0, sizeof(struct _Sagan_IPC_Message) * config->max_xbits);
+            IPC_Index_Init(Xbit_Index, config->max_xbits);
+            IPC_Wheel_Init(Xbit_Wheel, config->max_xbits, now);
+
+            for ( i = 0; i < counters_ipc->xbit_count; i++ )
                 {
+                    Xbit_Index_Add_MMAP(i);
+                    IPC_Wheel_Add(Xbit_Wheel, i, Xbit_IPC[i].xbit_expire);
+                }
+
+            counters_ipc->xbit_max = config->max_xbits;
+
+        }
 
-                    Sagan_Log(WARN, "[%s, line %d] Could not clean _Sagan_IPC_Flexbit.  Nothing to remove!", __FILE__, __LINE__);
-                    free(temp_flexbit_ipc);
-                    pthread_mutex_unlock(&Flexbit_Mutex);
-                    File_Unlock(config->shm_flexbit);
-                    return(1);
+    else if ( type == TRACK_CLIENTS )
+        {
+
+            uint64_t id;
+            uint32_t rev;
+            uint32_t hash;
+
+            if ( counters_ipc->track_clients_client_count > config->max_track_clients )
+                {
+                    counters_ipc->track_clients_client_count = config->max_track_clients;
                 }
 
-            Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for _Sagan_IPC_Flexbit.", __FILE__, __LINE__, new_count, old_count);
-            free(temp_flexbit_ipc);
+            IPC_Index_Init(Track_Clients_Index, config->max_track_clients);
+
+            for ( i = 0; i < counters_ipc->track_clients_client_count; i++ )
+                {
+                    Track_Clients_Key(SaganTrackClients_ipc[i].hostbits, &id, &rev, &hash);
+                    IPC_Index_Insert(Track_Clients_Index, id, rev, hash, i);
+                }
 
-            pthread_mutex_unlock(&Flexbit_Mutex);
-            File_Unlock(config->shm_flexbit);
-            return(0);
+            counters_ipc->track_clients_max = config->max_track_clients;
 
         }
 
-    else if ( type == XBIT && config->max_xbits < counters_ipc->xbit_count && config->xbit_storage == XBIT_STORAGE_MMAP )
-        {
+}
+
+/*****************************************************************************
+ * Clean_IPC_Object - If the max IPC is hit,  we attempt to "clean" out
+ * any stale IPC entries.
+ *****************************************************************************/
 
+bool Clean_IPC_Object( int type )
+{
 
-            int old_count = 0;
-            int new_count = 0;
+    bool ret = 0;
 
-            int i = 0;
+    if ( type == AFTER2 && counters_ipc->after2_count >= config->max_after2 )
+        {
 
-            File_Lock(config->shm_xbit);
-            pthread_mutex_lock(&Xbit_Mutex);
+            IPC_Lock_All(AFTER2);
 
-            struct _Sagan_IPC_Xbit *temp_xbit_ipc;
-            temp_xbit_ipc = malloc(sizeof(struct _Sagan_IPC_Xbit) * config->max_xbits);
-            memset(temp_xbit_ipc, 0, sizeof(sizeof(struct _Sagan_IPC_Xbit) * config->max_xbits));
+            ret = Clean_IPC_After2();
 
-            old_count = counters_ipc->xbit_count;
+            IPC_Unlock_All(AFTER2);
+            return(ret);
+        }
 
-            for (i = 0; i < counters_ipc->xbit_count; i++)
-                {
+    /* Threshold2 */
 
-                    if ( Xbit_IPC[i].xbit_expire != 0 && Xbit_IPC[i].xbit_expire >= Return_Epoch() )
-                        {
+    else if ( type == THRESHOLD2 && counters_ipc->thresh2_count >= config->max_threshold2 )
+        {
 
-                            strlcpy(temp_xbit_ipc[new_count].xbit_name, Xbit_IPC[i].xbit_name, sizeof(temp_xbit_ipc[new_count].xbit_name));
-                            strlcpy(temp_xbit_ipc[new_count].syslog_message, Xbit_IPC[i].syslog_message, sizeof(temp_xbit_ipc[new_count].syslog_message));
-                            strlcpy(temp_xbit_ipc[new_count].signature_msg, Xbit_IPC[i].signature_msg, sizeof(temp_xbit_ipc[new_count].signature_msg));
+            IPC_Lock_All(THRESHOLD2);
 
-                            temp_xbit_ipc[new_count].xbit_hash = Xbit_IPC[i].xbit_hash;
-                            temp_xbit_ipc[new_count].xbit_name_hash = Xbit_IPC[i].xbit_name_hash;
-                            temp_xbit_ipc[new_count].xbit_expire = Xbit_IPC[i].xbit_expire;
-                            temp_xbit_ipc[new_count].expire = Xbit_IPC[i].expire;
-                            temp_xbit_ipc[new_count].sid =  Xbit_IPC[i].sid;
+            ret = Clean_IPC_Threshold2();
 
-                            new_count++;
+            IPC_Unlock_All(THRESHOLD2);
+            return(ret);
 
-                        }
-                }
+        }
 
-            if ( new_count > 0 )
-                {
+    /* Flexbit_IPC */
 
-                    for ( i = 0; i < new_count; i++ )
-                        {
+    else if ( type == FLEXBIT && counters_ipc->flexbit_count >= config->max_flexbits )
+        {
 
-                            strlcpy(Xbit_IPC[i].xbit_name, temp_xbit_ipc[new_count].xbit_name, sizeof(Xbit_IPC[i].xbit_name));
-                            strlcpy(Xbit_IPC[i].syslog_message, temp_xbit_ipc[new_count].syslog_message, sizeof(Xbit_IPC[i].syslog_message));
-                            strlcpy(Xbit_IPC[i].signature_msg, temp_xbit_ipc[new_count].signature_msg, sizeof(Xbit_IPC[i].signature_msg));
+            IPC_Lock_All(FLEXBIT);
 
-                            Xbit_IPC[i].xbit_hash = temp_xbit_ipc[new_count].xbit_hash;
-                            Xbit_IPC[i].xbit_name_hash = temp_xbit_ipc[new_count].xbit_name_hash;
-                            Xbit_IPC[i].xbit_expire = temp_xbit_ipc[new_count].xbit_expire;
-                            Xbit_IPC[i].expire = temp_xbit_ipc[new_count].expire;
-                            Xbit_IPC[i].sid = temp_xbit_ipc[new_count].sid;
+            ret = Clean_IPC_Flexbit();
 
-                        }
+            IPC_Unlock_All(FLEXBIT);
+            return(ret);
 
-                    counters_ipc->xbit_count = new_count;
+        }
 
-                }
-            else
-                {
+    /* Xbit_IPC */
 
-                    Sagan_Log(WARN, "[%s, line %d] Could not clean _Sagan_IPC_Xbit.  Nothing to remove!", __FILE__, __LINE__);
-                    free(temp_xbit_ipc);
-                    pthread_mutex_unlock(&Xbit_Mutex);
-                    File_Unlock(config->shm_xbit);
-                    return(1);
+    else if ( type == XBIT && counters_ipc->xbit_count >= config->max_xbits && config->xbit_storage == XBIT_STORAGE_MMAP )
+        {
 
-                }
+            IPC_Lock_All(XBIT);
 
-            Sagan_Log(NORMAL, "[%s, line %d] Kept %d xbits out of %d for _Sagan_IPC_Xbit.", __FILE__, __LINE__, new_count, old_count);
-            free(temp_xbit_ipc);
+            ret = Clean_IPC_Xbit();
 
-            File_Unlock(config->shm_xbit);
-            pthread_mutex_unlock(&Xbit_Mutex);
+            IPC_Unlock_All(XBIT);
+            return(ret);
 
         }
 
@@ -467,6 +539,10 @@ void IPC_Init(void)
     bool new_counters = 0;
     bool new_object = 0;
 
+    size_t object_size = 0;
+
+    int i = 0;
+
     char tmp_object_check[255] = { 0 };
 
     Sagan_Log(NORMAL, "Initializing shared memory objects.");
@@ -519,6 +595,8 @@ void IPC_Init(void)
                 }
         }
 
+    IPC_Lock_Init(new_counters);
+
     /* xbit memory object - File based mmap() */
 
     if ( config->xbit_storage == XBIT_STORAGE_MMAP )
@@ -541,16 +619,29 @@ void IPC_Init(void)
 
             config->shm_xbit_status = true;
 
-            if ( ftruncate(config->shm_xbit, sizeof(_Sagan_IPC_Xbit) * config->max_xbits ) != 0 )
+            object_size = IPC_WHEEL_OFFSET(sizeof(_Sagan_IPC_Xbit), config->max_xbits) + IPC_Wheel_Bytes(config->max_xbits);
+
+            if ( ftruncate(config->shm_xbit, object_size ) != 0 )
                 {
                     Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate xbit. [%s]", __FILE__, __LINE__, strerror(errno));
                 }
 
-            if (( Xbit_IPC = mmap(0, sizeof(_Sagan_IPC_Xbit) * config->max_xbits, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_xbit, 0)) == MAP_FAILED )
+            if (( Xbit_IPC = mmap(0, object_size, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_xbit, 0)) == MAP_FAILED )
                 {
                     Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for xbit object! [%s]", __FILE__, __LINE__, strerror(errno));
                 }
 
+            Xbit_Message = (struct _Sagan_IPC_Message *)( (char *)Xbit_IPC + IPC_MESSAGE_OFFSET(sizeof(_Sagan_IPC_Xbit), config->max_xbits) );
+            Xbit_Index = (struct _Sagan_IPC_Index *)( (char *)Xbit_IPC + IPC_INDEX_OFFSET(sizeof(_Sagan_IPC_Xbit), config->max_xbits) );
+            Xbit_Wheel = (struct _Sagan_IPC_Wheel *)( (char *)Xbit_IPC + IPC_WHEEL_OFFSET(sizeof(_Sagan_IPC_Xbit), config->max_xbits) );
+
+            if ( new_object == 1 || counters_ipc->xbit_max != config->max_xbits )
+                {
+                    IPC_Lock_All(XBIT);
+                    IPC_Index_Rebuild(XBIT);
+                    IPC_Unlock_All(XBIT);
+                }
+
             if ( new_object == 0)
                 {
                     Sagan_Log(NORMAL, "- Xbit shared object reloaded (%d xbits loaded / max: %d).", counters_ipc->xbit_count, config->max_xbits);
@@ -586,16 +677,47 @@ void IPC_Init(void)
 
     config->shm_flexbit_status = true;
 
-    if ( ftruncate(config->shm_flexbit, sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits ) != 0 )
+    /* The flexbits,  their hash chains,  then their expiry wheel */
+
+    object_size = IPC_ALIGN( sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits ) + IPC_ALIGN( Flexbit_Index_Bytes_MMAP(config->max_flexbits) ) + IPC_Wheel_Bytes(config->max_flexbits);
+
+    if ( ftruncate(config->shm_flexbit, object_size ) != 0 )
         {
             Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate flexbit. [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
-    if (( flexbit_ipc = mmap(0, sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_flexbit, 0)) == MAP_FAILED )
+    if (( flexbit_ipc = mmap(0, object_size, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_flexbit, 0)) == MAP_FAILED )
         {
             Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for flexbit object! [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
+    Flexbit_Index = (struct _Sagan_IPC_Flexbit_Index *)( (char *)flexbit_ipc + IPC_ALIGN( sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits ) );
+    Flexbit_Wheel = (struct _Sagan_IPC_Wheel *)( (char *)Flexbit_Index + IPC_ALIGN( Flexbit_Index_Bytes_MMAP(config->max_flexbits) ) );
+
+    if ( new_object == 1 || counters_ipc->flexbit_max != config->max_flexbits )
+        {
+
+            IPC_Lock_All(FLEXBIT);
+
+            if ( counters_ipc->flexbit_count > config->max_flexbits )
+                {
+                    counters_ipc->flexbit_count = config->max_flexbits;
+                }
+
+            Flexbit_Index_Rebuild_MMAP();
+
+            IPC_Wheel_Init(Flexbit_Wheel, config->max_flexbits, Return_Epoch());
+
+            for ( i = 0; i < counters_ipc->flexbit_count; i++ )
+                {
+                    IPC_Wheel_Add(Flexbit_Wheel, i, flexbit_ipc[i].flexbit_expire + flexbit_ipc[i].expire);
+                }
+
+            counters_ipc->flexbit_max = config->max_flexbits;
+
+            IPC_Unlock_All(FLEXBIT);
+        }
+
     if ( new_object == 0)
         {
             Sagan_Log(NORMAL, "- Flexbit shared object reloaded (%d flexbits loaded / max: %d).", counters_ipc->flexbit_count, config->max_flexbits);
@@ -623,16 +745,29 @@ void IPC_Init(void)
 
     config->shm_thresh2_status = true;
 
-    if ( ftruncate(config->shm_thresh2, sizeof(_Threshold2_IPC) * config->max_threshold2 ) != 0 )
+    object_size = IPC_WHEEL_OFFSET(sizeof(_Threshold2_IPC), config->max_threshold2) + IPC_Wheel_Bytes(config->max_threshold2);
+
+    if ( ftruncate(config->shm_thresh2, object_size ) != 0 )
         {
             Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate thresh2. [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
-    if (( Threshold2_IPC = mmap(0, sizeof(_Threshold2_IPC) * config->max_threshold2, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_thresh2, 0)) == MAP_FAILED )
+    if (( Threshold2_IPC = mmap(0, object_size, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_thresh2, 0)) == MAP_FAILED )
         {
             Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for _Threshold2_IPC object! [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
+    Threshold2_Message = (struct _Sagan_IPC_Message *)( (char *)Threshold2_IPC + IPC_MESSAGE_OFFSET(sizeof(_Threshold2_IPC), config->max_threshold2) );
+    Threshold2_Index = (struct _Sagan_IPC_Index *)( (char *)Threshold2_IPC + IPC_INDEX_OFFSET(sizeof(_Threshold2_IPC), config->max_threshold2) );
+    Threshold2_Wheel = (struct _Sagan_IPC_Wheel *)( (char *)Threshold2_IPC + IPC_WHEEL_OFFSET(sizeof(_Threshold2_IPC), config->max_threshold2) );
+
+    if ( new_object == 1 || counters_ipc->thresh2_max != config->max_threshold2 )
+        {
+            IPC_Lock_All(THRESHOLD2);
+            IPC_Index_Rebuild(THRESHOLD2);
+            IPC_Unlock_All(THRESHOLD2);
+        }
+
     if ( new_object == 0 )
         {
             Sagan_Log(NORMAL, "- Threshold shared object reloaded (%d sources loaded / max: %d).", counters_ipc->thresh2_count, config->max_threshold2);
@@ -661,16 +796,29 @@ void IPC_Init(void)
 
     config->shm_after2_status = true;
 
-    if ( ftruncate(config->shm_after2, sizeof(_After2_IPC) * config->max_after2 ) != 0 )
+    object_size = IPC_WHEEL_OFFSET(sizeof(_After2_IPC), config->max_after2) + IPC_Wheel_Bytes(config->max_after2);
+
+    if ( ftruncate(config->shm_after2, object_size ) != 0 )
         {
             Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate after2. [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
-    if (( After2_IPC = mmap(0, sizeof(_After2_IPC) * config->max_after2, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_after2, 0)) == MAP_FAILED )
+    if (( After2_IPC = mmap(0, object_size, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_after2, 0)) == MAP_FAILED )
         {
             Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for _After2_IPC object! [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
+    After2_Message = (struct _Sagan_IPC_Message *)( (char *)After2_IPC + IPC_MESSAGE_OFFSET(sizeof(_After2_IPC), config->max_after2) );
+    After2_Index = (struct _Sagan_IPC_Index *)( (char *)After2_IPC + IPC_INDEX_OFFSET(sizeof(_After2_IPC), config->max_after2) );
+    After2_Wheel = (struct _Sagan_IPC_Wheel *)( (char *)After2_IPC + IPC_WHEEL_OFFSET(sizeof(_After2_IPC), config->max_after2) );
+
+    if ( new_object == 1 || counters_ipc->after2_max != config->max_after2 )
+        {
+            IPC_Lock_All(AFTER2);
+            IPC_Index_Rebuild(AFTER2);
+            IPC_Unlock_All(AFTER2);
+        }
+
     if ( new_object == 0 )
         {
             Sagan_Log(NORMAL, "- After shared object reloaded (%d sources loaded / max: %d).", counters_ipc->after2_count, config->max_after2);
@@ -701,16 +849,29 @@ void IPC_Init(void)
 
             config->shm_track_clients_status = true;
 
-            if ( ftruncate(config->shm_track_clients, sizeof(_Sagan_Track_Clients_IPC) * config->max_track_clients ) != 0 )
+            /* Clients,  then the address index */
+
+            object_size = IPC_ALIGN( sizeof(_Sagan_Track_Clients_IPC) * config->max_track_clients ) + IPC_Index_Bytes(config->max_track_clients);
+
+            if ( ftruncate(config->shm_track_clients, object_size ) != 0 )
                 {
                     Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate _Sagan_Track_Clients_IPC. [%s]", __FILE__, __LINE__, strerror(errno));
                 }
 
-            if (( SaganTrackClients_ipc = mmap(0, sizeof(_Sagan_Track_Clients_IPC) * config->max_track_clients, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_track_clients, 0)) == MAP_FAILED )
+            if (( SaganTrackClients_ipc = mmap(0, object_size, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_track_clients, 0)) == MAP_FAILED )
                 {
                     Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for _Sagan_Track_Clients_IPC! [%s]", __FILE__, __LINE__, strerror(errno));
                 }
 
+            Track_Clients_Index = (struct _Sagan_IPC_Index *)( (char *)SaganTrackClients_ipc + IPC_ALIGN( sizeof(_Sagan_Track_Clients_IPC) * config->max_track_clients ) );
+
+            if ( new_object == 1 || counters_ipc->track_clients_max != config->max_track_clients )
+                {
+                    IPC_Lock_All(TRACK_CLIENTS);
+                    IPC_Index_Rebuild(TRACK_CLIENTS);
+                    IPC_Unlock_All(TRACK_CLIENTS);
+                }
+
             if ( new_object == 0 )
                 {
                     Sagan_Log(NORMAL, "- Sagan_track_clients shared object reloaded (%d clients loaded / max: %d).", counters_ipc->track_clients_client_count, config->max_track_clients);
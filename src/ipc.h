@@ -31,8 +31,25 @@
 #include "config.h"             /* From autoconf */
 #endif
 
+/* Threshold2/after2/xbit objects are laid out as
+   [entries][messages][index][wheel],  each part starting on an 8 byte
+   boundary */
+
+#define IPC_ALIGN(x)			( ( (size_t)(x) + 7 ) & ~(size_t)7 )
+#define IPC_MESSAGE_OFFSET(size, max)	IPC_ALIGN( (size_t)(size) * (max) )
+#define IPC_INDEX_OFFSET(size, max)	( IPC_MESSAGE_OFFSET(size, max) + IPC_ALIGN( sizeof(struct _Sagan_IPC_Message) * (max) ) )
+#define IPC_WHEEL_OFFSET(size, max)	( IPC_INDEX_OFFSET(size, max) + IPC_ALIGN( IPC_Index_Bytes(max) ) )
+
 void IPC_Init(void);
 bool Clean_IPC_Object( int );
+bool Clean_IPC_Threshold2( void );
+bool Clean_IPC_After2( void );
+bool Clean_IPC_Flexbit( void );
+bool Clean_IPC_Xbit( void );
+int Expire_IPC_Threshold2( uint64_t, int );
+int Expire_IPC_After2( uint64_t, int );
+int Expire_IPC_Flexbit( uint64_t, int );
+int Expire_IPC_Xbit( uint64_t, int );
 void IPC_Check_Object(char *, bool, char *);
 
 
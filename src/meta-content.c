@@ -40,72 +40,37 @@
 
 #include "sagan.h"
 #include "sagan-defs.h"
-#include "meta-content.h"
 #include "rules.h"
+#include "rules-hot.h"
+#include "meta-content.h"
 #include "parsers/parsers.h"
 
-struct RuleBody *RuleBody;
+/****************************************************************************
+ * Meta_Content_Search - "meta" comes from the hot rule table.  Returns true
+ * if any of its alternatives is in "syslog_msg" (none of them for a negated
+ * meta_content).
+ ****************************************************************************/
 
-int Meta_Content_Search(char *syslog_msg, int rule_position, int meta_content_count)
+int Meta_Content_Search(char *syslog_msg, struct _Sagan_Rules_Hot *hot, struct _Sagan_Rule_Meta *meta)
 {
 
-    int z = meta_content_count;
+    const char **pattern = &hot->meta_patterns[meta->pattern];
+    bool found = false;
     int i;
 
-    /* Normal "meta_content" search */
-
-    if ( RuleBody[rule_position].meta_content_not[z] == 0 )
+    for ( i=0; i<meta->pattern_count && found == false; i++ )
         {
-            for ( i=0; i<RuleBody[rule_position].Meta[z].meta_counter; i++ )
-                {
-                    if ( RuleBody[rule_position].meta_content_case[z] == 1 )
-                        {
-
-                            if (Sagan_stristr(syslog_msg, RuleBody[rule_position].Meta[z].meta_content_converted[i], true))
-                                {
-                                    return(true);
-                                }
-                        }
-                    else
-                        {
 
-
-                            if (Sagan_strstr(syslog_msg, RuleBody[rule_position].Meta[z].meta_content_converted[i]))
-                                {
-                                    return(true);
-                                }
-                        }
+            if ( meta->nocase == true )
+                {
+                    found = Sagan_stristr(syslog_msg, pattern[i], true) != NULL;
                 }
-
-            return(false);
-
-        }
-    else
-        {
-
-            for ( i=0; i<RuleBody[rule_position].Meta[z].meta_counter; i++ )
+            else
                 {
-                    if ( RuleBody[rule_position].meta_content_case[z] == 1 )
-                        {
-
-                            if (Sagan_stristr(syslog_msg, RuleBody[rule_position].Meta[z].meta_content_converted[i], true))
-                                {
-                                    return(false);
-                                }
-                        }
-                    else
-                        {
-
-                            if (Sagan_strstr(syslog_msg, RuleBody[rule_position].Meta[z].meta_content_converted[i]))
-                                {
-                                    return(false);
-                                }
-                        }
-
+                    found = Sagan_strstr(syslog_msg, pattern[i]) != NULL;
                 }
+        }
 
-            return(true);
-
-        } /* End of "else" meta_content_not[z] == 0 */
+    return( found != meta->negate );
 
 } /* End of Meta_Content_Search() */
@@ -22,5 +22,5 @@
 #include "config.h"             /* From autoconf */
 #endif
 
-int Meta_Content_Search(char *, int, int);
+int Meta_Content_Search(char *, struct _Sagan_Rules_Hot *, struct _Sagan_Rule_Meta *);
 
@@ -35,6 +35,11 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
+
+#if defined(HAVE_SSE2) && SIZEOF_SIZE_T == 8
+#include <emmintrin.h>
+#endif
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -80,32 +85,145 @@ char *Sagan_strstr(const char *_x, const char *_y)
 
 #endif
 
+/* Case folding used by Sagan_stristr().  This matches what To_LowerC() does
+ * in the "C" locale,  without going through tolower() */
+
+static inline unsigned char Sagan_Fold( unsigned char c )
+{
+    return( ( c >= 'A' && c <= 'Z' ) ? c | 0x20 : c );
+}
+
+static inline bool Sagan_Fold_Compare( const unsigned char *h, const unsigned char *n, size_t len, bool needle_lower )
+{
+
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+        {
+
+            if ( Sagan_Fold(h[i]) != ( needle_lower ? Sagan_Fold(n[i]) : n[i] ) )
+                {
+                    return(false);
+                }
+        }
+
+    return(true);
+}
+
+#if defined(HAVE_SSE2) && SIZEOF_SIZE_T == 8
+
+/* Folds 'A' - 'Z' in 16 bytes at a time.  SSE2 only has signed compares,  so
+ * the bytes are shifted so that 'A' - 'Z' become the 26 lowest signed values */
+
+static inline __m128i Sagan_Fold_SSE2( __m128i v )
+{
+
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8( (char)(0x80 - 'A') ));
+    __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8( (char)(0x80 + 26) ));
+
+    return( _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20))) );
+}
+
+#endif
+
 /* This works similar to "strcasestr".  The "needle" (_y) is assumed to
  * already be converted to lowercase if "needle_lower" is FALSE.
  *
  * 0/FALSE == Don't convert needle
  * 1/TRUE  == Convert needle
+ *
+ * The haystack is never copied.  Candidate positions are found by comparing
+ * the (folded) first and last byte of the needle against 16 positions at a
+ * time,  then the middle of the needle is verified.  The returned pointer
+ * is into "_x".
  */
 
 char *Sagan_stristr(const char *_x, const char *_y, bool needle_lower )
 {
 
-    char *p = NULL;
-    char haystack_string[MAX_SYSLOGMSG] = { 0 };
-    char needle_string[512] = { 0 };
+    const unsigned char *h = (const unsigned char *)_x;
+    const unsigned char *n = (const unsigned char *)_y;
 
-    strlcpy(haystack_string, _x, sizeof(haystack_string));
-    To_LowerC(haystack_string);
+    size_t h_len;
+    size_t n_len;
+    size_t middle;
+    size_t i = 0;
 
-    strlcpy(needle_string, _y, sizeof(needle_string));
+    unsigned char first;
+    unsigned char last;
 
-    if ( needle_lower ) {
-        To_LowerC(needle_string);
+    n_len = strlen(_y);
+
+    if ( n_len == 0 )
+        {
+            return( (char *)_x );
+        }
+
+    h_len = strlen(_x);
+
+    if ( n_len > h_len )
+        {
+            return(NULL);
+        }
+
+    first = needle_lower ? Sagan_Fold(n[0]) : n[0];
+    last = needle_lower ? Sagan_Fold(n[n_len - 1]) : n[n_len - 1];
+    middle = n_len > 2 ? n_len - 2 : 0;
+
+#if defined(HAVE_SSE2) && SIZEOF_SIZE_T == 8
+
+    {
+
+        const __m128i v_first = _mm_set1_epi8( (char)first );
+        const __m128i v_last = _mm_set1_epi8( (char)last );
+
+        __m128i b_first;
+        __m128i b_last;
+
+        unsigned int mask;
+        unsigned int bit;
+
+        /* Both loads stay inside of the haystack */
+
+        for ( ; i + 16 <= h_len - n_len + 1; i += 16 )
+            {
+
+                b_first = Sagan_Fold_SSE2( _mm_loadu_si128( (const __m128i *)(h + i) ) );
+                b_last = Sagan_Fold_SSE2( _mm_loadu_si128( (const __m128i *)(h + i + n_len - 1) ) );
+
+                mask = (unsigned int)_mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8(b_first, v_first),
+                                                        _mm_cmpeq_epi8(b_last, v_last) ) );
+
+                while ( mask != 0 )
+                    {
+
+                        bit = __builtin_ctz(mask);
+
+                        if ( Sagan_Fold_Compare(h + i + bit + 1, n + 1, middle, needle_lower) )
+                            {
+                                return( (char *)(h + i + bit) );
+                            }
+
+                        mask &= mask - 1;
+                    }
+            }
     }
 
-    p = Sagan_strstr( haystack_string, needle_string);
+#endif
 
-    return p;
+    /* Whatever is left (or everything on non-SSE2 CPUs) */
+
+    for ( ; i + n_len <= h_len; i++ )
+        {
+
+            if ( Sagan_Fold(h[i]) == first && Sagan_Fold(h[i + n_len - 1]) == last &&
+                    Sagan_Fold_Compare(h + i + 1, n + 1, middle, needle_lower) )
+                {
+                    return( (char *)(h + i) );
+                }
+        }
+
+    return(NULL);
 
 }
 
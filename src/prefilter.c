@@ -0,0 +1,871 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* prefilter.c
+ *
+ * Multi-pattern "prefilter" for the rule engine.  At rule load time,  every
+ * positive content/meta_content literal is compiled into a single case folded
+ * Aho-Corasick automaton.  Each log line is then scanned one time and only
+ * rules that could possibly match (all of their required literals were seen)
+ * are handed to the full offset/depth/pcre/flexbit evaluation in engine.c.
+ *
+ * The automaton is case insensitive,  so a hit is a superset of what the
+ * engine will accept.  It only decides what to skip,  never what alerts.
+ * Rules with no positive literal (content:! only,  pcre only, etc) are
+ * always evaluated.
+ *
+ * The program/facility/level/tag/syslog priority filters are compiled too.
+ * Each exact value maps to a bitmap of the rules that accept it,  so a line
+ * costs one hash lookup per field no matter how many rules there are.  A
+ * rule that only wants "sshd" is never looked at for a "postfix" line.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "rules.h"
+#include "prefilter.h"
+
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+struct RuleBody *RuleBody;
+
+struct _Sagan_Prefilter *SaganPrefilter = NULL;
+
+static uint32_t prefilter_generation = 0;
+
+/* Per thread scan state.  "stamps" avoid clearing the arrays on every line */
+
+static __thread struct _Sagan_Prefilter *prefilter_active = NULL;
+static __thread uint32_t prefilter_thread_generation = 0;
+static __thread uint32_t prefilter_stamp = 0;
+static __thread uint32_t *prefilter_literal_stamp = NULL;
+static __thread uint32_t *prefilter_rule_stamp = NULL;
+static __thread uint64_t *prefilter_rule_mask = NULL;
+static __thread uint64_t *prefilter_eligible = NULL;	/* Rules passing the header filters */
+static __thread uint64_t *prefilter_field = NULL;
+
+typedef struct _Sagan_Prefilter_Literal _Sagan_Prefilter_Literal;
+struct _Sagan_Prefilter_Literal
+{
+    const char *literal;
+    int rule;
+    unsigned char group;
+    int literal_id;
+};
+
+static void Prefilter_Free( struct _Sagan_Prefilter *pf )
+{
+
+    struct _Sagan_Prefilter_Header *header = NULL;
+
+    uint32_t i;
+    int f;
+
+    if ( pf == NULL )
+        {
+            return;
+        }
+
+    for ( f = 0; f < PREFILTER_HEADER_FIELDS; f++ )
+        {
+
+            header = &pf->header[f];
+
+            for ( i = 0; i < header->table_size; i++ )
+                {
+                    free(header->table[i].value);
+                    free(header->table[i].rules);
+                }
+
+            for ( i = 0; i < (uint32_t)header->wildcard_count; i++ )
+                {
+                    free(header->wildcards[i].pattern);
+                }
+
+            free(header->table);
+            free(header->wildcards);
+            free(header->open);
+        }
+
+    free(pf->delta);
+    free(pf->output);
+    free(pf->dict);
+    free(pf->ref_start);
+    free(pf->refs);
+    free(pf->required);
+    free(pf);
+
+}
+
+/****************************************************************************
+ * Prefilter_Add_State - Adds an empty state to the trie,  growing the tables
+ * as needed.
+ ****************************************************************************/
+
+static int Prefilter_Add_State( struct _Sagan_Prefilter *pf, int *state_max )
+{
+
+    int i;
+
+    if ( pf->state_count >= *state_max )
+        {
+
+            *state_max = *state_max * 2;
+
+            pf->delta = realloc(pf->delta, (size_t)*state_max * pf->class_count * sizeof(int32_t));
+            pf->output = realloc(pf->output, (size_t)*state_max * sizeof(int32_t));
+
+            if ( pf->delta == NULL || pf->output == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for the prefilter automaton. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    for ( i = 0; i < pf->class_count; i++ )
+        {
+            pf->delta[ (size_t)pf->state_count * pf->class_count + i ] = -1;
+        }
+
+    pf->output[pf->state_count] = -1;
+
+    return(pf->state_count++);
+
+}
+
+/****************************************************************************
+ * Prefilter_Hash - FNV-1a,  for the header value tables
+ ****************************************************************************/
+
+static inline uint32_t Prefilter_Hash( const char *value )
+{
+
+    uint32_t hash = 2166136261U;
+
+    for ( ; *value != '\0'; value++ )
+        {
+            hash = ( hash ^ (unsigned char)*value ) * 16777619U;
+        }
+
+    return(hash);
+
+}
+
+/****************************************************************************
+ * Prefilter_Header_Find - Returns the slot for "value".  With "add",  an
+ * empty slot is claimed for a new value,  otherwise NULL if it's not there.
+ ****************************************************************************/
+
+static struct _Sagan_Prefilter_Value *Prefilter_Header_Find( struct _Sagan_Prefilter *pf, struct _Sagan_Prefilter_Header *header, const char *value, bool add )
+{
+
+    struct _Sagan_Prefilter_Value *slot = NULL;
+    uint32_t i = Prefilter_Hash(value) & ( header->table_size - 1 );
+
+    for (;;)
+        {
+
+            slot = &header->table[i];
+
+            if ( slot->value == NULL )
+                {
+
+                    if ( add == false )
+                        {
+                            return(NULL);
+                        }
+
+                    slot->value = strdup(value);
+                    slot->rules = calloc( pf->rule_words, sizeof(uint64_t) );
+
+                    if ( slot->value == NULL || slot->rules == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the prefilter header index. Abort!", __FILE__, __LINE__);
+                        }
+
+                    header->value_count++;
+                    return(slot);
+                }
+
+            if ( !strcmp(slot->value, value) )
+                {
+                    return(slot);
+                }
+
+            i = ( i + 1 ) & ( header->table_size - 1 );
+        }
+
+}
+
+/****************************************************************************
+ * Prefilter_Build_Header - Indexes the program/facility/level/tag/syslog
+ * priority of every rule.  Values are "|" separated alternatives.
+ ****************************************************************************/
+
+static void Prefilter_Build_Header( struct _Sagan_Prefilter *pf )
+{
+
+    struct _Sagan_Prefilter_Header *header = NULL;
+    struct _Sagan_Prefilter_Value *slot = NULL;
+
+    const char *field = NULL;
+    char tmpbuf[256];
+    char *ptmp = NULL;
+    char *tok = NULL;
+
+    int values = 0;
+    int b;
+    int f;
+
+    for ( f = 0; f < PREFILTER_HEADER_FIELDS; f++ )
+        {
+
+            header = &pf->header[f];
+
+            header->open = calloc( pf->rule_words, sizeof(uint64_t) );
+
+            /* Worst case every alternative of every rule is a new value.
+               Keep the table at most half full */
+
+            values = 0;
+
+            for ( b = 0; b < pf->rule_count; b++ )
+                {
+
+                    field = f == PREFILTER_HEADER_PROGRAM ? RuleBody[b].s_program :
+                            f == PREFILTER_HEADER_FACILITY ? RuleBody[b].s_facility :
+                            f == PREFILTER_HEADER_LEVEL ? RuleBody[b].s_level :
+                            f == PREFILTER_HEADER_TAG ? RuleBody[b].s_tag : RuleBody[b].s_syspri;
+
+                    for ( ; *field != '\0'; field++ )
+                        {
+                            values += *field == '|';
+                        }
+
+                    values++;
+                }
+
+            header->table_size = 16;
+
+            while ( header->table_size < (uint32_t)values * 2 )
+                {
+                    header->table_size = header->table_size << 1;
+                }
+
+            header->table = calloc( header->table_size, sizeof(struct _Sagan_Prefilter_Value) );
+
+            if ( header->open == NULL || header->table == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the prefilter header index. Abort!", __FILE__, __LINE__);
+                }
+
+            for ( b = 0; b < pf->rule_count; b++ )
+                {
+
+                    field = f == PREFILTER_HEADER_PROGRAM ? RuleBody[b].s_program :
+                            f == PREFILTER_HEADER_FACILITY ? RuleBody[b].s_facility :
+                            f == PREFILTER_HEADER_LEVEL ? RuleBody[b].s_level :
+                            f == PREFILTER_HEADER_TAG ? RuleBody[b].s_tag : RuleBody[b].s_syspri;
+
+                    if ( field[0] == '\0' )
+                        {
+                            header->open[b >> 6] |= 1ULL << ( b & 63 );
+                            continue;
+                        }
+
+                    header->used = true;
+                    pf->header_used = true;
+
+                    strlcpy(tmpbuf, field, sizeof(tmpbuf));
+                    ptmp = strtok_r(tmpbuf, "|", &tok);
+
+                    while ( ptmp != NULL )
+                        {
+
+                            /* Only "program" takes wildcards */
+
+                            if ( f == PREFILTER_HEADER_PROGRAM && strpbrk(ptmp, "*?") != NULL )
+                                {
+
+                                    header->wildcards = realloc(header->wildcards, (header->wildcard_count + 1) * sizeof(struct _Sagan_Prefilter_Wildcard));
+
+                                    if ( header->wildcards == NULL )
+                                        {
+                                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for prefilter wildcards. Abort!", __FILE__, __LINE__);
+                                        }
+
+                                    header->wildcards[header->wildcard_count].pattern = strdup(ptmp);
+                                    header->wildcards[header->wildcard_count].rule = b;
+
+                                    if ( header->wildcards[header->wildcard_count].pattern == NULL )
+                                        {
+                                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for prefilter wildcards. Abort!", __FILE__, __LINE__);
+                                        }
+
+                                    header->wildcard_count++;
+
+                                }
+                            else
+                                {
+
+                                    slot = Prefilter_Header_Find(pf, header, ptmp, true);
+                                    slot->rules[b >> 6] |= 1ULL << ( b & 63 );
+
+                                }
+
+                            ptmp = strtok_r(NULL, "|", &tok);
+                        }
+                }
+        }
+
+}
+
+/****************************************************************************
+ * Prefilter_Build - Compiles the content/meta_content literals of every
+ * loaded rule into a new automaton and swaps it in.  Called at start up and
+ * from the SIGHUP reload path.
+ ****************************************************************************/
+
+void Prefilter_Build( void )
+{
+
+    struct _Sagan_Prefilter *pf = NULL;
+    struct _Sagan_Prefilter_Literal *literals = NULL;
+
+    int literal_max = 0;
+    int literal_total = 0;
+
+    int state_max = 1024;
+
+    int32_t *fail = NULL;
+    int32_t *queue = NULL;
+    int head = 0;
+    int tail = 0;
+
+    int *ref_fill = NULL;
+
+    bool used[256] = { 0 };
+    int class_of[256] = { 0 };
+
+    const unsigned char *p = NULL;
+
+    int b;
+    int z;
+    int i;
+    int c;
+    int s;
+    int t;
+    int group;
+
+    pf = malloc(sizeof(struct _Sagan_Prefilter));
+
+    if ( pf == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the prefilter. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(pf, 0, sizeof(struct _Sagan_Prefilter));
+
+    pf->rule_count = counters->rulecount;
+    pf->rule_words = ( pf->rule_count + 63 ) / 64 + 1;
+    pf->required = calloc( pf->rule_count + 1, sizeof(uint64_t) );
+
+    if ( pf->required == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the prefilter rule masks. Abort!", __FILE__, __LINE__);
+        }
+
+    /* Collect the literals.  A rule matches only if every positive "content"
+       is found and,  for each positive "meta_content",  at least one of its
+       items is found.  Each of these is a "group" */
+
+    for ( b = 0; b < pf->rule_count; b++ )
+        {
+
+            group = 0;
+
+            for ( z = 0; z < RuleBody[b].content_count + RuleBody[b].meta_content_count && group < PREFILTER_MAX_GROUPS; z++ )
+                {
+
+                    bool group_used = false;
+                    int item_count = 0;
+
+                    if ( z < RuleBody[b].content_count )
+                        {
+                            if ( RuleBody[b].content_not[z] == true || RuleBody[b].s_content[z][0] == '\0' )
+                                {
+                                    continue;
+                                }
+
+                            item_count = 1;
+                        }
+                    else
+                        {
+                            if ( RuleBody[b].meta_content_not[z - RuleBody[b].content_count] == true )
+                                {
+                                    continue;
+                                }
+
+                            item_count = RuleBody[b].Meta[z - RuleBody[b].content_count].meta_counter;
+                        }
+
+                    for ( i = 0; i < item_count; i++ )
+                        {
+
+                            const char *literal = z < RuleBody[b].content_count ? RuleBody[b].s_content[z] :
+                                                  RuleBody[b].Meta[z - RuleBody[b].content_count].meta_content_converted[i];
+
+                            if ( literal[0] == '\0' )
+                                {
+                                    continue;
+                                }
+
+                            if ( literal_total >= literal_max )
+                                {
+                                    literal_max = literal_max == 0 ? 1024 : literal_max * 2;
+                                    literals = realloc(literals, literal_max * sizeof(struct _Sagan_Prefilter_Literal));
+
+                                    if ( literals == NULL )
+                                        {
+                                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for prefilter literals. Abort!", __FILE__, __LINE__);
+                                        }
+                                }
+
+                            literals[literal_total].literal = literal;
+                            literals[literal_total].rule = b;
+                            literals[literal_total].group = group;
+                            literals[literal_total].literal_id = -1;
+                            literal_total++;
+
+                            group_used = true;
+
+                            for ( p = (const unsigned char *)literal; *p != '\0'; p++ )
+                                {
+                                    used[ tolower(*p) ] = true;
+                                }
+                        }
+
+                    /* A meta_content with no usable items can't narrow anything down */
+
+                    if ( group_used == true )
+                        {
+                            pf->required[b] |= 1ULL << group;
+                            group++;
+                        }
+
+                }
+
+            if ( pf->required[b] != 0 )
+                {
+                    pf->filtered_count++;
+                }
+        }
+
+    /* Compress the alphabet.  Class 0 is every byte that is not part of any
+       literal.  Upper and lower case share a class */
+
+    pf->class_count = 1;
+
+    for ( c = 0; c < 256; c++ )
+        {
+            if ( used[c] == true )
+                {
+                    class_of[c] = pf->class_count++;
+                }
+        }
+
+    for ( c = 0; c < 256; c++ )
+        {
+            pf->byte_class[c] = class_of[ tolower(c) ];
+        }
+
+    /* Build the trie */
+
+    pf->delta = malloc( (size_t)state_max * pf->class_count * sizeof(int32_t) );
+    pf->output = malloc( (size_t)state_max * sizeof(int32_t) );
+
+    if ( pf->delta == NULL || pf->output == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the prefilter automaton. Abort!", __FILE__, __LINE__);
+        }
+
+    (void)Prefilter_Add_State(pf, &state_max);
+
+    for ( i = 0; i < literal_total; i++ )
+        {
+
+            s = 0;
+
+            for ( p = (const unsigned char *)literals[i].literal; *p != '\0'; p++ )
+                {
+
+                    c = pf->byte_class[*p];
+                    t = pf->delta[ (size_t)s * pf->class_count + c ];
+
+                    if ( t == -1 )
+                        {
+                            t = Prefilter_Add_State(pf, &state_max);
+                            pf->delta[ (size_t)s * pf->class_count + c ] = t;
+                        }
+
+                    s = t;
+                }
+
+            /* Identical (case folded) literals share one id */
+
+            if ( pf->output[s] == -1 )
+                {
+                    pf->output[s] = pf->literal_count++;
+                }
+
+            literals[i].literal_id = pf->output[s];
+        }
+
+    /* Failure links (BFS),  turning the trie into a full DFA as we go */
+
+    fail = calloc( pf->state_count, sizeof(int32_t) );
+    queue = malloc( pf->state_count * sizeof(int32_t) );
+    pf->dict = calloc( pf->state_count, sizeof(int32_t) );
+
+    if ( fail == NULL || queue == NULL || pf->dict == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the prefilter failure links. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( c = 0; c < pf->class_count; c++ )
+        {
+
+            t = pf->delta[c];
+
+            if ( t == -1 )
+                {
+                    pf->delta[c] = 0;
+                }
+            else
+                {
+                    fail[t] = 0;
+                    queue[tail++] = t;
+                }
+        }
+
+    while ( head < tail )
+        {
+
+            s = queue[head++];
+
+            pf->dict[s] = pf->output[ fail[s] ] >= 0 ? fail[s] : pf->dict[ fail[s] ];
+
+            for ( c = 0; c < pf->class_count; c++ )
+                {
+
+                    t = pf->delta[ (size_t)s * pf->class_count + c ];
+
+                    if ( t == -1 )
+                        {
+                            pf->delta[ (size_t)s * pf->class_count + c ] = pf->delta[ (size_t)fail[s] * pf->class_count + c ];
+                        }
+                    else
+                        {
+                            fail[t] = pf->delta[ (size_t)fail[s] * pf->class_count + c ];
+                            queue[tail++] = t;
+                        }
+                }
+        }
+
+    free(fail);
+    free(queue);
+
+    /* Literal -> rule/group references */
+
+    pf->ref_start = calloc( pf->literal_count + 1, sizeof(int) );
+    ref_fill = calloc( pf->literal_count + 1, sizeof(int) );
+    pf->refs = malloc( (literal_total + 1) * sizeof(struct _Sagan_Prefilter_Ref) );
+
+    if ( pf->ref_start == NULL || ref_fill == NULL || pf->refs == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the prefilter references. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < literal_total; i++ )
+        {
+            pf->ref_start[ literals[i].literal_id + 1 ]++;
+        }
+
+    for ( i = 0; i < pf->literal_count; i++ )
+        {
+            pf->ref_start[i + 1] += pf->ref_start[i];
+        }
+
+    for ( i = 0; i < literal_total; i++ )
+        {
+            t = pf->ref_start[ literals[i].literal_id ] + ref_fill[ literals[i].literal_id ]++;
+            pf->refs[t].rule = literals[i].rule;
+            pf->refs[t].group = literals[i].group;
+        }
+
+    free(ref_fill);
+    free(literals);
+
+    Prefilter_Build_Header(pf);
+
+    pf->generation = ++prefilter_generation;
+
+    Sagan_Log(NORMAL, "Prefilter compiled: %d literal(s), %d state(s), %d/%d rule(s) filtered.", pf->literal_count, pf->state_count, pf->filtered_count, pf->rule_count);
+    Sagan_Log(NORMAL, "Prefilter header index: %u program(s) (+%d wildcard), %u facility, %u level, %u tag, %u priority value(s).",
+              pf->header[PREFILTER_HEADER_PROGRAM].value_count, pf->header[PREFILTER_HEADER_PROGRAM].wildcard_count,
+              pf->header[PREFILTER_HEADER_FACILITY].value_count, pf->header[PREFILTER_HEADER_LEVEL].value_count,
+              pf->header[PREFILTER_HEADER_TAG].value_count, pf->header[PREFILTER_HEADER_PRIORITY].value_count);
+
+    /* Swap it in.  Reloads wait for the processor threads to go idle,  so
+       nothing is scanning with the old one */
+
+    Prefilter_Free( __atomic_exchange_n(&SaganPrefilter, pf, __ATOMIC_SEQ_CST) );
+
+}
+
+/****************************************************************************
+ * Prefilter_Hit - Records that "literal_id" was found in the current line
+ ****************************************************************************/
+
+static inline void Prefilter_Hit( struct _Sagan_Prefilter *pf, int literal_id )
+{
+
+    int i;
+    int rule;
+
+    if ( prefilter_literal_stamp[literal_id] == prefilter_stamp )
+        {
+            return;
+        }
+
+    prefilter_literal_stamp[literal_id] = prefilter_stamp;
+
+    for ( i = pf->ref_start[literal_id]; i < pf->ref_start[literal_id + 1]; i++ )
+        {
+
+            rule = pf->refs[i].rule;
+
+            if ( prefilter_rule_stamp[rule] != prefilter_stamp )
+                {
+                    prefilter_rule_stamp[rule] = prefilter_stamp;
+                    prefilter_rule_mask[rule] = 0;
+                }
+
+            prefilter_rule_mask[rule] |= 1ULL << pf->refs[i].group;
+        }
+}
+
+/****************************************************************************
+ * Prefilter_Header - Works out which rules pass the header filters.  A rule
+ * must accept every field it filters on.
+ ****************************************************************************/
+
+static void Prefilter_Header( struct _Sagan_Prefilter *pf, struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
+
+    struct _Sagan_Prefilter_Header *header = NULL;
+    struct _Sagan_Prefilter_Value *slot = NULL;
+
+    char *value = NULL;
+
+    int f;
+    int i;
+    int rule;
+
+    for ( i = 0; i < pf->rule_words; i++ )
+        {
+            prefilter_eligible[i] = ~0ULL;
+        }
+
+    for ( f = 0; f < PREFILTER_HEADER_FIELDS; f++ )
+        {
+
+            header = &pf->header[f];
+
+            if ( header->used == false )
+                {
+                    continue;
+                }
+
+            value = f == PREFILTER_HEADER_PROGRAM ? SaganProcSyslog_LOCAL->syslog_program :
+                    f == PREFILTER_HEADER_FACILITY ? SaganProcSyslog_LOCAL->syslog_facility :
+                    f == PREFILTER_HEADER_LEVEL ? SaganProcSyslog_LOCAL->syslog_level :
+                    f == PREFILTER_HEADER_TAG ? SaganProcSyslog_LOCAL->syslog_tag : SaganProcSyslog_LOCAL->syslog_priority;
+
+            slot = Prefilter_Header_Find(pf, header, value, false);
+
+            if ( header->wildcard_count == 0 )
+                {
+
+                    for ( i = 0; i < pf->rule_words; i++ )
+                        {
+                            prefilter_eligible[i] &= header->open[i] | ( slot != NULL ? slot->rules[i] : 0 );
+                        }
+
+                    continue;
+                }
+
+            for ( i = 0; i < pf->rule_words; i++ )
+                {
+                    prefilter_field[i] = header->open[i] | ( slot != NULL ? slot->rules[i] : 0 );
+                }
+
+            for ( i = 0; i < header->wildcard_count; i++ )
+                {
+
+                    rule = header->wildcards[i].rule;
+
+                    if ( ( prefilter_field[rule >> 6] & ( 1ULL << ( rule & 63 ) ) ) == 0 &&
+                            Wildcard(header->wildcards[i].pattern, value) == true )
+                        {
+                            prefilter_field[rule >> 6] |= 1ULL << ( rule & 63 );
+                        }
+                }
+
+            for ( i = 0; i < pf->rule_words; i++ )
+                {
+                    prefilter_eligible[i] &= prefilter_field[i];
+                }
+        }
+
+}
+
+/****************************************************************************
+ * Prefilter_Scan - Runs the header fields through the index and the log
+ * line through the automaton one time.  Must be called before
+ * Prefilter_Candidate() for each line.
+ ****************************************************************************/
+
+void Prefilter_Scan( struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
+
+    struct _Sagan_Prefilter *pf = __atomic_load_n(&SaganPrefilter, __ATOMIC_SEQ_CST);
+    const unsigned char *p = NULL;
+
+    int32_t s = 0;
+    int32_t o = 0;
+
+    prefilter_active = pf;
+
+    if ( pf == NULL )
+        {
+            return;
+        }
+
+    /* New automaton (start up or reload),  resize our scratch space */
+
+    if ( prefilter_thread_generation != pf->generation )
+        {
+
+            prefilter_literal_stamp = realloc(prefilter_literal_stamp, (pf->literal_count + 1) * sizeof(uint32_t));
+            prefilter_rule_stamp = realloc(prefilter_rule_stamp, (pf->rule_count + 1) * sizeof(uint32_t));
+            prefilter_rule_mask = realloc(prefilter_rule_mask, (pf->rule_count + 1) * sizeof(uint64_t));
+            prefilter_eligible = realloc(prefilter_eligible, pf->rule_words * sizeof(uint64_t));
+            prefilter_field = realloc(prefilter_field, pf->rule_words * sizeof(uint64_t));
+
+            if ( prefilter_literal_stamp == NULL || prefilter_rule_stamp == NULL || prefilter_rule_mask == NULL ||
+                    prefilter_eligible == NULL || prefilter_field == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for prefilter scan state. Abort!", __FILE__, __LINE__);
+                }
+
+            memset(prefilter_literal_stamp, 0, (pf->literal_count + 1) * sizeof(uint32_t));
+            memset(prefilter_rule_stamp, 0, (pf->rule_count + 1) * sizeof(uint32_t));
+
+            prefilter_stamp = 0;
+            prefilter_thread_generation = pf->generation;
+        }
+
+    prefilter_stamp++;
+
+    if ( prefilter_stamp == 0 )
+        {
+            memset(prefilter_literal_stamp, 0, (pf->literal_count + 1) * sizeof(uint32_t));
+            memset(prefilter_rule_stamp, 0, (pf->rule_count + 1) * sizeof(uint32_t));
+            prefilter_stamp = 1;
+        }
+
+    if ( pf->header_used == true )
+        {
+            Prefilter_Header(pf, SaganProcSyslog_LOCAL);
+        }
+
+    for ( p = (const unsigned char *)SaganProcSyslog_LOCAL->syslog_message; *p != '\0'; p++ )
+        {
+
+            s = pf->delta[ (size_t)s * pf->class_count + pf->byte_class[*p] ];
+
+            for ( o = pf->output[s] >= 0 ? s : pf->dict[s]; o != 0; o = pf->dict[o] )
+                {
+                    Prefilter_Hit(pf, pf->output[o]);
+                }
+        }
+
+}
+
+/****************************************************************************
+ * Prefilter_Candidate - Returns true if the rule at "rule_position" needs
+ * the full evaluation for the line last passed to Prefilter_Scan()
+ ****************************************************************************/
+
+bool Prefilter_Candidate( int rule_position )
+{
+
+    struct _Sagan_Prefilter *pf = prefilter_active;
+
+    /* Rules added by "dynamic_load" since the last build have no header
+       entries yet.  They wait for the rebuild after the batch rather than
+       run unfiltered */
+
+    if ( pf == NULL || rule_position >= pf->rule_count )
+        {
+            return(false);
+        }
+
+    if ( pf->header_used == true &&
+            ( prefilter_eligible[rule_position >> 6] & ( 1ULL << ( rule_position & 63 ) ) ) == 0 )
+        {
+            return(false);
+        }
+
+    if ( pf->required[rule_position] == 0 )
+        {
+            return(true);
+        }
+
+    if ( prefilter_rule_stamp[rule_position] != prefilter_stamp )
+        {
+            return(false);
+        }
+
+    return( prefilter_rule_mask[rule_position] == pf->required[rule_position] );
+
+}
@@ -0,0 +1,118 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#define PREFILTER_MAX_GROUPS	64	/* Bits in the per-rule "required" mask */
+
+/* Header fields rules can filter on */
+
+#define PREFILTER_HEADER_PROGRAM	0
+#define PREFILTER_HEADER_FACILITY	1
+#define PREFILTER_HEADER_LEVEL		2
+#define PREFILTER_HEADER_TAG		3
+#define PREFILTER_HEADER_PRIORITY	4
+#define PREFILTER_HEADER_FIELDS		5
+
+void Prefilter_Build( void );
+void Prefilter_Scan( struct _Sagan_Proc_Syslog * );
+bool Prefilter_Candidate( int );
+
+/* A literal can be "required" by several rules.  Each reference records
+   which rule and which content/meta_content "group" of that rule the literal
+   satisfies */
+
+typedef struct _Sagan_Prefilter_Ref _Sagan_Prefilter_Ref;
+struct _Sagan_Prefilter_Ref
+{
+    int rule;
+    unsigned char group;
+};
+
+/* Header index.  Exact values are hashed to the bitmap of rules that accept
+   them,  "program" values with * or ? are kept in a short list and checked
+   with Wildcard() */
+
+typedef struct _Sagan_Prefilter_Value _Sagan_Prefilter_Value;
+struct _Sagan_Prefilter_Value
+{
+    char *value;			/* NULL == empty slot */
+    uint64_t *rules;			/* rule_words */
+};
+
+typedef struct _Sagan_Prefilter_Wildcard _Sagan_Prefilter_Wildcard;
+struct _Sagan_Prefilter_Wildcard
+{
+    char *pattern;
+    int rule;
+};
+
+typedef struct _Sagan_Prefilter_Header _Sagan_Prefilter_Header;
+struct _Sagan_Prefilter_Header
+{
+    bool used;				/* Some rule filters on this field */
+    uint64_t *open;			/* Rules that don't filter on it */
+
+    uint32_t table_size;		/* Power of two */
+    uint32_t value_count;
+    _Sagan_Prefilter_Value *table;	/* Open addressing */
+
+    int wildcard_count;
+    _Sagan_Prefilter_Wildcard *wildcards;
+};
+
+typedef struct _Sagan_Prefilter _Sagan_Prefilter;
+struct _Sagan_Prefilter
+{
+
+    uint32_t generation;
+
+    /* Aho-Corasick DFA over a case folded,  compressed alphabet */
+
+    unsigned char byte_class[256];
+    int class_count;
+
+    int state_count;
+    int32_t *delta;			/* state_count * class_count */
+    int32_t *output;			/* Literal ending at state, -1 == none */
+    int32_t *dict;			/* Next state on the failure chain with output, 0 == none */
+
+    /* Literal -> rule references (CSR) */
+
+    int literal_count;
+    int *ref_start;			/* literal_count + 1 */
+    _Sagan_Prefilter_Ref *refs;
+
+    /* Per rule mask of groups that must be seen.  0 == rule has no
+       positive literal and is always evaluated */
+
+    int rule_count;
+    int filtered_count;
+    uint64_t *required;
+
+    /* Bitmaps of rules,  one bit per rule */
+
+    int rule_words;
+    bool header_used;
+    _Sagan_Prefilter_Header header[PREFILTER_HEADER_FIELDS];
+
+};
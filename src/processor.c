@@ -44,6 +44,8 @@
 #include "sagan-config.h"
 #include "input-pipe.h"
 #include "parsers/parsers.h"
+#include "batch-queue.h"
+#include "processor.h"
 
 #ifdef HAVE_LIBFASTJSON
 #include "input-json.h"
@@ -56,15 +58,18 @@
 #include "processors/dynamic-rules.h"
 #include "processors/client-stats.h"
 
+#ifdef WITH_BLUEDOT
+#include "processors/bluedot.h"
+#endif
+
 struct _SaganCounters *counters;
 struct _Sagan_Proc_Syslog *SaganProcSyslog;
-struct _Sagan_Pass_Syslog *SaganPassSyslog;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
 
 
-int proc_msgslot; 		/* Comes from sagan.c */
 int proc_running;   	        /* Comes from sagan.c */
+bool dynamic_rules_rebuild;	/* Set by Sagan_Dynamic_Rules() */
 
 bool dynamic_rule_flag = NORMAL_RULE;
 uint32_t dynamic_line_count = 0;
@@ -72,11 +77,14 @@ uint32_t dynamic_line_count = 0;
 
 bool death=false;
 
-pthread_cond_t SaganProcDoWork;
-pthread_mutex_t SaganProcWorkMutex;
-
 pthread_cond_t SaganReloadCond;
 pthread_mutex_t SaganReloadMutex;
+pthread_mutex_t SaganRulesLoadedMutex;
+
+/* Signalled when the last busy processor thread finishes its batch
+   during a reload,  see Processor_Reload_Begin() */
+
+static pthread_cond_t SaganProcIdleCond = PTHREAD_COND_INITIALIZER;
 
 pthread_mutex_t SaganDynamicFlag;
 
@@ -101,64 +109,67 @@ void Processor ( void )
 
 
     struct _Sagan_Pass_Syslog *SaganPassSyslog_LOCAL = NULL;
-    SaganPassSyslog_LOCAL = malloc(sizeof(struct _Sagan_Pass_Syslog));
-
-    if ( SaganPassSyslog_LOCAL == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganPassSyslog_LOCAL. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganPassSyslog_LOCAL, 0, sizeof(struct _Sagan_Pass_Syslog));
 
     int i;
 
     while(death == false)
         {
 
-            pthread_mutex_lock(&SaganProcWorkMutex);
+            /* The batch is ours until Batch_Queue_Release() */
 
-            while ( proc_msgslot == 0 ) pthread_cond_wait(&SaganProcDoWork, &SaganProcWorkMutex);
+            SaganPassSyslog_LOCAL = Batch_Queue_Take();
 
-            if ( config->sagan_reload )
+            if ( SaganPassSyslog_LOCAL == NULL )
                 {
-                    pthread_cond_wait(&SaganReloadCond, &SaganReloadMutex);
+                    continue; 		/* Shutting down */
                 }
 
-            proc_msgslot--;     /* This was ++ before coming over, so we now -- it to get to
-                                 * original value */
-
+            /* Counted as running before the reload flag is looked at.  A
+               reload either sees us in "proc_running" and waits for this
+               batch,  or we see the flag and wait for the reload */
 
-            /* Copy inbound array from global to local */
-
-            for (i=0; i < config->max_batch; i++)
+            for (;;)
                 {
 
+                    __atomic_add_fetch(&proc_running, 1, __ATOMIC_SEQ_CST);
 
-                    if (debug->debugsyslog)
+                    if ( __atomic_load_n(&config->sagan_reload, __ATOMIC_SEQ_CST) == false )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] [batch position %d] Raw log: %s",  __FILE__, __LINE__, i, SaganPassSyslog[proc_msgslot].syslog[i]);
+                            break;
                         }
 
-                    strlcpy(SaganPassSyslog_LOCAL->syslog[i],  SaganPassSyslog[proc_msgslot].syslog[i], sizeof(SaganPassSyslog_LOCAL->syslog[i]));
-                }
+                    pthread_mutex_lock(&SaganReloadMutex);
 
+                    if ( __atomic_sub_fetch(&proc_running, 1, __ATOMIC_SEQ_CST) == 0 )
+                        {
+                            pthread_cond_broadcast(&SaganProcIdleCond);
+                        }
 
-            pthread_mutex_unlock(&SaganProcWorkMutex);
+                    while ( config->sagan_reload )
+                        {
+                            pthread_cond_wait(&SaganReloadCond, &SaganReloadMutex);
+                        }
 
-            __atomic_add_fetch(&proc_running, 1, __ATOMIC_SEQ_CST);
+                    pthread_mutex_unlock(&SaganReloadMutex);
+                }
 
-            /* Process local syslog buffer */
+            /* Process the batch */
 
-            for (i=0; i < config->max_batch; i++)
+            for (i=0; i < SaganPassSyslog_LOCAL->count; i++)
                 {
 
+                    if (debug->debugsyslog)
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] [batch position %d] Raw log: %s",  __FILE__, __LINE__, i, BATCH_LINE(SaganPassSyslog_LOCAL, i));
+                        }
+
                     if ( config->input_type == INPUT_PIPE )
                         {
-                            SyslogInput_Pipe( SaganPassSyslog_LOCAL->syslog[i], SaganProcSyslog_LOCAL );
+                            SyslogInput_Pipe( BATCH_LINE(SaganPassSyslog_LOCAL, i), SaganProcSyslog_LOCAL );
                         }
                     else
                         {
-                            SyslogInput_JSON( SaganPassSyslog_LOCAL->syslog[i], SaganProcSyslog_LOCAL );
+                            SyslogInput_JSON( BATCH_LINE(SaganPassSyslog_LOCAL, i), SaganProcSyslog_LOCAL );
                         }
 
                     if (debug->debugsyslog)
@@ -183,7 +194,7 @@ void Processor ( void )
                                 }
                         }
 
-                    (void)Sagan_Engine(SaganProcSyslog_LOCAL, dynamic_rule_flag );
+                    (void)Sagan_Engine(SaganProcSyslog_LOCAL, dynamic_rule_flag, -1 );
 
                     /* If this is a dynamic run,  reset back to normal */
 
@@ -227,7 +238,44 @@ void Processor ( void )
 
                 }
 
-            __atomic_sub_fetch(&proc_running, 1, __ATOMIC_SEQ_CST);
+#ifdef WITH_BLUEDOT
+
+            /* Lines the Bluedot thread handed back after a deferred lookup */
+
+            if ( SaganPassSyslog_LOCAL->deferred != NULL )
+                {
+                    Sagan_Bluedot_Deferred_Run( SaganPassSyslog_LOCAL->deferred );
+                    SaganPassSyslog_LOCAL->deferred = NULL;
+                }
+
+#endif
+
+            Batch_Queue_Release( SaganPassSyslog_LOCAL );
+
+            if ( __atomic_sub_fetch(&proc_running, 1, __ATOMIC_SEQ_CST) == 0 &&
+                    __atomic_load_n(&config->sagan_reload, __ATOMIC_SEQ_CST) == true )
+                {
+                    pthread_mutex_lock(&SaganReloadMutex);
+                    pthread_cond_broadcast(&SaganProcIdleCond);
+                    pthread_mutex_unlock(&SaganReloadMutex);
+                }
+
+            /* "dynamic_load" added rules while we were on the batch.  The
+               prefilter and hot table are rebuilt once every thread is
+               between batches,  like on a SIGHUP.  Until then the new
+               rules are not evaluated */
+
+            if ( __atomic_exchange_n(&dynamic_rules_rebuild, false, __ATOMIC_SEQ_CST) == true )
+                {
+
+                    Processor_Reload_Begin();
+
+                    pthread_mutex_lock(&SaganRulesLoadedMutex);
+                    Sagan_Engine_Init();
+                    pthread_mutex_unlock(&SaganRulesLoadedMutex);
+
+                    Processor_Reload_End();
+                }
 
         } /*  for (;;) */
 
@@ -239,3 +287,43 @@ void Processor ( void )
 
 }
 
+/****************************************************************************
+ * Processor_Reload_Begin - Waits for any other reload to finish,  sets
+ * config->sagan_reload and returns once no processor thread is in the
+ * middle of a batch,  so the rule tables can be rebuilt and the old ones
+ * freed.  Batches taken from now on wait for Processor_Reload_End().
+ * Must not be called from inside a batch.
+ ****************************************************************************/
+
+void Processor_Reload_Begin( void )
+{
+
+    pthread_mutex_lock(&SaganReloadMutex);
+
+    while ( config->sagan_reload )
+        {
+            pthread_cond_wait(&SaganReloadCond, &SaganReloadMutex);
+        }
+
+    __atomic_store_n(&config->sagan_reload, true, __ATOMIC_SEQ_CST);
+
+    while ( __atomic_load_n(&proc_running, __ATOMIC_SEQ_CST) > 0 )
+        {
+            pthread_cond_wait(&SaganProcIdleCond, &SaganReloadMutex);
+        }
+
+}
+
+/****************************************************************************
+ * Processor_Reload_End - Lets the processor threads go again
+ ****************************************************************************/
+
+void Processor_Reload_End( void )
+{
+
+    __atomic_store_n(&config->sagan_reload, false, __ATOMIC_SEQ_CST);
+
+    pthread_cond_broadcast(&SaganReloadCond);
+    pthread_mutex_unlock(&SaganReloadMutex);
+
+}
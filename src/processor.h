@@ -24,3 +24,5 @@
 
 
 void Processor ( void );
+void Processor_Reload_Begin( void );
+void Processor_Reload_End( void );
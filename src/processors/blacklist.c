@@ -32,11 +32,13 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <pthread.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <inttypes.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -48,7 +50,10 @@
 struct _SaganCounters *counters;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
-struct _Sagan_Blacklist *SaganBlacklist;
+/* Lookups read SaganBlacklist without a lock.  Loads happen at start up
+   or during a reload,  when no processor thread is looking anything up */
+
+struct _Sagan_Blacklist_Table *SaganBlacklist = NULL;
 
 
 /****************************************************************************
@@ -63,8 +68,26 @@ void Sagan_Blacklist_Init ( void )
 }
 
 /****************************************************************************
- * Sagan_Blacklist_Load - Loads 32 bit IP addresses into memory so that they
- * can be queried later
+ * Sagan_Blacklist_Compare - qsort() order for ranges,  by start then end
+ ****************************************************************************/
+
+static int Sagan_Blacklist_Compare ( const void *a, const void *b )
+{
+
+    const struct _Sagan_Blacklist *ra = a;
+    const struct _Sagan_Blacklist *rb = b;
+
+    int rc = memcmp(ra->start, rb->start, MAXIPBIT);
+
+    return( rc != 0 ? rc : memcmp(ra->end, rb->end, MAXIPBIT) );
+
+}
+
+/****************************************************************************
+ * Sagan_Blacklist_Load - Loads IP addresses/networks into memory so that
+ * they can be queried later.  Each entry becomes the range of addresses it
+ * covers,  and the ranges are sorted and merged so a lookup is a binary
+ * search.
  ****************************************************************************/
 
 void Sagan_Blacklist_Load ( void )
@@ -81,7 +104,14 @@ void Sagan_Blacklist_Load ( void )
     char *ptmp = NULL;
 
     unsigned char ipbits[MAXIPBIT] = { 0 };
-    unsigned char maskbits[MAXIPBIT]= { 0 };
+
+    struct _Sagan_Blacklist *range = NULL;
+    struct _Sagan_Blacklist_Table *table = NULL;
+    struct _Sagan_Blacklist_Table *old = NULL;
+
+    int range_count = 0;
+    int range_size = 0;
+    int duplicates = 0;
 
     int line_count;
     int item_count;
@@ -121,18 +151,23 @@ void Sagan_Blacklist_Load ( void )
                     else
                         {
 
-                            /* Allocate memory for Blacklists,  not comments */
+                            /* Allocate memory for Blacklists,  not comments.  Grow
+                               by doubling,  feeds can be millions of lines */
 
                             line_count++;
 
-                            SaganBlacklist = (_Sagan_Blacklist *) realloc(SaganBlacklist, (counters->blacklist_count+1) * sizeof(_Sagan_Blacklist));
-
-                            if ( SaganBlacklist == NULL )
+                            if ( range_count == range_size )
                                 {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for SaganBlacklist. Abort!", __FILE__, __LINE__);
-                                }
 
-                            memset(&SaganBlacklist[counters->blacklist_count], 0, sizeof(_Sagan_Blacklist));
+                                    range_size = range_size == 0 ? 1024 : range_size * 2;
+
+                                    range = (_Sagan_Blacklist *) realloc(range, range_size * sizeof(_Sagan_Blacklist));
+
+                                    if ( range == NULL )
+                                        {
+                                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for SaganBlacklist. Abort!", __FILE__, __LINE__);
+                                        }
+                                }
 
                             Remove_Return(blacklistbuf);
 
@@ -145,12 +180,12 @@ void Sagan_Blacklist_Load ( void )
                             if ( tmpmask == NULL )
                                 {
 
-                                    /* If there is no CIDR,  then assume it's a /32 */
+                                    /* If there is no CIDR,  then it's a single address */
 
                                     strlcpy(tmp, iprange, sizeof(tmp));
                                     iprange = tmp;
-                                    mask = 32;
-                                    tmpmask = "32";
+                                    mask = strchr(iprange, ':') == NULL ? 32 : 128;
+                                    tmpmask = mask == 32 ? "32" : "128";
                                 }
                             else
                                 {
@@ -168,7 +203,7 @@ void Sagan_Blacklist_Load ( void )
                                     found = 1;
                                 }
 
-                            if ( mask == 0 || !Mask2Bit(mask, maskbits))
+                            if ( mask < 1 || mask > 128 )
                                 {
 
                                     Sagan_Log(ERROR, "[%s, line %d] Invalid mask in %s at line %d, skipping....", __FILE__, __LINE__, blacklist_filename, line_count);
@@ -176,18 +211,11 @@ void Sagan_Blacklist_Load ( void )
 
                                 }
 
-                            /* Record lower and upper range based on the /CIDR.  We then use IP2Bit(ipaddr) to determine
-                             * if it's within the blacklist range.
-                             *
-                             * Idea came from "ashitpro"
-                             * http://bytes.com/topic/c/answers/765104-determining-whether-given-ip-exist-cidr-ip-range
-                             *
-                             */
-
-
                             if ( found == 0 )
                                 {
 
+                                    memset(ipbits, 0, sizeof(ipbits));
+
                                     if (!IP2Bit(iprange, ipbits))
                                         {
 
@@ -195,31 +223,25 @@ void Sagan_Blacklist_Load ( void )
                                             found = 1;
 
                                         }
-                                    else
-                                        {
-                                            for ( i = 0; i < counters->blacklist_count; i++ )
-                                                {
-
-                                                    if ( !memcmp(SaganBlacklist[i].range.ipbits, ipbits, MAXIPBIT ) &&
-                                                            !memcmp(SaganBlacklist[i].range.maskbits, maskbits, MAXIPBIT ) )
-                                                        {
-                                                            Sagan_Log(WARN, "[%s, line %d] Got duplicate blacklist address %s/%s in %s on line %d, skipping....", __FILE__, __LINE__, iprange, tmpmask, blacklist_filename, line_count);
-                                                            found = 1;
-                                                        }
-                                                }
-                                        }
                                 }
 
+                            /* The range is the address with the bits past the mask
+                               cleared (start) and set (end) */
+
                             if ( found == 0 )
                                 {
 
-                                    memcpy(SaganBlacklist[counters->blacklist_count].range.ipbits, ipbits, sizeof(ipbits));
-                                    memcpy(SaganBlacklist[counters->blacklist_count].range.maskbits, maskbits, sizeof(maskbits));
+                                    for ( i = 0; i < MAXIPBIT; i++ )
+                                        {
 
-                                    item_count++;
+                                            unsigned char maskbyte = mask >= ( i + 1 ) * 8 ? 0xff : mask <= i * 8 ? 0x00 : (unsigned char)( 0xff << ( 8 - ( mask - i * 8 ) ) );
 
-                                    __atomic_add_fetch(&counters->blacklist_count, 1, __ATOMIC_SEQ_CST);
+                                            range[range_count].start[i] = ipbits[i] & maskbyte;
+                                            range[range_count].end[i] = ipbits[i] | ~maskbyte;
+                                        }
 
+                                    range_count++;
+                                    item_count++;
 
                                 }
                         }
@@ -227,14 +249,109 @@ void Sagan_Blacklist_Load ( void )
 
             fclose(blacklist);
 
-            Sagan_Log(NORMAL, "Blacklist Processor Loaded File: %s (File: %d, Total: %d)", blacklist_filename, item_count, counters->blacklist_count++);
+            Sagan_Log(NORMAL, "Blacklist Processor Loaded File: %s (File: %d, Total: %d)", blacklist_filename, item_count, range_count);
 
             blacklist_filename = strtok_r(NULL, ",", &ptmp);
 
         }
 
+    /* Sort,  drop duplicates and merge ranges that overlap */
+
+    qsort(range, range_count, sizeof(_Sagan_Blacklist), Sagan_Blacklist_Compare);
+
+    table = malloc(sizeof(_Sagan_Blacklist_Table));
+
+    if ( table == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBlacklist. Abort!", __FILE__, __LINE__);
+        }
+
+    table->count = 0;
+    table->range = range;
+
+    for ( i = 0; i < range_count; i++ )
+        {
+
+            if ( i > 0 && !memcmp(&range[i], &range[i-1], sizeof(_Sagan_Blacklist)) )
+                {
+                    duplicates++;
+                    continue;
+                }
+
+            __atomic_add_fetch(&counters->blacklist_count, 1, __ATOMIC_SEQ_CST);
+
+            if ( table->count > 0 && memcmp(range[i].start, range[table->count-1].end, MAXIPBIT) <= 0 )
+                {
+
+                    if ( memcmp(range[i].end, range[table->count-1].end, MAXIPBIT) > 0 )
+                        {
+                            memcpy(range[table->count-1].end, range[i].end, MAXIPBIT);
+                        }
+
+                    continue;
+                }
+
+            memcpy(&range[table->count], &range[i], sizeof(_Sagan_Blacklist));
+            table->count++;
+        }
+
+    if ( duplicates > 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Skipped %d duplicate blacklist entries.", __FILE__, __LINE__, duplicates);
+        }
+
+    Sagan_Log(NORMAL, "Blacklist Processor: %" PRIu64 " entries in %d ranges.", counters->blacklist_count, table->count);
+
+    /* Swap the new table in */
+
+    old = __atomic_exchange_n(&SaganBlacklist, table, __ATOMIC_SEQ_CST);
+
+    if ( old != NULL )
+        {
+            free(old->range);
+            free(old);
+        }
+
 }
 
+/***************************************************************************
+ * Sagan_Blacklist_Search - Binary search for the range covering ipaddr.
+ ***************************************************************************/
+
+static bool Sagan_Blacklist_Search ( struct _Sagan_Blacklist_Table *table, unsigned char *ipaddr )
+{
+
+    int low = 0;
+    int high = 0;
+    int mid = 0;
+
+    if ( table == NULL )
+        {
+            return(false);
+        }
+
+    high = table->count - 1;
+
+    /* Find the last range starting at or below ipaddr */
+
+    while ( low <= high )
+        {
+
+            mid = low + ( high - low ) / 2;
+
+            if ( memcmp(table->range[mid].start, ipaddr, MAXIPBIT) <= 0 )
+                {
+                    low = mid + 1;
+                }
+            else
+                {
+                    high = mid - 1;
+                }
+        }
+
+    return( high >= 0 && memcmp(ipaddr, table->range[high].end, MAXIPBIT) <= 0 );
+
+}
 
 /***************************************************************************
  * Sagan_Blacklist_IPADDR - Looks up the IP address in the Blacklist
@@ -244,20 +361,14 @@ void Sagan_Blacklist_Load ( void )
 bool Sagan_Blacklist_IPADDR ( unsigned char *ipaddr )
 {
 
-    int i = 0;
-
     counters->blacklist_lookup_count++;
 
-    for ( i = 0; i < counters->blacklist_count; i++)
+    if ( Sagan_Blacklist_Search( __atomic_load_n(&SaganBlacklist, __ATOMIC_ACQUIRE), ipaddr ) )
         {
 
-            if ( is_inrange(ipaddr, (unsigned char *)&SaganBlacklist[i].range, 1) )
-                {
-
-                    __atomic_add_fetch(&counters->blacklist_hit_count, 1, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&counters->blacklist_hit_count, 1, __ATOMIC_SEQ_CST);
 
-                    return(true);
-                }
+            return(true);
         }
 
     return(false);
@@ -272,26 +383,22 @@ bool Sagan_Blacklist_IPADDR ( unsigned char *ipaddr )
 bool Sagan_Blacklist_IPADDR_All ( char *syslog_message, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size )
 {
 
+    struct _Sagan_Blacklist_Table *table = __atomic_load_n(&SaganBlacklist, __ATOMIC_ACQUIRE);
+
     int i;
-    int b;
 
     for (i = 0; i < lookup_cache_size; i++)
         {
 
-            for ( b = 0; b < counters->blacklist_count; b++ )
+            if ( Sagan_Blacklist_Search( table, lookup_cache[i].ip_bits ) )
                 {
 
-                    if ( is_inrange(lookup_cache[i].ip_bits, (unsigned char *)&SaganBlacklist[b].range, 1) )
-                        {
-
-                            __atomic_add_fetch(&counters->blacklist_hit_count, 1, __ATOMIC_SEQ_CST);
+                    __atomic_add_fetch(&counters->blacklist_hit_count, 1, __ATOMIC_SEQ_CST);
 
-                            return(true);
-                        }
+                    return(true);
                 }
 
         }
 
     return(false);
 }
-
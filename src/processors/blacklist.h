@@ -25,15 +25,24 @@ void Sagan_Blacklist_Init( void );
 bool Sagan_Blacklist_IPADDR( unsigned char * );
 bool Sagan_Blacklist_IPADDR_All ( char *, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size );
 
+/* A blacklist entry as the range of addresses it covers.  IPv4 and IPv6
+   use the same 16 byte layout IP2Bit() produces,  so the bytes compare
+   in address order. */
+
 typedef struct _Sagan_Blacklist _Sagan_Blacklist;
 struct _Sagan_Blacklist
 {
+    unsigned char start[MAXIPBIT];
+    unsigned char end[MAXIPBIT];
+};
 
-    struct
-    {
-        unsigned char ipbits[MAXIPBIT];
-        unsigned char maskbits[MAXIPBIT];
-    } range;
+/* The loaded blacklist.  Overlapping entries are merged,  so "range" is
+   disjoint and sorted by start. */
 
+typedef struct _Sagan_Blacklist_Table _Sagan_Blacklist_Table;
+struct _Sagan_Blacklist_Table
+{
+    int count;
+    struct _Sagan_Blacklist *range;
 };
 
@@ -40,13 +40,23 @@
 #include <curl/curl.h>
 #include <json.h>
 #include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/prctl.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
 #include "rules.h"
+#include "rules-hot.h"
+#include "util-time.h"
+#include "batch-queue.h"
 
 #include "processors/bluedot.h"
+#include "processors/engine.h"
 
 #include "parsers/parsers.h"
 
@@ -55,289 +65,419 @@ struct _SaganConfig *config;
 struct _SaganDebug *debug;
 struct _Sagan_Bluedot_Skip *Bluedot_Skip;
 
-struct _Sagan_Bluedot_IP_Cache *SaganBluedotIPCache = NULL;
-struct _Sagan_Bluedot_Hash_Cache *SaganBluedotHashCache = NULL;
-struct _Sagan_Bluedot_URL_Cache *SaganBluedotURLCache = NULL;
-struct _Sagan_Bluedot_Filename_Cache *SaganBluedotFilenameCache = NULL;
-struct _Sagan_Bluedot_JA3_Cache *SaganBluedotJA3Cache = NULL;
+struct _Sagan_Bluedot_Cache *SaganBluedotIPCache = NULL;
+struct _Sagan_Bluedot_Cache *SaganBluedotHashCache = NULL;
+struct _Sagan_Bluedot_Cache *SaganBluedotURLCache = NULL;
+struct _Sagan_Bluedot_Cache *SaganBluedotFilenameCache = NULL;
+struct _Sagan_Bluedot_Cache *SaganBluedotJA3Cache = NULL;
 
 struct _Sagan_Bluedot_Cat_List *SaganBluedotCatList = NULL;
 
-struct _Sagan_Bluedot_IP_Queue *SaganBluedotIPQueue = NULL;
-struct _Sagan_Bluedot_Hash_Queue *SaganBluedotHashQueue = NULL;
-struct _Sagan_Bluedot_URL_Queue *SaganBluedotURLQueue = NULL;
-struct _Sagan_Bluedot_Filename_Queue *SaganBluedotFilenameQueue = NULL;
-struct _Sagan_Bluedot_JA3_Queue *SaganBluedotJA3Queue = NULL;
+/* Cache misses waiting on the Bluedot thread,  see Sagan_Bluedot_Queue() */
 
-struct _Rule_Struct *rulestruct;
+struct _Sagan_Bluedot_Pending **SaganBluedotPending = NULL;
+struct _Sagan_Bluedot_Pending *SaganBluedotSendHead = NULL;
+struct _Sagan_Bluedot_Pending *SaganBluedotSendTail = NULL;
 
-pthread_mutex_t SaganProcBluedotWorkMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t CounterBluedotGenericMutex=PTHREAD_MUTEX_INITIALIZER;
+/* Answered deferred lines not yet handed to a processor thread */
 
-pthread_mutex_t SaganProcBluedotIPWorkMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t SaganProcBluedotHashWorkMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t SaganProcBluedotURLWorkMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t SaganProcBluedotFilenameWorkMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t SaganProcBluedotJA3WorkMutex=PTHREAD_MUTEX_INITIALIZER;
+struct _Sagan_Bluedot_Deferred *SaganBluedotReady = NULL;
 
+int SaganBluedotDeferredCount = 0;
+int SaganBluedotWake[2] = { -1, -1 };		/* Pokes curl_multi_wait() */
 
-bool bluedot_cache_clean_lock=0;
-bool bluedot_dns_global=0;
+/* This rule was already deferred on this line.  A rule with two lookups
+   missing waits on the first,  the second is looked up again when the
+   rule is run again.  See Sagan_Bluedot_Defer_Reset() */
+
+static __thread bool bluedot_rule_deferred = false;
+
+struct RuleBody *RuleBody;
+
+bool death;
+
+pthread_mutex_t SaganBluedotPendingMutex=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t SaganBluedotPendingCond=PTHREAD_COND_INITIALIZER;
 
 /****************************************************************************
- * Sagan_Bluedot_Init() - init's some global variables and other items
- * that need to be done only once. - Champ Clark 05/15/2013
+ * Sagan_Bluedot_Cache_Create - Allocates a lookup cache of "max_cache"
+ * entries spread over BLUEDOT_CACHE_SHARDS shards.
  ****************************************************************************/
 
-void Sagan_Bluedot_Init(void)
+static struct _Sagan_Bluedot_Cache *Sagan_Bluedot_Cache_Create( uint64_t max_cache, uint64_t *count, bool nocase )
 {
 
-    char  timet[20] = { 0 };
+    struct _Sagan_Bluedot_Cache *cache = NULL;
+    struct _Sagan_Bluedot_Cache_Shard *shard = NULL;
 
-    time_t t;
-    struct tm *now = NULL;
+    uint32_t capacity = ( max_cache + BLUEDOT_CACHE_SHARDS - 1 ) / BLUEDOT_CACHE_SHARDS;
+    int i;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    if ( capacity == 0 )
+        {
+            capacity = 1;
+        }
 
-    config->bluedot_last_time = atol(timet);
+    cache = calloc(1, sizeof(_Sagan_Bluedot_Cache));
 
-    /* Bluedot IP Cache */
+    if ( cache == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot cache. Abort!", __FILE__, __LINE__);
+        }
 
-    SaganBluedotIPCache = malloc(config->bluedot_ip_max_cache * sizeof(struct _Sagan_Bluedot_IP_Cache));
+    cache->nocase = nocase;
+    cache->count = count;
 
-    if ( SaganBluedotIPCache == NULL )
+    for ( i = 0; i < BLUEDOT_CACHE_SHARDS; i++ )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotIPCache. Abort!", __FILE__, __LINE__);
-        }
 
-    memset(SaganBluedotIPCache, 0, config->bluedot_ip_max_cache * sizeof(_Sagan_Bluedot_IP_Cache));
+            shard = &cache->shard[i];
 
-    /* Bluedot Hash Cache */
+            pthread_mutex_init(&shard->lock, NULL);
 
-    SaganBluedotHashCache = malloc(config->bluedot_hash_max_cache * sizeof(struct _Sagan_Bluedot_Hash_Cache));
+            shard->capacity = capacity;
 
-    if ( SaganBluedotHashCache == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotHashCache. Abort!", __FILE__, __LINE__);
+            for ( shard->bucket_size = 1; shard->bucket_size < capacity; shard->bucket_size <<= 1 );
+
+            shard->bucket = calloc(shard->bucket_size, sizeof(uint32_t));
+            shard->entry = calloc(capacity + 1, sizeof(_Sagan_Bluedot_Cache_Entry));
+
+            if ( shard->bucket == NULL || shard->entry == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot cache. Abort!", __FILE__, __LINE__);
+                }
         }
 
-    memset(SaganBluedotHashCache, 0, config->bluedot_hash_max_cache * sizeof(_Sagan_Bluedot_Hash_Cache));
+    return(cache);
+
+}
+
+/****************************************************************************
+ * Sagan_Bluedot_Cache_Hash - FNV-1a over the key.  IP keys are IP2Bit()
+ * bits,  so this goes by length and not '\0'.
+ ****************************************************************************/
 
-    /* Bluedot URL Cache */
+static inline uint64_t Sagan_Bluedot_Cache_Hash( const char *key, uint32_t key_length, bool nocase )
+{
 
-    SaganBluedotURLCache = malloc(config->bluedot_url_max_cache * sizeof(struct _Sagan_Bluedot_URL_Cache));
+    uint64_t hash = 14695981039346656037ULL;
+    uint32_t i;
 
-    if ( SaganBluedotURLCache == NULL )
+    for ( i = 0; i < key_length; i++ )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotURLCache. Abort!", __FILE__, __LINE__);
+            hash = ( hash ^ (unsigned char)( nocase ? tolower((unsigned char)key[i]) : key[i] ) ) * 1099511628211ULL;
         }
 
-    memset(SaganBluedotURLCache, 0, config->bluedot_url_max_cache * sizeof(_Sagan_Bluedot_URL_Cache));
+    return(hash);
 
-    /* Bluedot Filename Cache */
+}
+
+/****************************************************************************
+ * Sagan_Bluedot_Cache_Find - Returns the entry for "key" in "shard",  0 if
+ * it's not there.  "link" is set to the slot pointing at it.  Shard must be
+ * locked.
+ ****************************************************************************/
 
-    SaganBluedotFilenameCache = malloc(config->bluedot_filename_max_cache * sizeof(struct _Sagan_Bluedot_Filename_Cache));
+static uint32_t Sagan_Bluedot_Cache_Find( struct _Sagan_Bluedot_Cache *cache, struct _Sagan_Bluedot_Cache_Shard *shard, uint64_t hash, const char *key, uint32_t key_length, uint32_t **link )
+{
+
+    struct _Sagan_Bluedot_Cache_Entry *entry = NULL;
+    uint32_t e;
 
-    if ( SaganBluedotFilenameCache == NULL )
+    *link = &shard->bucket[ hash & ( shard->bucket_size - 1 ) ];
+
+    for ( e = **link; e != 0; e = entry->next )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotFilenameCache. Abort!", __FILE__, __LINE__);
+
+            entry = &shard->entry[e];
+
+            if ( entry->hash == hash && entry->key_length == key_length &&
+                    ( cache->nocase ? !strncasecmp(entry->key, key, key_length) : !memcmp(entry->key, key, key_length) ) )
+                {
+                    return(e);
+                }
+
+            *link = &entry->next;
         }
 
-    memset(SaganBluedotFilenameCache, 0, config->bluedot_filename_max_cache * sizeof(_Sagan_Bluedot_Filename_Cache));
+    return(0);
+
+}
+
+/****************************************************************************
+ * Sagan_Bluedot_Cache_LRU_Unlink / Sagan_Bluedot_Cache_LRU_Push - Take an
+ * entry off the LRU list and put one on the "most recently used" end.
+ ****************************************************************************/
+
+static inline void Sagan_Bluedot_Cache_LRU_Unlink( struct _Sagan_Bluedot_Cache_Shard *shard, uint32_t e )
+{
 
-    /* Bluedot JA3 Cache */
+    struct _Sagan_Bluedot_Cache_Entry *entry = &shard->entry[e];
 
-    SaganBluedotJA3Cache = malloc(config->bluedot_ja3_max_cache * sizeof(struct _Sagan_Bluedot_JA3_Cache));
+    if ( entry->lru_prev != 0 )
+        {
+            shard->entry[entry->lru_prev].lru_next = entry->lru_next;
+        }
+    else
+        {
+            shard->lru_head = entry->lru_next;
+        }
 
-    if ( SaganBluedotJA3Cache == NULL )
+    if ( entry->lru_next != 0 )
+        {
+            shard->entry[entry->lru_next].lru_prev = entry->lru_prev;
+        }
+    else
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotJA3Cache. Abort!", __FILE__, __LINE__);
+            shard->lru_tail = entry->lru_prev;
         }
 
-    memset(SaganBluedotJA3Cache, 0, config->bluedot_ja3_max_cache * sizeof(_Sagan_Bluedot_JA3_Cache));
+    entry->lru_prev = 0;
+    entry->lru_next = 0;
 
-    /* ------------------ Queues ------------------------------------------------------ */
+}
 
-    /* Bluedot IP Queue */
+static inline void Sagan_Bluedot_Cache_LRU_Push( struct _Sagan_Bluedot_Cache_Shard *shard, uint32_t e )
+{
 
-    SaganBluedotIPQueue = malloc(config->bluedot_ip_queue * sizeof(struct _Sagan_Bluedot_IP_Queue));
+    shard->entry[e].lru_prev = 0;
+    shard->entry[e].lru_next = shard->lru_head;
 
-    if ( SaganBluedotIPQueue == NULL )
+    if ( shard->lru_head != 0 )
+        {
+            shard->entry[shard->lru_head].lru_prev = e;
+        }
+    else
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotIPQueue. Abort!", __FILE__, __LINE__);
+            shard->lru_tail = e;
         }
 
-    memset(SaganBluedotIPQueue, 0, config->bluedot_ip_queue * sizeof(_Sagan_Bluedot_IP_Queue));
+    shard->lru_head = e;
+
+}
+
+/****************************************************************************
+ * Sagan_Bluedot_Cache_Remove - Unlinks entry "e" ("link" points at it) and
+ * puts it on the free list.  Shard must be locked.
+ ****************************************************************************/
 
+static void Sagan_Bluedot_Cache_Remove( struct _Sagan_Bluedot_Cache *cache, struct _Sagan_Bluedot_Cache_Shard *shard, uint32_t e, uint32_t *link )
+{
 
-    /* Bluedot Hash Queue */
+    struct _Sagan_Bluedot_Cache_Entry *entry = &shard->entry[e];
 
-    SaganBluedotHashQueue = malloc(config->bluedot_hash_queue * sizeof(struct _Sagan_Bluedot_Hash_Queue));
+    *link = entry->next;
 
-    if ( SaganBluedotHashQueue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotHashQueue. Abort!", __FILE__, __LINE__);
-        }
+    Sagan_Bluedot_Cache_LRU_Unlink(shard, e);
 
-    memset(SaganBluedotHashQueue, 0, config->bluedot_hash_queue * sizeof(_Sagan_Bluedot_Hash_Queue));
+    free(entry->key);
+    entry->key = NULL;
+    entry->key_length = 0;
 
-    /* Bluedot URL Queue */
+    entry->next = shard->free;
+    shard->free = e;
 
-    SaganBluedotURLQueue = malloc(config->bluedot_url_queue * sizeof(struct _Sagan_Bluedot_URL_Queue));
+    __atomic_sub_fetch(cache->count, 1, __ATOMIC_SEQ_CST);
 
-    if ( SaganBluedotURLQueue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotURLQueue. Abort!", __FILE__, __LINE__);
-        }
+}
 
-    memset(SaganBluedotURLQueue, 0, config->bluedot_url_queue * sizeof(_Sagan_Bluedot_URL_Queue));
+/****************************************************************************
+ * Sagan_Bluedot_Cache_Get - Looks "key" up.  On a hit the entry becomes the
+ * most recently used and its results are copied out.  Entries past
+ * "cache-timeout" are dropped here and count as a miss.
+ ****************************************************************************/
 
-    /* Bluedot Filename Queue */
+static bool Sagan_Bluedot_Cache_Get( struct _Sagan_Bluedot_Cache *cache, const char *key, uint32_t key_length, uint64_t epoch_time,
+                                     int *alertid, uint64_t *mdate_utime, uint64_t *cdate_utime, char *bluedot_str, size_t bluedot_size )
+{
 
-    SaganBluedotFilenameQueue = malloc(config->bluedot_filename_queue * sizeof(struct _Sagan_Bluedot_Filename_Queue));
+    struct _Sagan_Bluedot_Cache_Shard *shard = NULL;
+    struct _Sagan_Bluedot_Cache_Entry *entry = NULL;
 
-    if ( SaganBluedotFilenameQueue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotFilenameQueue. Abort!", __FILE__, __LINE__);
-        }
+    uint64_t hash = Sagan_Bluedot_Cache_Hash(key, key_length, cache->nocase);
+    uint32_t *link = NULL;
+    uint32_t e;
 
-    memset(SaganBluedotFilenameQueue, 0, config->bluedot_filename_queue * sizeof(_Sagan_Bluedot_Filename_Queue));
+    shard = &cache->shard[ hash >> 60 ];
 
-    /* Bluedot JA3 Queue */
+    pthread_mutex_lock(&shard->lock);
 
-    SaganBluedotJA3Queue = malloc(config->bluedot_ja3_queue * sizeof(struct _Sagan_Bluedot_JA3_Queue));
+    e = Sagan_Bluedot_Cache_Find(cache, shard, hash, key, key_length, &link);
 
-    if ( SaganBluedotJA3Queue == NULL )
+    if ( e == 0 )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotJA3Queue. Abort!", __FILE__, __LINE__);
+            pthread_mutex_unlock(&shard->lock);
+            return(false);
         }
 
-    memset(SaganBluedotJA3Queue, 0, config->bluedot_ja3_queue * sizeof(_Sagan_Bluedot_JA3_Queue));
+    entry = &shard->entry[e];
 
-}
+    if ( entry->cache_utime + config->bluedot_timeout < epoch_time )
+        {
+            Sagan_Bluedot_Cache_Remove(cache, shard, e, link);
+            pthread_mutex_unlock(&shard->lock);
+            return(false);
+        }
+
+    Sagan_Bluedot_Cache_LRU_Unlink(shard, e);
+    Sagan_Bluedot_Cache_LRU_Push(shard, e);
+
+    *alertid = entry->alertid;
+    *mdate_utime = entry->mdate_utime;
+    *cdate_utime = entry->cdate_utime;
+
+    snprintf(bluedot_str, bluedot_size, "%s", entry->bluedot_json);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return(true);
 
+}
 
 /****************************************************************************
- * Sagan_Bluedot_Clean_Queue - Clean's the "queue" of the type of lookup
- * that happened.  This is called after a successful lookup.  We do this to
- * prevent multiple lookups (at the same time!) of the same item!  This
- * happens a lot with IP address looks
+ * Sagan_Bluedot_Cache_Peek - True if "key" is cached.  Leaves the LRU
+ * order alone.
  ****************************************************************************/
 
-int Sagan_Bluedot_Clean_Queue ( char *data, unsigned char type )
+static bool Sagan_Bluedot_Cache_Peek( struct _Sagan_Bluedot_Cache *cache, const char *key, uint32_t key_length )
 {
 
-    int i=0;
+    struct _Sagan_Bluedot_Cache_Shard *shard = NULL;
 
-    unsigned char ip_convert[MAXIPBIT] = { 0 };
+    uint64_t hash = Sagan_Bluedot_Cache_Hash(key, key_length, cache->nocase);
+    uint32_t *link = NULL;
+    uint32_t e;
 
-    if ( type == BLUEDOT_LOOKUP_IP )
-        {
+    shard = &cache->shard[ hash >> 60 ];
 
-            IP2Bit(data, ip_convert);
+    pthread_mutex_lock(&shard->lock);
+    e = Sagan_Bluedot_Cache_Find(cache, shard, hash, key, key_length, &link);
+    pthread_mutex_unlock(&shard->lock);
 
-            for (i=0; i<config->bluedot_ip_queue; i++)
-                {
+    return( e != 0 );
 
-                    if ( !memcmp(ip_convert, SaganBluedotIPQueue[i].ip, MAXIPBIT) )
-                        {
+}
 
-                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-                            memset(SaganBluedotIPQueue[i].ip, 0, MAXIPBIT);
-                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+/****************************************************************************
+ * Sagan_Bluedot_Cache_Put - Stores a lookup result.  If the shard is full,
+ * the least recently used entry is reused.
+ ****************************************************************************/
 
-                        }
+static void Sagan_Bluedot_Cache_Put( struct _Sagan_Bluedot_Cache *cache, const char *key, uint32_t key_length, uint64_t epoch_time,
+                                     int alertid, uint64_t mdate_utime, uint64_t cdate_utime, const char *bluedot_json )
+{
 
-                }
+    struct _Sagan_Bluedot_Cache_Shard *shard = NULL;
+    struct _Sagan_Bluedot_Cache_Entry *entry = NULL;
 
-            __atomic_sub_fetch(&counters->bluedot_ip_queue_current, 1, __ATOMIC_SEQ_CST);
+    uint64_t hash = Sagan_Bluedot_Cache_Hash(key, key_length, cache->nocase);
+    uint32_t *link = NULL;
+    uint32_t e;
 
-        }
+    shard = &cache->shard[ hash >> 60 ];
+
+    pthread_mutex_lock(&shard->lock);
+
+    e = Sagan_Bluedot_Cache_Find(cache, shard, hash, key, key_length, &link);
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
+    if ( e == 0 )
         {
 
-            for (i=0; i<config->bluedot_hash_queue; i++)
+            if ( shard->free == 0 && shard->used >= shard->capacity )
                 {
 
-                    if ( !strcasecmp(data, SaganBluedotHashQueue[i].hash ) )
-                        {
-
-                            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-                            memset(SaganBluedotHashQueue[i].hash, 0, SHA256_HASH_SIZE+1);
-                            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+                    /* Full,  drop the least recently used */
 
-                        }
+                    e = shard->lru_tail;
+                    Sagan_Bluedot_Cache_Find(cache, shard, shard->entry[e].hash, shard->entry[e].key, shard->entry[e].key_length, &link);
+                    Sagan_Bluedot_Cache_Remove(cache, shard, e, link);
 
+                    __atomic_add_fetch(&counters->bluedot_cache_evicted, 1, __ATOMIC_SEQ_CST);
                 }
 
-            __atomic_sub_fetch(&counters->bluedot_hash_queue_current, 1, __ATOMIC_SEQ_CST);
+            if ( shard->free != 0 )
+                {
+                    e = shard->free;
+                    shard->free = shard->entry[e].next;
+                }
+            else
+                {
+                    e = ++shard->used;
+                }
 
-        }
+            entry = &shard->entry[e];
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
-        {
+            entry->key = malloc(key_length);
 
-            for (i =0; i<config->bluedot_url_queue; i++)
+            if ( entry->key == NULL )
                 {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot cache key. Abort!", __FILE__, __LINE__);
+                }
 
-                    if ( !strcasecmp(data, SaganBluedotURLQueue[i].url ) )
-                        {
+            memcpy(entry->key, key, key_length);
+            entry->key_length = key_length;
+            entry->hash = hash;
 
-                            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-                            memset(SaganBluedotURLQueue[i].url, 0, sizeof(SaganBluedotURLQueue[i].url));
-                            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
-                        }
-                }
+            link = &shard->bucket[ hash & ( shard->bucket_size - 1 ) ];
+            entry->next = *link;
+            *link = e;
 
-            __atomic_sub_fetch(&counters->bluedot_url_queue_current, 1, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(cache->count, 1, __ATOMIC_SEQ_CST);
 
         }
-
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+    else
         {
+            entry = &shard->entry[e];
+            Sagan_Bluedot_Cache_LRU_Unlink(shard, e);
+        }
 
-            for  (i=0; i<config->bluedot_filename_queue; i++)
-                {
-
-                    if ( !strcasecmp(data, SaganBluedotFilenameQueue[i].filename ) )
-                        {
-
-                            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
-                            memset(SaganBluedotFilenameQueue[i].filename, 0, sizeof(SaganBluedotFilenameQueue[i].filename));
-                            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
-                        }
+    Sagan_Bluedot_Cache_LRU_Push(shard, e);
 
-                }
+    entry->cache_utime = epoch_time;
+    entry->mdate_utime = mdate_utime;
+    entry->cdate_utime = cdate_utime;
+    entry->alertid = alertid;
+    strlcpy(entry->bluedot_json, bluedot_json, sizeof(entry->bluedot_json));
 
-            __atomic_sub_fetch(&counters->bluedot_filename_queue_current, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&shard->lock);
 
+}
 
-        }
+/****************************************************************************
+ * Sagan_Bluedot_Init() - init's some global variables and other items
+ * that need to be done only once. - Champ Clark 05/15/2013
+ ****************************************************************************/
 
-    else if ( type == BLUEDOT_LOOKUP_JA3 )
-        {
+void Sagan_Bluedot_Init(void)
+{
 
-            for  (i=0; i<config->bluedot_ja3_queue; i++)
-                {
+    /* Bluedot caches.  Hashes,  URLs,  filenames and JA3 compare without
+       case,  like they always have */
 
-                    if ( !strcasecmp(data, SaganBluedotJA3Queue[i].ja3 ) )
-                        {
+    SaganBluedotIPCache = Sagan_Bluedot_Cache_Create(config->bluedot_ip_max_cache, &counters->bluedot_ip_cache_count, false);
+    SaganBluedotHashCache = Sagan_Bluedot_Cache_Create(config->bluedot_hash_max_cache, &counters->bluedot_hash_cache_count, true);
+    SaganBluedotURLCache = Sagan_Bluedot_Cache_Create(config->bluedot_url_max_cache, &counters->bluedot_url_cache_count, true);
+    SaganBluedotFilenameCache = Sagan_Bluedot_Cache_Create(config->bluedot_filename_max_cache, &counters->bluedot_filename_cache_count, true);
+    SaganBluedotJA3Cache = Sagan_Bluedot_Cache_Create(config->bluedot_ja3_max_cache, &counters->bluedot_ja3_cache_count, true);
 
-                            pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
-                            memset(SaganBluedotJA3Queue[i].ja3, 0, sizeof(SaganBluedotJA3Queue[i].ja3));
-                            pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
-                        }
+    /* Lookups in flight.  The Bluedot thread (Sagan_Bluedot_Handler) does all
+       of the HTTP work */
 
-                }
+    SaganBluedotPending = calloc(BLUEDOT_PENDING_BUCKETS, sizeof(struct _Sagan_Bluedot_Pending *));
 
-            __atomic_sub_fetch(&counters->bluedot_ja3_queue_current, 1, __ATOMIC_SEQ_CST);
+    if ( SaganBluedotPending == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotPending. Abort!", __FILE__, __LINE__);
+        }
 
+    if ( pipe(SaganBluedotWake) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Cannot create the Bluedot wake up pipe: %s. Abort!", __FILE__, __LINE__, strerror(errno));
         }
 
-    return(true);
+    fcntl(SaganBluedotWake[0], F_SETFL, O_NONBLOCK);
+    fcntl(SaganBluedotWake[1], F_SETFL, O_NONBLOCK);
+
 }
 
 /****************************************************************************
@@ -418,321 +558,305 @@ void Sagan_Bluedot_Load_Cat(void)
 }
 
 /****************************************************************************
- * write_callback_func() - Callback for data received via libcurl
+ * write_callback_func() - Callback for data received via libcurl.  The
+ * body can come in more than one piece.
  ****************************************************************************/
 
 size_t static write_callback_func(void *buffer, size_t size, size_t nmemb, void *userp)
 {
-    char **response_ptr =  (char**)userp;
-    *response_ptr = strndup(buffer, (size_t)(size *nmemb));     /* Return the string */
-}
-
-/****************************************************************************
- * Sagan_Bluedot_Clean_Cache() - Cleans cache.  Remove old,  stale entries
- * to make room for new,  fresh entries :)
- ****************************************************************************/
 
-void Sagan_Bluedot_Check_Cache_Time (void)
-{
-
-    time_t t;
-    struct tm *now = NULL;
+    struct _Sagan_Bluedot_Pending *pending = (struct _Sagan_Bluedot_Pending *)userp;
+    size_t length = size * nmemb;
+    char *tmp = NULL;
 
-    char  timet[20] = { 0 };
+    tmp = realloc(pending->response, pending->response_length + length + 1);
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
-    if ( bluedot_cache_clean_lock == 0 && atol(timet) > ( config->bluedot_last_time + config->bluedot_timeout ) )
+    if ( tmp == NULL )
         {
+            return(0);		/* Makes curl fail the transfer */
+        }
 
-            pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-
-            bluedot_cache_clean_lock = 1;
-
-            Sagan_Log(NORMAL, "Bluedot cache timeout reached %d minutes.  Cleaning up.", config->bluedot_timeout / 60);
-            Sagan_Bluedot_Clean_Cache();
+    memcpy(tmp + pending->response_length, buffer, length);
 
-            bluedot_cache_clean_lock = 0;
+    pending->response = tmp;
+    pending->response_length += length;
+    pending->response[pending->response_length] = '\0';
 
-            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
+    return(length);
+}
 
-        }
+/****************************************************************************
+ * Sagan_Bluedot_Type - What goes with each lookup type.  The cache,
+ * counters,  the "*-queue" limit and the query string extension.
+ ****************************************************************************/
 
-    if ( counters->bluedot_ip_cache_count >= config->bluedot_ip_max_cache )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of IP cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
+static struct _Sagan_Bluedot_Cache *Sagan_Bluedot_Type( unsigned char type, uint64_t **cache_hit, uint64_t **total, int **queue_current, int *queue_max, const char **lookup_url )
+{
 
-    if ( counters->bluedot_hash_cache_count >= config->bluedot_hash_max_cache )
+    switch ( type )
         {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of hash cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
 
-    if ( counters->bluedot_url_cache_count >= config->bluedot_url_max_cache )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of URL cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
+        case BLUEDOT_LOOKUP_IP:
+            *cache_hit = &counters->bluedot_ip_cache_hit;
+            *total = &counters->bluedot_ip_total;
+            *queue_current = &counters->bluedot_ip_queue_current;
+            *queue_max = config->bluedot_ip_queue;
+            *lookup_url = BLUEDOT_IP_LOOKUP_URL;
+            return(SaganBluedotIPCache);
+
+        case BLUEDOT_LOOKUP_HASH:
+            *cache_hit = &counters->bluedot_hash_cache_hit;
+            *total = &counters->bluedot_hash_total;
+            *queue_current = &counters->bluedot_hash_queue_current;
+            *queue_max = config->bluedot_hash_queue;
+            *lookup_url = BLUEDOT_HASH_LOOKUP_URL;
+            return(SaganBluedotHashCache);
+
+        case BLUEDOT_LOOKUP_URL:
+            *cache_hit = &counters->bluedot_url_cache_hit;
+            *total = &counters->bluedot_url_total;
+            *queue_current = &counters->bluedot_url_queue_current;
+            *queue_max = config->bluedot_url_queue;
+            *lookup_url = BLUEDOT_URL_LOOKUP_URL;
+            return(SaganBluedotURLCache);
+
+        case BLUEDOT_LOOKUP_FILENAME:
+            *cache_hit = &counters->bluedot_filename_cache_hit;
+            *total = &counters->bluedot_filename_total;
+            *queue_current = &counters->bluedot_filename_queue_current;
+            *queue_max = config->bluedot_filename_queue;
+            *lookup_url = BLUEDOT_FILENAME_LOOKUP_URL;
+            return(SaganBluedotFilenameCache);
+
+        case BLUEDOT_LOOKUP_JA3:
+            *cache_hit = &counters->bluedot_ja3_cache_hit;
+            *total = &counters->bluedot_ja3_total;
+            *queue_current = &counters->bluedot_ja3_queue_current;
+            *queue_max = config->bluedot_ja3_queue;
+            *lookup_url = BLUEDOT_JA3_LOOKUP_URL;
+            return(SaganBluedotJA3Cache);
 
-    if ( counters->bluedot_filename_cache_count >= config->bluedot_filename_max_cache )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of URL cache space! Considering increasing cache size!", __FILE__, __LINE__);
         }
 
-    if ( counters->bluedot_ja3_cache_count >= config->bluedot_ja3_max_cache )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of JA3 cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
+    Sagan_Log(ERROR, "[%s, line %d] Unknown Bluedot lookup type %d. Abort!", __FILE__, __LINE__, type);
 
+    return(NULL);
 }
 
 /****************************************************************************
- * Sagan_Bluedot_Clean_Cache - Cleans old Bluedot entries over the
- * specified "cache_timeout".
+ * Sagan_Bluedot_Pending_Find - Returns the in flight lookup for "key",
+ * NULL if there isn't one.  SaganBluedotPendingMutex must be held.
  ****************************************************************************/
 
-void Sagan_Bluedot_Clean_Cache ( void )
+static struct _Sagan_Bluedot_Pending *Sagan_Bluedot_Pending_Find( unsigned char type, uint64_t hash, const char *key, uint32_t key_length, bool nocase )
 {
 
-    int i;
-    int deleted_count=0;
-
-    int new_bluedot_ip_max_cache = 0;
-    int new_bluedot_hash_max_cache = 0;
-    int new_bluedot_url_max_cache = 0;
-    int new_bluedot_filename_max_cache = 0;
-    int new_bluedot_ja3_max_cache = 0;
-
-    char  timet[20] = { 0 };
-    time_t t;
-    struct tm *now=NULL;
-    uint64_t timeint;
-
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-    timeint = atol(timet);
-
-    if (debug->debugbluedot)
-        {
-            Sagan_Log(DEBUG, "[%s, line %d] Sagan/Bluedot cache clean time has been reached.", __FILE__, __LINE__);
-            Sagan_Log(DEBUG, "[%s, line %d] ----------------------------------------------------------------------", __FILE__, __LINE__);
-        }
-
-    config->bluedot_last_time = timeint;
-
-    deleted_count = 0;
+    struct _Sagan_Bluedot_Pending *pending = NULL;
 
-    for (i=0; i < config->bluedot_ip_max_cache; i++ )
+    for ( pending = SaganBluedotPending[ hash & ( BLUEDOT_PENDING_BUCKETS - 1 ) ]; pending != NULL; pending = pending->next )
         {
 
-            if ( ( timeint - SaganBluedotIPCache[i].cache_utime ) > config->bluedot_timeout )
+            if ( pending->type == type && pending->hash == hash && pending->key_length == key_length &&
+                    ( nocase ? !strncasecmp(pending->key, key, key_length) : !memcmp(pending->key, key, key_length) ) )
                 {
+                    return(pending);
+                }
+        }
 
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting IP address from cache -> %u",  __FILE__, __LINE__, SaganBluedotIPCache[i].ip);
-                        }
+    return(NULL);
+}
 
-                    pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
+/****************************************************************************
+ * Sagan_Bluedot_Queue - Called on a cache miss.  The lookup is handed to
+ * the Bluedot thread unless it's already in flight.  With "miss-policy:
+ * wait" we then wait up to "miss-wait" milliseconds for it and return true
+ * if it was answered (the result is in the cache).  With "defer" a copy of
+ * the line is kept and the rule is run again when the answer comes back.
+ ****************************************************************************/
 
-                    memset(SaganBluedotIPCache[i].ip, 0, MAXIPBIT);
-                    SaganBluedotIPCache[i].mdate_utime = 0;
-                    SaganBluedotIPCache[i].cdate_utime = 0;
-                    SaganBluedotIPCache[i].cache_utime = 0;
-                    SaganBluedotIPCache[i].alertid = 0;
+static bool Sagan_Bluedot_Queue( unsigned char type, const char *key, uint32_t key_length, const char *data, int rule_position, _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
 
-                    pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    struct _Sagan_Bluedot_Cache *cache = NULL;
+    struct _Sagan_Bluedot_Pending *pending = NULL;
+    struct _Sagan_Bluedot_Pending **bucket = NULL;
+    struct _Sagan_Bluedot_Deferred *deferred = NULL;
 
-                    deleted_count++;
+    uint64_t *cache_hit = NULL;
+    uint64_t *total = NULL;
+    int *queue_current = NULL;
+    int queue_max = 0;
+    const char *lookup_url = NULL;
 
-                }
-            else
-                {
+    uint64_t hash;
+    bool new_lookup = false;
 
-                    new_bluedot_ip_max_cache++;
+    struct timespec deadline;
+    int rc = 0;
 
-                }
-        }
+    cache = Sagan_Bluedot_Type(type, &cache_hit, &total, &queue_current, &queue_max, &lookup_url);
+    hash = Sagan_Bluedot_Cache_Hash(key, key_length, cache->nocase);
 
-    pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-    deleted_count = counters->bluedot_ip_cache_count - new_bluedot_ip_max_cache;
-    counters->bluedot_ip_cache_count = new_bluedot_ip_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    pthread_mutex_lock(&SaganBluedotPendingMutex);
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d IP addresses from Bluedot cache. New IP cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_ip_cache_count);
+    pending = Sagan_Bluedot_Pending_Find(type, hash, key, key_length, cache->nocase);
 
-    /* Clean hash cache */
+    /* Answered between the caller's cache miss and here? */
 
-    deleted_count = 0;
+    if ( pending == NULL && Sagan_Bluedot_Cache_Peek(cache, key, key_length) == true )
+        {
+            pthread_mutex_unlock(&SaganBluedotPendingMutex);
+            return(true);
+        }
 
-    for (i=0; i < config->bluedot_hash_max_cache; i++ )
+    if ( pending == NULL )
         {
 
-            if ( ( timeint - SaganBluedotHashCache[i].cache_utime ) > config->bluedot_timeout )
+            if ( *queue_current >= queue_max )
                 {
-
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting Hash address from cache -> %s",  __FILE__, __LINE__, SaganBluedotHashCache[i].hash);
-                        }
-
-                    pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-
-                    memset(SaganBluedotHashCache[i].hash, 0, SHA256_HASH_SIZE+1);
-                    SaganBluedotHashCache[i].cache_utime = 0;
-                    SaganBluedotHashCache[i].alertid = 0;
-
-                    pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
-
-                    deleted_count++;
-
+                    pthread_mutex_unlock(&SaganBluedotPendingMutex);
+                    Sagan_Log(NORMAL, "[%s, line %d] Out of Bluedot queue space for '%s'! Considering increasing the queue size!", __FILE__, __LINE__, data);
+                    return(false);
                 }
-            else
-                {
 
-                    new_bluedot_hash_max_cache++;
+            pending = calloc(1, sizeof(struct _Sagan_Bluedot_Pending));
 
+            if ( pending == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot lookup. Abort!", __FILE__, __LINE__);
                 }
-        }
-
-    pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-    deleted_count = counters->bluedot_hash_cache_count - new_bluedot_hash_max_cache;
-    counters->bluedot_hash_cache_count = new_bluedot_hash_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
-
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d hashes from Bluedot cache. New hash cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_hash_cache_count);
-
-    /* Clean URL cache */
-
-    deleted_count = 0;
 
-    for (i=0; i < config->bluedot_url_max_cache; i++ )
-        {
+            pending->key = malloc(key_length);
+            pending->data = strdup(data);
 
-            if ( ( timeint - SaganBluedotURLCache[i].cache_utime ) > config->bluedot_timeout )
+            if ( pending->key == NULL || pending->data == NULL )
                 {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot lookup. Abort!", __FILE__, __LINE__);
+                }
 
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting URL address from cache -> %s",  __FILE__, __LINE__, SaganBluedotURLCache[i].url);
-                        }
-
-                    pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-
-                    memset(SaganBluedotURLCache[i].url, 0, sizeof(SaganBluedotURLCache[i].url));
-                    SaganBluedotURLCache[i].cache_utime = 0;
-                    SaganBluedotURLCache[i].alertid = 0;
-
-                    pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+            memcpy(pending->key, key, key_length);
+            pending->key_length = key_length;
+            pending->hash = hash;
+            pending->type = type;
 
-                    deleted_count++;
+            bucket = &SaganBluedotPending[ hash & ( BLUEDOT_PENDING_BUCKETS - 1 ) ];
+            pending->next = *bucket;
+            *bucket = pending;
 
+            if ( SaganBluedotSendTail != NULL )
+                {
+                    SaganBluedotSendTail->send_next = pending;
                 }
             else
                 {
-
-                    new_bluedot_url_max_cache++;
-
+                    SaganBluedotSendHead = pending;
                 }
-        }
 
-    pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-    deleted_count = counters->bluedot_url_cache_count - new_bluedot_url_max_cache;
-    counters->bluedot_url_cache_count = new_bluedot_url_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+            SaganBluedotSendTail = pending;
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d URLs from Bluedot cache. New URL cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_url_cache_count);
+            __atomic_add_fetch(queue_current, 1, __ATOMIC_SEQ_CST);
 
-    /* Clean Filename cache */
+            new_lookup = true;
+        }
 
-    deleted_count = 0;
+    else if ( debug->debugbluedot )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up.", __FILE__, __LINE__, data);
+        }
 
-    for (i=0; i < config->bluedot_filename_max_cache; i++ )
+    if ( config->bluedot_defer == true )
         {
 
-            if ( ( timeint - SaganBluedotFilenameCache[i].cache_utime ) > config->bluedot_timeout )
+            if ( SaganProcSyslog_LOCAL != NULL && bluedot_rule_deferred == false )
                 {
 
-                    if (debug->debugbluedot)
+                    if ( __atomic_load_n(&SaganBluedotDeferredCount, __ATOMIC_SEQ_CST) < config->bluedot_max_deferred )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting filename from cache -> %s",  __FILE__, __LINE__, SaganBluedotFilenameCache[i].filename);
-                        }
 
-                    pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+                            deferred = malloc(sizeof(struct _Sagan_Bluedot_Deferred));
 
-                    memset(SaganBluedotFilenameCache[i].filename, 0, sizeof(SaganBluedotFilenameCache[i].filename));
-                    SaganBluedotFilenameCache[i].cache_utime = 0;
-                    SaganBluedotFilenameCache[i].alertid = 0;
+                            if ( deferred == NULL )
+                                {
+                                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for deferred Bluedot rule. Abort!", __FILE__, __LINE__);
+                                }
 
-                    pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+                            /* Processor threads wait out a reload before a
+                               batch,  so this is the table "rule_position"
+                               came from */
 
-                    deleted_count++;
+                            deferred->rule_position = rule_position;
+                            deferred->generation = Rules_Hot_Get()->generation;
+                            memcpy(&deferred->SaganProcSyslog, SaganProcSyslog_LOCAL, sizeof(struct _Sagan_Proc_Syslog));
 
-                }
-            else
-                {
+                            deferred->next = pending->deferred;
+                            pending->deferred = deferred;
 
-                    new_bluedot_filename_max_cache++;
+                            __atomic_add_fetch(&SaganBluedotDeferredCount, 1, __ATOMIC_SEQ_CST);
 
+                            bluedot_rule_deferred = true;
+                        }
+                    else
+                        {
+                            __atomic_add_fetch(&counters->bluedot_deferred_dropped, 1, __ATOMIC_SEQ_CST);
+                        }
                 }
-        }
 
-    pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
-    deleted_count = counters->bluedot_filename_cache_count - new_bluedot_filename_max_cache;
-    counters->bluedot_filename_cache_count = new_bluedot_filename_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+            pthread_mutex_unlock(&SaganBluedotPendingMutex);
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d Filenames from Bluedot cache. New Filename cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_filename_cache_count);
+            if ( new_lookup == true )
+                {
+                    (void)write(SaganBluedotWake[1], "", 1);
+                }
 
-    /* Clean JA3 cache */
+            return(false);
+        }
 
-    deleted_count = 0;
+    pthread_mutex_unlock(&SaganBluedotPendingMutex);
 
-    for (i=0; i < config->bluedot_ja3_max_cache; i++ )
+    if ( new_lookup == true )
         {
+            (void)write(SaganBluedotWake[1], "", 1);
+        }
 
-            if ( ( timeint - SaganBluedotJA3Cache[i].cache_utime ) > config->bluedot_timeout )
-                {
-
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting JA3 from cache -> %s",  __FILE__, __LINE__, SaganBluedotJA3Cache[i].ja3);
-                        }
-
-                    pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
-
-                    memset(SaganBluedotJA3Cache[i].ja3, 0, sizeof(SaganBluedotJA3Cache[i].ja3));
-                    SaganBluedotFilenameCache[i].cache_utime = 0;
-                    SaganBluedotFilenameCache[i].alertid = 0;
+    if ( config->bluedot_wait == 0 )
+        {
+            return(false);
+        }
 
-                    pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
+    clock_gettime(CLOCK_REALTIME, &deadline);
 
-                    deleted_count++;
+    deadline.tv_sec += config->bluedot_wait / 1000;
+    deadline.tv_nsec += ( config->bluedot_wait % 1000 ) * 1000000L;
 
-                }
-            else
-                {
+    if ( deadline.tv_nsec >= 1000000000L )
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
 
-                    new_bluedot_ja3_max_cache++;
+    pthread_mutex_lock(&SaganBluedotPendingMutex);
 
-                }
+    while ( rc == 0 && Sagan_Bluedot_Pending_Find(type, hash, key, key_length, cache->nocase) != NULL )
+        {
+            rc = pthread_cond_timedwait(&SaganBluedotPendingCond, &SaganBluedotPendingMutex, &deadline);
         }
 
-    pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
-    deleted_count = counters->bluedot_ja3_cache_count - new_bluedot_ja3_max_cache;
-    counters->bluedot_ja3_cache_count = new_bluedot_ja3_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
-
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d JA3 hashes from Bluedot cache. New Filename cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_ja3_cache_count);
+    pthread_mutex_unlock(&SaganBluedotPendingMutex);
 
+    if ( rc != 0 )
+        {
+            __atomic_add_fetch(&counters->bluedot_wait_timeout, 1, __ATOMIC_SEQ_CST);
+            return(false);
+        }
 
+    return(true);
 }
 
 /***************************************************************************
- * Sagan_Bluedot_IP_Lookup - This does the actual Bluedot lookup.  It returns
- * the bluedot_alertid value (0 if not found)
+ * Sagan_Bluedot_Lookup - Returns the Bluedot category (bluedot_alertid)
+ * for "data",  0 if not found or not known yet.  Answers come from the
+ * cache.  Misses are looked up by the Bluedot thread,  see
+ * Sagan_Bluedot_Queue()
  ***************************************************************************/
 
 /* type
@@ -744,90 +868,30 @@ void Sagan_Bluedot_Clean_Cache ( void )
  * 5 == JA3
  */
 
-unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, char *bluedot_str, size_t bluedot_size )
+unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, char *bluedot_str, size_t bluedot_size )
 {
 
     unsigned char ip_convert[MAXIPBIT] = { 0 };
 
-    char tmpurl[1024] = { 0 };
-    char tmpdeviceid[64] = { 0 };
-    char bluedot_json[1024] = { 0 };
+    struct _Sagan_Bluedot_Cache *cache = NULL;
 
-    CURL *curl;
-    CURLcode res;
+    uint64_t *cache_hit = NULL;
+    uint64_t *total = NULL;
+    int *queue_current = NULL;
+    int queue_max = 0;
+    const char *lookup_url = NULL;
 
-    struct curl_slist *headers = NULL;
-    char *response=NULL;
+    char *key = data;
+    uint32_t key_length = 0;
+    bool from_cache = true;
 
-    struct json_object *json_in = NULL;
-    json_object *string_obj;
+    int bluedot_alertid = 0;
+    uint64_t mdate_utime = 0;
+    uint64_t cdate_utime = 0;
 
-    const char *cat=NULL;
-    const char *cdate_utime=NULL;
-    const char *mdate_utime=NULL;
-
-    uint64_t cdate_utime_u32;
-    uint64_t mdate_utime_u32;
-
-    signed char bluedot_alertid = 0;		/* -128 to 127 */
     int i;
 
-    char tmp[64] = { 0 };
-
-    char  timet[20] = { 0 };
-    time_t t;
-    struct tm *now=NULL;
-
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
-    uint64_t epoch_time = atol(timet);
-
-    /* Check IP TTL for Bluedot */
-
-    if ( bluedot_dns_global == 0 && epoch_time - config->bluedot_dns_last_lookup > config->bluedot_dns_ttl )
-        {
-
-            if ( debug->debugbluedot )
-                {
-                    Sagan_Log(DEBUG, "[%s, line %d] Bluedot host TTL of %d seconds reached.  Doing new lookup for '%s'.", __FILE__, __LINE__, config->bluedot_dns_ttl, config->bluedot_host);
-                }
-
-
-            pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-            bluedot_dns_global = 1;
-
-            i = DNS_Lookup( config->bluedot_host, tmp, sizeof(tmp) );
-
-            if ( i != 0 )
-                {
-                    Sagan_Log(WARN, "[%s, line %d] Cannot lookup DNS for '%s'.  Staying with old value of %s.", __FILE__, __LINE__, config->bluedot_host, config->bluedot_ip);
-                }
-            else
-                {
-
-                    strlcpy(config->bluedot_ip, tmp, sizeof(config->bluedot_ip));
-
-                    if ( debug->debugbluedot )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Bluedot host IP is now: %s", __FILE__, __LINE__, config->bluedot_ip);
-                        }
-
-                }
-
-            config->bluedot_dns_last_lookup = epoch_time;
-            bluedot_dns_global = 0;
-            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
-
-        }
-
-
-    /************************************************************************/
-    /* Lookup types                                                         */
-    /************************************************************************/
-
-    /* IP Address Lookup */
+    uint64_t epoch_time = Return_Epoch();
 
     if ( type == BLUEDOT_LOOKUP_IP )
         {
@@ -865,643 +929,585 @@ unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_pos
 
                 }
 
+            key = (char *)ip_convert;
+            key_length = MAXIPBIT;
 
-            for (i=0; i<config->bluedot_ip_max_cache; i++)
-                {
-
-                    if (!memcmp( ip_convert, SaganBluedotIPCache[i].ip, MAXIPBIT ))
-                        {
-
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled %s from Bluedot cache with category of \"%d\". [cdate_epoch: %d / mdate_epoch: %d]", __FILE__, __LINE__, data, SaganBluedotIPCache[i].alertid, SaganBluedotIPCache[i].cdate_utime, SaganBluedotIPCache[i].mdate_utime);
-                                }
-
-                            bluedot_alertid = SaganBluedotIPCache[i].alertid;
-
-                            if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_mdate_effective_period != 0 )
-                                {
-
-                                    if ( ( epoch_time - SaganBluedotIPCache[i].mdate_utime ) > rulestruct[rule_position].bluedot_mdate_effective_period )
-                                        {
-
-                                            if ( debug->debugbluedot )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] From Bluedot Cache - mdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_mdate_effective_period);
-                                                }
-
-                                            __atomic_add_fetch(&counters->bluedot_mdate_cache, 1, __ATOMIC_SEQ_CST);
-
-                                            bluedot_alertid = 0;
-                                        }
-                                }
-
-                            else if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_cdate_effective_period != 0 )
-                                {
-
-                                    if ( ( epoch_time - SaganBluedotIPCache[i].cdate_utime ) > rulestruct[rule_position].bluedot_cdate_effective_period )
-                                        {
-
-                                            if ( debug->debugbluedot )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] ctime_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_cdate_effective_period);
-                                                }
-
-                                            __atomic_add_fetch(&counters->bluedot_cdate_cache, 1, __ATOMIC_SEQ_CST);
-
-                                            bluedot_alertid = 0;
-                                        }
-                                }
-
-                            __atomic_add_fetch(&counters->bluedot_ip_cache_hit, 1, __ATOMIC_SEQ_CST);
-
-                            snprintf(bluedot_str, bluedot_size, "%s",  SaganBluedotIPCache[i].bluedot_json);
-                            return(bluedot_alertid);
-
-                        }
-
-                }
-
-            /* Check Bluedot IP Queue,  make sure we aren't looking up something that is already being looked up */
+        }
+    else
+        {
+            key_length = strlen(data);
+        }
 
-            for (i=0; i < config->bluedot_ip_queue; i++)
-                {
-                    if ( !memcmp(ip_convert, SaganBluedotIPQueue[i].ip, MAXIPBIT ))
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s (%u) is already being looked up. Skipping....", __FILE__, __LINE__, data, SaganBluedotIPQueue[i].ip);
-                                }
+    cache = Sagan_Bluedot_Type(type, &cache_hit, &total, &queue_current, &queue_max, &lookup_url);
 
-                            return(false);
-                        }
-                }
+    if ( Sagan_Bluedot_Cache_Get(cache, key, key_length, epoch_time, &bluedot_alertid, &mdate_utime, &cdate_utime, bluedot_str, bluedot_size) )
+        {
+            __atomic_add_fetch(cache_hit, 1, __ATOMIC_SEQ_CST);
+        }
+    else
+        {
 
-            /* If not in Bluedot IP queue,  add it */
+            /* Not cached.  Either wait a bit for the answer or pick the line
+               up again once it's in,  depending on "miss-policy" */
 
-            if ( counters->bluedot_ip_queue_current >= config->bluedot_ip_queue )
+            if ( Sagan_Bluedot_Queue(type, key, key_length, data, rule_position, SaganProcSyslog_LOCAL) == false ||
+                    Sagan_Bluedot_Cache_Get(cache, key, key_length, epoch_time, &bluedot_alertid, &mdate_utime, &cdate_utime, bluedot_str, bluedot_size) == false )
                 {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of IP queue space! Considering increasing cache size!", __FILE__, __LINE__);
                     return(false);
                 }
 
+            from_cache = false;
+        }
 
-            for (i=0; i < config->bluedot_ip_queue; i++)
-                {
-
-                    /* Find an empty slot */
-
-                    if ( SaganBluedotIPQueue[i].ip[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-
-                            memcpy(SaganBluedotIPQueue[i].ip, ip_convert, MAXIPBIT);
-                            counters->bluedot_ip_queue_current++;
-
-                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
-
-                            break;
-
-                        }
-                }
-
-
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_IP_LOOKUP_URL, data);
-
-        }  /* BLUEDOT_LOOKUP_IP */
+    if ( debug->debugbluedot )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Bluedot category \"%d\" for %s%s. [cdate_epoch: %" PRIu64 " / mdate_epoch: %" PRIu64 "]", __FILE__, __LINE__, bluedot_alertid, data, from_cache ? " (cached)" : "", cdate_utime, mdate_utime);
+        }
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
+    if ( type == BLUEDOT_LOOKUP_IP )
         {
 
-            for (i=0; i<counters->bluedot_hash_cache_count; i++)
+            if ( bluedot_alertid != 0 && RuleBody[rule_position].BlueDot.bluedot_mdate_effective_period != 0 )
                 {
 
-                    if (!strcasecmp(data, SaganBluedotHashCache[i].hash))
+                    if ( ( epoch_time - mdate_utime ) > RuleBody[rule_position].BlueDot.bluedot_mdate_effective_period )
                         {
 
-                            if (debug->debugbluedot)
+                            if ( debug->debugbluedot )
                                 {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file hash '%s' from Bluedot hash cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotHashCache[i].alertid);
+                                    Sagan_Log(DEBUG, "[%s, line %d] mdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, RuleBody[rule_position].BlueDot.bluedot_mdate_effective_period);
                                 }
 
-                            __atomic_add_fetch(&counters->bluedot_hash_cache_hit, 1, __ATOMIC_SEQ_CST);
-
-                            snprintf(bluedot_str, bluedot_size, "%s", SaganBluedotHashCache[i].bluedot_json);
-                            return(SaganBluedotHashCache[i].alertid);
-
-                        }
-
-                }
-
-            /* Check Bluedot Hash Queue,  make sure we aren't looking up something that is already being looked up */
-
-            for (i=0; i < config->bluedot_hash_queue; i++)
-                {
-                    if ( !strcasecmp(data, SaganBluedotHashQueue[i].hash ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
+                            __atomic_add_fetch(from_cache ? &counters->bluedot_mdate_cache : &counters->bluedot_mdate, 1, __ATOMIC_SEQ_CST);
 
-                            return(false);
+                            bluedot_alertid = 0;
                         }
                 }
 
-
-            if ( counters->bluedot_hash_queue_current >= config->bluedot_hash_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of hash queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
-                }
-
-            /* If not in Bluedot Hash queue,  add it */
-
-            for (i=0; i < config->bluedot_ip_queue; i++)
+            else if ( bluedot_alertid != 0 && RuleBody[rule_position].BlueDot.bluedot_cdate_effective_period != 0 )
                 {
-                    /* Find an empty slot */
 
-                    if ( SaganBluedotHashQueue[i].hash[0] == 0 )
+                    if ( ( epoch_time - cdate_utime ) > RuleBody[rule_position].BlueDot.bluedot_cdate_effective_period )
                         {
-                            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-
-                            strlcpy(SaganBluedotHashQueue[i].hash, data, sizeof(SaganBluedotHashQueue[i].hash));
-                            counters->bluedot_hash_queue_current++;
 
-                            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+                            if ( debug->debugbluedot )
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] cdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, RuleBody[rule_position].BlueDot.bluedot_cdate_effective_period);
+                                }
 
-                            break;
+                            __atomic_add_fetch(from_cache ? &counters->bluedot_cdate_cache : &counters->bluedot_cdate, 1, __ATOMIC_SEQ_CST);
 
+                            bluedot_alertid = 0;
                         }
                 }
 
-
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_HASH_LOOKUP_URL, data);
         }
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
-        {
+    return(bluedot_alertid);
+}
 
-            for (i=0; i<counters->bluedot_url_cache_count; i++)
-                {
+/***************************************************************************
+ * Sagan_Bluedot_DNS - Looks the Bluedot host up again every "ttl" seconds.
+ ***************************************************************************/
 
-                    if (!strcasecmp(data, SaganBluedotURLCache[i].url))
-                        {
+static void Sagan_Bluedot_DNS( uint64_t epoch_time )
+{
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file URL '%s' from Bluedot URL cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotURLCache[i].alertid);
-                                }
+    char tmp[64] = { 0 };
 
-                            __atomic_add_fetch(&counters->bluedot_url_cache_hit, 1, __ATOMIC_SEQ_CST);
+    if ( epoch_time - config->bluedot_dns_last_lookup <= (uint64_t)config->bluedot_dns_ttl )
+        {
+            return;
+        }
 
-                            snprintf(bluedot_str, bluedot_size, "%s", SaganBluedotURLCache[i].bluedot_json);
-                            return(SaganBluedotURLCache[i].alertid);
+    if ( debug->debugbluedot )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Bluedot host TTL of %d seconds reached.  Doing new lookup for '%s'.", __FILE__, __LINE__, config->bluedot_dns_ttl, config->bluedot_host);
+        }
 
-                        }
+    if ( DNS_Lookup( config->bluedot_host, tmp, sizeof(tmp) ) != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot lookup DNS for '%s'.  Staying with old value of %s.", __FILE__, __LINE__, config->bluedot_host, config->bluedot_ip);
+        }
+    else
+        {
 
+            strlcpy(config->bluedot_ip, tmp, sizeof(config->bluedot_ip));
 
+            if ( debug->debugbluedot )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Bluedot host IP is now: %s", __FILE__, __LINE__, config->bluedot_ip);
                 }
 
-            /* Check Bluedot Hash Queue,  make sure we aren't looking up something that is already being looked up */
-
-            for (i=0; i < config->bluedot_url_queue; i++)
-                {
-                    if ( !strcasecmp(data, SaganBluedotURLQueue[i].url ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
+        }
 
-                            return(false);
-                        }
-                }
+    config->bluedot_dns_last_lookup = epoch_time;
 
+}
 
-            /* If not in Bluedot URL queue,  add it */
+/***************************************************************************
+ * Sagan_Bluedot_Result - Parses what Bluedot returned for "pending" and
+ * stores it in the cache.  Errors aren't cached and return false.
+ ***************************************************************************/
 
-            if ( counters->bluedot_url_queue_current >= config->bluedot_url_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of URL queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
-                }
+static bool Sagan_Bluedot_Result( struct _Sagan_Bluedot_Pending *pending, CURLcode res )
+{
 
+    struct _Sagan_Bluedot_Cache *cache = NULL;
 
-            for (i=0; i < config->bluedot_url_queue; i++)
-                {
+    uint64_t *cache_hit = NULL;
+    uint64_t *total = NULL;
+    int *queue_current = NULL;
+    int queue_max = 0;
+    const char *lookup_url = NULL;
 
-                    /* Find an empty slot */
+    struct json_object *json_in = NULL;
+    json_object *string_obj = NULL;
 
-                    if ( SaganBluedotURLQueue[i].url[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
+    const char *cat=NULL;
+    const char *cdate_utime=NULL;
+    const char *mdate_utime=NULL;
 
-                            strlcpy(SaganBluedotURLQueue[i].url, data, sizeof(SaganBluedotURLQueue[i].url));
-                            counters->bluedot_url_queue_current++;
+    uint64_t cdate_utime_u64 = 0;
+    uint64_t mdate_utime_u64 = 0;
 
-                            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+    signed char bluedot_alertid = 0;		/* -128 to 127 */
 
-                            break;
+    cache = Sagan_Bluedot_Type(pending->type, &cache_hit, &total, &queue_current, &queue_max, &lookup_url);
 
-                        }
-                }
+    if ( res != CURLE_OK || pending->response == NULL )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Bluedot lookup of '%s' failed: %s", __FILE__, __LINE__, pending->data, res != CURLE_OK ? curl_easy_strerror(res) : "empty response");
+            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
+            return(false);
+        }
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_URL_LOOKUP_URL, data);
+    Remove_Return(pending->response);
+    json_in = json_tokener_parse(pending->response);
 
+    if ( json_in == NULL )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Bluedot returned invalid JSON for '%s'.", __FILE__, __LINE__, pending->data);
+            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
+            return(false);
         }
 
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+    if ( pending->type == BLUEDOT_LOOKUP_IP )
         {
 
-            for (i=0; i<counters->bluedot_filename_cache_count; i++)
+            json_object_object_get_ex(json_in, "ctime_epoch", &string_obj);
+            cdate_utime = json_object_get_string(string_obj);
+
+            if ( cdate_utime != NULL )
+                {
+                    cdate_utime_u64 = atol(cdate_utime);
+                }
+            else
                 {
+                    Sagan_Log(WARN, "Bluedot return a bad ctime_epoch.");
+                }
 
-                    if (!strcasecmp(data, SaganBluedotFilenameCache[i].filename))
-                        {
+            string_obj = NULL;
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file filename '%s' from Bluedot filename cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotFilenameCache[i].alertid);
-                                }
+            json_object_object_get_ex(json_in, "mtime_epoch", &string_obj);
+            mdate_utime = json_object_get_string(string_obj);
 
-                            __atomic_add_fetch(&counters->bluedot_filename_cache_hit, 1, __ATOMIC_SEQ_CST);
+            if ( mdate_utime != NULL )
+                {
+                    mdate_utime_u64 = atol(mdate_utime);
+                }
+            else
+                {
+                    Sagan_Log(WARN, "Bluedot return a bad mdate_epoch.");
+                }
 
-                            snprintf(bluedot_str, bluedot_size, "%s",  SaganBluedotFilenameCache[i].bluedot_json);
-                            return(SaganBluedotFilenameCache[i].alertid);
+        }
 
-                        }
+    string_obj = NULL;
 
-                }
+    json_object_object_get_ex(json_in, "code", &string_obj);
+    cat = json_object_get_string(string_obj);
 
-            /* Check Bluedot File Queue,  make sure we aren't looking up something that is already being looked up */
+    if ( cat == NULL )
+        {
+            Sagan_Log(WARN, "Bluedot return a qipcode category.");
 
-            for (i=0; i < config->bluedot_filename_queue; i++)
-                {
-                    if ( !strcasecmp(SaganBluedotFilenameQueue[i].filename, data ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
+            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
 
-                            return(false);
-                        }
-                }
+            json_object_put(json_in);
+            return(false);
+        }
 
+    bluedot_alertid = atoi(cat);
 
-            /* If not in Bluedot Filename queue,  add it */
+    if ( debug->debugbluedot)
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Bluedot return category \"%d\" for %s. [cdate_epoch: %" PRIu64 " / mdate_epoch: %" PRIu64 "]", __FILE__, __LINE__, bluedot_alertid, pending->data, cdate_utime_u64, mdate_utime_u64);
+        }
 
-            if ( counters->bluedot_filename_queue_current >= config->bluedot_filename_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of filename queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
-                }
+    if ( bluedot_alertid == -1 )
+        {
+            Sagan_Log(WARN, "Bluedot reports an invalid API key.  Lookup aborted!");
 
+            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
 
-            for (i=0; i < config->bluedot_filename_queue; i++)
-                {
+            json_object_put(json_in);
+            return(false);
+        }
 
-                    /* Find an empty slot */
+    Sagan_Bluedot_Cache_Put(cache, pending->key, pending->key_length, Return_Epoch(), bluedot_alertid, mdate_utime_u64, cdate_utime_u64, pending->response);
 
-                    if ( SaganBluedotFilenameQueue[i].filename[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+    __atomic_add_fetch(total, 1, __ATOMIC_SEQ_CST);
 
-                            strlcpy(SaganBluedotFilenameQueue[i].filename, data, sizeof(SaganBluedotFilenameQueue[i].filename));
-                            counters->bluedot_filename_queue_current++;
+    json_object_put(json_in);       		/* Clear json_in as we're done with it */
 
-                            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+    return(true);
+}
 
-                            break;
+/***************************************************************************
+ * Sagan_Bluedot_Deferred_Free - Drops a list of deferred lines without
+ * running them
+ ***************************************************************************/
 
-                        }
-                }
+void Sagan_Bluedot_Deferred_Free( struct _Sagan_Bluedot_Deferred *deferred )
+{
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_FILENAME_LOOKUP_URL, data);
-        }
+    struct _Sagan_Bluedot_Deferred *deferred_next = NULL;
 
-    else if ( type == BLUEDOT_LOOKUP_JA3 )
+    for ( ; deferred != NULL; deferred = deferred_next )
         {
+            deferred_next = deferred->next;
 
-            for (i=0; i<counters->bluedot_ja3_cache_count; i++)
-                {
+            __atomic_sub_fetch(&SaganBluedotDeferredCount, 1, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&counters->bluedot_deferred_dropped, 1, __ATOMIC_SEQ_CST);
 
-                    if (!strcasecmp(data, SaganBluedotJA3Cache[i].ja3))
-                        {
+            free(deferred);
+        }
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file JA3 '%s' from Bluedot JA3 cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotJA3Cache[i].alertid);
-                                }
+}
 
-                            __atomic_add_fetch(&counters->bluedot_ja3_cache_hit, 1, __ATOMIC_SEQ_CST);
+/***************************************************************************
+ * Sagan_Bluedot_Deferred_Run - Called by Processor() for a batch the
+ * Bluedot thread queued.  Runs each deferred rule on its line again,
+ * unless the rules were reloaded since and "rule_position" means
+ * something else now.
+ ***************************************************************************/
 
-                            snprintf(bluedot_str, bluedot_size, "%s",  SaganBluedotJA3Cache[i].bluedot_json);
-                            return(SaganBluedotJA3Cache[i].alertid);
+void Sagan_Bluedot_Deferred_Run( struct _Sagan_Bluedot_Deferred *deferred )
+{
 
-                        }
+    struct _Sagan_Bluedot_Deferred *deferred_next = NULL;
+    uint32_t generation = Rules_Hot_Get()->generation;
 
-                }
+    for ( ; deferred != NULL; deferred = deferred_next )
+        {
 
-            /* Check Bluedot JA3 Queue,  make sure we aren't looking up something that is already being looked up */
+            deferred_next = deferred->next;
 
-            for (i=0; i < config->bluedot_ja3_queue; i++)
+            if ( deferred->generation == generation )
                 {
-                    if ( !strcasecmp(SaganBluedotJA3Queue[i].ja3, data ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
-
-                            return(false);
-                        }
+                    (void)Sagan_Engine(&deferred->SaganProcSyslog, DYNAMIC_RULE, deferred->rule_position);
+                    __atomic_add_fetch(&counters->bluedot_deferred, 1, __ATOMIC_SEQ_CST);
                 }
-
-
-            /* If not in Bluedot JA3 queue,  add it */
-
-            if ( counters->bluedot_ja3_queue_current >= config->bluedot_ja3_queue )
+            else
                 {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of JA3 queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
+                    __atomic_add_fetch(&counters->bluedot_deferred_dropped, 1, __ATOMIC_SEQ_CST);
                 }
 
+            __atomic_sub_fetch(&SaganBluedotDeferredCount, 1, __ATOMIC_SEQ_CST);
 
-            for (i=0; i < config->bluedot_ja3_queue; i++)
-                {
+            free(deferred);
+        }
 
-                    /* Find an empty slot */
+}
 
-                    if ( SaganBluedotJA3Queue[i].ja3[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
+/***************************************************************************
+ * Sagan_Bluedot_Defer_Reset - Called by Sagan_Engine() before a rule's
+ * Bluedot lookups.  Until then,  further misses for the rule don't defer
+ * the line again.
+ ***************************************************************************/
 
-                            strlcpy(SaganBluedotJA3Queue[i].ja3, data, sizeof(SaganBluedotJA3Queue[i].ja3));
-                            counters->bluedot_ja3_queue_current++;
+void Sagan_Bluedot_Defer_Reset( void )
+{
+    bluedot_rule_deferred = false;
+}
 
-                            pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
+/***************************************************************************
+ * Sagan_Bluedot_Ready_Send - Hands the ready list to the processor threads
+ * as a batch of its own,  so the rules don't run on (and hold up) the curl
+ * thread.  If every batch buffer is out,  it's tried again on the next
+ * pass.
+ ***************************************************************************/
 
-                            break;
+static void Sagan_Bluedot_Ready_Send( void )
+{
 
-                        }
-                }
+    struct _Sagan_Pass_Syslog *batch = NULL;
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_FILENAME_LOOKUP_URL, data);
+    if ( __atomic_load_n(&SaganBluedotReady, __ATOMIC_SEQ_CST) == NULL )
+        {
+            return;
         }
 
+    batch = Batch_Queue_Try_Get();
 
+    if ( batch == NULL )
+        {
+            return;
+        }
 
-    snprintf(tmpdeviceid, sizeof(tmpdeviceid), "X-BLUEDOT-DEVICEID: %s", config->bluedot_device_id);
+    pthread_mutex_lock(&SaganBluedotPendingMutex);
 
-    /* Do the Bluedot API call */
+    batch->deferred = SaganBluedotReady;
+    SaganBluedotReady = NULL;
 
-    curl = curl_easy_init();
+    pthread_mutex_unlock(&SaganBluedotPendingMutex);
 
-    if (curl)
-        {
+    Batch_Queue_Push(batch);
 
-            curl_easy_setopt(curl, CURLOPT_URL, tmpurl);
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback_func);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-            curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);    /* WIll send SIGALRM if not set */
+}
 
-            headers = NULL;
+/***************************************************************************
+ * Sagan_Bluedot_Done - Takes an answered (or failed) lookup out of the
+ * pending table,  wakes up anyone waiting on it and moves the lines that
+ * were deferred on it to the ready list,  see Sagan_Bluedot_Ready_Send().
+ * If there's no answer they are dropped,  or they'd just miss and defer
+ * again.
+ ***************************************************************************/
 
-            headers = curl_slist_append (headers, BLUEDOT_PROCESSOR_USER_AGENT);
-            headers = curl_slist_append (headers, tmpdeviceid);
-//	    headers = curl_slist_append (headers, "X-Bluedot-Verbose: 1");		/* For more verbose output */
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers );
-            res = curl_easy_perform(curl);
-        }
+static void Sagan_Bluedot_Done( struct _Sagan_Bluedot_Pending *pending, bool answered )
+{
 
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
-    curl_global_cleanup();
+    struct _Sagan_Bluedot_Pending **link = NULL;
+    struct _Sagan_Bluedot_Deferred *deferred = NULL;
+    struct _Sagan_Bluedot_Deferred *deferred_next = NULL;
 
-    if ( response == NULL )
-        {
-            Sagan_Log(WARN, "[%s, line %d] Bluedot returned a empty \"response\".", __FILE__, __LINE__);
+    uint64_t *cache_hit = NULL;
+    uint64_t *total = NULL;
+    int *queue_current = NULL;
+    int queue_max = 0;
+    const char *lookup_url = NULL;
 
-            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
+    (void)Sagan_Bluedot_Type(pending->type, &cache_hit, &total, &queue_current, &queue_max, &lookup_url);
 
-            return(false);
+    pthread_mutex_lock(&SaganBluedotPendingMutex);
+
+    for ( link = &SaganBluedotPending[ pending->hash & ( BLUEDOT_PENDING_BUCKETS - 1 ) ]; *link != NULL; link = &(*link)->next )
+        {
+
+            if ( *link == pending )
+                {
+                    *link = pending->next;
+                    break;
+                }
         }
 
-    Remove_Return(response);
-    json_in = json_tokener_parse(response);
+    deferred = pending->deferred;
+    pending->deferred = NULL;
 
-    strlcpy(bluedot_json, response, sizeof(bluedot_json));              /* Returned for alerts */
+    /* The answer is in the cache now,  so this time the rule gets past the
+       Bluedot check */
 
-    if ( type == BLUEDOT_LOOKUP_IP )
+    if ( answered == true )
         {
 
-            json_object_object_get_ex(json_in, "ctime_epoch", &string_obj);
-            cdate_utime = json_object_get_string(string_obj);
-
-            if ( cdate_utime != NULL )
+            for ( ; deferred != NULL; deferred = deferred_next )
                 {
+                    deferred_next = deferred->next;
+                    deferred->next = SaganBluedotReady;
+                    SaganBluedotReady = deferred;
+                }
+        }
 
-                    cdate_utime_u32 = atol(cdate_utime);
+    __atomic_sub_fetch(queue_current, 1, __ATOMIC_SEQ_CST);
 
-                }
-            else
-                {
+    pthread_cond_broadcast(&SaganBluedotPendingCond);
+    pthread_mutex_unlock(&SaganBluedotPendingMutex);
 
-                    Sagan_Log(WARN, "Bluedot return a bad ctime_epoch.");
+    Sagan_Bluedot_Deferred_Free(deferred);
 
-                }
+    free(pending->key);
+    free(pending->data);
+    free(pending->response);
+    free(pending);
 
-            json_object_object_get_ex(json_in, "mtime_epoch", &string_obj);
-            mdate_utime = json_object_get_string(string_obj);
+}
 
-            if ( mdate_utime != NULL )
-                {
+/***************************************************************************
+ * Sagan_Bluedot_Handler - The Bluedot thread.  Picks up cache misses,
+ * sends them through one curl "multi" handle (connections to the Bluedot
+ * host are kept open and reused,  up to "max-connections" at a time) and
+ * hands the answers back.
+ ***************************************************************************/
 
-                    mdate_utime_u32 = atol(mdate_utime);
+void Sagan_Bluedot_Handler( void )
+{
 
-                }
-            else
-                {
+    (void)SetThreadName("SaganBluedot");
 
-                    Sagan_Log(WARN, "Bluedot return a bad mdate_epoch.");
+    CURLM *multi = NULL;
+    CURLMsg *msg = NULL;
+    CURL *curl = NULL;
 
-                }
+    CURL **idle = NULL;
+    int idle_count = 0;
 
-        }
+    struct curl_slist *headers = NULL;
+    struct curl_waitfd wake;
 
-    json_object_object_get_ex(json_in, "code", &string_obj);
-    cat = json_object_get_string(string_obj);
+    struct _Sagan_Bluedot_Pending *batch = NULL;
+    struct _Sagan_Bluedot_Pending *pending = NULL;
 
-    if ( cat == NULL )
-        {
-            Sagan_Log(WARN, "Bluedot return a qipcode category.");
+    uint64_t *cache_hit = NULL;
+    uint64_t *total = NULL;
+    int *queue_current = NULL;
+    int queue_max = 0;
+    const char *lookup_url = NULL;
 
-            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
+    char tmpurl[1024] = { 0 };
+    char tmpdeviceid[64] = { 0 };
+    char drain[64];
+    char *escaped = NULL;
 
-            return(false);
-        }
+    int running = 0;
+    int msgs_left = 0;
+    int numfds = 0;
 
-    /* strtok_r() doesn't like const char *cat */
+    bool answered = false;
 
-    bluedot_alertid  = atoi(cat);
+    multi = curl_multi_init();
 
-    if ( debug->debugbluedot)
+    if ( multi == NULL )
         {
-            Sagan_Log(DEBUG, "[%s, line %d] Bluedot return category \"%d\" for %s. [cdate_epoch: %d / mdate_epoch: %d]", __FILE__, __LINE__, bluedot_alertid, data, cdate_utime_u32, mdate_utime_u32);
+            Sagan_Log(ERROR, "[%s, line %d] curl_multi_init() failed. Abort!", __FILE__, __LINE__);
         }
 
-    if ( bluedot_alertid == -1 )
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)config->bluedot_max_connections);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)config->bluedot_max_connections);
+
+    idle = malloc(config->bluedot_max_connections * sizeof(CURL *));
+
+    if ( idle == NULL )
         {
-            Sagan_Log(WARN, "Bluedot reports an invalid API key.  Lookup aborted!");
-            counters->bluedot_error_count++;
-            return(false);
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot handles. Abort!", __FILE__, __LINE__);
         }
 
+    snprintf(tmpdeviceid, sizeof(tmpdeviceid), "X-BLUEDOT-DEVICEID: %s", config->bluedot_device_id);
 
-    /************************************************************************/
-    /* Add entries to cache                                                 */
-    /************************************************************************/
+    headers = curl_slist_append (headers, BLUEDOT_PROCESSOR_USER_AGENT);
+    headers = curl_slist_append (headers, tmpdeviceid);
+//  headers = curl_slist_append (headers, "X-Bluedot-Verbose: 1");		/* For more verbose output */
 
-    /* IP Address lookup */
+    wake.fd = SaganBluedotWake[0];
+    wake.events = CURL_WAIT_POLLIN;
 
-    if ( type == BLUEDOT_LOOKUP_IP )
+    while ( death == false )
         {
 
-            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-
-            /* Store data into cache */
+            /* Everything queued since the last pass goes out together */
 
-            memcpy(SaganBluedotIPCache[counters->bluedot_ip_cache_count].ip, ip_convert, MAXIPBIT);
-            strlcpy(SaganBluedotIPCache[counters->bluedot_ip_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotIPCache[counters->bluedot_ip_cache_count].bluedot_json));
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].cache_utime = epoch_time;                   /* store utime */
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].cdate_utime = cdate_utime_u32;
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].mdate_utime = mdate_utime_u32;
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].alertid = bluedot_alertid;
+            pthread_mutex_lock(&SaganBluedotPendingMutex);
 
-            counters->bluedot_ip_total++;
-            counters->bluedot_ip_cache_count++;
+            batch = SaganBluedotSendHead;
+            SaganBluedotSendHead = NULL;
+            SaganBluedotSendTail = NULL;
 
-            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+            pthread_mutex_unlock(&SaganBluedotPendingMutex);
 
-            if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_mdate_effective_period != 0 )
+            if ( batch != NULL )
                 {
-
-                    if ( ( epoch_time - mdate_utime_u32 ) > rulestruct[rule_position].bluedot_mdate_effective_period )
-                        {
-
-                            if ( debug->debugbluedot )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] mdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_mdate_effective_period);
-                                }
-
-                            __atomic_add_fetch(&counters->bluedot_mdate, 1, __ATOMIC_SEQ_CST);
-
-                            bluedot_alertid = 0;
-                        }
+                    Sagan_Bluedot_DNS( Return_Epoch() );
                 }
 
-            else if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_cdate_effective_period != 0 )
+            while ( batch != NULL )
                 {
 
-                    if ( ( epoch_time - cdate_utime_u32 ) > rulestruct[rule_position].bluedot_cdate_effective_period )
-                        {
-
-                            if ( debug->debugbluedot )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] cdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_cdate_effective_period);
-                                }
+                    pending = batch;
+                    batch = batch->send_next;
 
-                            __atomic_add_fetch(&counters->bluedot_cdate, 1, __ATOMIC_SEQ_CST);
+                    (void)Sagan_Bluedot_Type(pending->type, &cache_hit, &total, &queue_current, &queue_max, &lookup_url);
 
+                    curl = idle_count > 0 ? idle[--idle_count] : curl_easy_init();
 
-                            bluedot_alertid = 0;
+                    if ( curl == NULL )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] curl_easy_init() failed. Dropping Bluedot lookup of '%s'.", __FILE__, __LINE__, pending->data);
+                            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
+                            Sagan_Bluedot_Done(pending, false);
+                            continue;
                         }
-                }
 
-        }
+                    escaped = curl_easy_escape(curl, pending->data, 0);
 
-    /* File hash lookup */
+                    snprintf(tmpurl, sizeof(tmpurl), "http://%s:%d/%s%s%s", config->bluedot_ip, config->bluedot_port, config->bluedot_uri, lookup_url, escaped != NULL ? escaped : pending->data);
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
-        {
+                    curl_free(escaped);
 
-            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
+                    pending->curl = curl;
 
-            counters->bluedot_hash_total++;
+                    curl_easy_setopt(curl, CURLOPT_URL, tmpurl);
+                    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback_func);
+                    curl_easy_setopt(curl, CURLOPT_WRITEDATA, pending);
+                    curl_easy_setopt(curl, CURLOPT_PRIVATE, pending);
+                    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+                    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);    /* WIll send SIGALRM if not set */
+                    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+                    curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long)config->bluedot_http_timeout);
 
-            strlcpy(SaganBluedotHashCache[counters->bluedot_hash_cache_count].hash, data, sizeof(SaganBluedotHashCache[counters->bluedot_hash_cache_count].hash));
-            strlcpy(SaganBluedotHashCache[counters->bluedot_hash_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotHashCache[counters->bluedot_hash_cache_count].bluedot_json));
-            SaganBluedotHashCache[counters->bluedot_hash_cache_count].cache_utime = epoch_time;
-            SaganBluedotHashCache[counters->bluedot_hash_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_hash_cache_count++;
+                    curl_multi_add_handle(multi, curl);
 
-            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+                }
 
-        }
+            curl_multi_perform(multi, &running);
 
-    /* URL lookup */
+            while ( ( msg = curl_multi_info_read(multi, &msgs_left) ) != NULL )
+                {
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
-        {
-            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
+                    if ( msg->msg != CURLMSG_DONE )
+                        {
+                            continue;
+                        }
 
-            counters->bluedot_url_total++;
+                    curl = msg->easy_handle;
+                    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&pending);
 
-            strlcpy(SaganBluedotURLCache[counters->bluedot_url_cache_count].url, data, sizeof(SaganBluedotURLCache[counters->bluedot_url_cache_count].url));
-            strlcpy(SaganBluedotURLCache[counters->bluedot_url_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotURLCache[counters->bluedot_url_cache_count].bluedot_json));
-            SaganBluedotURLCache[counters->bluedot_url_cache_count].cache_utime = epoch_time;
-            SaganBluedotURLCache[counters->bluedot_url_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_url_cache_count++;
+                    answered = Sagan_Bluedot_Result(pending, msg->data.result);
 
-            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+                    curl_multi_remove_handle(multi, curl);
 
-        }
+                    if ( idle_count < config->bluedot_max_connections )
+                        {
+                            curl_easy_reset(curl);
+                            idle[idle_count++] = curl;
+                        }
+                    else
+                        {
+                            curl_easy_cleanup(curl);
+                        }
 
-    /* Filename Lookup */
+                    Sagan_Bluedot_Done(pending, answered);
 
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
-        {
+                }
 
-            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+            Sagan_Bluedot_Ready_Send();
 
-            counters->bluedot_filename_total++;
+            curl_multi_wait(multi, &wake, 1, 1000, &numfds);
 
-            strlcpy(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].filename, data, sizeof(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].filename));
-            strlcpy(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].bluedot_json));
-            SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].cache_utime = epoch_time;
-            SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_filename_cache_count++;
+            while ( read(SaganBluedotWake[0], drain, sizeof(drain)) > 0 );
 
-            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
         }
 
-    /* JA3 Lookup */
-
-    else if ( type == BLUEDOT_LOOKUP_JA3 )
+    while ( idle_count > 0 )
         {
-
-            pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
-
-            counters->bluedot_ja3_total++;
-
-            strlcpy(SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].ja3, data, sizeof(SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].ja3));
-            strlcpy(SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].bluedot_json));
-            SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].cache_utime = epoch_time;
-            SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_ja3_cache_count++;
-
-            pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
+            curl_easy_cleanup(idle[--idle_count]);
         }
 
-    Sagan_Bluedot_Clean_Queue(data, type);	/* Remove item for "queue" */
-
-    json_object_put(json_in);       		/* Clear json_in as we're done with it */
+    free(idle);
+    curl_slist_free_all(headers);
+    curl_multi_cleanup(multi);
 
-    snprintf(bluedot_str, bluedot_size, "%s", bluedot_json);
+    pthread_exit(NULL);
 
-    return(bluedot_alertid);
 }
 
 /***************************************************************************
@@ -1517,10 +1523,10 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
     if ( type == BLUEDOT_LOOKUP_IP )
         {
 
-            for ( i = 0; i < rulestruct[rule_position].bluedot_ip_cat_count; i++ )
+            for ( i = 0; i < RuleBody[rule_position].BlueDot.bluedot_ip_cat_count; i++ )
                 {
 
-                    if ( bluedot_results == rulestruct[rule_position].bluedot_ip_cats[i] )
+                    if ( bluedot_results == RuleBody[rule_position].BlueDot.bluedot_ip_cats[i] )
                         {
 
                             __atomic_add_fetch(&counters->bluedot_ip_positive_hit, 1, __ATOMIC_SEQ_CST);
@@ -1535,10 +1541,10 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
 
     if ( type == BLUEDOT_LOOKUP_HASH )
         {
-            for ( i = 0; i < rulestruct[rule_position].bluedot_hash_cat_count; i++ )
+            for ( i = 0; i < RuleBody[rule_position].BlueDot.bluedot_hash_cat_count; i++ )
                 {
 
-                    if ( bluedot_results == rulestruct[rule_position].bluedot_hash_cats[i] )
+                    if ( bluedot_results == RuleBody[rule_position].BlueDot.bluedot_hash_cats[i] )
                         {
                             __atomic_add_fetch(&counters->bluedot_hash_positive_hit, 1, __ATOMIC_SEQ_CST);
 
@@ -1550,10 +1556,10 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
 
     if ( type == BLUEDOT_LOOKUP_URL )
         {
-            for ( i = 0; i < rulestruct[rule_position].bluedot_url_cat_count; i++ )
+            for ( i = 0; i < RuleBody[rule_position].BlueDot.bluedot_url_cat_count; i++ )
                 {
 
-                    if ( bluedot_results == rulestruct[rule_position].bluedot_url_cats[i] )
+                    if ( bluedot_results == RuleBody[rule_position].BlueDot.bluedot_url_cats[i] )
                         {
 
                             __atomic_add_fetch(&counters->bluedot_url_positive_hit, 1, __ATOMIC_SEQ_CST);
@@ -1566,10 +1572,10 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
 
     if ( type == BLUEDOT_LOOKUP_FILENAME )
         {
-            for ( i = 0; i < rulestruct[rule_position].bluedot_filename_cat_count; i++ )
+            for ( i = 0; i < RuleBody[rule_position].BlueDot.bluedot_filename_cat_count; i++ )
                 {
 
-                    if ( bluedot_results == rulestruct[rule_position].bluedot_filename_cats[i] )
+                    if ( bluedot_results == RuleBody[rule_position].BlueDot.bluedot_filename_cats[i] )
                         {
                             __atomic_add_fetch(&counters->bluedot_filename_positive_hit, 1, __ATOMIC_SEQ_CST);
 
@@ -1583,10 +1589,10 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
 
     if ( type == BLUEDOT_LOOKUP_JA3 )
         {
-            for ( i = 0; i < rulestruct[rule_position].bluedot_ja3_cat_count; i++ )
+            for ( i = 0; i < RuleBody[rule_position].BlueDot.bluedot_ja3_cat_count; i++ )
                 {
 
-                    if ( bluedot_results == rulestruct[rule_position].bluedot_ja3_cats[i] )
+                    if ( bluedot_results == RuleBody[rule_position].BlueDot.bluedot_ja3_cats[i] )
                         {
                             __atomic_add_fetch(&counters->bluedot_ja3_positive_hit, 1, __ATOMIC_SEQ_CST);
 
@@ -1606,7 +1612,7 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
  * message and preforms a Bluedot query.
  ***************************************************************************/
 
-int Sagan_Bluedot_IP_Lookup_All ( char *syslog_message, int rule_position, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size )
+int Sagan_Bluedot_IP_Lookup_All ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_position, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size )
 {
 
     int i;
@@ -1617,7 +1623,7 @@ int Sagan_Bluedot_IP_Lookup_All ( char *syslog_message, int rule_position, _Saga
     for (i = 0; i < lookup_cache_size; i++)
         {
 
-            bluedot_results = Sagan_Bluedot_Lookup(lookup_cache[i].ip, BLUEDOT_LOOKUP_IP, rule_position, NULL, 0);
+            bluedot_results = Sagan_Bluedot_Lookup(lookup_cache[i].ip, BLUEDOT_LOOKUP_IP, rule_position, SaganProcSyslog_LOCAL, NULL, 0);
             bluedot_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, rule_position, BLUEDOT_LOOKUP_IP );
 
             if ( bluedot_flag == 1 )
@@ -1664,10 +1670,10 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
                             if ( type == BLUEDOT_LOOKUP_IP )
                                 {
 
-                                    if ( rulestruct[rule_number].bluedot_ip_cat_count <= BLUEDOT_MAX_CAT )
+                                    if ( RuleBody[rule_number].BlueDot.bluedot_ip_cat_count <= BLUEDOT_MAX_CAT )
                                         {
-                                            rulestruct[rule_number].bluedot_ip_cats[rulestruct[rule_number].bluedot_ip_cat_count] =  SaganBluedotCatList[i].cat_number;
-                                            rulestruct[rule_number].bluedot_ip_cat_count++;
+                                            RuleBody[rule_number].BlueDot.bluedot_ip_cats[RuleBody[rule_number].BlueDot.bluedot_ip_cat_count] =  SaganBluedotCatList[i].cat_number;
+                                            RuleBody[rule_number].BlueDot.bluedot_ip_cat_count++;
                                         }
                                     else
                                         {
@@ -1677,10 +1683,10 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
 
                             if ( type == BLUEDOT_LOOKUP_HASH )
                                 {
-                                    if ( rulestruct[rule_number].bluedot_hash_cat_count <= BLUEDOT_MAX_CAT )
+                                    if ( RuleBody[rule_number].BlueDot.bluedot_hash_cat_count <= BLUEDOT_MAX_CAT )
                                         {
-                                            rulestruct[rule_number].bluedot_hash_cats[rulestruct[rule_number].bluedot_hash_cat_count] =  SaganBluedotCatList[i].cat_number;
-                                            rulestruct[rule_number].bluedot_hash_cat_count++;
+                                            RuleBody[rule_number].BlueDot.bluedot_hash_cats[RuleBody[rule_number].BlueDot.bluedot_hash_cat_count] =  SaganBluedotCatList[i].cat_number;
+                                            RuleBody[rule_number].BlueDot.bluedot_hash_cat_count++;
                                         }
                                     else
                                         {
@@ -1690,10 +1696,10 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
 
                             if ( type == BLUEDOT_LOOKUP_URL )
                                 {
-                                    if ( rulestruct[rule_number].bluedot_url_cat_count <= BLUEDOT_MAX_CAT )
+                                    if ( RuleBody[rule_number].BlueDot.bluedot_url_cat_count <= BLUEDOT_MAX_CAT )
                                         {
-                                            rulestruct[rule_number].bluedot_url_cats[rulestruct[rule_number].bluedot_url_cat_count] =  SaganBluedotCatList[i].cat_number;
-                                            rulestruct[rule_number].bluedot_url_cat_count++;
+                                            RuleBody[rule_number].BlueDot.bluedot_url_cats[RuleBody[rule_number].BlueDot.bluedot_url_cat_count] =  SaganBluedotCatList[i].cat_number;
+                                            RuleBody[rule_number].BlueDot.bluedot_url_cat_count++;
                                         }
                                     else
                                         {
@@ -1703,10 +1709,10 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
 
                             if ( type == BLUEDOT_LOOKUP_FILENAME )
                                 {
-                                    if ( rulestruct[rule_number].bluedot_filename_cat_count <= BLUEDOT_MAX_CAT )
+                                    if ( RuleBody[rule_number].BlueDot.bluedot_filename_cat_count <= BLUEDOT_MAX_CAT )
                                         {
-                                            rulestruct[rule_number].bluedot_filename_cats[rulestruct[rule_number].bluedot_filename_cat_count] =  SaganBluedotCatList[i].cat_number;
-                                            rulestruct[rule_number].bluedot_filename_cat_count++;
+                                            RuleBody[rule_number].BlueDot.bluedot_filename_cats[RuleBody[rule_number].BlueDot.bluedot_filename_cat_count] =  SaganBluedotCatList[i].cat_number;
+                                            RuleBody[rule_number].BlueDot.bluedot_filename_cat_count++;
                                         }
                                     else
                                         {
@@ -1716,10 +1722,10 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
 
                             if ( type == BLUEDOT_LOOKUP_JA3 )
                                 {
-                                    if ( rulestruct[rule_number].bluedot_ja3_cat_count <= BLUEDOT_MAX_CAT )
+                                    if ( RuleBody[rule_number].BlueDot.bluedot_ja3_cat_count <= BLUEDOT_MAX_CAT )
                                         {
-                                            rulestruct[rule_number].bluedot_ja3_cats[rulestruct[rule_number].bluedot_ja3_cat_count] =  SaganBluedotCatList[i].cat_number;
-                                            rulestruct[rule_number].bluedot_ja3_cat_count++;
+                                            RuleBody[rule_number].BlueDot.bluedot_ja3_cats[RuleBody[rule_number].BlueDot.bluedot_ja3_cat_count] =  SaganBluedotCatList[i].cat_number;
+                                            RuleBody[rule_number].BlueDot.bluedot_ja3_cat_count++;
                                         }
                                     else
                                         {
@@ -46,16 +46,16 @@
 
 int Sagan_Bluedot_Cat_Compare ( unsigned char, int, unsigned char );
 int Sagan_Bluedot ( _Sagan_Proc_Syslog *, int  );
-unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, char *bluedot_str, size_t bluedot_size );
-int Sagan_Bluedot_IP_Lookup_All ( char *, int, _Sagan_Lookup_Cache_Entry *, int );
+unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, char *bluedot_str, size_t bluedot_size );
+int Sagan_Bluedot_IP_Lookup_All ( _Sagan_Proc_Syslog *, int, _Sagan_Lookup_Cache_Entry *, int );
 
-void Sagan_Bluedot_Clean_Cache ( void );
 void Sagan_Bluedot_Init(void);
 void Sagan_Bluedot_Load_Cat(void);
 void Sagan_Verify_Categories( char *, int, const char *, int, unsigned char );
-void Sagan_Bluedot_Check_Cache_Time (void);
-
-int Sagan_Bluedot_Clean_Queue ( char *, unsigned char );
+void Sagan_Bluedot_Handler( void );
+void Sagan_Bluedot_Deferred_Run( struct _Sagan_Bluedot_Deferred * );
+void Sagan_Bluedot_Deferred_Free( struct _Sagan_Bluedot_Deferred * );
+void Sagan_Bluedot_Defer_Reset( void );
 
 
 typedef struct _Sagan_Bluedot_Cat_List _Sagan_Bluedot_Cat_List;
@@ -66,86 +66,83 @@ struct _Sagan_Bluedot_Cat_List
 };
 
 
-typedef struct _Sagan_Bluedot_IP_Cache _Sagan_Bluedot_IP_Cache;
-struct _Sagan_Bluedot_IP_Cache
-{
-    unsigned char ip[MAXIPBIT];
-    uint64_t mdate_utime;
-    uint64_t cdate_utime;
-    uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int	alertid;
-};
+/* Lookup caches.  One per lookup type,  split into shards that each have
+   their own lock,  hash chains and LRU list.  Entries older than
+   "cache-timeout" are dropped when they are next looked at,  and the least
+   recently used entry of a full shard is reused for new results. */
 
-typedef struct _Sagan_Bluedot_Hash_Cache _Sagan_Bluedot_Hash_Cache;
-struct _Sagan_Bluedot_Hash_Cache
-{
-    char hash[SHA256_HASH_SIZE+1];
-    uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int alertid;
-};
-
-typedef struct _Sagan_Bluedot_URL_Cache _Sagan_Bluedot_URL_Cache;
-struct _Sagan_Bluedot_URL_Cache
-{
-    char url[8192];
-    uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int alertid;
-};
+#define BLUEDOT_CACHE_SHARDS 16
 
-typedef struct _Sagan_Bluedot_Filename_Cache _Sagan_Bluedot_Filename_Cache;
-struct _Sagan_Bluedot_Filename_Cache
+typedef struct _Sagan_Bluedot_Cache_Entry _Sagan_Bluedot_Cache_Entry;
+struct _Sagan_Bluedot_Cache_Entry
 {
-    char filename[256];
+    uint64_t hash;
+    uint32_t next;			/* Hash chain (or free list),  0 == end */
+    uint32_t lru_prev;			/* Toward the most recently used */
+    uint32_t lru_next;
+    uint32_t key_length;
+    char *key;				/* IP2Bit() bits for IPs */
     uint64_t cache_utime;
+    uint64_t mdate_utime;
+    uint64_t cdate_utime;
     char bluedot_json[BLUEDOT_JSON_SIZE];
     int alertid;
 };
 
-typedef struct _Sagan_Bluedot_JA3_Cache _Sagan_Bluedot_JA3_Cache;
-struct _Sagan_Bluedot_JA3_Cache
+typedef struct _Sagan_Bluedot_Cache_Shard _Sagan_Bluedot_Cache_Shard;
+struct _Sagan_Bluedot_Cache_Shard
 {
-    char ja3[MD5_HASH_SIZE+1];
-    uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int alertid;
+    pthread_mutex_t lock;
+    uint32_t *bucket;			/* bucket_size heads */
+    uint32_t bucket_size;		/* Power of 2 */
+    struct _Sagan_Bluedot_Cache_Entry *entry;	/* Entry 0 is never used */
+    uint32_t capacity;
+    uint32_t used;			/* Entries handed out at least once */
+    uint32_t free;			/* Released entries */
+    uint32_t lru_head;
+    uint32_t lru_tail;
 };
 
-
-typedef struct _Sagan_Bluedot_IP_Queue _Sagan_Bluedot_IP_Queue;
-struct _Sagan_Bluedot_IP_Queue
+typedef struct _Sagan_Bluedot_Cache _Sagan_Bluedot_Cache;
+struct _Sagan_Bluedot_Cache
 {
-    unsigned char ip[MAXIPBIT];
+    bool nocase;			/* Keys compare case insensitive */
+    uint64_t *count;			/* counters->bluedot_*_cache_count */
+    struct _Sagan_Bluedot_Cache_Shard shard[BLUEDOT_CACHE_SHARDS];
 };
 
-typedef struct _Sagan_Bluedot_Hash_Queue _Sagan_Bluedot_Hash_Queue;
-struct _Sagan_Bluedot_Hash_Queue
-{
-    char hash[SHA256_HASH_SIZE+1];
-};
+#define BLUEDOT_PENDING_BUCKETS 4096
 
-typedef struct _Sagan_Bluedot_URL_Queue _Sagan_Bluedot_URL_Queue;
-struct _Sagan_Bluedot_URL_Queue
-{
-    char url[8192];
-};
+/* Lookups that missed the cache.  There is one entry per key,  so an IP,
+   hash,  etc. is only asked for once no matter how many lines want it.  The
+   Bluedot thread sends them with curl "multi" and drops the entry once the
+   answer is in the cache. */
 
-typedef struct _Sagan_Bluedot_Filename_Queue _Sagan_Bluedot_Filename_Queue;
-struct _Sagan_Bluedot_Filename_Queue
+typedef struct _Sagan_Bluedot_Deferred _Sagan_Bluedot_Deferred;
+struct _Sagan_Bluedot_Deferred
 {
-    char filename[256];
+    struct _Sagan_Bluedot_Deferred *next;
+    int rule_position;
+    uint32_t generation;			/* Rule table "rule_position" is from */
+    struct _Sagan_Proc_Syslog SaganProcSyslog;	/* Line to run the rule on again */
 };
 
-typedef struct _Sagan_Bluedot_JA3_Queue _Sagan_Bluedot_JA3_Queue;
-struct _Sagan_Bluedot_JA3_Queue
+typedef struct _Sagan_Bluedot_Pending _Sagan_Bluedot_Pending;
+struct _Sagan_Bluedot_Pending
 {
-    char ja3[MD5_HASH_SIZE+1];
+    struct _Sagan_Bluedot_Pending *next;	/* Hash chain */
+    struct _Sagan_Bluedot_Pending *send_next;	/* Not handed to curl yet */
+    uint64_t hash;
+    unsigned char type;
+    uint32_t key_length;
+    char *key;					/* Same as the cache key */
+    char *data;					/* What goes in the URL */
+    void *curl;					/* CURL easy handle while in flight */
+    char *response;
+    size_t response_length;
+    struct _Sagan_Bluedot_Deferred *deferred;
 };
 
-
-
 typedef struct _Sagan_Bluedot_Skip _Sagan_Bluedot_Skip;
 struct _Sagan_Bluedot_Skip
 {
@@ -33,10 +33,12 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <pthread.h>
 
 
@@ -50,23 +52,55 @@
 
 #define MAX_BROINTEL_LINE_SIZE 10240
 
+#define BROINTEL_SET_START	1024		/* Slots,  power of 2 */
+#define BROINTEL_NODE_START	4096
+
 struct _SaganConfig *config;
 struct _SaganCounters *counters;
 struct _SaganDebug *debug;
 
 struct _Sagan_Processor_Info *processor_info_brointel = NULL;
 
-struct _Sagan_BroIntel_Intel_Addr *Sagan_BroIntel_Intel_Addr;
-struct _Sagan_BroIntel_Intel_Domain *Sagan_BroIntel_Intel_Domain;
-struct _Sagan_BroIntel_Intel_File_Hash *Sagan_BroIntel_Intel_File_Hash;
-struct _Sagan_BroIntel_Intel_URL *Sagan_BroIntel_Intel_URL;
-struct _Sagan_BroIntel_Intel_Software *Sagan_BroIntel_Intel_Software;
-struct _Sagan_BroIntel_Intel_Email *Sagan_BroIntel_Intel_Email;
-struct _Sagan_BroIntel_Intel_User_Name *Sagan_BroIntel_Intel_User_Name;
-struct _Sagan_BroIntel_Intel_File_Name *Sagan_BroIntel_Intel_File_Name;
-struct _Sagan_BroIntel_Intel_Cert_Hash *Sagan_BroIntel_Intel_Cert_Hash;
+/* Readers only ever see a complete table.  Sagan_BroIntel_Load_File()
+   builds a new one and swaps it in,  at start up or during a reload when
+   no processor thread is using the old one */
+
+struct _Sagan_BroIntel_Table *SaganBroIntel = NULL;
 
-pthread_mutex_t CounterBroIntelGenericMutex=PTHREAD_MUTEX_INITIALIZER;
+/* The trie as it's loaded.  Sagan_BroIntel_Build() turns it into the
+   automaton and it's thrown away */
+
+typedef struct _Sagan_BroIntel_Trie _Sagan_BroIntel_Trie;
+struct _Sagan_BroIntel_Trie
+{
+    uint32_t child;
+    uint32_t sibling;
+    uint16_t types;
+    unsigned char c;
+};
+
+static struct _Sagan_BroIntel_Trie *brointel_trie = NULL;
+static uint32_t brointel_trie_count = 0;
+static uint32_t brointel_trie_size = 0;
+static uint32_t brointel_trie_root[256];
+
+static const struct
+{
+    const char *name;
+    uint16_t type;
+} brointel_types[] =
+{
+    { "Intel::ADDR", BROINTEL_ADDR },
+    { "Intel::DOMAIN", BROINTEL_DOMAIN },
+    { "Intel::FILE_HASH", BROINTEL_FILE_HASH },
+    { "Intel::URL", BROINTEL_URL },
+    { "Intel::SOFTWARE", BROINTEL_SOFTWARE },
+    { "Intel::EMAIL", BROINTEL_EMAIL },
+    { "Intel::USER_NAME", BROINTEL_USER_NAME },
+    { "Intel::FILE_NAME", BROINTEL_FILE_NAME },
+    { "Intel::CERT_HASH", BROINTEL_CERT_HASH },
+    { NULL, 0 }
+};
 
 /*****************************************************************************
  * Sagan_BroIntel_Init - Sets up globals.  Not really used yet.
@@ -78,460 +112,659 @@ void Sagan_BroIntel_Init(void)
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_Load_File - Loads BroIntel data and splits it up
- * into different arrays.
- * ***************************************************************************/
+ * Sagan_BroIntel_Free - Releases a table built by Sagan_BroIntel_Load_File()
+ *****************************************************************************/
 
-void Sagan_BroIntel_Load_File ( void )
+static void Sagan_BroIntel_Free( struct _Sagan_BroIntel_Table *table )
 {
 
-    FILE *brointel_file;
+    if ( table == NULL )
+        {
+            return;
+        }
 
-    char *value;
-    char *type;
-    char *description;
+    free(table->set);
+    free(table->keys);
+    free(table->node);
+    free(table->label);
+    free(table);
 
-    bool found_flag;
-    bool found_flag_array;
+}
 
-    char *tok = NULL; ;
-    char *ptmp = NULL;
+/*****************************************************************************
+ * Sagan_BroIntel_Hash - FNV-1a.  Keys can be IP2Bit() bits,  so this is
+ * length based rather than '\0' terminated.
+ *****************************************************************************/
 
-    int line_count;
-    int i;
+static inline uint64_t Sagan_BroIntel_Hash( const unsigned char *key, size_t length )
+{
 
-    unsigned char bits_ip[MAXIPBIT] = {0};
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
 
-    char *brointel_filename = NULL;
-    char brointelbuf[MAX_BROINTEL_LINE_SIZE] = { 0 };
+    for ( i = 0; i < length; i++ )
+        {
+            hash = ( hash ^ key[i] ) * 1099511628211ULL;
+        }
 
-    __atomic_store_n (&counters->brointel_dups, 0, __ATOMIC_SEQ_CST);
+    return(hash);
 
-    brointel_filename = strtok_r(config->brointel_files, ",", &ptmp);
+}
 
-    while ( brointel_filename != NULL )
+/*****************************************************************************
+ * Sagan_BroIntel_Set_Find - Returns the types "key" was loaded as,  0 if it
+ * isn't in the set.
+ *****************************************************************************/
+
+static uint16_t Sagan_BroIntel_Set_Find( struct _Sagan_BroIntel_Table *table, const unsigned char *key, size_t length )
+{
+
+    struct _Sagan_BroIntel_Key *slot = NULL;
+
+    uint64_t hash = Sagan_BroIntel_Hash(key, length);
+    uint32_t i = hash & ( table->set_size - 1 );
+
+    for (;;)
         {
 
-            Sagan_Log(NORMAL, "Bro Intel Processor Loading File: %s.", brointel_filename);
+            slot = &table->set[i];
 
-            if (( brointel_file = fopen(brointel_filename, "r")) == NULL )
+            if ( slot->length == 0 )
                 {
-                    Sagan_Log(ERROR, "[%s, line %d] Could not load Bro Intel file! (%s - %s)", __FILE__, __LINE__, brointel_filename, strerror(errno));
+                    return(0);
                 }
 
-            while(fgets(brointelbuf, MAX_BROINTEL_LINE_SIZE, brointel_file) != NULL)
+            if ( slot->hash == hash && slot->length == length &&
+                    !memcmp(table->keys + slot->offset, key, length) )
                 {
+                    return(slot->types);
+                }
 
-                    /* Skip comments and blank linkes */
+            i = ( i + 1 ) & ( table->set_size - 1 );
+        }
 
-                    if (brointelbuf[0] == '#' || brointelbuf[0] == 10 || brointelbuf[0] == ';' || brointelbuf[0] == 32 )
+}
+
+/*****************************************************************************
+ * Sagan_BroIntel_Set_Add - Adds "key" as "type".  Returns false if it was
+ * already loaded as that type.
+ *****************************************************************************/
+
+static bool Sagan_BroIntel_Set_Add( struct _Sagan_BroIntel_Table *table, const unsigned char *key, size_t length, uint16_t type )
+{
+
+    struct _Sagan_BroIntel_Key *slot = NULL;
+    struct _Sagan_BroIntel_Key *old_set = NULL;
+
+    uint64_t hash = Sagan_BroIntel_Hash(key, length);
+    uint32_t old_size;
+    uint32_t i;
+    uint32_t n;
+
+    /* Keep the set at most half full so probes stay short */
+
+    if ( ( table->set_count + 1 ) * 2 > table->set_size )
+        {
+
+            old_set = table->set;
+            old_size = table->set_size;
+
+            table->set_size = old_size * 2;
+            table->set = calloc( table->set_size, sizeof(_Sagan_BroIntel_Key) );
+
+            if ( table->set == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the Bro Intel set. Abort!", __FILE__, __LINE__);
+                }
+
+            for ( i = 0; i < old_size; i++ )
+                {
+
+                    if ( old_set[i].length == 0 )
                         {
-                            line_count++;
                             continue;
                         }
-                    else
+
+                    n = old_set[i].hash & ( table->set_size - 1 );
+
+                    while ( table->set[n].length != 0 )
                         {
+                            n = ( n + 1 ) & ( table->set_size - 1 );
+                        }
 
-                            Remove_Return(brointelbuf);
+                    memcpy(&table->set[n], &old_set[i], sizeof(_Sagan_BroIntel_Key));
+                }
 
-                            value = strtok_r(brointelbuf, "\t", &tok);
-                            type = strtok_r(NULL, "\t", &tok);
-                            description = strtok_r(NULL, "\t", &tok);
+            free(old_set);
+        }
 
-                            if ( value == NULL || type == NULL || description == NULL )
-                                {
-                                    Sagan_Log(WARN, "[%s, line %d] Got invalid line at %d in %s", __FILE__, __LINE__, line_count, brointel_filename);
-                                }
+    i = hash & ( table->set_size - 1 );
 
-                            found_flag = 0;
+    for (;;)
+        {
 
-                            if (!strcmp(type, "Intel::ADDR") && IP2Bit(value, bits_ip))
-                                {
+            slot = &table->set[i];
 
-                                    found_flag = 1; 			/* Used to short circuit other 'type' lookups */
-                                    found_flag_array = 0;		/* Used to short circuit/warn when dups are found.  This way we don't waste memory/CPU */
+            if ( slot->length == 0 )
+                {
+                    break;
+                }
 
-                                    /* Check for duplicates. */
+            if ( slot->hash == hash && slot->length == length &&
+                    !memcmp(table->keys + slot->offset, key, length) )
+                {
 
-                                    for (i=0; i < counters->brointel_addr_count; i++)
-                                        {
+                    if ( slot->types & type )
+                        {
+                            return(false);
+                        }
 
-                                            if ( !memcmp(Sagan_BroIntel_Intel_Addr[i].bits_ip, bits_ip, MAXIPBIT) )
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::ADDR address %s in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(& counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+                    slot->types |= type;
+                    return(true);
+                }
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+            i = ( i + 1 ) & ( table->set_size - 1 );
+        }
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    /* New key,  copy it to the end of the key arena */
 
-                                            Sagan_BroIntel_Intel_Addr = (_Sagan_BroIntel_Intel_Addr *) realloc(Sagan_BroIntel_Intel_Addr, (counters->brointel_addr_count+1) * sizeof(_Sagan_BroIntel_Intel_Addr));
+    if ( table->keys_length + length > table->keys_size )
+        {
 
-                                            if ( Sagan_BroIntel_Intel_Addr == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Addr. Abort!", __FILE__, __LINE__);
-                                                }
+            while ( table->keys_length + length > table->keys_size )
+                {
+                    table->keys_size = table->keys_size * 2;
+                }
 
-                                            memset(&Sagan_BroIntel_Intel_Addr[counters->brointel_addr_count], 0, sizeof(_Sagan_BroIntel_Intel_Addr));
+            table->keys = realloc(table->keys, table->keys_size);
 
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            memcpy( Sagan_BroIntel_Intel_Addr[counters->brointel_addr_count].bits_ip, bits_ip, sizeof(bits_ip) );
-                                            counters->brointel_addr_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
-                                        }
+            if ( table->keys == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for the Bro Intel keys. Abort!", __FILE__, __LINE__);
+                }
+        }
 
-                                }
+    memcpy(table->keys + table->keys_length, key, length);
 
-                            if (!strcmp(type, "Intel::DOMAIN") && found_flag == 0)
-                                {
-                                    To_LowerC(value);
+    slot->hash = hash;
+    slot->offset = table->keys_length;
+    slot->length = length;
+    slot->types = type;
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    table->keys_length += length;
+    table->set_count++;
 
+    return(true);
 
-                                    for (i=0; i < counters-> brointel_domain_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Domain[i].domain, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::DOMAIN '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+}
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+/*****************************************************************************
+ * Sagan_BroIntel_Add_Node - Adds an empty node to the load time trie,
+ * growing it as needed.
+ *****************************************************************************/
 
-                                    if ( found_flag_array == 0 )
-                                        {
-                                            Sagan_BroIntel_Intel_Domain = (_Sagan_BroIntel_Intel_Domain *) realloc(Sagan_BroIntel_Intel_Domain, (counters->brointel_domain_count+1) * sizeof(_Sagan_BroIntel_Intel_Domain));
+static uint32_t Sagan_BroIntel_Add_Node( unsigned char c )
+{
 
-                                            if ( Sagan_BroIntel_Intel_Domain == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Domain. Abort!", __FILE__, __LINE__);
-                                                }
+    if ( brointel_trie_count >= brointel_trie_size )
+        {
 
-                                            memset(&Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count], 0, sizeof(_Sagan_BroIntel_Intel_Domain));
+            brointel_trie_size = brointel_trie_size * 2;
+            brointel_trie = realloc(brointel_trie, (size_t)brointel_trie_size * sizeof(_Sagan_BroIntel_Trie));
 
-                                            strlcpy(Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count].domain, value, sizeof(Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count].domain));
+            if ( brointel_trie == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for the Bro Intel trie. Abort!", __FILE__, __LINE__);
+                }
+        }
 
-                                            __atomic_add_fetch(&counters->brointel_domain_count, 1, __ATOMIC_SEQ_CST);
+    memset(&brointel_trie[brointel_trie_count], 0, sizeof(_Sagan_BroIntel_Trie));
+    brointel_trie[brointel_trie_count].c = c;
 
+    return(brointel_trie_count++);
 
-                                        }
+}
 
-                                }
+/*****************************************************************************
+ * Sagan_BroIntel_Pattern_Add - Adds "value" to the trie as "type".  Returns
+ * false if it was already loaded as that type.
+ *****************************************************************************/
 
-                            if (!strcmp(type, "Intel::FILE_HASH") && found_flag == 0)
-                                {
-                                    To_LowerC(value);
+static bool Sagan_BroIntel_Pattern_Add( const char *value, uint16_t type )
+{
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    const unsigned char *p = NULL;
 
-                                    for (i=0; i < counters->brointel_file_hash_count; i++)
-                                        {
+    uint32_t s = 0;
+    uint32_t t = 0;
 
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_File_Hash[i].hash, value))
-                                                {
+    for ( p = (const unsigned char *)value; *p != '\0'; p++ )
+        {
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::FILE_HASH '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+            if ( s == 0 )
+                {
+                    t = brointel_trie_root[*p];
+                }
+            else
+                {
+                    for ( t = brointel_trie[s].child; t != 0 && brointel_trie[t].c != *p; t = brointel_trie[t].sibling );
+                }
 
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+            if ( t == 0 )
+                {
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+                    t = Sagan_BroIntel_Add_Node(*p);
 
-                                    if ( found_flag_array == 0 )
-                                        {
+                    if ( s == 0 )
+                        {
+                            brointel_trie_root[*p] = t;
+                        }
+                    else
+                        {
+                            brointel_trie[t].sibling = brointel_trie[s].child;
+                            brointel_trie[s].child = t;
+                        }
+                }
 
-                                            Sagan_BroIntel_Intel_File_Hash = (_Sagan_BroIntel_Intel_File_Hash *) realloc(Sagan_BroIntel_Intel_File_Hash, (counters->brointel_file_hash_count+1) * sizeof(_Sagan_BroIntel_Intel_File_Hash));
+            s = t;
+        }
 
-                                            if ( Sagan_BroIntel_Intel_File_Hash == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_File_Hash. Abort!", __FILE__, __LINE__);
-                                                }
+    if ( brointel_trie[s].types & type )
+        {
+            return(false);
+        }
 
-                                            memset(&Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count], 0, sizeof(_Sagan_BroIntel_Intel_File_Hash));
+    brointel_trie[s].types |= type;
 
-                                            strlcpy(Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count].hash, value, sizeof(Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count].hash));
-                                            counters->brointel_file_hash_count++;
+    return(true);
 
-                                        }
-                                }
+}
 
+/*****************************************************************************
+ * Sagan_BroIntel_Next - Automaton transition.  Follows failure links until
+ * "c" can be matched,  or we are back at the root.
+ *****************************************************************************/
 
-                            if (!strcmp(type, "Intel::URL") && found_flag == 0)
-                                {
+static inline uint32_t Sagan_BroIntel_Next( struct _Sagan_BroIntel_Table *table, uint32_t s, unsigned char c )
+{
 
-                                    To_LowerC(value);
+    const unsigned char *t = NULL;
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    while ( s != 0 )
+        {
 
-                                    for (i=0; i < counters->brointel_url_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_URL[i].url, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::URL '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+            t = memchr(table->label + table->node[s].child, c, table->node[s].child_count);
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+            if ( t != NULL )
+                {
+                    return(t - table->label);
+                }
 
+            s = table->node[s].fail;
+        }
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    return(table->root[c]);
 
-                                            Sagan_BroIntel_Intel_URL = (_Sagan_BroIntel_Intel_URL *) realloc(Sagan_BroIntel_Intel_URL, (counters->brointel_url_count+1) * sizeof(_Sagan_BroIntel_Intel_URL));
+}
 
-                                            if ( Sagan_BroIntel_Intel_URL == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_URL. Abort!", __FILE__, __LINE__);
-                                                }
+/*****************************************************************************
+ * Sagan_BroIntel_Build - Lays the trie out breadth first,  then sets the
+ * failure links.  Each node also picks up the types of its failure node,
+ * so the scan never has to walk the chain for output.
+ *****************************************************************************/
 
-                                            memset(&Sagan_BroIntel_Intel_URL[counters->brointel_url_count], 0, sizeof(_Sagan_BroIntel_Intel_URL));
+static void Sagan_BroIntel_Build( struct _Sagan_BroIntel_Table *table )
+{
 
-                                            strlcpy(Sagan_BroIntel_Intel_URL[counters->brointel_url_count].url, value, sizeof(Sagan_BroIntel_Intel_URL[counters->brointel_url_count].url));
+    uint32_t *order = NULL;		/* Trie node for each automaton node */
+    uint32_t next = 1;
 
-                                            __atomic_add_fetch(&counters->brointel_url_count, 1, __ATOMIC_SEQ_CST);
+    uint32_t i;
+    uint32_t k;
+    uint32_t t;
+    int c;
 
-                                        }
+    table->node_count = brointel_trie_count;
+    table->node = calloc( table->node_count, sizeof(_Sagan_BroIntel_Node) );
+    table->label = calloc( table->node_count, sizeof(unsigned char) );
 
-                                }
+    order = malloc( table->node_count * sizeof(uint32_t) );
 
+    if ( table->node == NULL || table->label == NULL || order == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the Bro Intel automaton. Abort!", __FILE__, __LINE__);
+        }
 
-                            if (!strcmp(type, "Intel::SOFTWARE") && found_flag == 0)
-                                {
+    order[0] = 0;
 
+    for ( c = 0; c < 256; c++ )
+        {
 
-                                    To_LowerC(value);
+            if ( brointel_trie_root[c] != 0 )
+                {
+                    table->root[c] = next;
+                    order[next++] = brointel_trie_root[c];
+                }
+        }
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    for ( i = 1; i < table->node_count; i++ )
+        {
 
-                                    for (i=0; i < counters->brointel_software_count++; i++)
-                                        {
+            t = order[i];
 
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Software[i].software, value))
-                                                {
+            table->label[i] = brointel_trie[t].c;
+            table->node[i].types = brointel_trie[t].types;
+            table->node[i].child = next;
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::SOFTWARE '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+            for ( t = brointel_trie[t].child; t != 0; t = brointel_trie[t].sibling )
+                {
+                    order[next++] = t;
+                    table->node[i].child_count++;
+                }
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+            table->node_types |= table->node[i].types;
+        }
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    free(order);
 
-                                            Sagan_BroIntel_Intel_Software = (_Sagan_BroIntel_Intel_Software *) realloc(Sagan_BroIntel_Intel_Software, (counters->brointel_software_count+1) * sizeof(_Sagan_BroIntel_Intel_Software));
+    /* Parents come before their children,  and a node's failure node is
+       always shallower than it is */
 
-                                            if ( Sagan_BroIntel_Intel_Software == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Software. Abort!", __FILE__, __LINE__);
-                                                }
+    for ( i = 1; i < table->node_count; i++ )
+        {
 
-                                            memset(&Sagan_BroIntel_Intel_Software[counters->brointel_software_count], 0, sizeof(_Sagan_BroIntel_Intel_Software));
+            for ( k = table->node[i].child; k < table->node[i].child + table->node[i].child_count; k++ )
+                {
 
-                                            strlcpy(Sagan_BroIntel_Intel_Software[counters->brointel_software_count].software, value, sizeof(Sagan_BroIntel_Intel_Software[counters->brointel_software_count].software));
+                    t = Sagan_BroIntel_Next(table, table->node[i].fail, table->label[k]);
 
-                                            __atomic_add_fetch(&counters->brointel_software_count, 1, __ATOMIC_SEQ_CST);
+                    table->node[k].fail = t;
+                    table->node[k].types |= table->node[t].types;
+                }
+        }
 
+}
 
-                                        }
-                                }
+/*****************************************************************************
+ * Sagan_BroIntel_Is_Hash - Hex digits only.  These are exact matched against
+ * tokens,  anything else is matched as a substring.
+ *****************************************************************************/
 
-                            if (!strcmp(type, "Intel::EMAIL") && found_flag == 0)
-                                {
+static bool Sagan_BroIntel_Is_Hash( const char *value )
+{
 
-                                    To_LowerC(value);
+    for ( ; *value != '\0'; value++ )
+        {
 
-                                    found_flag_array = 0;
+            if ( !( ( *value >= '0' && *value <= '9' ) || ( *value >= 'a' && *value <= 'f' ) ) )
+                {
+                    return(false);
+                }
+        }
 
-                                    for (i=0; i < counters->brointel_email_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Email[i].email, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::EMAIL '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+    return(true);
 
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+}
 
-                                                    found_flag_array = 1;
+/*****************************************************************************
+ * Sagan_BroIntel_Count - Bumps the loaded counter for "type"
+ *****************************************************************************/
 
-                                                }
-                                        }
+static void Sagan_BroIntel_Count( uint16_t type )
+{
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    switch ( type )
+        {
 
-                                            Sagan_BroIntel_Intel_Email = (_Sagan_BroIntel_Intel_Email *) realloc(Sagan_BroIntel_Intel_Email, (counters->brointel_email_count+1) * sizeof(_Sagan_BroIntel_Intel_Email));
+        case BROINTEL_ADDR:
+            __atomic_add_fetch(&counters->brointel_addr_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
-                                            if ( Sagan_BroIntel_Intel_Email == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Email. Abort!", __FILE__, __LINE__);
-                                                }
+        case BROINTEL_DOMAIN:
+            __atomic_add_fetch(&counters->brointel_domain_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
-                                            memset(&Sagan_BroIntel_Intel_Email[counters->brointel_email_count], 0, sizeof(_Sagan_BroIntel_Intel_Email));
+        case BROINTEL_FILE_HASH:
+            __atomic_add_fetch(&counters->brointel_file_hash_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
-                                            strlcpy(Sagan_BroIntel_Intel_Email[counters->brointel_email_count].email, value, sizeof(Sagan_BroIntel_Intel_Email[counters->brointel_email_count].email));
+        case BROINTEL_URL:
+            __atomic_add_fetch(&counters->brointel_url_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
-                                            __atomic_add_fetch(&counters->brointel_email_count, 1, __ATOMIC_SEQ_CST);
+        case BROINTEL_SOFTWARE:
+            __atomic_add_fetch(&counters->brointel_software_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
-                                            found_flag = 1;
-                                        }
+        case BROINTEL_EMAIL:
+            __atomic_add_fetch(&counters->brointel_email_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
-                                }
+        case BROINTEL_USER_NAME:
+            __atomic_add_fetch(&counters->brointel_user_name_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
+        case BROINTEL_FILE_NAME:
+            __atomic_add_fetch(&counters->brointel_file_name_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
-                            if (!strcmp(type, "Intel::USER_NAME") && found_flag == 0)
-                                {
-                                    To_LowerC(value);
+        case BROINTEL_CERT_HASH:
+            __atomic_add_fetch(&counters->brointel_cert_hash_count, 1, __ATOMIC_SEQ_CST);
+            break;
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+        }
 
-                                    for (i=0; i < counters->brointel_user_name_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_User_Name[i].username, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::USER_NAME '%s' in %s on line %.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+}
 
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+/*****************************************************************************
+ * Sagan_BroIntel_Load_File - Loads BroIntel data into a new table.
+ * Intel::ADDR and hex hashes go into the exact match set,  everything else
+ * into the automaton.  The table is swapped in once it's complete.
+ * ***************************************************************************/
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+void Sagan_BroIntel_Load_File ( void )
+{
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    FILE *brointel_file;
 
+    struct _Sagan_BroIntel_Table *table = NULL;
 
-                                            Sagan_BroIntel_Intel_User_Name = (_Sagan_BroIntel_Intel_User_Name *) realloc(Sagan_BroIntel_Intel_User_Name, (counters->brointel_user_name_count+1) * sizeof(_Sagan_BroIntel_Intel_User_Name));
+    char *value;
+    char *type;
+    char *description;
 
-                                            if ( Sagan_BroIntel_Intel_User_Name == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_User_Name. Abort!", __FILE__, __LINE__);
-                                                }
+    char *tok = NULL; ;
+    char *ptmp = NULL;
 
-                                            memset(&Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count], 0, sizeof(_Sagan_BroIntel_Intel_User_Name));
+    int line_count = 0;
+    int i;
 
-                                            strlcpy(Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count].username, value, sizeof(Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count].username));
+    uint16_t type_flag;
+    size_t length;
+    bool added;
 
-                                            __atomic_add_fetch(&counters->brointel_user_name_count, 1, __ATOMIC_SEQ_CST);
+    unsigned char bits_ip[MAXIPBIT] = {0};
 
-                                        }
-                                }
+    char *brointel_filename = NULL;
+    char brointelbuf[MAX_BROINTEL_LINE_SIZE] = { 0 };
 
-                            if (!strcmp(type, "Intel::FILE_NAME") && found_flag == 0)
-                                {
+    __atomic_store_n (&counters->brointel_addr_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_domain_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_file_hash_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_url_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_software_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_email_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_user_name_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_file_name_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_cert_hash_count, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&counters->brointel_dups, 0, __ATOMIC_SEQ_CST);
 
-                                    To_LowerC(value);
+    table = calloc(1, sizeof(_Sagan_BroIntel_Table));
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    if ( table == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the Bro Intel table. Abort!", __FILE__, __LINE__);
+        }
 
-                                    for (i=0; i < counters->brointel_file_name_count; i++)
-                                        {
+    table->set_size = BROINTEL_SET_START;
+    table->set = calloc( table->set_size, sizeof(_Sagan_BroIntel_Key) );
 
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_File_Name[i].file_name, value))
-                                                {
+    table->keys_size = BROINTEL_SET_START * MAXIPBIT;
+    table->keys = malloc( table->keys_size );
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::FILE_NAME '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+    brointel_trie_count = 0;
+    brointel_trie_size = BROINTEL_NODE_START;
+    brointel_trie = malloc( (size_t)brointel_trie_size * sizeof(_Sagan_BroIntel_Trie) );
 
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+    memset(brointel_trie_root, 0, sizeof(brointel_trie_root));
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+    if ( table->set == NULL || table->keys == NULL || brointel_trie == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the Bro Intel table. Abort!", __FILE__, __LINE__);
+        }
 
+    Sagan_BroIntel_Add_Node(0);		/* Root */
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    brointel_filename = strtok_r(config->brointel_files, ",", &ptmp);
 
-                                            Sagan_BroIntel_Intel_File_Name = (_Sagan_BroIntel_Intel_File_Name *) realloc(Sagan_BroIntel_Intel_File_Name, (counters->brointel_file_name_count+1) * sizeof(_Sagan_BroIntel_Intel_File_Name));
+    while ( brointel_filename != NULL )
+        {
 
-                                            if ( Sagan_BroIntel_Intel_File_Name == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_File_Name. Abort!", __FILE__, __LINE__);
-                                                }
+            Sagan_Log(NORMAL, "Bro Intel Processor Loading File: %s.", brointel_filename);
 
-                                            memset(&Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count], 0, sizeof(_Sagan_BroIntel_Intel_File_Name));
+            if (( brointel_file = fopen(brointel_filename, "r")) == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Could not load Bro Intel file! (%s - %s)", __FILE__, __LINE__, brointel_filename, strerror(errno));
+                }
 
-                                            strlcpy(Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count].file_name, value, sizeof(Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count].file_name));
+            while(fgets(brointelbuf, MAX_BROINTEL_LINE_SIZE, brointel_file) != NULL)
+                {
 
-                                            __atomic_add_fetch(&counters->brointel_file_name_count, 1, __ATOMIC_SEQ_CST);
+                    line_count++;
 
-                                        }
+                    /* Skip comments and blank linkes */
 
-                                }
+                    if (brointelbuf[0] == '#' || brointelbuf[0] == 10 || brointelbuf[0] == ';' || brointelbuf[0] == 32 )
+                        {
+                            continue;
+                        }
+
+                    Remove_Return(brointelbuf);
+
+                    value = strtok_r(brointelbuf, "\t", &tok);
+                    type = strtok_r(NULL, "\t", &tok);
+                    description = strtok_r(NULL, "\t", &tok);
 
-                            if (!strcmp(type, "Intel::CERT_HASH") && found_flag == 0)
+                    if ( value == NULL || type == NULL || description == NULL )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] Got invalid line at %d in %s", __FILE__, __LINE__, line_count, brointel_filename);
+                            continue;
+                        }
+
+                    type_flag = 0;
+
+                    for ( i = 0; brointel_types[i].name != NULL; i++ )
+                        {
+
+                            if ( !strcmp(type, brointel_types[i].name) )
                                 {
-                                    To_LowerC(value);
+                                    type_flag = brointel_types[i].type;
+                                    break;
+                                }
+                        }
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+                    if ( type_flag == 0 )
+                        {
+                            continue;
+                        }
 
-                                    for (i=0; i < counters->brointel_cert_hash_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::CERT_HASH '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+                    if ( type_flag == BROINTEL_ADDR )
+                        {
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+                            if ( !IP2Bit(value, bits_ip) )
+                                {
+                                    continue;
+                                }
 
-                                    if ( found_flag_array == 0 )
-                                        {
-                                            Sagan_BroIntel_Intel_Cert_Hash = (_Sagan_BroIntel_Intel_Cert_Hash *) realloc(Sagan_BroIntel_Intel_Cert_Hash, (counters->brointel_cert_hash_count+1) * sizeof(_Sagan_BroIntel_Intel_Cert_Hash));
+                            added = Sagan_BroIntel_Set_Add(table, bits_ip, MAXIPBIT, type_flag);
 
-                                            if ( Sagan_BroIntel_Intel_Cert_Hash == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Cert_Hash. Abort!", __FILE__, __LINE__);
-                                                }
+                        }
+                    else
+                        {
 
-                                            memset(&Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count], 0, sizeof(_Sagan_BroIntel_Intel_Cert_Hash));
+                            To_LowerC(value);
+                            length = strlen(value);
 
-                                            strlcpy(Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count].cert_hash, value, sizeof(Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count].cert_hash));
+                            if ( length == 0 )
+                                {
+                                    continue;
+                                }
+
+                            if ( ( type_flag == BROINTEL_FILE_HASH || type_flag == BROINTEL_CERT_HASH ) &&
+                                    length <= UINT16_MAX && Sagan_BroIntel_Is_Hash(value) )
+                                {
 
-                                            __atomic_add_fetch(&counters->brointel_cert_hash_count, 1, __ATOMIC_SEQ_CST);
+                                    added = Sagan_BroIntel_Set_Add(table, (unsigned char *)value, length, type_flag);
 
+                                    if ( table->hash_length_min == 0 || length < table->hash_length_min )
+                                        {
+                                            table->hash_length_min = length;
                                         }
-                                }
 
+                                    if ( length > table->hash_length_max )
+                                        {
+                                            table->hash_length_max = length;
+                                        }
 
+                                }
+                            else
+                                {
+                                    added = Sagan_BroIntel_Pattern_Add(value, type_flag);
+                                }
                         }
 
-                    line_count++;
+                    if ( added == false )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] Got duplicate %s '%s' in %s on line %d.", __FILE__, __LINE__, type, value, brointel_filename, line_count);
+                            __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+                            continue;
+                        }
+
+                    Sagan_BroIntel_Count(type_flag);
 
                 }
+
             fclose(brointel_file);
             brointel_filename = strtok_r(NULL, ",", &ptmp);
             line_count = 0;
         }
 
+    Sagan_BroIntel_Build(table);
+
+    free(brointel_trie);
+    brointel_trie = NULL;
+
+    Sagan_Log(NORMAL, "Bro Intel Processor: %u exact match key(s), %u automaton node(s).", table->set_count, table->node_count);
+
+    /* Swap the new table in */
+
+    Sagan_BroIntel_Free( __atomic_exchange_n(&SaganBroIntel, table, __ATOMIC_SEQ_CST) );
+
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_IPADDR - Search array for blacklisted IP addresses
+ * Sagan_BroIntel_IPADDR - Search set for blacklisted IP addresses
  *****************************************************************************/
 
 bool Sagan_BroIntel_IPADDR ( unsigned char *ip, char *ipaddr )
 {
 
-    int i = 0;
+    struct _Sagan_BroIntel_Table *table = __atomic_load_n(&SaganBroIntel, __ATOMIC_ACQUIRE);
 
-    unsigned char ip_convert[MAXIPBIT] = { 0 };
-    memset(ip_convert, 0, MAXIPBIT);
-    memcpy(ip_convert, ip, MAXIPBIT);
+    if ( table == NULL )
+        {
+            return(false);
+        }
 
     /* If RFC1918 and friends,  we can short circuit here */
 
@@ -546,21 +779,15 @@ bool Sagan_BroIntel_IPADDR ( unsigned char *ip, char *ipaddr )
             return(false);
         }
 
-    /* Search array for for the IP address */
-
-    for ( i = 0; i < counters->brointel_addr_count; i++)
+    if ( Sagan_BroIntel_Set_Find(table, ip, MAXIPBIT) & BROINTEL_ADDR )
         {
 
-            if ( !memcmp(ip_convert, Sagan_BroIntel_Intel_Addr[i].bits_ip, MAXIPBIT) )
+            if ( debug->debugbrointel )
                 {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found IP %u.", __FILE__, __LINE__, ip);
-                        }
-
-                    return(true);
+                    Sagan_Log(DEBUG, "[%s, line %d] Found IP %s.", __FILE__, __LINE__, ipaddr);
                 }
 
+            return(true);
         }
 
     return(false);
@@ -575,246 +802,105 @@ bool Sagan_BroIntel_IPADDR ( unsigned char *ip, char *ipaddr )
 bool Sagan_BroIntel_IPADDR_All ( char *syslog_message, _Sagan_Lookup_Cache_Entry *lookup_cache, size_t cache_size)
 {
 
-    int i;
-    int b;
+    struct _Sagan_BroIntel_Table *table = __atomic_load_n(&SaganBroIntel, __ATOMIC_ACQUIRE);
+
+    size_t i;
 
-    for (i = 0; i < MAX_PARSE_IP; i++)
+    if ( table == NULL )
         {
+            return(false);
+        }
 
+    for (i = 0; i < cache_size; i++)
+        {
 
             if ( lookup_cache[i].status == 0 )
                 {
                     return(false);
                 }
 
-            for ( b = 0; b < counters->brointel_addr_count; b++ )
+            if ( Sagan_BroIntel_Set_Find(table, lookup_cache[i].ip_bits, MAXIPBIT) & BROINTEL_ADDR )
                 {
-
-                    if ( !memcmp(Sagan_BroIntel_Intel_Addr[b].bits_ip, lookup_cache[i].ip_bits, sizeof(Sagan_BroIntel_Intel_Addr[b].bits_ip)))
-                        {
-                            return(true);
-                        }
-                }
-        }
-
-    return(false);
-}
-
-/*****************************************************************************
- * Sagan_BroIntel_DOMAIN - Search DOMAIN array
- *****************************************************************************/
-
-bool Sagan_BroIntel_DOMAIN ( char *syslog_message )
-{
-
-    int i;
-
-    for ( i = 0; i < counters->brointel_domain_count; i++)
-        {
-
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Domain[i].domain, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found domain %s.", __FILE__, __LINE__, Sagan_BroIntel_Intel_Domain[i].domain);
-                        }
-
                     return(true);
                 }
-
         }
 
     return(false);
-
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_FILE_HASH - Search FILE_HASH array
+ * Sagan_BroIntel_Scan - One pass of the automaton over the message for the
+ * substring types,  then every run of hex digits that could be a loaded
+ * hash is looked up in the set.
  *****************************************************************************/
 
-bool Sagan_BroIntel_FILE_HASH ( char *syslog_message )
+int Sagan_BroIntel_Scan ( char *syslog_message )
 {
 
-    int i;
-
-    for ( i = 0; i < counters->brointel_file_hash_count; i++)
-        {
-
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_File_Hash[i].hash, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found file hash %s.", __FILE__, __LINE__, Sagan_BroIntel_Intel_File_Hash[i].hash);
-                        }
+    struct _Sagan_BroIntel_Table *table = __atomic_load_n(&SaganBroIntel, __ATOMIC_ACQUIRE);
 
-                    return(true);
-                }
-
-        }
+    const unsigned char *p = NULL;
+    const unsigned char *start = NULL;
 
-    return(false);
-
-}
+    uint32_t s = 0;
+    int found = 0;
+    size_t length;
 
-/*****************************************************************************
- * Sagan_BroIntel_URL - Search URL array
- *****************************************************************************/
-
-bool Sagan_BroIntel_URL ( char *syslog_message )
-{
-
-    int i;
-
-    for ( i = 0; i < counters->brointel_url_count; i++)
+    if ( table == NULL )
         {
-
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_URL[i].url, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found URL \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_URL[i].url);
-                        }
-
-                    return(true);
-                }
-
+            return(0);
         }
 
-    return(false);
-}
-
-/*****************************************************************************
- * Sagan_BroIntel_SOFTWARE - Search SOFTWARE array
- ****************************************************************************/
-
-bool Sagan_BroIntel_SOFTWARE ( char *syslog_message )
-{
-
-    int i;
-
-    for ( i = 0; i < counters->brointel_software_count; i++)
+    if ( table->node_types != 0 )
         {
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Software[i].software, false) )
+            for ( p = (const unsigned char *)syslog_message; *p != '\0'; p++ )
                 {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found software \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Software[i].software);
-                        }
 
-                    return(true);
-                }
-
-        }
+                    s = Sagan_BroIntel_Next(table, s, *p);
 
-    return(false);
-}
-
-/*****************************************************************************
- * Sagan_BroIntel_EMAIL - Search EMAIL array
- *****************************************************************************/
-
-bool Sagan_BroIntel_EMAIL ( char *syslog_message )
-{
-
-    int i;
+                    if ( table->node[s].types != 0 )
+                        {
 
-    for ( i = 0; i < counters->brointel_email_count; i++)
-        {
+                            found |= table->node[s].types;
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Email[i].email, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found e-mail address \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Email[i].email);
+                            if ( ( found & table->node_types ) == table->node_types )
+                                {
+                                    break;
+                                }
                         }
-
-                    return(true);
                 }
-
         }
 
-    return(false);
-}
-
-/*****************************************************************************
- * Sagan_BroIntel_USER_NAME - Search USER_NAME array
- ****************************************************************************/
-
-bool Sagan_BroIntel_USER_NAME ( char *syslog_message )
-{
-
-    int i;
-
-    for ( i = 0; i < counters->brointel_user_name_count; i++)
+    if ( table->hash_length_max != 0 )
         {
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_User_Name[i].username, false) )
+            for ( p = (const unsigned char *)syslog_message; *p != '\0'; )
                 {
-                    if ( debug->debugbrointel )
+
+                    if ( !( ( *p >= '0' && *p <= '9' ) || ( *p >= 'a' && *p <= 'f' ) ) )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the username \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_User_Name[i].username);
+                            p++;
+                            continue;
                         }
 
-                    return(true);
-                }
-
-        }
-
-    return(false);
-}
-
-/****************************************************************************
- * Sagan_BroIntel_FILE_NAME - Search FILE_NAME array
- ****************************************************************************/
+                    for ( start = p; ( *p >= '0' && *p <= '9' ) || ( *p >= 'a' && *p <= 'f' ); p++ );
 
-bool Sagan_BroIntel_FILE_NAME ( char *syslog_message )
-{
-
-    int i;
+                    length = p - start;
 
-    for ( i = 0; i < counters->brointel_file_name_count; i++)
-        {
-
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_File_Name[i].file_name, false) )
-                {
-                    if ( debug->debugbrointel )
+                    if ( length >= table->hash_length_min && length <= table->hash_length_max )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the file name \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_File_Name[i].file_name);
+                            found |= Sagan_BroIntel_Set_Find(table, start, length) & ( BROINTEL_FILE_HASH | BROINTEL_CERT_HASH );
                         }
-
-                    return(true);
                 }
-
         }
 
-    return(false);
-}
-
-/***************************************************************************
- * Sagan_BroIntel_CERT_HASH - Search CERT_HASH array
- ***************************************************************************/
-
-bool Sagan_BroIntel_CERT_HASH ( char *syslog_message )
-{
-
-    int i;
-
-    for ( i = 0; i < counters->brointel_cert_hash_count; i++)
+    if ( debug->debugbrointel && found != 0 )
         {
-
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the CERT_HASH \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash);
-                        }
-
-                    return(true);
-                }
-
+            Sagan_Log(DEBUG, "[%s, line %d] Found Bro Intel types 0x%04x.", __FILE__, __LINE__, found);
         }
 
-    return(false);
+    return(found);
+
 }
 
@@ -40,60 +40,67 @@
 #define BROINTEL_PROCESSOR_GENERATOR_ID 1003
 
 
-typedef struct _Sagan_BroIntel_Intel_Addr _Sagan_BroIntel_Intel_Addr;
-struct _Sagan_BroIntel_Intel_Addr
+/* Intel types,  as a bit mask */
+
+#define BROINTEL_ADDR		0x0001
+#define BROINTEL_DOMAIN		0x0002
+#define BROINTEL_FILE_HASH	0x0004
+#define BROINTEL_URL		0x0008
+#define BROINTEL_SOFTWARE	0x0010
+#define BROINTEL_EMAIL		0x0020
+#define BROINTEL_USER_NAME	0x0040
+#define BROINTEL_FILE_NAME	0x0080
+#define BROINTEL_CERT_HASH	0x0100
+
+/* Exact match set slot.  Intel::ADDR (as IP2Bit() bits) and hex
+   FILE_HASH/CERT_HASH values are looked up here. */
+
+typedef struct _Sagan_BroIntel_Key _Sagan_BroIntel_Key;
+struct _Sagan_BroIntel_Key
 {
-    unsigned char bits_ip[MAXIPBIT];
+    uint64_t hash;
+    uint32_t offset;		/* Where the key bytes start in "keys" */
+    uint16_t length;		/* 0 == empty slot */
+    uint16_t types;
 };
 
-typedef struct _Sagan_BroIntel_Intel_Domain _Sagan_BroIntel_Intel_Domain;
-struct _Sagan_BroIntel_Intel_Domain
-{
-    char domain[255];
-};
+/* Aho-Corasick automaton node for every other type.  Nodes are numbered
+   breadth first,  so the children of a node are "child_count" nodes in a
+   row starting at "child" and their bytes are together in "label".  Node 0
+   is the root. */
 
-typedef struct _Sagan_BroIntel_Intel_File_Hash _Sagan_BroIntel_Intel_File_Hash;
-struct _Sagan_BroIntel_Intel_File_Hash
+typedef struct _Sagan_BroIntel_Node _Sagan_BroIntel_Node;
+struct _Sagan_BroIntel_Node
 {
-    char hash[64];
+    uint32_t child;
+    uint32_t fail;		/* Longest proper suffix that is also a prefix */
+    uint16_t child_count;
+    uint16_t types;		/* Types of the patterns ending here or at a suffix */
 };
 
-typedef struct _Sagan_BroIntel_Intel_URL _Sagan_BroIntel_Intel_URL;
-struct _Sagan_BroIntel_Intel_URL
+typedef struct _Sagan_BroIntel_Table _Sagan_BroIntel_Table;
+struct _Sagan_BroIntel_Table
 {
-    char url[10240];
-};
 
-typedef struct _Sagan_BroIntel_Intel_Software _Sagan_BroIntel_Intel_Software;
-struct _Sagan_BroIntel_Intel_Software
-{
-    char software[128];
-};
+    struct _Sagan_BroIntel_Key *set;
+    uint32_t set_size;		/* Power of 2 */
+    uint32_t set_count;
 
-typedef struct _Sagan_BroIntel_Intel_Email _Sagan_BroIntel_Intel_Email;
-struct _Sagan_BroIntel_Intel_Email
-{
-    char email[128];
-};
+    unsigned char *keys;
+    uint32_t keys_length;
+    uint32_t keys_size;
 
-typedef struct _Sagan_BroIntel_Intel_User_Name _Sagan_BroIntel_Intel_User_Name;
-struct _Sagan_BroIntel_Intel_User_Name
-{
-    char username[64];
-};
+    uint16_t hash_length_min;	/* Range of hex hash lengths loaded */
+    uint16_t hash_length_max;
 
-typedef struct _Sagan_BroIntel_Intel_File_Name _Sagan_BroIntel_Intel_File_Name;
-struct _Sagan_BroIntel_Intel_File_Name
-{
-    char file_name[128];
-};
+    struct _Sagan_BroIntel_Node *node;
+    unsigned char *label;
+    uint32_t node_count;
+    uint16_t node_types;	/* Every type loaded into the automaton */
 
-typedef struct _Sagan_BroIntel_Intel_Cert_Hash _Sagan_BroIntel_Intel_Cert_Hash;
-struct _Sagan_BroIntel_Intel_Cert_Hash
-{
-    char cert_hash[64];
-};
+    uint32_t root[256];		/* Root transitions,  0 == stay at the root */
 
+};
 
 void Sagan_BroIntel_Init(void);
 void Sagan_BroIntel_Load_File(void);
@@ -101,12 +108,8 @@ void Sagan_BroIntel_Load_File(void);
 bool  Sagan_BroIntel_IPADDR ( unsigned char *, char *ipaddr );
 bool  Sagan_BroIntel_IPADDR_All ( char *, _Sagan_Lookup_Cache_Entry *, size_t);
 
-bool  Sagan_BroIntel_DOMAIN ( char * );
-bool  Sagan_BroIntel_FILE_HASH ( char * );
-bool  Sagan_BroIntel_URL ( char * );
-bool  Sagan_BroIntel_SOFTWARE( char * );
-bool  Sagan_BroIntel_EMAIL( char * );
-bool  Sagan_BroIntel_USER_NAME ( char * );
-bool  Sagan_BroIntel_FILE_NAME ( char * );
-bool  Sagan_BroIntel_CERT_HASH ( char * );
+/* Expects the lowercased message.  Intel values are lowercased at load.
+   Returns the BROINTEL_* types found in it. */
+
+int   Sagan_BroIntel_Scan ( char * );
 
@@ -52,6 +52,8 @@
 #include "sagan-config.h"
 
 #include "lockfile.h"
+#include "util-time.h"
+#include "ipc-index.h"
 
 #include "processors/client-stats.h"
 
@@ -62,6 +64,7 @@ struct _SaganCounters *counters;
 struct _SaganDebug *debug;
 
 struct _Client_Stats_Struct *Client_Stats = NULL;
+struct _Sagan_IPC_Index *Client_Stats_Index = NULL;
 
 pthread_mutex_t ClientStatsMutex=PTHREAD_MUTEX_INITIALIZER;
 
@@ -90,6 +93,17 @@ void Client_Stats_Init( void )
 
     memset(Client_Stats, 0, sizeof(struct _Client_Stats_Struct));
 
+    /* Address hash -> position in Client_Stats */
+
+    Client_Stats_Index = malloc(IPC_Index_Bytes(config->client_stats_max));
+
+    if ( Client_Stats_Index == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Client_Stats_Index. Abort!", __FILE__, __LINE__);
+        }
+
+    IPC_Index_Init(Client_Stats_Index, config->client_stats_max);
+
 }
 
 /****************************************************************************
@@ -202,70 +216,57 @@ void Client_Stats_Add_Update_IP( char *ip, char *program, char *message )
     uint32_t hash = Djb2_Hash( ip );
 
     int i = 0;
-    time_t t;
-    struct tm *now;
-    uint64_t epoch = 0;
-    char timet[20];
+    uint64_t epoch = Return_Epoch();
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-    epoch = atol(timet);
+    pthread_mutex_lock(&ClientStatsMutex);
 
+    i = IPC_Index_Find(Client_Stats_Index, 0, 0, hash);
 
-    for ( i = 0; i < counters->client_stats_count; i++ )
+    if ( i != -1 )
         {
 
-            /* Search here */
+            Client_Stats[i].epoch = epoch;
 
-            if ( Client_Stats[i].hash == hash )
+            if ( Client_Stats[i].epoch > Client_Stats[i].old_epoch + config->client_stats_interval)
                 {
-                    Client_Stats[i].epoch = epoch;
 
-                    if ( Client_Stats[i].epoch > Client_Stats[i].old_epoch + config->client_stats_interval)
+                    if ( debug->debugclient_stats )
                         {
+                            Sagan_Log(DEBUG,"[%s, line %d] Updating program/message data for IP address %s [%d]", __FILE__, __LINE__, ip, i);
+                        }
 
+                    strlcpy( Client_Stats[i].program, program, sizeof(Client_Stats[i].program) );
+                    strlcpy( Client_Stats[i].message, message, sizeof(Client_Stats[i].message) );
 
-                            if ( debug->debugclient_stats )
-                                {
-                                    Sagan_Log(DEBUG,"[%s, line %d] Updating program/message data for IP address %s [%d]", __FILE__, __LINE__, ip, i);
-                                }
-
-                            pthread_mutex_lock(&ClientStatsMutex);
-
-                            strlcpy( Client_Stats[i].program, program, sizeof(Client_Stats[i].program) );
-                            strlcpy( Client_Stats[i].message, message, sizeof(Client_Stats[i].message) );
-
-                            Client_Stats[i].old_epoch = epoch;
-
-                            pthread_mutex_unlock(&ClientStatsMutex);
+                    Client_Stats[i].old_epoch = epoch;
 
-                        }
+                }
 
-                    return;
+            pthread_mutex_unlock(&ClientStatsMutex);
 
-                }
+            return;
 
         }
 
     if ( counters->client_stats_count < config->client_stats_max )
         {
 
-            pthread_mutex_lock(&ClientStatsMutex);
-
             if ( debug->debugclient_stats )
                 {
                     Sagan_Log(DEBUG,"[%s, line %d] Adding client IP address %s [%d]", __FILE__, __LINE__, ip, counters->client_stats_count);
                 }
 
+            i = counters->client_stats_count;
+
+            Client_Stats[i].hash = hash;
+            Client_Stats[i].epoch = epoch;
+            Client_Stats[i].old_epoch = epoch;
 
-            Client_Stats[counters->client_stats_count].hash = hash;
-            Client_Stats[counters->client_stats_count].epoch = epoch;
-            Client_Stats[counters->client_stats_count].old_epoch = epoch;
+            strlcpy(Client_Stats[i].ip, ip, sizeof(Client_Stats[i].ip));
+            strlcpy( Client_Stats[i].program, program, sizeof(Client_Stats[i].program ) );
+            strlcpy( Client_Stats[i].message, message, sizeof(Client_Stats[i].message ) );
 
-            strlcpy(Client_Stats[counters->client_stats_count].ip, ip, sizeof(Client_Stats[counters->client_stats_count].ip));
-            strlcpy( Client_Stats[counters->client_stats_count].program, program, sizeof(Client_Stats[counters->client_stats_count].program ) );
-            strlcpy( Client_Stats[counters->client_stats_count].message, message, sizeof(Client_Stats[counters->client_stats_count].message ) );
+            IPC_Index_Insert(Client_Stats_Index, 0, 0, hash, i);
 
             counters->client_stats_count++;
 
@@ -276,6 +277,8 @@ void Client_Stats_Add_Update_IP( char *ip, char *program, char *message )
 
         {
 
+            pthread_mutex_unlock(&ClientStatsMutex);
+
             Sagan_Log(WARN, "[%s, line %d] 'clients-stats' processors ran out of space.  Consider increasing 'max-clients'!", __FILE__, __LINE__);
 
 
@@ -51,6 +51,7 @@ struct _Rules_Loaded *rules_loaded;
 struct _SaganCounters *counters;
 
 bool reload_rules;
+bool dynamic_rules_rebuild;
 
 pthread_mutex_t SaganRulesLoadedMutex;
 pthread_mutex_t CounterDynamicGenericMutex=PTHREAD_MUTEX_INITIALIZER;
@@ -134,6 +135,12 @@ int Sagan_Dynamic_Rules ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_po
 
             Load_Rules(RuleBody[rule_position].DynamicLoad.dynamic_ruleset);
 
+            /* This thread is in the middle of a batch with the current
+               prefilter and hot table,  so they can't be rebuilt (and
+               freed) here.  Processor() does it after the batch */
+
+            __atomic_store_n(&dynamic_rules_rebuild, true, __ATOMIC_SEQ_CST);
+
             reload_rules = 0;
             pthread_mutex_unlock(&SaganRulesLoadedMutex);
 
@@ -42,7 +42,6 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "aetas.h"
-#include "meta-content.h"
 #include "send-alert.h"
 #include "flexbit.h"
 #include "flexbit-mmap.h"
@@ -53,6 +52,10 @@
 #include "after.h"
 #include "threshold.h"
 #include "xbit.h"
+#include "prefilter.h"
+#include "rules-hot.h"
+#include "meta-content.h"
+#include "replay.h"
 
 #include "parsers/parsers.h"
 
@@ -90,10 +93,37 @@ struct _Sagan_IPC_Counters *counters_ipc;
 
 void Sagan_Engine_Init ( void )
 {
-    /* Nothing to do yet */
+
+    /* Compile the content/meta_content prefilter for the loaded rule set */
+
+    Prefilter_Build();
+
+    /* Pack what every line reads for every rule into the hot table */
+
+    Rules_Hot_Build();
+
 }
 
-int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_flag )
+/****************************************************************************
+ * Sagan_Engine_Fold - Returns the lower case copy of the message,  making
+ * it the first time a rule on this line asks.  Most lines never get past
+ * the prefilter to a "nocase" search and never pay for the copy.
+ ****************************************************************************/
+
+static char *Sagan_Engine_Fold( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, char *lower, bool *folded )
+{
+
+    if ( *folded == false )
+        {
+            strlcpy(lower, SaganProcSyslog_LOCAL->syslog_message, MAX_SYSLOGMSG);
+            To_LowerC(lower);
+            *folded = true;
+        }
+
+    return(lower);
+}
+
+int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_flag, int only_rule )
 {
 
     struct _Sagan_Processor_Info *processor_info_engine = NULL;
@@ -116,6 +146,9 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
     memset(lookup_cache, 0, sizeof(_Sagan_Lookup_Cache_Entry) * MAX_PARSE_IP);
 
+    struct _Sagan_Parse_Context parse_context;
+    memset(&parse_context, 0, sizeof(parse_context));
+
     bool after_log_flag = false;
     bool thresh_log_flag = false;
 
@@ -124,6 +157,9 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
     int b = 0;
     int z = 0;
 
+    int profile_rule = -1;		/* Replay (-R) rule timing */
+    uint64_t profile_start = 0;
+
     bool match = false;
     int sagan_match = 0;	/* Used to determine if all has "matched" (content, pcre, meta_content, etc) */
 
@@ -141,9 +177,6 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
     bool alert_time_trigger = false;
     bool check_flow_return = true;  /* 1 = match, 0 = no match */
 
-    char *ptmp;
-    char *tok2;
-
     char parse_ip_src[MAXIP] = { 0 };
     char parse_ip_dst[MAXIP] = { 0 };
     char parse_md5_hash[MD5_HASH_SIZE+1] = { 0 };
@@ -160,16 +193,27 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
     uint32_t ip_dstport_u32 = 0;
     unsigned char ip_dst_bits[MAXIPBIT] = { 0 };
 
-    char tmpbuf[128] = { 0 };
     char s_msg[1024] = { 0 };
     char alter_content[MAX_SYSLOGMSG] = { 0 };
     char meta_alter_content[MAX_SYSLOGMSG] = { 0 };
 
+    char syslog_message_lower[MAX_SYSLOGMSG];	/* Folded one time,  shared by "nocase" searches */
+    bool syslog_message_folded = false;		/* Only once a rule needs it */
+    char *content_source = NULL;
+    const char *search = NULL;
+
+    struct _Sagan_Rules_Hot *hot = NULL;
+    struct _Sagan_Rule_Hot *rule_hot = NULL;
+    struct _Sagan_Rule_Content *rule_content = NULL;
+    struct _Sagan_Rule_Meta *rule_meta = NULL;
+    struct _Sagan_Rule_Pcre *rule_pcre = NULL;
+
     struct timeval tp;
     unsigned char proto = 0;
     int lookup_cache_size = 0;
 
     bool brointel_results = false;
+    int brointel_types = -1;			/* Sagan_BroIntel_Scan(),  once per line and only if needed */
     bool blacklist_results = false;
 
     char *ip_src = NULL;
@@ -296,10 +340,54 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
     /* First we search for 'program' and such.   This way,  we don't waste CPU
      * time with pcre/content.  */
 
+    /* One hash lookup per header field (program, facility, etc) and one pass
+       over the message for every rule's content/meta_content literals.  Rules
+       that can't possibly match are skipped below */
+
+    if ( only_rule < 0 )
+        {
+            Prefilter_Scan( SaganProcSyslog_LOCAL );
+        }
+
+    /* Counts,  content modifiers and pcre handles come from the packed
+       table,  RuleBody is only read once a rule has matched */
+
+    hot = Rules_Hot_Get();
+
+    /* "only_rule" is a single rule being run again on a line,  like after a
+       deferred Bluedot lookup.  It already got past the prefilter once */
 
-    for(b=0; b < counters->rulecount; b++)
+    for(b = ( only_rule < 0 ? 0 : only_rule ); b < counters->rulecount; b++)
         {
 
+            if ( only_rule >= 0 )
+                {
+                    if ( b != only_rule )
+                        {
+                            break;
+                        }
+                }
+
+            else if ( Prefilter_Candidate(b) == false )
+                {
+                    continue;
+                }
+
+            /* Added by "dynamic_load",  not in the table until Processor()
+               rebuilds it after the batch */
+
+            if ( hot == NULL || b >= hot->rule_count )
+                {
+                    continue;
+                }
+
+            rule_hot = &hot->rules[b];
+
+            if ( config->sagan_replay == true )
+                {
+                    Replay_Profile_Lap( &profile_rule, &profile_start, b );
+                }
+
             ip_src_flag = false;
             ip_dst_flag = false;
 
@@ -393,96 +481,13 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
             /* Process "normal" rules.  Skip dynamic rules if it's not time to process them */
 
-            if ( RuleBody[b].DynamicLoad.has_dynamic == false || ( RuleBody[b].DynamicLoad.has_dynamic == true && dynamic_rule_flag == true ) )
+            if ( rule_hot->has_dynamic == false || dynamic_rule_flag == true )
                 {
 
-                    match = false;
-
-                    if ( RuleBody[b].s_program[0] != '\0' )
-                        {
-
-                            strlcpy(tmpbuf, RuleBody[b].s_program, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
+                    /* program/facility/level/tag/syslog priority were already checked
+                       by the prefilter header index (Prefilter_Candidate() above) */
 
-                            while ( ptmp != NULL )
-                                {
-                                    if ( Wildcard(ptmp, SaganProcSyslog_LOCAL->syslog_program) == 1 )
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( RuleBody[b].s_facility[0] != '\0' )
-                        {
-                            strlcpy(tmpbuf, RuleBody[b].s_facility, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_facility))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( RuleBody[b].s_level[0] != '\0' )
-                        {
-                            strlcpy(tmpbuf, RuleBody[b].s_level, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_level))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( RuleBody[b].s_tag[0] != '\0' )
-                        {
-                            strlcpy(tmpbuf, RuleBody[b].s_tag, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_tag))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( RuleBody[b].s_syspri[0] != '\0' )
-                        {
-                            strlcpy(tmpbuf, RuleBody[b].s_syspri, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_priority))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
+                    match = false;
 
                     /* If there has been a match above,  or NULL on all,  then we continue with
                      * PCRE/content search */
@@ -492,25 +497,36 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                     if ( match == false )
                         {
 
-                            if ( RuleBody[b].content_count != 0 )
+                            if ( rule_hot->content_count != 0 )
                                 {
 
-                                    for(z=0; z<RuleBody[b].content_count; z++)
+                                    for(z=0; z<rule_hot->content_count; z++)
                                         {
 
+                                            rule_content = &hot->contents[rule_hot->content + z];
+
+                                            /* "nocase" content is searched for in the folded copy of the message */
+
+                                            content_source = rule_content->nocase == true ?
+                                                             Sagan_Engine_Fold(SaganProcSyslog_LOCAL, syslog_message_lower, &syslog_message_folded) :
+                                                             SaganProcSyslog_LOCAL->syslog_message;
+
+                                            /* No offset/depth/distance,  search the message in place */
+
+                                            search = content_source;
 
                                             /* Content: OFFSET */
 
                                             alter_num = 0;
 
-                                            if ( RuleBody[b].s_offset[z] != 0 )
+                                            if ( rule_content->offset != 0 )
                                                 {
 
-                                                    if ( strlen(SaganProcSyslog_LOCAL->syslog_message) > RuleBody[b].s_offset[z] )
+                                                    if ( strlen(content_source) > rule_content->offset )
                                                         {
 
-                                                            alter_num = strlen(SaganProcSyslog_LOCAL->syslog_message) - RuleBody[b].s_offset[z];
-                                                            strlcpy(alter_content, SaganProcSyslog_LOCAL->syslog_message + (strlen(SaganProcSyslog_LOCAL->syslog_message) - alter_num), alter_num + 1);
+                                                            alter_num = strlen(content_source) - rule_content->offset;
+                                                            strlcpy(alter_content, content_source + (strlen(content_source) - alter_num), alter_num + 1);
 
                                                         }
                                                     else
@@ -520,78 +536,52 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                                         }
 
-                                                }
-                                            else
-                                                {
-
-                                                    strlcpy(alter_content, SaganProcSyslog_LOCAL->syslog_message, sizeof(alter_content));
+                                                    search = alter_content;
 
                                                 }
 
                                             /* Content: DEPTH */
 
-                                            if ( RuleBody[b].s_depth[z] != 0 )
+                                            if ( rule_content->depth != 0 )
                                                 {
 
+                                                    if ( search != alter_content )
+                                                        {
+                                                            strlcpy(alter_content, content_source, sizeof(alter_content));
+                                                        }
+
                                                     /* We do +2 to account for alter_count[0] and whitespace at the begin of syslog message */
 
-                                                    strlcpy(alter_content, alter_content, RuleBody[b].s_depth[z] + 2);
+                                                    strlcpy(alter_content, alter_content, rule_content->depth + 2);
+                                                    search = alter_content;
 
                                                 }
 
                                             /* Content: DISTANCE */
 
-                                            if ( RuleBody[b].s_distance[z] != 0 )
+                                            if ( rule_content->distance != 0 )
                                                 {
 
-                                                    alter_num = strlen(SaganProcSyslog_LOCAL->syslog_message) - ( RuleBody[b].s_depth[z-1] + RuleBody[b].s_distance[z] + 1);
-                                                    strlcpy(alter_content, SaganProcSyslog_LOCAL->syslog_message + (strlen(SaganProcSyslog_LOCAL->syslog_message) - alter_num), alter_num + 1);
+                                                    alter_num = strlen(content_source) - ( rule_content->prev_depth + rule_content->distance + 1);
+                                                    strlcpy(alter_content, content_source + (strlen(content_source) - alter_num), alter_num + 1);
 
                                                     /* Content: WITHIN */
 
-                                                    if ( RuleBody[b].s_within[z] != 0 )
+                                                    if ( rule_content->within != 0 )
                                                         {
-                                                            strlcpy(alter_content, alter_content, RuleBody[b].s_within[z] + 1);
+                                                            strlcpy(alter_content, alter_content, rule_content->within + 1);
 
                                                         }
 
-                                                }
-
-                                            /* If case insensitive */
+                                                    search = alter_content;
 
-                                            if ( RuleBody[b].s_nocase[z] == 1 )
-                                                {
-
-                                                    if (RuleBody[b].content_not[z] != 1 && Sagan_stristr(alter_content, RuleBody[b].s_content[z], false))
-
-                                                        {
-                                                            sagan_match++;
-                                                        }
-                                                    else
-                                                        {
-
-                                                            /* for content: ! */
-
-                                                            if ( RuleBody[b].content_not[z] == 1 && !Sagan_stristr(alter_content, RuleBody[b].s_content[z], false)) sagan_match++;
-
-                                                        }
                                                 }
-                                            else
-                                                {
-
-                                                    /* If case sensitive */
 
-                                                    if ( RuleBody[b].content_not[z] != 1 && Sagan_strstr(alter_content, RuleBody[b].s_content[z] ))
-                                                        {
-                                                            sagan_match++;
-                                                        }
-                                                    else
-                                                        {
+                                            /* Found for content:,  not found for content: ! */
 
-                                                            /* for content: ! */
-                                                            if ( RuleBody[b].content_not[z] == 1 && !Sagan_strstr(alter_content, RuleBody[b].s_content[z])) sagan_match++;
-
-                                                        }
+                                            if ( ( Sagan_strstr(search, rule_content->pattern) != NULL ) != rule_content->negate )
+                                                {
+                                                    sagan_match++;
                                                 }
                                         }
                                 }
@@ -602,13 +592,15 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                              * if there is a "content",  but that has failed,  there is no point in doing the
                              * pcre or meta_content. */
 
-                            if ( RuleBody[b].pcre_count != 0 && sagan_match == RuleBody[b].content_count )
+                            if ( rule_hot->pcre_count != 0 && sagan_match == rule_hot->content_count )
                                 {
 
-                                    for(z=0; z<RuleBody[b].pcre_count; z++)
+                                    for(z=0; z<rule_hot->pcre_count; z++)
                                         {
 
-                                            rc = pcre_exec( RuleBody[b].re_pcre[z], RuleBody[b].pcre_extra[z], SaganProcSyslog_LOCAL->syslog_message, (int)strlen(SaganProcSyslog_LOCAL->syslog_message), 0, 0, ovector, PCRE_OVECCOUNT);
+                                            rule_pcre = &hot->pcres[rule_hot->pcre + z];
+
+                                            rc = pcre_exec( rule_pcre->re, rule_pcre->extra, SaganProcSyslog_LOCAL->syslog_message, (int)strlen(SaganProcSyslog_LOCAL->syslog_message), 0, 0, ovector, PCRE_OVECCOUNT);
 
                                             if ( rc > 0 )
                                                 {
@@ -620,24 +612,30 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                             /* Search via meta_content */
 
-                            if ( RuleBody[b].meta_content_count != 0 && sagan_match == RuleBody[b].content_count + RuleBody[b].pcre_count )
+                            if ( rule_hot->meta_content_count != 0 && sagan_match == rule_hot->content_count + rule_hot->pcre_count )
                                 {
 
-                                    for (z=0; z<RuleBody[b].meta_content_count; z++)
+                                    for (z=0; z<rule_hot->meta_content_count; z++)
                                         {
 
+                                            rule_meta = &hot->metas[rule_hot->meta + z];
+
                                             meta_alter_num = 0;
 
+                                            content_source = rule_meta->nocase == true ?
+                                                             Sagan_Engine_Fold(SaganProcSyslog_LOCAL, syslog_message_lower, &syslog_message_folded) :
+                                                             SaganProcSyslog_LOCAL->syslog_message;
+
                                             /* Meta_content: OFFSET */
 
-                                            if ( RuleBody[b].meta_offset[z] != 0 )
+                                            if ( rule_meta->offset != 0 )
                                                 {
 
-                                                    if ( strlen(SaganProcSyslog_LOCAL->syslog_message) > RuleBody[b].meta_offset[z] )
+                                                    if ( strlen(content_source) > rule_meta->offset )
                                                         {
 
-                                                            meta_alter_num = strlen(SaganProcSyslog_LOCAL->syslog_message) - RuleBody[b].meta_offset[z];
-                                                            strlcpy(meta_alter_content, SaganProcSyslog_LOCAL->syslog_message + (strlen(SaganProcSyslog_LOCAL->syslog_message) - meta_alter_num), meta_alter_num + 1);
+                                                            meta_alter_num = strlen(content_source) - rule_meta->offset;
+                                                            strlcpy(meta_alter_content, content_source + (strlen(content_source) - meta_alter_num), meta_alter_num + 1);
 
                                                         }
                                                     else
@@ -651,41 +649,41 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             else
                                                 {
 
-                                                    strlcpy(meta_alter_content, SaganProcSyslog_LOCAL->syslog_message, sizeof(meta_alter_content));
+                                                    strlcpy(meta_alter_content, content_source, sizeof(meta_alter_content));
 
                                                 }
 
 
                                             /* Meta_content: DEPTH */
 
-                                            if ( RuleBody[b].meta_depth[z] != 0 )
+                                            if ( rule_meta->depth != 0 )
                                                 {
 
                                                     /* We do +2 to account for alter_count[0] and whitespace at the begin of syslog message */
 
-                                                    strlcpy(meta_alter_content, meta_alter_content, RuleBody[b].meta_depth[z] + 2);
+                                                    strlcpy(meta_alter_content, meta_alter_content, rule_meta->depth + 2);
 
                                                 }
 
                                             /* Meta_content: DISTANCE */
 
-                                            if ( RuleBody[b].meta_distance[z] != 0 )
+                                            if ( rule_meta->distance != 0 )
                                                 {
 
-                                                    meta_alter_num = strlen(SaganProcSyslog_LOCAL->syslog_message) - ( RuleBody[b].meta_depth[z-1] + RuleBody[b].meta_distance[z] + 1 );
-                                                    strlcpy(meta_alter_content, SaganProcSyslog_LOCAL->syslog_message + (strlen(SaganProcSyslog_LOCAL->syslog_message) - meta_alter_num), meta_alter_num + 1);
+                                                    meta_alter_num = strlen(content_source) - ( rule_meta->prev_depth + rule_meta->distance + 1 );
+                                                    strlcpy(meta_alter_content, content_source + (strlen(content_source) - meta_alter_num), meta_alter_num + 1);
 
                                                     /* Meta_ontent: WITHIN */
 
-                                                    if ( RuleBody[b].meta_within[z] != 0 )
+                                                    if ( rule_meta->within != 0 )
                                                         {
-                                                            strlcpy(meta_alter_content, meta_alter_content, RuleBody[b].meta_within[z] + 1);
+                                                            strlcpy(meta_alter_content, meta_alter_content, rule_meta->within + 1);
 
                                                         }
 
                                                 }
 
-                                            rc = Meta_Content_Search(meta_alter_content, b, z);
+                                            rc = Meta_Content_Search(meta_alter_content, hot, rule_meta);
 
                                             if ( rc == 1 )
                                                 {
@@ -700,7 +698,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                     /* if you got match */
 
-                    if ( sagan_match == RuleBody[b].pcre_count + RuleBody[b].content_count + RuleBody[b].meta_content_count )
+                    if ( sagan_match == rule_hot->match_count )
                         {
 
                             if ( match == false )
@@ -775,11 +773,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                             }
                                                     }
 
-                                                    else
-                                                        {
-
-                                                            IP2Bit(ip_src, ip_src_bits);
-                                                        }
+                                                    IP2Bit(ip_src, ip_src_bits);
 
 
                                                 }
@@ -801,10 +795,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                             }
                                                     }
 
-                                                    else
-                                                        {
-                                                            IP2Bit(ip_dst, ip_dst_bits);
-                                                        }
+                                                    IP2Bit(ip_dst, ip_dst_bits);
 
 
                                                 }
@@ -845,20 +836,24 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                     /* parse_src_ip: {position} - Parse_IP build a cache table for IPs, ports, etc.  This way,
                                     we only parse the syslog string one time regardless of the rule options! */
 
-                                    if ( RuleBody[b].s_find_src_ip == 1 ||
-                                            RuleBody[b].s_find_src_ip == 1 ||
+                                    if ( parse_context.ip_parsed == false && (
+                                                RuleBody[b].s_find_src_ip == 1 ||
+                                                RuleBody[b].s_find_dst_ip == 1 ||
                                             RuleBody[b].Blacklist.blacklist_ipaddr_all == 1 ||
                                             RuleBody[b].s_find_proto == 1 ||
 #ifdef WITH_BLUEDOT
                                             RuleBody[b].BlueDot.bluedot_ipaddr_type == 4 ||
 #endif
-                                            RuleBody[b].BroIntel.brointel_ipaddr_all == 1 )
+                                            RuleBody[b].BroIntel.brointel_ipaddr_all == 1 ) )
                                         {
 
-                                            lookup_cache_size = Parse_IP(SaganProcSyslog_LOCAL->syslog_message, lookup_cache );
+                                            parse_context.lookup_cache_size = Parse_IP(SaganProcSyslog_LOCAL->syslog_message, lookup_cache );
+                                            parse_context.ip_parsed = true;
 
                                         }
 
+                                    lookup_cache_size = parse_context.lookup_cache_size;
+
                                     if ( ip_src_flag == false && RuleBody[b].s_find_src_ip == true )
                                         {
 
@@ -878,6 +873,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                             {
 
                                                                 ip_src = SaganProcSyslog_LOCAL->syslog_host;
+                                                                IP2Bit(ip_src, ip_src_bits);
                                                                 ip_src_flag = false;
                                                             }
                                                     }
@@ -912,6 +908,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                             {
 
                                                                 ip_dst = SaganProcSyslog_LOCAL->syslog_host;
+                                                                IP2Bit(ip_dst, ip_dst_bits);
                                                                 ip_dst_flag = false;
 
                                                             }
@@ -927,22 +924,40 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                     /* parse_hash: md5 */
 
-                                    if ( parse_md5_hash[0] == '\0' && RuleBody[b].s_find_hash_type == PARSE_HASH_MD5 )
+                                    if ( RuleBody[b].s_find_hash_type == PARSE_HASH_MD5 )
                                         {
-                                            Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_MD5, parse_md5_hash, sizeof(parse_md5_hash));
-                                            md5_hash = parse_md5_hash;
+
+                                            if ( parse_context.md5_parsed == false )
+                                                {
+                                                    Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_MD5, parse_context.md5_hash, sizeof(parse_context.md5_hash));
+                                                    parse_context.md5_parsed = true;
+                                                }
+
+                                            md5_hash = parse_context.md5_hash;
                                         }
 
-                                    else if ( parse_sha1_hash[0] == '\0' && RuleBody[b].s_find_hash_type == PARSE_HASH_SHA1 )
+                                    else if ( RuleBody[b].s_find_hash_type == PARSE_HASH_SHA1 )
                                         {
-                                            Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_SHA1, parse_sha256_hash, sizeof(parse_sha1_hash));
-                                            sha1_hash = parse_sha1_hash;
+
+                                            if ( parse_context.sha1_parsed == false )
+                                                {
+                                                    Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_SHA1, parse_context.sha1_hash, sizeof(parse_context.sha1_hash));
+                                                    parse_context.sha1_parsed = true;
+                                                }
+
+                                            sha1_hash = parse_context.sha1_hash;
                                         }
 
-                                    else if ( parse_sha256_hash[0] == '\0' && RuleBody[b].s_find_hash_type == PARSE_HASH_SHA256 )
+                                    else if ( RuleBody[b].s_find_hash_type == PARSE_HASH_SHA256 )
                                         {
-                                            Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_SHA256, parse_sha256_hash, sizeof(parse_sha256_hash));
-                                            sha256_hash = parse_sha256_hash;
+
+                                            if ( parse_context.sha256_parsed == false )
+                                                {
+                                                    Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_SHA256, parse_context.sha256_hash, sizeof(parse_context.sha256_hash));
+                                                    parse_context.sha256_parsed = true;
+                                                }
+
+                                            sha256_hash = parse_context.sha256_hash;
                                         }
 
                                     /*  DEBUG
@@ -958,7 +973,14 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                     if ( RuleBody[b].s_find_proto_program == true )
                                         {
-                                            proto = Parse_Proto_Program(SaganProcSyslog_LOCAL->syslog_program);
+
+                                            if ( parse_context.proto_program_parsed == false )
+                                                {
+                                                    parse_context.proto_program = Parse_Proto_Program(SaganProcSyslog_LOCAL->syslog_program);
+                                                    parse_context.proto_program_parsed = true;
+                                                }
+
+                                            proto = parse_context.proto_program;
                                         }
 
 
@@ -986,9 +1008,9 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                             ip_src = SaganProcSyslog_LOCAL->syslog_host;
 							}
 
-						    IP2Bit(ip_src, ip_src_bits);
-
 						}
+
+                                                IP2Bit(ip_src, ip_src_bits);
                                             }
 
 					    if ( ip_dst_flag == false ) {
@@ -1013,8 +1035,9 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 							    ip_dst = SaganProcSyslog_LOCAL->syslog_host;
 							}
 
-						    IP2Bit(ip_dst, ip_dst_bits);
 						}
+
+                                                IP2Bit(ip_dst, ip_dst_bits);
                                             }
 
 
@@ -1172,12 +1195,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                             if ( ip_src_flag == true && RuleBody[b].GeoIP.geoip2_src_or_dst == 1 )
                                                 {
-                                                    geoip2_return = GeoIP2_Lookup_Country(ip_src, b );
+                                                    geoip2_return = GeoIP2_Lookup_Country(ip_src, ip_src_bits, b );
                                                 }
 
                                             else if ( ip_dst_flag == true && RuleBody[b].GeoIP.geoip2_src_or_dst == 2 )
                                                 {
-                                                    geoip2_return = GeoIP2_Lookup_Country(ip_dst, b );
+                                                    geoip2_return = GeoIP2_Lookup_Country(ip_dst, ip_dst_bits, b );
                                                 }
 
                                             if ( geoip2_return != GEOIP_SKIP )
@@ -1280,6 +1303,8 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             bluedot_results = 0;
                                             bluedot_json[0] = '\0';
 
+                                            Sagan_Bluedot_Defer_Reset();
+
                                             if ( RuleBody[b].BlueDot.bluedot_ipaddr_type )
                                                 {
 
@@ -1287,27 +1312,27 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                                     if ( RuleBody[b].BlueDot.bluedot_ipaddr_type == 1 && ip_src_flag )
                                                         {
-                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                             bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                         }
 
                                                     if ( RuleBody[b].BlueDot.bluedot_ipaddr_type == 2 && ip_dst_flag )
                                                         {
-                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                             bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                         }
 
                                                     if ( RuleBody[b].BlueDot.bluedot_ipaddr_type == 3 && ip_src_flag && ip_dst_flag )
                                                         {
 
-                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                             bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
 
                                                             /* If the source isn't found,  then check the dst */
 
                                                             if ( bluedot_ip_flag != 0 )
                                                                 {
-                                                                    bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json));
+                                                                    bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                                     bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                                 }
 
@@ -1316,7 +1341,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     if ( lookup_cache_size > 0 && RuleBody[b].BlueDot.bluedot_ipaddr_type == 4 )
                                                         {
 
-                                                            bluedot_ip_flag = Sagan_Bluedot_IP_Lookup_All(SaganProcSyslog_LOCAL->syslog_message, b, lookup_cache, lookup_cache_size );
+                                                            bluedot_ip_flag = Sagan_Bluedot_IP_Lookup_All(SaganProcSyslog_LOCAL, b, lookup_cache, lookup_cache_size );
 
                                                         }
 
@@ -1330,7 +1355,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     if ( md5_hash[0] != '\0')
                                                         {
 
-                                                            bluedot_results = Sagan_Bluedot_Lookup( md5_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup( md5_hash, BLUEDOT_LOOKUP_HASH, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                             bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH);
 
                                                         }
@@ -1338,7 +1363,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     if ( sha256_hash[0] != '\0' )
                                                         {
 
-                                                            bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                             bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH );
 
                                                         }
@@ -1346,7 +1371,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     if ( sha256_hash[0] != '\0')
                                                         {
 
-                                                            bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                             bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH);
 
                                                         }
@@ -1356,7 +1381,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             if ( RuleBody[b].BlueDot.bluedot_url && normalize_http_uri != NULL )
                                                 {
 
-                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_http_uri, BLUEDOT_LOOKUP_URL, b, bluedot_json, sizeof(bluedot_json));
+                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_http_uri, BLUEDOT_LOOKUP_URL, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                     bluedot_url_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_URL);
 
                                                 }
@@ -1364,27 +1389,20 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             if ( RuleBody[b].BlueDot.bluedot_filename && normalize_filename != NULL )
                                                 {
 
-                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_filename, BLUEDOT_LOOKUP_FILENAME, b, bluedot_json, sizeof(bluedot_json));
+                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_filename, BLUEDOT_LOOKUP_FILENAME, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                     bluedot_filename_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_FILENAME);
 
                                                 }
 
-                                            if ( rulestruct[b].bluedot_ja3 && normalize_ja3 != NULL )
+                                            if ( RuleBody[b].BlueDot.bluedot_ja3 && normalize_ja3 != NULL )
                                                 {
 
-                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_ja3, BLUEDOT_LOOKUP_JA3, b, bluedot_json, sizeof(bluedot_json));
+                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_ja3, BLUEDOT_LOOKUP_JA3, b, SaganProcSyslog_LOCAL, bluedot_json, sizeof(bluedot_json));
                                                     bluedot_ja3_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_JA3);
 
                                                 }
 
 
-
-                                            /* Do cleanup at the end in case any "hits" above refresh the cache.  This why we don't
-                                             * "delete" an entry only to re-add it! */
-
-                                            Sagan_Bluedot_Check_Cache_Time();
-
-
                                         }
 #endif
 
@@ -1421,39 +1439,26 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                         }
                                                 }
 
-                                            if ( brointel_results == false && RuleBody[b].BroIntel.brointel_domain )
-                                                {
-                                                    brointel_results = Sagan_BroIntel_DOMAIN(SaganProcSyslog_LOCAL->syslog_message);
-                                                }
-
-                                            if ( brointel_results == false && RuleBody[b].BroIntel.brointel_file_hash )
-                                                {
-                                                    brointel_results = Sagan_BroIntel_FILE_HASH(SaganProcSyslog_LOCAL->syslog_message);
-                                                }
-
-                                            if ( brointel_results == false && RuleBody[b].BroIntel.brointel_url )
-                                                {
-                                                    brointel_results = Sagan_BroIntel_URL(SaganProcSyslog_LOCAL->syslog_message);
-                                                }
-
-                                            if ( brointel_results == false && RuleBody[b].BroIntel.brointel_software )
-                                                {
-                                                    brointel_results = Sagan_BroIntel_SOFTWARE(SaganProcSyslog_LOCAL->syslog_message);
-                                                }
-
-                                            if ( brointel_results == false && RuleBody[b].BroIntel.brointel_user_name )
+                                            if ( brointel_results == false && ( RuleBody[b].BroIntel.brointel_domain ||
+                                                    RuleBody[b].BroIntel.brointel_file_hash || RuleBody[b].BroIntel.brointel_url ||
+                                                    RuleBody[b].BroIntel.brointel_software || RuleBody[b].BroIntel.brointel_email ||
+                                                    RuleBody[b].BroIntel.brointel_user_name || RuleBody[b].BroIntel.brointel_file_name ||
+                                                    RuleBody[b].BroIntel.brointel_cert_hash ) )
                                                 {
-                                                    brointel_results = Sagan_BroIntel_USER_NAME(SaganProcSyslog_LOCAL->syslog_message);
-                                                }
 
-                                            if ( brointel_results == false && RuleBody[b].BroIntel.brointel_file_name )
-                                                {
-                                                    brointel_results = Sagan_BroIntel_FILE_NAME(SaganProcSyslog_LOCAL->syslog_message);
-                                                }
+                                                    if ( brointel_types == -1 )
+                                                        {
+                                                            brointel_types = Sagan_BroIntel_Scan( Sagan_Engine_Fold(SaganProcSyslog_LOCAL, syslog_message_lower, &syslog_message_folded) );
+                                                        }
 
-                                            if ( brointel_results == false && RuleBody[b].BroIntel.brointel_cert_hash )
-                                                {
-                                                    brointel_results = Sagan_BroIntel_CERT_HASH(SaganProcSyslog_LOCAL->syslog_message);
+                                                    brointel_results = ( RuleBody[b].BroIntel.brointel_domain && ( brointel_types & BROINTEL_DOMAIN ) ) ||
+                                                                       ( RuleBody[b].BroIntel.brointel_file_hash && ( brointel_types & BROINTEL_FILE_HASH ) ) ||
+                                                                       ( RuleBody[b].BroIntel.brointel_url && ( brointel_types & BROINTEL_URL ) ) ||
+                                                                       ( RuleBody[b].BroIntel.brointel_software && ( brointel_types & BROINTEL_SOFTWARE ) ) ||
+                                                                       ( RuleBody[b].BroIntel.brointel_email && ( brointel_types & BROINTEL_EMAIL ) ) ||
+                                                                       ( RuleBody[b].BroIntel.brointel_user_name && ( brointel_types & BROINTEL_USER_NAME ) ) ||
+                                                                       ( RuleBody[b].BroIntel.brointel_file_name && ( brointel_types & BROINTEL_FILE_NAME ) ) ||
+                                                                       ( RuleBody[b].BroIntel.brointel_cert_hash && ( brointel_types & BROINTEL_CERT_HASH ) );
                                                 }
 
                                         }
@@ -1658,10 +1663,15 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
         } /* End for for loop */
 
+    if ( profile_rule >= 0 )
+        {
+            Replay_Profile_Lap( &profile_rule, &profile_start, -1 );
+        }
+
 
 #ifdef HAVE_LIBFASTJSON
 
-    if ( config->eve_flag && config->eve_logs )
+    if ( config->eve_flag && config->eve_logs && only_rule < 0 )
         {
             Log_JSON(SaganProcSyslog_LOCAL, tp, json_normalize);
         }
@@ -27,5 +27,28 @@
 #define SAGAN_PROCESSOR_TAG NULL
 #define SAGAN_PROCESSOR_GENERATOR_ID 1
 
-int Sagan_Engine ( _Sagan_Proc_Syslog *, bool );
+/* Facts parsed out of the message being processed.  Each parser runs at
+   most one time per message,  no matter how many rules ask for it */
+
+typedef struct _Sagan_Parse_Context _Sagan_Parse_Context;
+struct _Sagan_Parse_Context
+{
+
+    bool ip_parsed;
+    int lookup_cache_size;
+
+    bool md5_parsed;
+    bool sha1_parsed;
+    bool sha256_parsed;
+
+    char md5_hash[MD5_HASH_SIZE+1];
+    char sha1_hash[SHA1_HASH_SIZE+1];
+    char sha256_hash[SHA256_HASH_SIZE+1];
+
+    bool proto_program_parsed;
+    int proto_program;
+
+};
+
+int Sagan_Engine ( _Sagan_Proc_Syslog *, bool, int );
 void Sagan_Engine_Init ( void );
@@ -45,6 +45,11 @@
 #include "sagan-defs.h"
 #include "sagan-config.h"
 #include "lockfile.h"
+#include "batch-queue.h"
+
+#ifdef HAVE_LIBHIREDIS
+#include "redis.h"
+#endif
 
 #include "processors/perfmon.h"
 
@@ -86,6 +91,8 @@ void Sagan_Perfmonitor_Handler( void )
     uint64_t last_geoip2_lookup = 0;
     uint64_t last_geoip2_hit = 0;
     uint64_t last_geoip2_miss = 0;
+    uint64_t last_geoip2_cache_lookup = 0;
+    uint64_t last_geoip2_cache_hit = 0;
 #endif
 
 #ifdef WITH_BLUEDOT
@@ -115,6 +122,22 @@ void Sagan_Perfmonitor_Handler( void )
 
     uint64_t last_dns_miss_count = 0;
 
+    uint64_t last_queue_dropped = 0;
+    uint64_t last_queue_full = 0;
+    uint64_t last_queue_dequeued = 0;
+    uint64_t last_queue_wait_usec = 0;
+
+    uint64_t last_ipc_lock_wait_usec[IPC_LOCK_TABLES] = { 0 };
+
+#ifdef HAVE_LIBHIREDIS
+    uint64_t last_redis_writer_commands = 0;
+    uint64_t last_redis_writer_batches = 0;
+    uint64_t last_redis_writer_rtt_usec = 0;
+    uint64_t last_redis_writer_threads_drop = 0;
+#endif
+    int ipc_lock_table[] = { THRESHOLD2, AFTER2, FLEXBIT, XBIT, TRACK_CLIENTS };
+    int l = 0;
+
     while (1)
         {
 
@@ -230,7 +253,7 @@ void Sagan_Perfmonitor_Handler( void )
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_cache_count);
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_cache_hit - last_bluedot_ip_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_hit;
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_positive_hit - last_bluedot_ip_positive_hit);
                             last_bluedot_ip_positive_hit = counters->bluedot_ip_positive_hit;
@@ -243,20 +266,20 @@ void Sagan_Perfmonitor_Handler( void )
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_cache_count);
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_cache_hit - last_bluedot_hash_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            last_bluedot_hash_cache_hit = counters->bluedot_hash_cache_hit;
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_positive_hit - last_bluedot_hash_positive_hit);
                             last_bluedot_hash_positive_hit = counters->bluedot_hash_positive_hit;
 
                             bluedot_hash_total = counters->bluedot_hash_total / seconds;
-                            fprintf(config->perfmonitor_file_stream, "%lu,", total);
+                            fprintf(config->perfmonitor_file_stream, "%lu,", bluedot_hash_total);
 
                             /* URL */
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_cache_count);
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_cache_hit - last_bluedot_url_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            last_bluedot_url_cache_hit = counters->bluedot_url_cache_hit;
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_positive_hit - last_bluedot_url_positive_hit);
                             last_bluedot_url_positive_hit = counters->bluedot_url_positive_hit;
@@ -269,7 +292,7 @@ void Sagan_Perfmonitor_Handler( void )
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_cache_count);
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_cache_hit - last_bluedot_filename_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            last_bluedot_filename_cache_hit = counters->bluedot_filename_cache_hit;
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_positive_hit - last_bluedot_filename_positive_hit);
                             last_bluedot_filename_positive_hit = counters->bluedot_filename_positive_hit;
@@ -297,6 +320,69 @@ void Sagan_Perfmonitor_Handler( void )
 #ifndef WITH_BLUEDOT
 
                     fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
+#endif
+
+                    /* Batch queue */
+
+                    fprintf(config->perfmonitor_file_stream, ",%" PRIu64 ",", Batch_Queue_Depth());
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->queue_depth_max);
+
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->queue_full - last_queue_full);
+                    last_queue_full = counters->queue_full;
+
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->queue_dropped - last_queue_dropped);
+                    last_queue_dropped = counters->queue_dropped;
+
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->queue_dequeued > last_queue_dequeued ? ( counters->queue_wait_usec - last_queue_wait_usec ) / ( counters->queue_dequeued - last_queue_dequeued ) : 0 );
+                    last_queue_wait_usec = counters->queue_wait_usec;
+                    last_queue_dequeued = counters->queue_dequeued;
+
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64, counters->queue_wait_usec_max);
+
+                    /* Time spent waiting on shared table locks */
+
+                    for ( l = 0; l < IPC_LOCK_TABLES; l++ )
+                        {
+                            fprintf(config->perfmonitor_file_stream, ",%" PRIu64, counters->ipc_lock_wait_usec[ ipc_lock_table[l] ] - last_ipc_lock_wait_usec[ ipc_lock_table[l] ]);
+                            last_ipc_lock_wait_usec[ ipc_lock_table[l] ] = counters->ipc_lock_wait_usec[ ipc_lock_table[l] ];
+                        }
+
+                    /* Redis "writer" queue and pipeline round trips */
+
+#ifdef HAVE_LIBHIREDIS
+
+                    fprintf(config->perfmonitor_file_stream, ",%" PRIu64 ",", Redis_Writer_Queue_Depth());
+
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->redis_writer_commands - last_redis_writer_commands);
+                    last_redis_writer_commands = counters->redis_writer_commands;
+
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->redis_writer_batches > last_redis_writer_batches ? ( counters->redis_writer_rtt_usec - last_redis_writer_rtt_usec ) / ( counters->redis_writer_batches - last_redis_writer_batches ) : 0 );
+                    last_redis_writer_rtt_usec = counters->redis_writer_rtt_usec;
+                    last_redis_writer_batches = counters->redis_writer_batches;
+
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64, counters->redis_writer_threads_drop - last_redis_writer_threads_drop);
+                    last_redis_writer_threads_drop = counters->redis_writer_threads_drop;
+
+#else
+
+                    fprintf(config->perfmonitor_file_stream, ",0,0,0,0");
+
+#endif
+
+                    /* GeoIP2 per-thread lookup cache */
+
+#ifdef HAVE_LIBMAXMINDDB
+
+                    fprintf(config->perfmonitor_file_stream, ",%" PRIu64 ",", counters->geoip2_cache_hit - last_geoip2_cache_hit);
+
+                    fprintf(config->perfmonitor_file_stream, "%.3f", CalcPct( counters->geoip2_cache_hit - last_geoip2_cache_hit, counters->geoip2_lookup - last_geoip2_cache_lookup ) );
+                    last_geoip2_cache_hit = counters->geoip2_cache_hit;
+                    last_geoip2_cache_lookup = counters->geoip2_lookup;
+
+#else
+
+                    fprintf(config->perfmonitor_file_stream, ",0,0");
+
 #endif
 
                     fprintf(config->perfmonitor_file_stream, "\n");
@@ -352,7 +438,7 @@ void Sagan_Perfmonitor_Open(void)
     config->perfmonitor_file_stream_status = true;
 
     fprintf(config->perfmonitor_file_stream, "################################ Perfmon start: pid=%d at=%s ###################################\n", getpid(), curtime);
-    fprintf(config->perfmonitor_file_stream, "# engine.utime,engine.total,engine.sig_match.total,engine.alerts.total,engine.after.total,engine.threshold.total, engine.drop.total,engine.ignored.total,engine.eps,geoip2.lookup.total,geoip2.hits,geoip2.misses,processor.drop.total,processor.blacklist.hits,processor.tracker.total,processor.tracker.down,output.drop.total,processor.esmtp.success,processor.esmtp.failed,dns.total,dns.miss,processor.bluedot_ip_cache_count,processor.bluedot_ip_cache_hit,processor.bluedot_ip_positive_hit,processor.bluedot_ip_qps,processor.bluedot_hash_cache_count,processor.bluedot_hash_cache_hit,processor.bluedot_hash_positive_hit,processor.bluedot_hash_qps,processor.bluedot_url_cache_count,processor.bluedot_url_cache_hit,processor.bluedot_url_positive_hit,processor.bluedot_url_qps,processor.bluedot_filename_cache_count,processor.bluedot_filename_cache_hit,processor.bluedot_filename_positive_hit,processor.bluedot_filename_qps,processor.bluedot_error_count,processor.bluedot_total_qps\n");
+    fprintf(config->perfmonitor_file_stream, "# engine.utime,engine.total,engine.sig_match.total,engine.alerts.total,engine.after.total,engine.threshold.total, engine.drop.total,engine.ignored.total,engine.eps,geoip2.lookup.total,geoip2.hits,geoip2.misses,processor.drop.total,processor.blacklist.hits,processor.tracker.total,processor.tracker.down,output.drop.total,processor.esmtp.success,processor.esmtp.failed,dns.total,dns.miss,processor.bluedot_ip_cache_count,processor.bluedot_ip_cache_hit,processor.bluedot_ip_positive_hit,processor.bluedot_ip_qps,processor.bluedot_hash_cache_count,processor.bluedot_hash_cache_hit,processor.bluedot_hash_positive_hit,processor.bluedot_hash_qps,processor.bluedot_url_cache_count,processor.bluedot_url_cache_hit,processor.bluedot_url_positive_hit,processor.bluedot_url_qps,processor.bluedot_filename_cache_count,processor.bluedot_filename_cache_hit,processor.bluedot_filename_positive_hit,processor.bluedot_filename_qps,processor.bluedot_error_count,processor.bluedot_total_qps,queue.depth,queue.depth.max,queue.full,queue.drop.total,queue.latency.avg_usec,queue.latency.max_usec,ipc.threshold.lock_wait_usec,ipc.after.lock_wait_usec,ipc.flexbit.lock_wait_usec,ipc.xbit.lock_wait_usec,ipc.track_clients.lock_wait_usec,redis.queue.depth,redis.writer.commands,redis.writer.rtt.avg_usec,redis.writer.drop,geoip2.cache.hits,geoip2.cache.hit_pct\n");
     fflush(config->perfmonitor_file_stream);
 
 }
@@ -50,19 +50,51 @@
 #include "sagan-config.h"
 #include "send-alert.h"
 #include "util-time.h"
+#include "ipc-lock.h"
+#include "ipc-index.h"
 
 #include "processors/track-clients.h"
 
-pthread_mutex_t IPCTrackClientCounter=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t IPCTrackClientsStatus=PTHREAD_MUTEX_INITIALIZER;
-
 struct _Sagan_Processor_Info *processor_info_track_client = NULL;
 struct _Sagan_Proc_Syslog *SaganProcSyslog;
 struct _Sagan_Track_Clients_IPC *SaganTrackClients_ipc;
+struct _Sagan_IPC_Index *Track_Clients_Index;
 struct _Sagan_IPC_Counters *counters_ipc;
 
 struct _SaganConfig *config;
 
+/****************************************************************************
+ * Track_Clients_Stripe - Lock stripe for a client (FNV-1a of its address)
+ ****************************************************************************/
+
+static uint32_t Track_Clients_Stripe( unsigned char *hostbits )
+{
+
+    uint32_t hash = 2166136261U;
+    int i = 0;
+
+    for ( i = 0; i < MAXIPBIT; i++ )
+        {
+            hash = ( hash ^ hostbits[i] ) * 16777619U;
+        }
+
+    return(hash);
+
+}
+
+/****************************************************************************
+ * Track_Clients_Key - Splits the 16 address bytes into an (exact) index key
+ ****************************************************************************/
+
+void Track_Clients_Key( unsigned char *hostbits, uint64_t *id, uint32_t *rev, uint32_t *hash )
+{
+
+    memcpy(id, hostbits, sizeof(uint64_t));
+    memcpy(rev, hostbits + 8, sizeof(uint32_t));
+    memcpy(hash, hostbits + 12, sizeof(uint32_t));
+
+}
+
 /****************************************************************************
  * Sagan_Track_Clients - Main routine to "tracks" via IPC/memory IPs that
  * are reporting or not.
@@ -72,58 +104,78 @@ struct _SaganConfig *config;
 void Track_Clients ( char *host )
 {
 
-    char utime_tmp[20] = { 0 };
-    time_t t;
-    struct tm *now;
     int i;
-    uint64_t utime_u64;
+    uint64_t utime_u64 = Return_Epoch();
+    uint32_t stripe;
     unsigned char hostbits[MAXIPBIT] = { 0 };
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(utime_tmp, sizeof(utime_tmp), "%s",  now);
-    utime_u64 = atol(utime_tmp);
+    uint64_t key_id;
+    uint32_t key_rev;
+    uint32_t key_hash;
+
     int expired_time = config->pp_sagan_track_clients * 60;
 
     IP2Bit(host, hostbits);
+    stripe = Track_Clients_Stripe(hostbits);
+    Track_Clients_Key(hostbits, &key_id, &key_rev, &key_hash);
 
     /********************************************/
     /** Record update tracking if record exsist */
     /********************************************/
 
-    pthread_mutex_lock(&IPCTrackClientCounter);
-    File_Lock(config->shm_track_clients);
+    /* Clients are only ever added,  so an existing one can be updated
+       under its own stripe */
+
+    IPC_Lock(TRACK_CLIENTS, stripe);
 
-    for (i=0; i<counters_ipc->track_clients_client_count; i++)
+    i = IPC_Index_Find(Track_Clients_Index, key_id, key_rev, key_hash);
+
+    if ( i != -1 )
         {
-            if ( !memcmp(SaganTrackClients_ipc[i].hostbits, hostbits, MAXIPBIT ) )
-                {
 
-                    SaganTrackClients_ipc[i].utime = utime_u64;
-                    SaganTrackClients_ipc[i].expire = expired_time;
+            SaganTrackClients_ipc[i].utime = utime_u64;
+            SaganTrackClients_ipc[i].expire = expired_time;
+
+            IPC_Unlock(TRACK_CLIENTS, stripe);
+
+            return;
+        }
+
+    IPC_Unlock(TRACK_CLIENTS, stripe);
+
+    /* New client.  Lock the whole table and check nobody added it
+       meanwhile */
+
+    IPC_Lock_All(TRACK_CLIENTS);
+
+    i = IPC_Index_Find(Track_Clients_Index, key_id, key_rev, key_hash);
 
-                    File_Unlock(config->shm_track_clients);
-                    pthread_mutex_unlock(&IPCTrackClientCounter);
+    if ( i != -1 )
+        {
+
+            SaganTrackClients_ipc[i].utime = utime_u64;
+            SaganTrackClients_ipc[i].expire = expired_time;
+
+            IPC_Unlock_All(TRACK_CLIENTS);
 
-                    return;
-                }
+            return;
         }
 
     if ( counters_ipc->track_clients_client_count < config->max_track_clients )
         {
-            memcpy(SaganTrackClients_ipc[counters_ipc->track_clients_client_count].hostbits, hostbits, sizeof(hostbits));
-            SaganTrackClients_ipc[counters_ipc->track_clients_client_count].utime = utime_u64;
-            SaganTrackClients_ipc[counters_ipc->track_clients_client_count].status = 0;
-            SaganTrackClients_ipc[counters_ipc->track_clients_client_count].expire = expired_time;
 
-            File_Lock(config->shm_counters);
+            i = counters_ipc->track_clients_client_count;
 
-            counters_ipc->track_clients_client_count++;
+            memcpy(SaganTrackClients_ipc[i].hostbits, hostbits, sizeof(hostbits));
+            SaganTrackClients_ipc[i].utime = utime_u64;
+            SaganTrackClients_ipc[i].status = 0;
+            SaganTrackClients_ipc[i].expire = expired_time;
 
-            File_Unlock(config->shm_counters);
-            File_Unlock(config->shm_track_clients);
+            IPC_Index_Insert(Track_Clients_Index, key_id, key_rev, key_hash, i);
 
-            pthread_mutex_unlock(&IPCTrackClientCounter);
+            counters_ipc->track_clients_client_count++;
+
+            IPC_Unlock_All(TRACK_CLIENTS);
 
             return;
 
@@ -131,8 +183,7 @@ void Track_Clients ( char *host )
     else
         {
 
-            File_Unlock(config->shm_track_clients);
-            pthread_mutex_unlock(&IPCTrackClientCounter);
+            IPC_Unlock_All(TRACK_CLIENTS);
 
             Sagan_Log(WARN, "[%s, line %d] Client tracking has reached it's max! (%d).  Increase 'track_clients' in your configuration!", __FILE__, __LINE__, config->max_track_clients);
 
@@ -177,49 +228,60 @@ void Track_Clients_Thread_Init ( void )
 void Track_Clients_Thread ( void )
 {
 
-    for(;;)
-        {
+    (void)SetThreadName("SaganClientTrck");
 
-            (void)SetThreadName("SaganClientTrck");
+    struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL = NULL;
 
-            struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL = NULL;
-
-            int alertid;
-            int i;
+    int alertid;
+    int i;
+    int count;
+    int slice;
+    int cursor = 0;
 
-            const char *tmp_ip = NULL;
+    const char *tmp_ip = NULL;
 
-            char utime_tmp[20] = { 0 };
-            time_t t;
-            struct tm *now;
+    uint64_t utime_u32;
 
-            uint64_t utime_u32;
+    struct timeval tp;
 
-            struct timeval tp;
+    int expired_time;
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(utime_tmp, sizeof(utime_tmp), "%s",  now);
-            utime_u32 = atol(utime_tmp);
+    /* We populate this later for output plugins */
 
-            int expired_time = config->pp_sagan_track_clients * 60;
+    SaganProcSyslog_LOCAL = malloc(sizeof(struct _Sagan_Proc_Syslog));
 
-            /* We populate this later for output plugins */
+    if ( SaganProcSyslog_LOCAL == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganProcSyslog_LOCAL. Abort!", __FILE__, __LINE__);
+        }
 
-            SaganProcSyslog_LOCAL = malloc(sizeof(struct _Sagan_Proc_Syslog));
+    for(;;)
+        {
 
-            if ( SaganProcSyslog_LOCAL == NULL )
-                {
-                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganProcSyslog_LOCAL. Abort!", __FILE__, __LINE__);
-                }
+            utime_u32 = Return_Epoch();
+            expired_time = config->pp_sagan_track_clients * 60;
 
             /*********************************/
             /* Look through "known" system   */
             /*********************************/
 
-            for (i=0; i<counters_ipc->track_clients_client_count; i++)
+            /* Rather than walking every client once a minute,  a slice of
+               the table is checked each second.  Each client is still
+               looked at once per TRACK_CLIENTS_SCAN_INTERVAL */
+
+            count = __atomic_load_n(&counters_ipc->track_clients_client_count, __ATOMIC_SEQ_CST);
+            slice = ( count + TRACK_CLIENTS_SCAN_INTERVAL - 1 ) / TRACK_CLIENTS_SCAN_INTERVAL;
+
+            for ( ; slice > 0; slice-- )
                 {
 
+                    if ( cursor >= count )
+                        {
+                            cursor = 0;
+                        }
+
+                    i = cursor++;
+
                     /* Check if host is in a down state */
 
                     if ( SaganTrackClients_ipc[i].status == 1 )
@@ -232,22 +294,15 @@ void Track_Clients_Thread ( void )
 
                                     /* Update status and seen time */
 
-                                    pthread_mutex_lock(&IPCTrackClientsStatus);
-
-                                    File_Lock(config->shm_track_clients);
+                                    IPC_Lock(TRACK_CLIENTS, Track_Clients_Stripe(SaganTrackClients_ipc[i].hostbits));
 
                                     SaganTrackClients_ipc[i].status = 0;
 
-                                    /* Update counters */
-
-                                    File_Lock(config->shm_counters);
+                                    IPC_Unlock(TRACK_CLIENTS, Track_Clients_Stripe(SaganTrackClients_ipc[i].hostbits));
 
-                                    counters_ipc->track_clients_down--;
-
-                                    File_Unlock(config->shm_counters);
-                                    File_Unlock(config->shm_track_clients);
+                                    /* Update counters */
 
-                                    pthread_mutex_unlock(&IPCTrackClientsStatus);
+                                    __atomic_sub_fetch(&counters_ipc->track_clients_down, 1, __ATOMIC_SEQ_CST);
 
 
                                     tmp_ip = Bit2IP(SaganTrackClients_ipc[i].hostbits, NULL, 0);
@@ -299,22 +354,15 @@ void Track_Clients_Thread ( void )
 
                                     /* Update status and utime */
 
-                                    pthread_mutex_lock(&IPCTrackClientsStatus);
-
-                                    File_Lock(config->shm_track_clients);
+                                    IPC_Lock(TRACK_CLIENTS, Track_Clients_Stripe(SaganTrackClients_ipc[i].hostbits));
 
                                     SaganTrackClients_ipc[i].status = 1;
 
-                                    /* Update counters */
-
-                                    File_Lock(config->shm_counters);
-
-                                    counters_ipc->track_clients_down++;
+                                    IPC_Unlock(TRACK_CLIENTS, Track_Clients_Stripe(SaganTrackClients_ipc[i].hostbits));
 
-                                    File_Unlock(config->shm_counters);
-                                    File_Unlock(config->shm_track_clients);
+                                    /* Update counters */
 
-                                    pthread_mutex_unlock(&IPCTrackClientsStatus);
+                                    __atomic_add_fetch(&counters_ipc->track_clients_down, 1, __ATOMIC_SEQ_CST);
 
                                     tmp_ip = Bit2IP(SaganTrackClients_ipc[i].hostbits, NULL, 0);
 
@@ -359,8 +407,8 @@ void Track_Clients_Thread ( void )
                         } /* End of else */
 
                 }  /* End for 'for' loop */
-            free(SaganProcSyslog_LOCAL);
-            sleep(60);
+
+            sleep(1);
 
         } /* End Ifinite Loop */
 
@@ -37,6 +37,8 @@
 #define PROCESSOR_TAG NULL
 #define PROCESSOR_GENERATOR_ID 100
 
+#define TRACK_CLIENTS_SCAN_INTERVAL 60		/* Seconds to check every client once */
+
 void Track_Clients_Thread_Init ( void );
 void Track_Clients_Thread ( void );
 
@@ -52,3 +54,4 @@ struct _Sagan_Track_Clients_IPC
 };
 
 void Track_Clients ( char *host );
+void Track_Clients_Key( unsigned char *hostbits, uint64_t *id, uint32_t *rev, uint32_t *hash );
@@ -28,9 +28,11 @@
 
 #include <stdio.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 #include <hiredis/hiredis.h>
 
 #ifdef HAVE_SYS_PRCTL_H
@@ -41,24 +43,47 @@
 #include "sagan-config.h"
 #include "lockfile.h"
 #include "redis.h"
+#include "util-time.h"
+#include "util-track.h"
 
+struct _SaganCounters *counters;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
 
-int redis_msgslot = 0;
-
-pthread_cond_t SaganRedisDoWork=PTHREAD_COND_INITIALIZER;
-pthread_mutex_t SaganRedisWorkMutex=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t RedisReaderMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t RedisWriterMutex=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t RedisErrorMutex=PTHREAD_MUTEX_INITIALIZER;
 
-bool connection_write_error = false;
 bool connection_read_error = false;
 
-redisContext *c_writer_redis;
+/* Every "writer" thread has its own connection,  so pipelines from
+   different threads don't interleave */
+
+__thread redisContext *c_writer_redis;
+__thread redisContext *c_reader_thread = NULL;
+
+/* Each processor thread caches what it last learned about a key for
+   "reader_cache_ttl" seconds.  It is per thread,  so it needs no lock. */
+
+__thread struct _Redis_Reader_Cache *Redis_Reader_Cache = NULL;
+
+/* Every "writer" thread has its own FIFO ring of REDIS_WRITER_BATCH
+   commands,  the oldest at "head".  A key always goes to the same ring,  so
+   a SET and a later DEL for it reach Redis in the order they were queued. */
+
+typedef struct _Sagan_Redis_Ring _Sagan_Redis_Ring;
+struct _Sagan_Redis_Ring
+{
+    struct _Sagan_Redis_Write *write;
+    uint32_t head;
+    uint32_t count;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+struct _Sagan_Redis_Ring *Sagan_Redis_Ring = NULL;
 
-struct _Sagan_Redis_Write *Sagan_Redis_Write = NULL;
+uint32_t redis_queue_count = 0;		/* All rings */
+uint32_t redis_writer_next = 0;		/* Ring for the next "writer" thread to start */
 
 /*****************************************************************************
  * Redis_Writer_Init - Redis "writer" threads initialization.
@@ -67,17 +92,86 @@ struct _Sagan_Redis_Write *Sagan_Redis_Write = NULL;
 void Redis_Writer_Init ( void )
 {
 
-    Sagan_Redis_Write = malloc(config->redis_max_writer_threads * sizeof(struct _Sagan_Redis_Write));
+    int i = 0;
+
+    Sagan_Redis_Ring = calloc(config->redis_max_writer_threads, sizeof(struct _Sagan_Redis_Ring));
 
-    if ( Sagan_Redis_Write == NULL )
+    if ( Sagan_Redis_Ring == NULL )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Sagan_Redis_Write. Abort!", __FILE__, __LINE__);
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Sagan_Redis_Ring. Abort!", __FILE__, __LINE__);
         }
 
-    memset(Sagan_Redis_Write, 0, sizeof(struct _Sagan_Redis_Write));
+    for ( i = 0; i < config->redis_max_writer_threads; i++ )
+        {
+
+            Sagan_Redis_Ring[i].write = calloc(REDIS_WRITER_BATCH, sizeof(struct _Sagan_Redis_Write));
+
+            if ( Sagan_Redis_Ring[i].write == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Sagan_Redis_Ring. Abort!", __FILE__, __LINE__);
+                }
+
+            pthread_mutex_init(&Sagan_Redis_Ring[i].mutex, NULL);
+            pthread_cond_init(&Sagan_Redis_Ring[i].cond, NULL);
+        }
 
 }
 
+/*****************************************************************************
+ * Redis_Writer_Push - Queues a command for the "writer" thread that owns
+ * "key".  Returns false (and counts a drop) if its ring is full.
+ *****************************************************************************/
+
+bool Redis_Writer_Push ( const char *command, const char *key, const char *value, int expire )
+{
+
+    struct _Sagan_Redis_Ring *ring = &Sagan_Redis_Ring[ Track_Hash(key, 0) % config->redis_max_writer_threads ];
+
+    uint32_t slot = 0;
+    uint32_t depth = 0;
+
+    pthread_mutex_lock(&ring->mutex);
+
+    if ( ring->count == REDIS_WRITER_BATCH )
+        {
+            pthread_mutex_unlock(&ring->mutex);
+            __atomic_add_fetch(&counters->redis_writer_threads_drop, 1, __ATOMIC_SEQ_CST);
+            return(false);
+        }
+
+    slot = ( ring->head + ring->count ) % REDIS_WRITER_BATCH;
+
+    strlcpy(ring->write[slot].command, command, sizeof(ring->write[slot].command));
+    strlcpy(ring->write[slot].key, key, sizeof(ring->write[slot].key));
+    strlcpy(ring->write[slot].value, value, sizeof(ring->write[slot].value));
+    ring->write[slot].expire = expire;
+
+    ring->count++;
+
+    /* Counted before the writer can take it,  so the total never dips */
+
+    depth = __atomic_add_fetch(&redis_queue_count, 1, __ATOMIC_SEQ_CST);
+
+    pthread_cond_signal(&ring->cond);
+    pthread_mutex_unlock(&ring->mutex);
+
+    if ( depth > __atomic_load_n(&counters->redis_writer_queue_max, __ATOMIC_RELAXED) )
+        {
+            __atomic_store_n(&counters->redis_writer_queue_max, depth, __ATOMIC_RELAXED);
+        }
+
+    return(true);
+}
+
+/*****************************************************************************
+ * Redis_Writer_Queue_Depth - Commands waiting for a "writer" thread.
+ *****************************************************************************/
+
+uint64_t Redis_Writer_Queue_Depth ( void )
+{
+    return( __atomic_load_n(&redis_queue_count, __ATOMIC_RELAXED) );
+}
+
 /*****************************************************************************
  * Redis_Reader_Connect - Connection for "read" operations.  These are
  * non-threaded operations
@@ -149,37 +243,37 @@ void Redis_Reader_Connect ( void )
 }
 
 /*****************************************************************************
- * Redis_Writer_Connect - Handles login and auth for "writer" (detached)
- * Redis threads
+ * Redis_Connect - Handles login and auth for the per thread "writer" and
+ * "reader" connections.  Doesn't return until it has a connection.
  *****************************************************************************/
 
-void Redis_Writer_Connect(void)
+static redisContext *Redis_Connect( const char *type )
 {
 
     redisReply *reply;
+    redisContext *c_redis = NULL;
 
-    c_writer_redis = NULL;
-
-    while ( c_writer_redis == NULL || c_writer_redis->err )
+    while ( c_redis == NULL || c_redis->err )
         {
 
             struct timeval timeout = { 1, 500000 }; // 1.5 seconds
-            c_writer_redis = redisConnectWithTimeout(config->redis_server, config->redis_port, timeout);
+            c_redis = redisConnectWithTimeout(config->redis_server, config->redis_port, timeout);
 
-            if (c_writer_redis == NULL || c_writer_redis->err)
+            if (c_redis == NULL || c_redis->err)
                 {
 
-                    if (c_writer_redis)
+                    if (c_redis)
                         {
 
-                            redisFree(c_writer_redis);
-                            Sagan_Log(WARN, "[%s, line %d] Redis 'writer' connection error! Sleeping for 2 seconds.", __FILE__, __LINE__);
+                            redisFree(c_redis);
+                            c_redis = NULL;
+                            Sagan_Log(WARN, "[%s, line %d] Redis '%s' connection error! Sleeping for 2 seconds.", __FILE__, __LINE__, type);
 
                         }
                     else
                         {
 
-                            Sagan_Log(WARN, "[%s, line %d] Redis 'writer' connection error - Can't allocate Redis context.", __FILE__, __LINE__);
+                            Sagan_Log(WARN, "[%s, line %d] Redis '%s' connection error - Can't allocate Redis context.", __FILE__, __LINE__, type);
 
                         }
 
@@ -195,15 +289,15 @@ void Redis_Writer_Connect(void)
     if ( config->redis_password[0] != '\0' )
         {
 
-            reply = redisCommand(c_writer_redis, "AUTH %s", config->redis_password);
+            reply = redisCommand(c_redis, "AUTH %s", config->redis_password);
 
-            if (!strcmp(reply->str, "OK"))
+            if ( reply != NULL && reply->str != NULL && !strcmp(reply->str, "OK"))
                 {
 
                     if ( debug->debugredis )
                         {
 
-                            Sagan_Log( DEBUG, "Authentication success for 'writer' to Redis server at %s:%d (pthread ID: %lu).", config->redis_server, config->redis_port, pthread_self() );
+                            Sagan_Log( DEBUG, "Authentication success for '%s' to Redis server at %s:%d (pthread ID: %lu).", type, config->redis_server, config->redis_port, pthread_self() );
 
                         }
 
@@ -212,20 +306,92 @@ void Redis_Writer_Connect(void)
                 {
 
                     Remove_Lock_File();
-                    Sagan_Log(ERROR, "Authentication failure for 'writer' to to Redis server at %s:%d (pthread ID: %lu). Abort!", config->redis_server, config->redis_port, pthread_self() );
+                    Sagan_Log(ERROR, "Authentication failure for '%s' to to Redis server at %s:%d (pthread ID: %lu). Abort!", type, config->redis_server, config->redis_port, pthread_self() );
 
                 }
+
+            freeReplyObject(reply);
         }
 
-    pthread_mutex_lock(&RedisErrorMutex);
-    connection_write_error = false;
-    pthread_mutex_unlock(&RedisErrorMutex);
+    return(c_redis);
+}
+
+/*****************************************************************************
+ * Redis_Writer_Pipeline - Sends a batch down one connection and collects
+ * the replies.  Returns false if the connection dropped part way.
+ *****************************************************************************/
+
+static bool Redis_Writer_Pipeline ( struct _Sagan_Redis_Write *batch, bool *skip, int count )
+{
 
+    redisReply *reply;
+
+    int i = 0;
+    int sent = 0;
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            if ( skip[i] == true )
+                {
+                    continue;
+                }
+
+            if ( debug->debugredis )
+                {
+
+                    if ( batch[i].expire == 0 )
+                        {
+                            Sagan_Log(DEBUG, "Thread %u received the following work: '%s %s %s'", pthread_self(), batch[i].command, batch[i].key, batch[i].value);
+                        }
+                    else
+                        {
+                            Sagan_Log(DEBUG, "Thread %u received the following work: '%s %s %s EX %d'", pthread_self(), batch[i].command, batch[i].key, batch[i].value, batch[i].expire);
+                        }
+
+                }
+
+            if ( batch[i].expire != 0 )
+                {
+                    redisAppendCommand(c_writer_redis, "%s %s %s EX %d", batch[i].command, batch[i].key, batch[i].value, batch[i].expire);
+                }
+            else if ( batch[i].value[0] == '\0' )
+                {
+                    redisAppendCommand(c_writer_redis, "%s %s", batch[i].command, batch[i].key);
+                }
+            else
+                {
+                    redisAppendCommand(c_writer_redis, "%s %s %s", batch[i].command, batch[i].key, batch[i].value);
+                }
+
+            sent++;
+        }
+
+    /* The first redisGetReply() flushes the whole pipeline */
+
+    for ( i = 0; i < sent; i++ )
+        {
+
+            if ( redisGetReply(c_writer_redis, (void **)&reply) != REDIS_OK || reply == NULL )
+                {
+                    return(false);
+                }
+
+            if ( debug->debugredis )
+                {
+                    Sagan_Log(DEBUG, "Thread %u reply-str: '%s'", pthread_self(), reply->str);
+                }
+
+            freeReplyObject(reply);
+        }
+
+    return(true);
 }
 
 /*****************************************************************************
- * Redis_Writer - Threads that "write" to Redis.  We spawn up several to
- * avoid blocking.  Writer accepts "stacked" commands seperated by ;
+ * Redis_Writer - Threads that "write" to Redis.  Each thread drains its own
+ * ring,  up to REDIS_WRITER_BATCH commands at a time,  and pipelines them
+ * over its own connection,  so a batch costs one round trip.
  *****************************************************************************/
 
 void Redis_Writer ( void )
@@ -233,93 +399,107 @@ void Redis_Writer ( void )
 
     (void)SetThreadName("SaganRedisWriter");
 
-    redisReply *reply;
+    struct _Sagan_Redis_Ring *ring = &Sagan_Redis_Ring[ __atomic_fetch_add(&redis_writer_next, 1, __ATOMIC_SEQ_CST) % config->redis_max_writer_threads ];
+    struct _Sagan_Redis_Write *batch = NULL;
+    bool skip[REDIS_WRITER_BATCH] = { 0 };
+
+    struct timespec start;
+    struct timespec end;
+
+    uint64_t rtt = 0;
 
-    char command[16] = { 0 };
-    char key[128] = { 0 };
-    char value[MAX_SYSLOGMSG*2];
-    int expire = 0;
+    int count = 0;
+    int coalesced = 0;
+    int i = 0;
+    int j = 0;
 
-    Redis_Writer_Connect();
+    batch = malloc(REDIS_WRITER_BATCH * sizeof(struct _Sagan_Redis_Write));
+
+    if ( batch == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for batch. Abort!", __FILE__, __LINE__);
+        }
+
+    c_writer_redis = Redis_Connect("writer");
 
     /* Redis "threaded" operations */
 
     for (;;)
         {
 
-            pthread_mutex_lock(&SaganRedisWorkMutex);
+            pthread_mutex_lock(&ring->mutex);
 
-            while ( redis_msgslot == 0 ) pthread_cond_wait(&SaganRedisDoWork, &SaganRedisWorkMutex);
+            while ( ring->count == 0 ) pthread_cond_wait(&ring->cond, &ring->mutex);
 
-            redis_msgslot--;
+            count = ring->count;
 
-            strlcpy(command, Sagan_Redis_Write[redis_msgslot].command, sizeof(command));
-            strlcpy(key, Sagan_Redis_Write[redis_msgslot].key, sizeof(key));
-            strlcpy(value, Sagan_Redis_Write[redis_msgslot].value, sizeof(value));
-            expire = Sagan_Redis_Write[redis_msgslot].expire;
+            for ( i = 0; i < count; i++ )
+                {
 
-            pthread_mutex_unlock(&SaganRedisWorkMutex);
+                    strlcpy(batch[i].command, ring->write[ring->head].command, sizeof(batch[i].command));
+                    strlcpy(batch[i].key, ring->write[ring->head].key, sizeof(batch[i].key));
+                    strlcpy(batch[i].value, ring->write[ring->head].value, sizeof(batch[i].value));
+                    batch[i].expire = ring->write[ring->head].expire;
 
-            if ( connection_write_error == true )
-                {
-                    Sagan_Log(WARN, "[%s, line %d] Redis is an error state.  Cannot write.", __FILE__, __LINE__);
+                    ring->head = ( ring->head + 1 ) % REDIS_WRITER_BATCH;
                 }
-            else
-                {
 
-                    if ( debug->debugredis )
-                        {
+            ring->count = 0;
 
-                            if ( expire == 0 )
-                                {
-                                    Sagan_Log(DEBUG, "Thread %u received the following work: '%s %s %s'", pthread_self(), command, key, value);
-                                }
-                            else
-                                {
-                                    Sagan_Log(DEBUG, "Thread %u received the following work: '%s %s %s EX %d'", pthread_self(), command, key, value, expire);
-                                }
+            pthread_mutex_unlock(&ring->mutex);
 
+            __atomic_sub_fetch(&redis_queue_count, count, __ATOMIC_SEQ_CST);
 
-                        }
+            /* Every command we queue (SET .. EX / DEL) replaces whatever the
+               key held,  so only the last one for a key in a batch matters */
 
+            coalesced = 0;
 
-                    if ( expire == 0 )
-                        {
-                            pthread_mutex_lock(&RedisWriterMutex);
-                            reply = redisCommand(c_writer_redis, "%s %s %s", command, key, value);
-                            pthread_mutex_unlock(&RedisWriterMutex);
-                        }
-                    else
-                        {
-                            pthread_mutex_lock(&RedisWriterMutex);
-                            reply = redisCommand(c_writer_redis, "%s %s %s EX %d", command, key, value, expire);
-                            pthread_mutex_unlock(&RedisWriterMutex);
-                        }
+            for ( i = 0; i < count; i++ )
+                {
 
-                    if ( reply != NULL )
+                    skip[i] = false;
+
+                    for ( j = i + 1; j < count; j++ )
                         {
 
-                            if ( debug->debugredis )
+                            if ( !strcmp(batch[i].key, batch[j].key) )
                                 {
-                                    Sagan_Log(DEBUG, "Thread %u reply-str: '%s'", pthread_self(), reply->str);
+                                    skip[i] = true;
+                                    coalesced++;
+                                    break;
                                 }
 
-                            freeReplyObject(reply);
-
                         }
-                    else
-                        {
+                }
 
-                            Sagan_Log(WARN, "[%s, line %d] Got disconnected from Redis.  Reconnecting....", __FILE__, __LINE__);
+            clock_gettime(CLOCK_MONOTONIC, &start);
 
-                            pthread_mutex_lock(&RedisErrorMutex);
-                            connection_write_error = true;
-                            pthread_mutex_unlock(&RedisErrorMutex);
+            /* SET and DEL are idempotent,  so after a reconnect the whole
+               batch is simply sent again */
 
-                            Redis_Writer_Connect();
-                        }
+            while ( Redis_Writer_Pipeline( batch, skip, count ) == false )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Got disconnected from Redis.  Reconnecting....", __FILE__, __LINE__);
+
+                    redisFree(c_writer_redis);
+                    c_writer_redis = Redis_Connect("writer");
+                }
+
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            rtt = ( end.tv_sec - start.tv_sec ) * 1000000 + ( end.tv_nsec - start.tv_nsec ) / 1000;
 
+            __atomic_add_fetch(&counters->redis_writer_batches, 1, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&counters->redis_writer_commands, count - coalesced, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&counters->redis_writer_coalesced, coalesced, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&counters->redis_writer_rtt_usec, rtt, __ATOMIC_SEQ_CST);
+
+            if ( rtt > __atomic_load_n(&counters->redis_writer_rtt_usec_max, __ATOMIC_RELAXED) )
+                {
+                    __atomic_store_n(&counters->redis_writer_rtt_usec_max, rtt, __ATOMIC_RELAXED);
                 }
+
         }
 }
 
@@ -401,4 +581,150 @@ void Redis_Reader ( char *redis_command, char *str, size_t size )
         }
 }
 
+/*****************************************************************************
+ * Redis_Reader_Cache_Slot - The cache slot for "key",  or NULL if the cache
+ * is disabled.
+ *****************************************************************************/
+
+static struct _Redis_Reader_Cache *Redis_Reader_Cache_Slot( const char *key )
+{
+
+    if ( config->redis_reader_cache_ttl == 0 )
+        {
+            return(NULL);
+        }
+
+    if ( Redis_Reader_Cache == NULL )
+        {
+
+            Redis_Reader_Cache = calloc(REDIS_READER_CACHE, sizeof(struct _Redis_Reader_Cache));
+
+            if ( Redis_Reader_Cache == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Redis_Reader_Cache. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    return( &Redis_Reader_Cache[ Track_Hash(key, 0) & ( REDIS_READER_CACHE - 1 ) ] );
+}
+
+/*****************************************************************************
+ * Redis_Reader_Cache_Update - Records a key this thread just set or unset,
+ * so its own lookups see it before the "writer" threads get to Redis.
+ *****************************************************************************/
+
+void Redis_Reader_Cache_Update ( const char *key, bool exists )
+{
+
+    struct _Redis_Reader_Cache *cache = Redis_Reader_Cache_Slot( key );
+
+    if ( cache != NULL )
+        {
+            strlcpy(cache->key, key, sizeof(cache->key));
+            cache->exists = exists;
+            cache->expires = Return_Epoch() + config->redis_reader_cache_ttl;
+        }
+
+}
+
+/*****************************************************************************
+ * Redis_Reader_Exists - Sets results[i] to whether keys[i] exists.  Keys
+ * not in this thread's cache are sent as one pipeline of EXISTS over this
+ * thread's own connection.  If the connection drops,  the keys that were
+ * not answered come back false (like Redis_Reader()).
+ *****************************************************************************/
+
+void Redis_Reader_Exists ( char keys[][128], int count, bool *results )
+{
+
+    redisReply *reply;
+    struct _Redis_Reader_Cache *cache = NULL;
+
+    bool miss[count];
+
+    uint64_t now = Return_Epoch();
+
+    int misses = 0;
+    int i = 0;
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            results[i] = false;
+            miss[i] = false;
+
+            cache = Redis_Reader_Cache_Slot( keys[i] );
+
+            if ( cache != NULL && cache->expires > now && !strcmp(cache->key, keys[i]) )
+                {
+                    results[i] = cache->exists;
+                    __atomic_add_fetch(&counters->redis_reader_cache_hit, 1, __ATOMIC_SEQ_CST);
+                    continue;
+                }
+
+            miss[i] = true;
+            misses++;
+        }
+
+    __atomic_add_fetch(&counters->redis_reader_lookups, count, __ATOMIC_SEQ_CST);
+
+    if ( misses == 0 )
+        {
+            return;
+        }
+
+    if ( c_reader_thread == NULL )
+        {
+            c_reader_thread = Redis_Connect("reader");
+        }
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            if ( miss[i] == true )
+                {
+                    redisAppendCommand(c_reader_thread, "EXISTS %s", keys[i]);
+                }
+
+        }
+
+    __atomic_add_fetch(&counters->redis_reader_round_trips, 1, __ATOMIC_SEQ_CST);
+
+    /* Replies come back in the order the EXISTS went out.  The first
+       redisGetReply() flushes the whole pipeline. */
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            if ( miss[i] == false )
+                {
+                    continue;
+                }
+
+            if ( redisGetReply(c_reader_thread, (void **)&reply) != REDIS_OK || reply == NULL )
+                {
+
+                    Sagan_Log(WARN, "[%s, line %d] Got disconnected from Redis.  Reconnecting....", __FILE__, __LINE__);
+
+                    redisFree(c_reader_thread);
+                    c_reader_thread = Redis_Connect("reader");
+                    return;
+                }
+
+            results[i] = ( reply->type == REDIS_REPLY_INTEGER && reply->integer > 0 );
+
+            if ( debug->debugredis )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Redis EXISTS %s: %d", __FILE__, __LINE__, keys[i], results[i]);
+                }
+
+            freeReplyObject(reply);
+
+            Redis_Reader_Cache_Update( keys[i], results[i] );
+
+        }
+
+}
+
 #endif
+
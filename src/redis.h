@@ -22,10 +22,24 @@
 
 #include <hiredis/hiredis.h>
 
+/* Most commands a "writer" thread pulls off the queue and pipelines in one
+   round trip.  The queue holds this many per writer thread. */
+
+#define REDIS_WRITER_BATCH	32
+
+/* Slots in each processor thread's cache of Redis_Reader_Exists() results.
+   Must be a power of 2. */
+
+#define REDIS_READER_CACHE	1024
+
 void Redis_Reader_Connect ( void );
 void Redis_Writer (void);
 void Redis_Writer_Init (void);
+bool Redis_Writer_Push ( const char *command, const char *key, const char *value, int expire );
+uint64_t Redis_Writer_Queue_Depth ( void );
 void Redis_Reader ( char *redis_command, char *str, size_t size );
+void Redis_Reader_Exists ( char keys[][128], int count, bool *results );
+void Redis_Reader_Cache_Update ( const char *key, bool exists );
 
 typedef struct _Sagan_Redis_Write _Sagan_Redis_Write;
 struct _Sagan_Redis_Write
@@ -36,4 +50,12 @@ struct _Sagan_Redis_Write
     int expire;
 };
 
+typedef struct _Redis_Reader_Cache _Redis_Reader_Cache;
+struct _Redis_Reader_Cache
+{
+    char key[128];
+    uint64_t expires;
+    bool exists;
+};
+
 #endif
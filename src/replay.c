@@ -0,0 +1,497 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* replay.c
+ *
+ * Offline replay of archived logs (-R).  The file is mmap()'ed and cut into
+ * line aligned shards,  one reader thread per shard (one per CPU),  which
+ * all feed the normal batch queue and Processor() threads.  Nothing is
+ * polled,  Sagan exits as soon as the queue drains.
+ *
+ * With -O (ordered) a single shard is used and the batch queue holds back
+ * output until earlier batches are done,  so alerts come out in the same
+ * order as the input while rules are still checked in parallel.
+ *
+ * At the end,  a lines/sec figure and the rules that used the most time
+ * are logged.  Rule time is kept per thread so profiling doesn't make the
+ * processor threads fight over counters.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "rules.h"
+#include "batch-queue.h"
+#include "input-source.h"
+#include "replay.h"
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+struct RuleBody *RuleBody;
+
+/* A line aligned piece of the file and its reader */
+
+typedef struct _Sagan_Replay_Shard _Sagan_Replay_Shard;
+struct _Sagan_Replay_Shard
+{
+    const char *start;
+    const char *end;
+    struct _Sagan_Input_Source source;		/* Counters and batch */
+};
+
+static int replay_fd = -1;
+static const char *replay_map = NULL;
+static size_t replay_size = 0;
+
+static struct _Sagan_Replay_Shard *replay_shard = NULL;
+static int replay_shards = 0;
+
+/* Per thread rule timing,  merged at the end */
+
+static pthread_mutex_t ReplayProfileMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct _Sagan_Replay_Profile_Table **replay_profiles = NULL;
+static int replay_profile_count = 0;
+
+static __thread struct _Sagan_Replay_Profile_Table *replay_profile = NULL;
+
+static uint64_t Replay_Clock( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec );
+}
+
+/****************************************************************************
+ * Replay_Init - Maps the file and works out the shards.  Returns the
+ * number of reader threads Replay_Run() will start,  for Batch_Queue_Init().
+ ****************************************************************************/
+
+int Replay_Init( void )
+{
+
+    struct stat st;
+    const char *newline = NULL;
+
+    size_t offset = 0;
+    size_t target = 0;
+    long cpus = 1;
+    int i = 0;
+
+    if ( config->sagan_replay_ordered == true && counters->input_source_count > 1 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Ordered replay (-O) can't be used with sagan:core 'inputs'. Abort!", __FILE__, __LINE__);
+        }
+
+    replay_fd = open(config->sagan_fifo, O_RDONLY);
+
+    if ( replay_fd == -1 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not open file '%s' [%s]. Abort!", __FILE__, __LINE__, config->sagan_fifo, strerror(errno));
+        }
+
+    if ( fstat(replay_fd, &st) == -1 || !S_ISREG(st.st_mode) )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] '%s' is not a regular file. Replay needs one. Abort!", __FILE__, __LINE__, config->sagan_fifo);
+        }
+
+    replay_size = st.st_size;
+
+    if ( replay_size > 0 )
+        {
+
+            replay_map = mmap(NULL, replay_size, PROT_READ, MAP_PRIVATE, replay_fd, 0);
+
+            if ( replay_map == MAP_FAILED )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Could not mmap() '%s' [%s]. Abort!", __FILE__, __LINE__, config->sagan_fifo, strerror(errno));
+                }
+
+#ifdef MADV_SEQUENTIAL
+            (void)madvise((void *)replay_map, replay_size, MADV_SEQUENTIAL);
+#endif
+
+        }
+
+    /* One shard per CPU,  but not for tiny files.  Ordered output needs the
+       batches queued in file order,  so a single shard */
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    replay_shards = cpus > 0 ? (int)cpus : 1;
+
+    if ( (size_t)replay_shards > replay_size / REPLAY_SHARD_MIN )
+        {
+            replay_shards = (int)( replay_size / REPLAY_SHARD_MIN );
+        }
+
+    if ( replay_shards < 1 || config->sagan_replay_ordered == true )
+        {
+            replay_shards = 1;
+        }
+
+    replay_shard = calloc(replay_shards, sizeof(_Sagan_Replay_Shard));
+
+    if ( replay_shard == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for replay shards. Abort!", __FILE__, __LINE__);
+        }
+
+    /* Cut at roughly even offsets,  then move each cut past the next \n */
+
+    for (i = 0; i < replay_shards; i++)
+        {
+
+            replay_shard[i].start = replay_map + offset;
+            replay_shard[i].end = replay_map + replay_size;
+
+            if ( i < replay_shards - 1 )
+                {
+
+                    target = ( replay_size / replay_shards ) * ( i + 1 );
+
+                    if ( target < offset )
+                        {
+                            target = offset;
+                        }
+
+                    newline = memchr(replay_map + target, '\n', replay_size - target);
+
+                    if ( newline != NULL )
+                        {
+                            replay_shard[i].end = newline + 1;
+                        }
+                }
+
+            offset = replay_shard[i].end - replay_map;
+
+            replay_shard[i].source.type = INPUT_SOURCE_FILE;
+            replay_shard[i].source.shard = i;
+            strlcpy(replay_shard[i].source.path, config->sagan_fifo, sizeof(replay_shard[i].source.path));
+        }
+
+    return(replay_shards);
+
+}
+
+/****************************************************************************
+ * Replay_Shard - Reader thread for one shard.  Lines are copied out of the
+ * map first,  the ignore list and the parsers expect a NULL at the end.
+ ****************************************************************************/
+
+static void *Replay_Shard( void *data )
+{
+
+    struct _Sagan_Replay_Shard *shard = (struct _Sagan_Replay_Shard *)data;
+
+    const char *line = shard->start;
+    const char *newline = NULL;
+
+    char syslogstring[MAX_SYSLOGMSG];
+    size_t length = 0;
+
+#ifdef HAVE_SYS_PRCTL_H
+    (void)SetThreadName("SaganReplay");
+#endif
+
+    shard->source.batch = Batch_Queue_Get();
+
+    while ( line < shard->end )
+        {
+
+            newline = memchr(line, '\n', shard->end - line);
+
+            if ( newline == NULL )
+                {
+                    newline = shard->end;
+                }
+
+            length = newline - line;
+
+            /* Blank lines are skipped,  like the FIFO/file reader does */
+
+            if ( length == 0 )
+                {
+                    line = newline + 1;
+                    continue;
+                }
+
+            if ( length > MAX_SYSLOGMSG - 1 )
+                {
+                    __atomic_add_fetch(&shard->source.truncated, 1, __ATOMIC_SEQ_CST);
+                    length = MAX_SYSLOGMSG - 1;
+                }
+
+            memcpy(syslogstring, line, length);
+            syslogstring[length] = '\0';
+
+            Input_Source_Line( &shard->source, syslogstring, length );
+
+            line = newline + 1;
+        }
+
+    shard->source.batch = Batch_Queue_Put( shard->source.batch );
+
+    pthread_exit(NULL);
+
+}
+
+/****************************************************************************
+ * Replay_Profile_Lap - Called by the engine for every rule it checks.  The
+ * time since the last call is charged to "rule",  then "next" becomes the
+ * rule being timed (-1 to stop).
+ ****************************************************************************/
+
+void Replay_Profile_Lap( int *rule, uint64_t *start, int next )
+{
+
+    uint64_t now = Replay_Clock();
+    int size = 0;
+
+    if ( *rule >= 0 )
+        {
+
+            if ( replay_profile == NULL )
+                {
+
+                    replay_profile = calloc(1, sizeof(_Sagan_Replay_Profile_Table));
+
+                    if ( replay_profile == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule profile. Abort!", __FILE__, __LINE__);
+                        }
+
+                    pthread_mutex_lock(&ReplayProfileMutex);
+
+                    replay_profiles = (_Sagan_Replay_Profile_Table **) realloc(replay_profiles, (replay_profile_count+1) * sizeof(_Sagan_Replay_Profile_Table *));
+
+                    if ( replay_profiles == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for rule profile. Abort!", __FILE__, __LINE__);
+                        }
+
+                    replay_profiles[replay_profile_count++] = replay_profile;
+
+                    pthread_mutex_unlock(&ReplayProfileMutex);
+                }
+
+            /* First use,  or the rules were reloaded with more rules */
+
+            if ( *rule >= replay_profile->size )
+                {
+
+                    size = counters->rulecount > *rule ? counters->rulecount : *rule + 1;
+
+                    pthread_mutex_lock(&ReplayProfileMutex);
+
+                    replay_profile->rule = (_Sagan_Replay_Profile *) realloc(replay_profile->rule, size * sizeof(_Sagan_Replay_Profile));
+
+                    if ( replay_profile->rule == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for rule profile. Abort!", __FILE__, __LINE__);
+                        }
+
+                    memset(&replay_profile->rule[replay_profile->size], 0, ( size - replay_profile->size ) * sizeof(_Sagan_Replay_Profile));
+                    replay_profile->size = size;
+
+                    pthread_mutex_unlock(&ReplayProfileMutex);
+                }
+
+            replay_profile->rule[*rule].nsec += now - *start;
+            replay_profile->rule[*rule].checks++;
+        }
+
+    *rule = next;
+    *start = now;
+
+}
+
+static int Replay_Profile_Compare( const void *a, const void *b )
+{
+
+    const struct _Sagan_Replay_Total *ta = (const struct _Sagan_Replay_Total *)a;
+    const struct _Sagan_Replay_Total *tb = (const struct _Sagan_Replay_Total *)b;
+
+    if ( ta->nsec == tb->nsec )
+        {
+            return(0);
+        }
+
+    return( ta->nsec < tb->nsec ? 1 : -1 );
+
+}
+
+/****************************************************************************
+ * Replay_Summary - Logs the rules that used the most time.  Only safe once
+ * the queue has drained.
+ ****************************************************************************/
+
+static void Replay_Summary( void )
+{
+
+    struct _Sagan_Replay_Total *total = NULL;
+
+    uint64_t all_nsec = 0;
+    int i = 0;
+    int j = 0;
+
+    if ( replay_profile_count == 0 || counters->rulecount == 0 )
+        {
+            return;
+        }
+
+    total = calloc(counters->rulecount, sizeof(_Sagan_Replay_Total));
+
+    if ( total == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule profile summary. Abort!", __FILE__, __LINE__);
+        }
+
+    for (i = 0; i < counters->rulecount; i++)
+        {
+
+            total[i].rule = i;
+
+            for (j = 0; j < replay_profile_count; j++)
+                {
+
+                    if ( i < replay_profiles[j]->size )
+                        {
+                            total[i].nsec += replay_profiles[j]->rule[i].nsec;
+                            total[i].checks += replay_profiles[j]->rule[i].checks;
+                        }
+                }
+
+            all_nsec += total[i].nsec;
+        }
+
+    qsort(total, counters->rulecount, sizeof(_Sagan_Replay_Total), Replay_Profile_Compare);
+
+    Sagan_Log(NORMAL, "Time spent in rules: %.3f seconds (all threads). Top %d:", (double)all_nsec / 1000000000, REPLAY_TOP_RULES);
+
+    for (i = 0; i < counters->rulecount && i < REPLAY_TOP_RULES && total[i].nsec > 0; i++)
+        {
+            Sagan_Log(NORMAL, "  sid %" PRIu64 ": %.3f ms, %" PRIu64 " check(s), %" PRIu64 " ns/check (%.2f%%) - %s", RuleBody[total[i].rule].s_sid, (double)total[i].nsec / 1000000, total[i].checks, total[i].checks > 0 ? total[i].nsec / total[i].checks : 0, CalcPct(total[i].nsec, all_nsec), RuleBody[total[i].rule].s_msg);
+        }
+
+    free(total);
+
+}
+
+/****************************************************************************
+ * Replay_Run - Starts the shard readers and returns once every line has
+ * been read and processed.
+ ****************************************************************************/
+
+void Replay_Run( void )
+{
+
+    pthread_t *thread_id = NULL;
+
+    uint64_t start = Replay_Clock();
+    uint64_t elapsed = 0;
+    uint64_t lines = 0;
+    uint64_t ignored = 0;
+    uint64_t truncated = 0;
+
+    double seconds = 0;
+    int rc = 0;
+    int i = 0;
+
+    Sagan_Log(NORMAL, "Replaying %s (%zu bytes) with %d shard(s)%s.", config->sagan_fifo, replay_size, replay_shards, config->sagan_replay_ordered == true ? ", output in input order" : "");
+
+    thread_id = calloc(replay_shards, sizeof(pthread_t));
+
+    if ( thread_id == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for replay threads. Abort!", __FILE__, __LINE__);
+        }
+
+    for (i = 0; i < replay_shards; i++)
+        {
+
+            rc = pthread_create( &thread_id[i], NULL, Replay_Shard, &replay_shard[i] );
+
+            if ( rc != 0 )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Could not pthread_create() for replay shard %d [error: %d]. Abort!", __FILE__, __LINE__, i, rc);
+                }
+        }
+
+    for (i = 0; i < replay_shards; i++)
+        {
+            pthread_join(thread_id[i], NULL);
+        }
+
+    Sagan_Log(NORMAL, "EOF reached. Waiting for threads to catch up....");
+
+    Batch_Queue_Wait_Drained();
+
+    elapsed = Replay_Clock() - start;
+
+    if ( replay_map != NULL )
+        {
+            munmap((void *)replay_map, replay_size);
+        }
+
+    close(replay_fd);
+    free(thread_id);
+
+    for (i = 0; i < replay_shards; i++)
+        {
+            lines += replay_shard[i].source.received;
+            ignored += replay_shard[i].source.ignored;
+            truncated += replay_shard[i].source.truncated;
+        }
+
+    seconds = (double)elapsed / 1000000000;
+
+    Sagan_Log(NORMAL, "");
+    Sagan_Log(NORMAL, "Replay: %" PRIu64 " line(s) in %.3f seconds, %.0f lines/sec (%" PRIu64 " ignored, %" PRIu64 " truncated).", lines, seconds, seconds > 0 ? lines / seconds : 0, ignored, truncated);
+
+    Replay_Summary();
+
+}
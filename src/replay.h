@@ -0,0 +1,52 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+typedef struct _Sagan_Replay_Profile _Sagan_Replay_Profile;
+struct _Sagan_Replay_Profile
+{
+    uint64_t nsec;
+    uint64_t checks;
+};
+
+/* One thread's timings.  "size" follows counters->rulecount,  which can
+   grow when the rules are reloaded */
+
+typedef struct _Sagan_Replay_Profile_Table _Sagan_Replay_Profile_Table;
+struct _Sagan_Replay_Profile_Table
+{
+    struct _Sagan_Replay_Profile *rule;
+    int size;
+};
+
+typedef struct _Sagan_Replay_Total _Sagan_Replay_Total;
+struct _Sagan_Replay_Total
+{
+    int rule;
+    uint64_t nsec;
+    uint64_t checks;
+};
+
+int Replay_Init( void );
+void Replay_Run( void );
+void Replay_Profile_Lap( int *, uint64_t *, int );
@@ -0,0 +1,248 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* rules-hot.c
+ *
+ * Compact copy of what the engine reads for every candidate rule on every
+ * line.  RuleBody is several kilobytes per rule (fixed size content,
+ * reference and flexbit arrays),  so walking it touches a lot of memory
+ * that is only needed once a rule has matched.  The counts,  content and
+ * meta_content modifiers and pcre handles are packed here into small
+ * contiguous arrays and the content and meta_content strings into one
+ * pattern arena.  Everything else stays in RuleBody,  at the same index.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "rules.h"
+#include "rules-hot.h"
+
+struct _SaganCounters *counters;
+struct RuleBody *RuleBody;
+
+struct _Sagan_Rules_Hot *SaganRulesHot = NULL;
+
+static uint32_t rules_hot_generation = 0;
+
+static void Rules_Hot_Free( struct _Sagan_Rules_Hot *hot )
+{
+
+    if ( hot == NULL )
+        {
+            return;
+        }
+
+    free(hot->rules);
+    free(hot->contents);
+    free(hot->pcres);
+    free(hot->metas);
+    free(hot->meta_patterns);
+    free(hot->patterns);
+    free(hot);
+
+}
+
+/****************************************************************************
+ * Rules_Hot_Build - Packs the evaluation fields of the loaded rule set.
+ * Called from Sagan_Engine_Init() at start up and on reload.
+ ****************************************************************************/
+
+void Rules_Hot_Build( void )
+{
+
+    struct _Sagan_Rules_Hot *hot = NULL;
+    struct _Sagan_Rule_Content *c = NULL;
+    struct _Sagan_Rule_Meta *m = NULL;
+
+    uint32_t content_total = 0;
+    uint32_t pcre_total = 0;
+    uint32_t meta_total = 0;
+    uint32_t meta_pattern_total = 0;
+    size_t pattern_total = 0;
+    size_t pattern_fill = 0;
+    size_t len = 0;
+
+    int b = 0;
+    int z = 0;
+    int i = 0;
+
+    for ( b = 0; b < counters->rulecount; b++ )
+        {
+
+            content_total += RuleBody[b].content_count;
+            pcre_total += RuleBody[b].pcre_count;
+            meta_total += RuleBody[b].meta_content_count;
+
+            for ( z = 0; z < RuleBody[b].content_count; z++ )
+                {
+                    pattern_total += strlen(RuleBody[b].s_content[z]) + 1;
+                }
+
+            for ( z = 0; z < RuleBody[b].meta_content_count; z++ )
+                {
+
+                    meta_pattern_total += RuleBody[b].Meta[z].meta_counter;
+
+                    for ( i = 0; i < RuleBody[b].Meta[z].meta_counter; i++ )
+                        {
+                            pattern_total += strlen(RuleBody[b].Meta[z].meta_content_converted[i]) + 1;
+                        }
+                }
+        }
+
+    hot = calloc(1, sizeof(struct _Sagan_Rules_Hot));
+
+    if ( hot == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for hot rule table. Abort!", __FILE__, __LINE__);
+        }
+
+    hot->generation = ++rules_hot_generation;
+    hot->rule_count = counters->rulecount;
+    hot->content_count = content_total;
+    hot->pcre_count = pcre_total;
+    hot->meta_count = meta_total;
+    hot->meta_pattern_count = meta_pattern_total;
+    hot->pattern_size = pattern_total;
+
+    /* +1 so a rule set without content/pcre still gets valid pointers */
+
+    hot->rules = calloc(hot->rule_count + 1, sizeof(struct _Sagan_Rule_Hot));
+    hot->contents = calloc(content_total + 1, sizeof(struct _Sagan_Rule_Content));
+    hot->pcres = calloc(pcre_total + 1, sizeof(struct _Sagan_Rule_Pcre));
+    hot->metas = calloc(meta_total + 1, sizeof(struct _Sagan_Rule_Meta));
+    hot->meta_patterns = calloc(meta_pattern_total + 1, sizeof(const char *));
+    hot->patterns = malloc(pattern_total + 1);
+
+    if ( hot->rules == NULL || hot->contents == NULL || hot->pcres == NULL ||
+            hot->metas == NULL || hot->meta_patterns == NULL || hot->patterns == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for hot rule table. Abort!", __FILE__, __LINE__);
+        }
+
+    content_total = 0;
+    pcre_total = 0;
+    meta_total = 0;
+    meta_pattern_total = 0;
+
+    for ( b = 0; b < counters->rulecount; b++ )
+        {
+
+            hot->rules[b].content = content_total;
+            hot->rules[b].pcre = pcre_total;
+            hot->rules[b].meta = meta_total;
+            hot->rules[b].content_count = RuleBody[b].content_count;
+            hot->rules[b].pcre_count = RuleBody[b].pcre_count;
+            hot->rules[b].meta_content_count = RuleBody[b].meta_content_count;
+            hot->rules[b].match_count = RuleBody[b].content_count + RuleBody[b].pcre_count + RuleBody[b].meta_content_count;
+            hot->rules[b].has_dynamic = RuleBody[b].DynamicLoad.has_dynamic;
+
+            for ( z = 0; z < RuleBody[b].content_count; z++ )
+                {
+
+                    c = &hot->contents[content_total++];
+
+                    len = strlen(RuleBody[b].s_content[z]) + 1;
+                    memcpy(hot->patterns + pattern_fill, RuleBody[b].s_content[z], len);
+
+                    c->pattern = hot->patterns + pattern_fill;
+                    pattern_fill += len;
+
+                    c->offset = RuleBody[b].s_offset[z];
+                    c->depth = RuleBody[b].s_depth[z];
+                    c->distance = RuleBody[b].s_distance[z];
+                    c->within = RuleBody[b].s_within[z];
+                    c->nocase = RuleBody[b].s_nocase[z];
+                    c->negate = RuleBody[b].content_not[z];
+
+                    /* "distance" is relative to the depth of the content before it.
+                       The first content has none */
+
+                    c->prev_depth = z > 0 ? RuleBody[b].s_depth[z-1] : 0;
+
+                }
+
+            for ( z = 0; z < RuleBody[b].pcre_count; z++ )
+                {
+                    hot->pcres[pcre_total].re = RuleBody[b].re_pcre[z];
+                    hot->pcres[pcre_total].extra = RuleBody[b].pcre_extra[z];
+                    pcre_total++;
+                }
+
+            for ( z = 0; z < RuleBody[b].meta_content_count; z++ )
+                {
+
+                    m = &hot->metas[meta_total++];
+
+                    m->pattern = meta_pattern_total;
+                    m->pattern_count = RuleBody[b].Meta[z].meta_counter;
+
+                    for ( i = 0; i < RuleBody[b].Meta[z].meta_counter; i++ )
+                        {
+
+                            len = strlen(RuleBody[b].Meta[z].meta_content_converted[i]) + 1;
+                            memcpy(hot->patterns + pattern_fill, RuleBody[b].Meta[z].meta_content_converted[i], len);
+
+                            hot->meta_patterns[meta_pattern_total++] = hot->patterns + pattern_fill;
+                            pattern_fill += len;
+                        }
+
+                    m->offset = RuleBody[b].meta_offset[z];
+                    m->depth = RuleBody[b].meta_depth[z];
+                    m->distance = RuleBody[b].meta_distance[z];
+                    m->within = RuleBody[b].meta_within[z];
+                    m->nocase = RuleBody[b].meta_content_case[z];
+                    m->negate = RuleBody[b].meta_content_not[z];
+                    m->prev_depth = z > 0 ? RuleBody[b].meta_depth[z-1] : 0;
+
+                }
+
+        }
+
+    hot->patterns[pattern_fill] = '\0';
+
+    Sagan_Log(NORMAL, "Hot rule table: %d rule(s), %u content(s), %u pcre(s), %u meta_content(s), %zu byte(s) of patterns.", hot->rule_count, hot->content_count, hot->pcre_count, hot->meta_count, hot->pattern_size);
+
+    /* Swap it in,  see Prefilter_Build() */
+
+    Rules_Hot_Free( __atomic_exchange_n(&SaganRulesHot, hot, __ATOMIC_SEQ_CST) );
+
+}
+
+/****************************************************************************
+ * Rules_Hot_Get - Returns the current table.  Load it once per line and
+ * use that pointer for the whole line.
+ ****************************************************************************/
+
+struct _Sagan_Rules_Hot *Rules_Hot_Get( void )
+{
+    return( __atomic_load_n(&SaganRulesHot, __ATOMIC_SEQ_CST) );
+}
@@ -0,0 +1,106 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+void Rules_Hot_Build( void );
+struct _Sagan_Rules_Hot *Rules_Hot_Get( void );
+
+/* One content: as the engine evaluates it.  "pattern" points into the
+   shared pattern arena */
+
+typedef struct _Sagan_Rule_Content _Sagan_Rule_Content;
+struct _Sagan_Rule_Content
+{
+    const char *pattern;
+    int offset;
+    int depth;
+    int prev_depth;			/* depth of the content before,  for distance */
+    int distance;
+    int within;
+    bool nocase;
+    bool negate;
+};
+
+/* One meta_content: and its list of alternatives.  "pattern" is the first
+   entry in meta_patterns[] */
+
+typedef struct _Sagan_Rule_Meta _Sagan_Rule_Meta;
+struct _Sagan_Rule_Meta
+{
+    uint32_t pattern;
+    int pattern_count;
+    int offset;
+    int depth;
+    int prev_depth;			/* depth of the meta_content before,  for distance */
+    int distance;
+    int within;
+    bool nocase;
+    bool negate;
+};
+
+typedef struct _Sagan_Rule_Pcre _Sagan_Rule_Pcre;
+struct _Sagan_Rule_Pcre
+{
+    pcre *re;
+    pcre_extra *extra;
+};
+
+/* Per rule evaluation descriptor.  Same index as RuleBody,  which keeps
+   everything only needed once a rule has matched */
+
+typedef struct _Sagan_Rule_Hot _Sagan_Rule_Hot;
+struct _Sagan_Rule_Hot
+{
+    uint32_t content;			/* First entry in contents[] */
+    uint32_t pcre;			/* First entry in pcres[] */
+    uint32_t meta;			/* First entry in metas[] */
+    unsigned char content_count;
+    unsigned char pcre_count;
+    unsigned char meta_content_count;
+    unsigned char match_count;		/* content + pcre + meta_content */
+    bool has_dynamic;
+};
+
+typedef struct _Sagan_Rules_Hot _Sagan_Rules_Hot;
+struct _Sagan_Rules_Hot
+{
+    uint32_t generation;		/* Bumped on every reload */
+
+    int rule_count;
+    _Sagan_Rule_Hot *rules;
+
+    uint32_t content_count;
+    _Sagan_Rule_Content *contents;
+
+    uint32_t pcre_count;
+    _Sagan_Rule_Pcre *pcres;
+
+    uint32_t meta_count;
+    _Sagan_Rule_Meta *metas;
+
+    uint32_t meta_pattern_count;
+    const char **meta_patterns;		/* Into the pattern arena */
+
+    size_t pattern_size;
+    char *patterns;			/* NUL terminated,  back to back */
+};
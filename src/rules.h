@@ -255,10 +255,6 @@ struct BlueDot {
 	bool bluedot_url;
 	bool bluedot_filename;
 	bool bluedot_ja3;
-
-	bool bluedot_file_hash;
-	bool bluedot_url;
-	bool bluedot_filename;
 };
 #endif
 
@@ -96,7 +96,10 @@ struct _SaganConfig
     int          sagan_log_fd;
     char         sagan_lockfile[MAXPATH];
     char         sagan_fifo[MAXPATH];
+    char         sagan_inputs[CONFBUF];		/* Extra inputs,  "type:path,..." */
     bool         sagan_is_file;                       /* FIFO or FILE */
+    bool         sagan_replay;                        /* mmap'ed, sharded FILE (-R) */
+    bool         sagan_replay_ordered;                /* Output in input order (-O) */
     char         sagan_log_path[MAXPATH];
     char         sagan_rule_path[MAXPATH];
     bool         multiline_rules;	// True enables, causing pre-processing with temporary file.
@@ -117,6 +120,8 @@ struct _SaganConfig
 
     int          max_processor_threads;
     int		 max_batch;
+    int		 batch_queue_depth;		/* 0 == max_processor_threads */
+    int		 batch_queue_backpressure;	/* BATCH_QUEUE_* */
 
     int          default_port;
     bool         disable_dns_warnings;
@@ -232,6 +237,7 @@ struct _SaganConfig
     char	redis_password[255];
 
     int		redis_max_writer_threads;
+    int		redis_reader_cache_ttl;		/* Seconds,  0 == no cache */
 
 #endif
 
@@ -277,7 +283,6 @@ struct _SaganConfig
     uint64_t	 bluedot_url_max_cache;
     uint64_t 	 bluedot_filename_max_cache;
     uint64_t	 bluedot_ja3_max_cache;
-    uint64_t     bluedot_last_time;                    /* For cache cleaning */
 
     int		 bluedot_ip_queue;
     int		 bluedot_hash_queue;
@@ -285,6 +290,13 @@ struct _SaganConfig
     int		 bluedot_filename_queue;
     int		 bluedot_ja3_queue;
 
+    int		 bluedot_port;
+    bool	 bluedot_defer;			/* miss-policy: "defer" */
+    int		 bluedot_wait;			/* miss-wait,  milliseconds */
+    int		 bluedot_max_connections;
+    int		 bluedot_http_timeout;
+    int		 bluedot_max_deferred;
+
 #endif
 
 
@@ -300,6 +312,7 @@ struct _SaganConfig
     MMDB_s 	geoip2;
     char        geoip2_country_file[MAXPATH];
     bool 	have_geoip2;
+    uint32_t	geoip2_cache_size;		/* Per processor thread */
 
 #endif
 
@@ -44,7 +44,7 @@ typedef void json_object;
 
 #define SENSOR_NAME		"default_sensor_name"
 #define CLUSTER_NAME		"default_cluster_name"
-#define MMAP_VERSION		2.0
+#define MMAP_VERSION		2.7
 
 #define CLASSBUF		1024
 #define RULEBUF			5128
@@ -85,6 +85,8 @@ typedef void json_object;
 #define MAX_SYSLOG_BATCH	100
 #define DEFAULT_SYSLOG_BATCH	1
 
+#define BATCH_SLAB_LINE_SIZE	512		/* Starting slab bytes per batch line.  Grows as needed */
+
 #define MAXPATH 		255		/* Max path for files/directories */
 #define MAXHOST         	255		/* Max host length */
 #define MAXPROGRAM		32		/* Max syslog 'program' length */
@@ -101,6 +103,11 @@ typedef void json_object;
 
 #define MAX_FIFO_SIZE		1048576		/* Max pipe/FIFO size in bytes/pages */
 
+#define MAX_INPUT_CLIENTS	64		/* Max connections per unix-stream input */
+
+#define REPLAY_SHARD_MIN	1048576		/* Smallest replay (-R) shard in bytes */
+#define REPLAY_TOP_RULES	20		/* Rules listed in the replay summary */
+
 #define MAX_THREADS     	4096            /* Max system threads */
 
 #define MAX_VAR_NAME_SIZE  	64		/* Max "var" name size */
@@ -216,6 +223,10 @@ typedef void json_object;
 #define THRESHOLD2			1
 #define FLEXBIT				2
 #define XBIT				3
+#define TRACK_CLIENTS			4
+
+#define IPC_LOCK_TABLES			5		/* One lock set per type above */
+#define IPC_LOCK_STRIPES		16		/* Mutexes per shared table */
 
 #define PARSE_HASH_MD5			1
 #define	PARSE_HASH_SHA1			2
@@ -233,6 +244,8 @@ typedef void json_object;
 
 #define	THREAD_NAME_LEN			16
 
+#define GEOIP_CACHE_DEFAULT		4096	/* Entries per processor thread */
+
 #ifdef WITH_BLUEDOT
 
 #define BLUEDOT_IP_DEFAULT		500000
@@ -248,6 +261,12 @@ typedef void json_object;
 #define BLUEDOT_FILENAME_QUEUE_DEFAULT	1000
 #define BLUEDOT_JA3_QUEUE_DEFAULT	1000
 
+#define BLUEDOT_PORT_DEFAULT		80
+#define BLUEDOT_WAIT_DEFAULT		50	/* Milliseconds */
+#define BLUEDOT_MAX_CONNECTIONS_DEFAULT	8
+#define BLUEDOT_HTTP_TIMEOUT_DEFAULT	10	/* Seconds */
+#define BLUEDOT_MAX_DEFERRED_DEFAULT	1000
+
 #endif
 
 /* Outside WITH_BLUEDOT because used in arg passing */
@@ -70,6 +70,9 @@
 #include "ipc.h"
 #include "tracking-syslog.h"
 #include "parsers/parsers.h"
+#include "batch-queue.h"
+#include "input-source.h"
+#include "replay.h"
 
 #include "input-pipe.h"
 
@@ -121,6 +124,7 @@ struct _JSON_Message_Map *JSON_Message_Map = NULL;
 /* Already Init'ed */
 
 struct _Sagan_Ignorelist *SaganIgnorelist;
+struct _Sagan_Input_Source *SaganInputSource;
 
 #ifdef WITH_BLUEDOT
 #include <curl/curl.h>
@@ -132,15 +136,9 @@ struct _Sagan_Ignorelist *SaganIgnorelist;
 #include "redis.h"
 #endif
 
-struct _Sagan_Pass_Syslog *SaganPassSyslog = NULL;
-
-
-int proc_msgslot = 0;
 int proc_running = 0;
+bool dynamic_rules_rebuild = false;
 
-
-pthread_cond_t SaganProcDoWork=PTHREAD_COND_INITIALIZER;
-pthread_mutex_t SaganProcWorkMutex=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t SaganRulesLoadedMutex=PTHREAD_MUTEX_INITIALIZER;
 
 /* ########################################################################
@@ -163,17 +161,17 @@ int main(int argc, char **argv)
         { "config",       required_argument,    NULL,   'f' },
         { "log",          required_argument,    NULL,   'l' },
         { "file",	  required_argument,    NULL,   'F' },
+        { "replay",	  required_argument,    NULL,   'R' },
+        { "ordered",	  no_argument,		NULL,	'O' },
         { "quiet", 	  no_argument, 		NULL, 	'Q' },
         {0, 0, 0, 0}
     };
 
     static const char *short_options =
-        "l:f:u:F:d:c:pDhCQ";
+        "l:f:u:F:R:d:c:pDhCQO";
 
     int option_index = 0;
 
-    struct _Sagan_Pass_Syslog *SaganPassSyslog_LOCAL = NULL;
-
     /****************************************************************************/
     /* libpcap/PLOG (syslog sniffer) local variables                            */
     /****************************************************************************/
@@ -212,6 +210,19 @@ int main(int argc, char **argv)
     pthread_attr_init(&thread_client_stats_attr);
     pthread_attr_setdetachstate(&thread_client_stats_attr,  PTHREAD_CREATE_DETACHED);
 
+#ifdef WITH_BLUEDOT
+
+    /****************************************************************************/
+    /* Bluedot local variables                                                  */
+    /****************************************************************************/
+
+    pthread_t bluedot_thread;
+    pthread_attr_t thread_bluedot_attr;
+    pthread_attr_init(&thread_bluedot_attr);
+    pthread_attr_setdetachstate(&thread_bluedot_attr,  PTHREAD_CREATE_DETACHED);
+
+#endif
+
     /****************************************************************************/
     /* Various local variables						        */
     /****************************************************************************/
@@ -245,13 +256,9 @@ int main(int argc, char **argv)
     pthread_attr_setdetachstate(&tracking_thread_attr,  PTHREAD_CREATE_DETACHED);
 
 
-    bool fifoerr = false;
-    bool ignore_flag = false;
-
-    char syslogstring[MAX_SYSLOGMSG] = { 0 };
-
     signed char c;
     int rc=0;
+    int replay_readers = 0;
 
     int i;
 
@@ -260,8 +267,6 @@ int main(int argc, char **argv)
 
     bool debugflag = false;
 
-    int batch_count = 0;
-
     /* Allocate memory for global struct _SaganDebug */
 
     debug = malloc(sizeof(_SaganDebug));
@@ -565,6 +570,16 @@ int main(int argc, char **argv)
                     strlcpy(config->sagan_fifo,optarg,sizeof(config->sagan_fifo) - 1);
                     break;
 
+                case 'R':
+                    config->sagan_is_file = true;
+                    config->sagan_replay = true;
+                    strlcpy(config->sagan_fifo,optarg,sizeof(config->sagan_fifo) - 1);
+                    break;
+
+                case 'O':
+                    config->sagan_replay_ordered = true;
+                    break;
+
                 case 'f':
                     strlcpy(config->sagan_config,optarg,sizeof(config->sagan_config) - 1);
                     break;
@@ -705,23 +720,28 @@ int main(int argc, char **argv)
 
     (void)Sagan_Engine_Init();
 
-    SaganPassSyslog = malloc(config->max_processor_threads * sizeof(_Sagan_Pass_Syslog));
+    /* Reading a file,  there is no reason to ever throw data away */
 
-    if ( SaganPassSyslog == NULL )
+    if ( config->sagan_is_file == true )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganPassSyslog. Abort!", __FILE__, __LINE__);
+            config->batch_queue_backpressure = BATCH_QUEUE_BLOCK;
         }
 
-    memset(SaganPassSyslog, 0, sizeof(struct _Sagan_Pass_Syslog));
+    Input_Source_Init();
 
-    SaganPassSyslog_LOCAL = malloc(config->max_processor_threads * sizeof(_Sagan_Pass_Syslog));
+    if ( config->sagan_replay_ordered == true && config->sagan_replay == false )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Ordered output (-O) only works with replay (-R). Abort!", __FILE__, __LINE__);
+        }
 
-    if ( SaganPassSyslog_LOCAL == NULL )
+    /* Replay (-R) readers hold a batch each,  on top of the inputs */
+
+    if ( config->sagan_replay == true )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganPassSyslog_LOCAL. Abort!", __FILE__, __LINE__);
+            replay_readers = Replay_Init();
         }
 
-    memset(SaganPassSyslog_LOCAL, 0, sizeof(struct _Sagan_Pass_Syslog));
+    Batch_Queue_Init( counters->input_source_count + replay_readers );
 
 
     pthread_t processor_id[config->max_processor_threads];
@@ -897,7 +917,7 @@ int main(int argc, char **argv)
 
             Sagan_Log(NORMAL, "");
             Sagan_Log(NORMAL, "Bluedot IP: %s", config->bluedot_ip);
-            Sagan_Log(NORMAL, "Bluedot URL: http://%s/%s", config->bluedot_ip, config->bluedot_uri);
+            Sagan_Log(NORMAL, "Bluedot URL: http://%s:%d/%s", config->bluedot_ip, config->bluedot_port, config->bluedot_uri);
             Sagan_Log(NORMAL, "Bluedot Device ID: %s", config->bluedot_device_id);
             Sagan_Log(NORMAL, "Bluedot Categories File: %s", config->bluedot_cat);
             Sagan_Log(NORMAL, "Bluedot loaded %d categories.", counters->bluedot_cat_count);
@@ -908,6 +928,24 @@ int main(int argc, char **argv)
             Sagan_Log(NORMAL, "Bluedot URL Cache Size: %" PRIu64 "", config->bluedot_url_max_cache);
             Sagan_Log(NORMAL, "Bluedot Filename Cache Size: %" PRIu64 "", config->bluedot_filename_max_cache);
             Sagan_Log(NORMAL, "Bluedot JA3 Cache Size: %" PRIu64 "", config->bluedot_ja3_max_cache);
+            Sagan_Log(NORMAL, "Bluedot Max Connections: %d", config->bluedot_max_connections);
+
+            if ( config->bluedot_defer == true )
+                {
+                    Sagan_Log(NORMAL, "Bluedot Miss Policy: defer (max %d lines).", config->bluedot_max_deferred);
+                }
+            else
+                {
+                    Sagan_Log(NORMAL, "Bluedot Miss Policy: wait (%d ms).", config->bluedot_wait);
+                }
+
+            rc = pthread_create( &bluedot_thread, &thread_bluedot_attr, (void *)Sagan_Bluedot_Handler, NULL );
+
+            if ( rc != 0 )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Error creating Bluedot thread [error: %d].", __FILE__, __LINE__, rc);
+                }
 
         }
 
@@ -1124,225 +1162,39 @@ int main(int argc, char **argv)
 
     Sagan_Log(NORMAL, "");
 
-    if ( !config->sagan_is_file )
-        {
+    /* Start the readers for every input but the first, which we read here */
 
-            Sagan_Log(NORMAL, "Attempting to open syslog FIFO (%s).", config->sagan_fifo);
+    Input_Source_Start();
 
+    if ( config->sagan_replay == true )
+        {
+            Replay_Run();
         }
     else
         {
 
-            Sagan_Log(NORMAL, "Attempting to open syslog FILE (%s).", config->sagan_fifo);
-
-        }
-
+            Input_Source_Read( &SaganInputSource[0] );
 
+            /* Only a file (-F) gets here,  at EOF.  Other inputs keep
+               running,  FIFOs and sockets until a signal */
 
-    while(true)
-        {
-
-            FILE *fd;
-
-            if (( fd = fopen(config->sagan_fifo, "r" )) == NULL )
+            if ( counters->input_source_count > 1 )
                 {
-
-                    if ( config->sagan_is_file == false )
-                        {
-
-                            /* try to create it */
-
-                            Sagan_Log(NORMAL, "Fifo not found, creating it (%s).", config->sagan_fifo);
-
-                            if (mkfifo(config->sagan_fifo, 0700) == -1)
-                                {
-                                    Sagan_Log(ERROR, "Could not create FIFO '%s'. Abort!", config->sagan_fifo);
-                                }
-
-                            fd = fopen(config->sagan_fifo, "r");
-
-                            if ( fd == NULL )
-                                {
-                                    Sagan_Log(ERROR, "Error opening %s. Abort!", config->sagan_fifo);
-                                }
-
-                        }
-                    else
-                        {
-
-                            Sagan_Log(ERROR, "Could not open file '%s'. Abort!", config->sagan_fifo);
-                        }
-
+                    Sagan_Log(NORMAL, "EOF reached on %s. Still reading the other input(s).", SaganInputSource[0].path);
+                    Input_Source_Join();
                 }
 
-            if ( config->sagan_is_file == false )
-                {
-                    Sagan_Log(NORMAL, "Successfully opened FIFO (%s).", config->sagan_fifo);
-
-#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
-
-                    Set_Pipe_Size(fd);
-
-#endif
-
-                }
-            else
-                {
-                    Sagan_Log(NORMAL, "Successfully opened FILE (%s) and processing events.....", config->sagan_fifo);
-                }
-
-            while(fd != NULL)
-                {
-
-
-                    while(fgets(syslogstring, MAX_SYSLOGMSG, fd) != NULL)
-                        {
-
-                            /* If the FIFO was in a error state,  let user know the FIFO writer has resumed */
-
-                            if ( fifoerr == true )
-                                {
-
-                                    Sagan_Log(NORMAL, "FIFO writer has restarted. Processing events.");
-
-#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
-
-                                    Set_Pipe_Size(fd);
-
-#endif
-                                    fifoerr = false;
-                                }
-
-                            __atomic_add_fetch(&counters->events_received, 1, __ATOMIC_SEQ_CST);
-
-                            /* Copy log line to batch/queue if we haven't reached our batch limit */
-
-                            if ( batch_count <= config->max_batch )
-                                {
-
-                                    if (debug->debugsyslog)
-                                        {
-                                            Sagan_Log(DEBUG, "[%s, line %d] [batch position %d] Raw log: %s",  __FILE__, __LINE__, batch_count, syslogstring);
-                                        }
-
-                                    /* Check for "drop" to save CPU from "ignore list" */
-
-                                    if ( config->sagan_droplist_flag )
-                                        {
-
-                                            ignore_flag = false;
-
-                                            for (i = 0; i < counters->droplist_count; i++)
-                                                {
-
-                                                    if (Sagan_strstr(syslogstring, SaganIgnorelist[i].ignore_string))
-                                                        {
-                                                            __atomic_add_fetch(&counters->ignore_count, 1, __ATOMIC_SEQ_CST);
-                                                            ignore_flag = true;
-                                                            break;
-
-                                                        }
-                                                }
-
-
-                                        }
-
-                                    /* Add to batch */
-
-                                    if ( ignore_flag == false )
-                                        {
-
-                                            /* Copy data to _LOCAL array */
-
-                                            strlcpy(SaganPassSyslog_LOCAL[proc_msgslot].syslog[batch_count], syslogstring, sizeof(SaganPassSyslog_LOCAL[proc_msgslot].syslog[batch_count]));
-
-                                            batch_count++;
-                                        }
-
-                                }
-
-                            /* Do we have enough threads? */
-
-
-                            if ( proc_msgslot < config->max_processor_threads )
-                                {
-
-                                    /* Has our batch count been reached */
-
-                                    if ( batch_count >= config->max_batch )
-                                        {
-
-                                            batch_count=0;              /* Reset batch/queue */
-
-                                            pthread_mutex_lock(&SaganProcWorkMutex);
-
-                                            /* Copy local thread data to global thread */
-
-                                            for ( i = 0; i < config->max_batch; i++)
-                                                {
-                                                    strlcpy(SaganPassSyslog[proc_msgslot].syslog[i], SaganPassSyslog_LOCAL[proc_msgslot].syslog[i], sizeof(SaganPassSyslog[proc_msgslot].syslog[i]));
-                                                }
-
-                                            counters->events_processed = counters->events_processed + config->max_batch;
-
-                                            proc_msgslot++;
-
-                                            /* Send work to thread */
-
-                                            pthread_cond_signal(&SaganProcDoWork);
-                                            pthread_mutex_unlock(&SaganProcWorkMutex);
-                                        }
-
-                                }
-                            else
-                                {
-
-                                    /* If there's no thread, we lose the entire batch */
-
-                                    counters->worker_thread_exhaustion = counters->worker_thread_exhaustion + config->max_batch; ;
-                                    batch_count = 0;
-                                }
-
-                        } /* while(fgets) */
-
-                    /* fgets() has returned a error,  likely due to the FIFO writer leaving */
-
-                    if ( fifoerr == false )
-                        {
-
-                            if ( config->sagan_is_file != 0 )
-                                {
-                                    Sagan_Log(NORMAL, "EOF reached. Waiting for threads to catch up....");
-                                    Sagan_Log(NORMAL, "");
-
-                                    while(proc_msgslot != 0 || proc_running != 0)
-                                        {
-                                            Sagan_Log(NORMAL, "Waiting on %d/%d threads....", proc_msgslot, proc_running);
-                                            sleep(1);
-                                        }
-
-                                    fclose(fd);
-                                    Statistics();
-                                    Remove_Lock_File();
-
-                                    Sagan_Log(NORMAL, "Exiting.");
-                                    exit(0);
-
-                                }
-                            else
-                                {
-
-                                    Sagan_Log(WARN, "FIFO writer closed.  Waiting for FIFO writer to restart....");
-                                    fifoerr = true; 			/* Set flag so our wile(fgets) knows */
-                                }
-                        }
-                    sleep(1);		/* So we don't eat 100% CPU */
+            Sagan_Log(NORMAL, "EOF reached. Waiting for threads to catch up....");
+            Sagan_Log(NORMAL, "");
 
-                } /* while(fd != NULL)  */
+            Batch_Queue_Wait_Drained();
+        }
 
-            fclose(fd); 			/* ???? */
+    Statistics();
+    Remove_Lock_File();
 
-        } /* End of while(1) */
+    Sagan_Log(NORMAL, "Exiting.");
+    exit(0);
 
 } /* End of main */
 
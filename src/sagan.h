@@ -36,6 +36,7 @@
 #include <time.h>
 #include <arpa/inet.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "sagan-defs.h"
 
@@ -147,7 +148,7 @@ char      *strrpbrk(const char *str, const char *accept);
 //int       Character_Count ( char *, char *);
 
 #if defined(F_GETPIPE_SZ) && defined(F_SETPIPE_SZ)
-void      Set_Pipe_Size( FILE * );
+void      Set_Pipe_Size( int );
 #endif
 
 
@@ -173,6 +174,23 @@ struct _SaganDNSCache
     char src_ip[20];
 };
 
+/* Shared table locks (see ipc-lock.c).  Each stripe has a cache line to
+   itself */
+
+typedef union _Sagan_IPC_Stripe _Sagan_IPC_Stripe;
+union _Sagan_IPC_Stripe
+{
+    pthread_mutex_t mutex;
+    char pad[64];
+};
+
+typedef struct _Sagan_IPC_Lock _Sagan_IPC_Lock;
+struct _Sagan_IPC_Lock
+{
+    int stripes;
+    _Sagan_IPC_Stripe stripe[IPC_LOCK_STRIPES];
+};
+
 typedef struct _Sagan_IPC_Counters _Sagan_IPC_Counters;
 struct _Sagan_IPC_Counters
 {
@@ -182,12 +200,21 @@ struct _Sagan_IPC_Counters
     int  flexbit_count;
     int	 xbit_count;
 
+    int  flexbit_max;			/* Layout the objects were written with */
+    int  xbit_max;
+
     int  thresh2_count;
     int  after2_count;
 
+    int  thresh2_max;			/* Layout the objects were written with */
+    int  after2_max;
+
     int	 track_client_count;
     int  track_clients_client_count;
     int  track_clients_down;
+    int  track_clients_max;		/* Layout the object was written with */
+
+    _Sagan_IPC_Lock locks[IPC_LOCK_TABLES];
 
 };
 
@@ -221,7 +248,15 @@ struct _SaganCounters
     uint64_t malformed_program;
     uint64_t malformed_message;
 
-    uint64_t worker_thread_exhaustion;
+    uint64_t queue_enqueued;		/* Batches handed to processor threads */
+    uint64_t queue_dequeued;
+    uint64_t queue_full;		/* Times a reader found the queue full */
+    uint64_t queue_dropped;		/* Lines dropped due to "queue-backpressure" */
+    uint64_t queue_depth_max;
+    uint64_t queue_wait_usec;		/* Total time batches waited in the queue */
+    uint64_t queue_wait_usec_max;
+
+    uint64_t ipc_lock_wait_usec[IPC_LOCK_TABLES];	/* Time spent waiting on shared table locks */
 
     int	     ruleset_track_count;
 
@@ -252,6 +287,8 @@ struct _SaganCounters
 
     int	     droplist_count;
 
+    int	     input_source_count;
+
     int      brointel_addr_count;
     int      brointel_domain_count;
     int      brointel_file_hash_count;
@@ -272,6 +309,7 @@ struct _SaganCounters
     uint64_t geoip2_hit;				/* GeoIP hit count */
     uint64_t geoip2_lookup;				/* Total lookups */
     uint64_t geoip2_error;				/* Lookup Errors */
+    uint64_t geoip2_cache_hit;				/* Lookups answered by the thread cache */
     int	     geoip_skip_count;
 #endif
 
@@ -294,6 +332,10 @@ struct _SaganCounters
     uint64_t bluedot_mdate_cache;                                 /* Hits from cache , but where over a modification date */
     uint64_t bluedot_cdate_cache;      			   /* Hits from cache , but where over a create date */
     uint64_t bluedot_error_count;
+    uint64_t bluedot_cache_evicted;				   /* Least recently used entries dropped from a full cache */
+    uint64_t bluedot_wait_timeout;				   /* "miss-wait" ran out before Bluedot answered */
+    uint64_t bluedot_deferred;					   /* Rules run again once Bluedot answered */
+    uint64_t bluedot_deferred_dropped;				   /* Over "max-deferred" */
 
     uint64_t bluedot_hash_cache_count;
     uint64_t bluedot_hash_cache_hit;
@@ -327,7 +369,16 @@ struct _SaganCounters
 #endif
 
 #ifdef HAVE_LIBHIREDIS
-    uint64_t redis_writer_threads_drop;
+    uint64_t redis_writer_threads_drop;		/* Commands dropped,  queue full */
+    uint64_t redis_writer_queue_max;
+    uint64_t redis_writer_batches;		/* Pipelined round trips */
+    uint64_t redis_writer_commands;
+    uint64_t redis_writer_coalesced;		/* Commands replaced by a later one for the same key */
+    uint64_t redis_writer_rtt_usec;		/* Total time spent on round trips */
+    uint64_t redis_writer_rtt_usec_max;
+    uint64_t redis_reader_lookups;		/* Keys asked of Redis_Reader_Exists() */
+    uint64_t redis_reader_cache_hit;
+    uint64_t redis_reader_round_trips;
 #endif
 
 #ifdef HAVE_LIBFASTJSON
@@ -436,7 +487,21 @@ struct _Sagan_Proc_Syslog
 typedef struct _Sagan_Pass_Syslog _Sagan_Pass_Syslog;
 struct _Sagan_Pass_Syslog
 {
-    char syslog[MAX_SYSLOG_BATCH][MAX_SYSLOGMSG];
+    int count;				/* Lines in this batch */
+    uint64_t enqueue_usec;		/* For queue latency */
+    uint64_t sequence;			/* Queue order,  used by ordered replay */
+
+    /* Lines are stored NULL terminated,  back to back,  in "slab" */
+
+    char *slab;
+    size_t slab_used;
+    size_t slab_size;
+    uint32_t line[MAX_SYSLOG_BATCH];	/* Offset of each line in "slab" */
+
+    /* Lines whose Bluedot lookup has been answered,  to run the deferred
+       rule on again.  Only set on batches the Bluedot thread queues */
+
+    struct _Sagan_Bluedot_Deferred *deferred;
 };
 
 
@@ -526,11 +591,25 @@ struct _Sagan_Event
 
 };
 
+/* Binary threshold2/after2 tracking key (see util-track.c).  Fields the
+   rule doesn't track by are zero */
+
+typedef struct _Sagan_Track_Key _Sagan_Track_Key;
+struct _Sagan_Track_Key
+{
+    unsigned char ip_src[MAXIPBIT];
+    unsigned char ip_dst[MAXIPBIT];
+    uint32_t src_port;
+    uint32_t dst_port;
+    uint64_t username;			/* Hash of the username,  0 == none */
+};
+
 typedef struct _Threshold2_IPC _Threshold2_IPC;
 struct _Threshold2_IPC
 {
 
-    uint32_t hash;
+    uint64_t hash;
+    _Sagan_Track_Key key;
 
     bool threshold2_method_src;
     bool threshold2_method_dst;
@@ -551,8 +630,6 @@ struct _Threshold2_IPC
     uint64_t utime;
     uint64_t sid;
     int expire;
-    char syslog_message[MAX_SYSLOGMSG];
-    char signature_msg[MAX_SAGAN_MSG];
 };
 
 
@@ -560,7 +637,8 @@ typedef struct _After2_IPC _After2_IPC;
 struct _After2_IPC
 {
 
-    uint32_t hash;
+    uint64_t hash;
+    _Sagan_Track_Key key;
 
     bool after2_method_src;
     bool after2_method_dst;
@@ -583,6 +661,14 @@ struct _After2_IPC
     uint32_t rev;
 
     int expire;
+};
+
+/* Last log line/signature for a threshold2/after2 entry.  Kept in their own
+   array (same position as the entry) so lookups don't stride over them */
+
+typedef struct _Sagan_IPC_Message _Sagan_IPC_Message;
+struct _Sagan_IPC_Message
+{
     char syslog_message[MAX_SYSLOGMSG];
     char signature_msg[MAX_SAGAN_MSG];
 };
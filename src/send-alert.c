@@ -34,6 +34,7 @@
 
 #include "output.h"
 #include "gen-msg.h"
+#include "batch-queue.h"
 
 #include "processors/engine.h"
 
@@ -107,6 +108,10 @@ void Send_Alert ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, json_object *json_n
     SaganProcessorEvent->flow_id	    =    SaganProcSyslog_LOCAL->flow_id;
 
 
+    /* Ordered replay (-O) keeps alerts in input order */
+
+    Batch_Queue_Order_Wait();
+
     Output ( SaganProcessorEvent );
     free(SaganProcessorEvent);
 
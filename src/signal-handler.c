@@ -52,11 +52,14 @@
 #include "config-yaml.h"
 #include "lockfile.h"
 #include "signal-handler.h"
+#include "processor.h"
 #include "stats.h"
 #include "gen-msg.h"
 #include "classifications.h"
 
 #include "processors/perfmon.h"
+#include "processors/engine.h"
+#include "batch-queue.h"
 #include "rules.h"
 #include "ignore-list.h"
 #include "flow.h"
@@ -97,22 +100,11 @@ struct RuleBody *RuleBody;
 struct _Rules_Loaded *rules_loaded;
 struct _Class_Struct *classstruct;
 struct _Sagan_Processor_Generator *generator;
-struct _Sagan_Blacklist *SaganBlacklist;
 struct _Sagan_Track_Clients *SaganTrackClients;
 struct _SaganVar *var;
 
 struct _Sagan_Ignorelist *SaganIgnorelist;
 
-struct _Sagan_BroIntel_Intel_Addr *Sagan_BroIntel_Intel_Addr;
-struct _Sagan_BroIntel_Intel_Domain *Sagan_BroIntel_Intel_Domain;
-struct _Sagan_BroIntel_Intel_File_Hash *Sagan_BroIntel_Intel_File_Hash;
-struct _Sagan_BroIntel_Intel_URL *Sagan_BroIntel_Intel_URL;
-struct _Sagan_BroIntel_Intel_Software *Sagan_BroIntel_Intel_Software;
-struct _Sagan_BroIntel_Intel_Email *Sagan_BroIntel_Intel_Email;
-struct _Sagan_BroIntel_Intel_User_Name *Sagan_BroIntel_Intel_User_Name;
-struct _Sagan_BroIntel_Intel_File_Name *Sagan_BroIntel_Intel_File_Name;
-struct _Sagan_BroIntel_Intel_Cert_Hash *Sagan_BroIntel_Intel_Cert_Hash;
-
 pthread_mutex_t SaganReloadMutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t SaganReloadCond = PTHREAD_COND_INITIALIZER;
 
@@ -157,6 +149,7 @@ void Sig_Handler( void )
                     /* This tells "new" threads to stop processing new data */
 
                     death=true;
+                    Batch_Queue_Wake();
 
                     /* We wait until there are no more running/processing threads
                        or until the thread space is zero.  We don't want to start
@@ -305,9 +298,10 @@ void Sig_Handler( void )
 
                 case SIGHUP:
 
-                    config->sagan_reload = 1;				/* Only this thread can alter this */
+                    /* Nothing below is safe while a processor thread is
+                       still working on a batch with the old tables */
 
-                    pthread_mutex_lock(&SaganReloadMutex);
+                    Processor_Reload_Begin();
 
                     Sagan_Log(NORMAL, "[Reloading Sagan version %s.]-------", VERSION);
 
@@ -368,40 +362,12 @@ void Sig_Handler( void )
 
                     /* Multi Threaded processors */
 
-                    config->blacklist_flag = 0;
-
-                    if ( config->blacklist_flag )
-                        {
-                            free(SaganBlacklist);
-                        }
+                    /* The blacklist table is swapped,  not freed,  by
+                       Sagan_Blacklist_Load() */
 
                     config->blacklist_flag = 0;
 
-                    if ( config->brointel_flag )
-                        {
-                            free(Sagan_BroIntel_Intel_Addr);
-                            free(Sagan_BroIntel_Intel_Domain);
-                            free(Sagan_BroIntel_Intel_File_Hash);
-                            free(Sagan_BroIntel_Intel_URL);
-                            free(Sagan_BroIntel_Intel_Software);
-                            free(Sagan_BroIntel_Intel_Email);
-                            free(Sagan_BroIntel_Intel_User_Name);
-                            free(Sagan_BroIntel_Intel_File_Name);
-                            free(Sagan_BroIntel_Intel_Cert_Hash);
-
-                            __atomic_store_n (&counters->brointel_addr_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_domain_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_file_hash_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_url_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_software_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_email_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_user_name_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_file_name_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_cert_hash_count, 0, __ATOMIC_SEQ_CST);
-                            __atomic_store_n (&counters->brointel_dups, 0, __ATOMIC_SEQ_CST);
-
-
-                        }
+                    /* Same for Bro Intel,  see Sagan_BroIntel_Load_File() */
 
                     config->brointel_flag = 0;
 
@@ -431,7 +397,7 @@ void Sig_Handler( void )
 
                     /* GeoIP skip */
                     __atomic_store_n (&counters->geoip_skip_count, 0, __ATOMIC_SEQ_CST);
-                    memset(GeoIP_Skip, 0, sizeof(_Sagan_GeoIP_Skip));
+                    config->geoip2_cache_size = GEOIP_CACHE_DEFAULT;
 #endif
 
 
@@ -454,6 +420,7 @@ void Sig_Handler( void )
 
                     pthread_mutex_lock(&SaganRulesLoadedMutex);
                     Load_YAML_Config(config->sagan_config);	/* <- RELOAD */
+                    Sagan_Engine_Init();
                     pthread_mutex_unlock(&SaganRulesLoadedMutex);
 
                     /************************************************************/
@@ -525,10 +492,7 @@ void Sig_Handler( void )
 #endif
 
 
-                    pthread_cond_signal(&SaganReloadCond);
-                    pthread_mutex_unlock(&SaganReloadMutex);
-
-                    config->sagan_reload = 0;
+                    Processor_Reload_End();
 
                     Sagan_Log(NORMAL, "Configuration reloaded.");
                     break;
@@ -40,11 +40,18 @@
 #include "stats.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "batch-queue.h"
+#include "input-source.h"
+
+#ifdef HAVE_LIBHIREDIS
+#include "redis.h"
+#endif
 
 struct _SaganCounters *counters;
 struct _Sagan_IPC_Counters *counters_ipc;
 struct _Sagan_Ruleset_Track *Ruleset_Track;
 struct _SaganConfig *config;
+struct _Sagan_Input_Source *SaganInputSource;
 
 int proc_running; 	/* Count of executing threads */
 
@@ -115,10 +122,23 @@ void Statistics( void )
 
 //        Sagan_Log(NORMAL, "           Malformed                : h:%" PRIu64 "|f:%" PRIu64 "|p:%" PRIu64 "|l:%" PRIu64 "|T:%" PRIu64 "|d:%" PRIu64 "|T:%" PRIu64 "|P:%" PRIu64 "|M:%" PRIu64 "", counters->malformed_host, counters->malformed_facility, counters->malformed_priority, counters->malformed_level, counters->malformed_tag, counters->malformed_date, counters->malformed_time, counters->malformed_program, counters->malformed_message);
 
-            Sagan_Log(NORMAL, "           Thread Exhaustion          : %" PRIu64 " (%.3f%%)", counters->worker_thread_exhaustion,  CalcPct( counters->worker_thread_exhaustion, counters->events_received) );
+            Sagan_Log(NORMAL, "           Queue Dropped              : %" PRIu64 " (%.3f%%)", counters->queue_dropped,  CalcPct( counters->queue_dropped, counters->events_received) );
+            Sagan_Log(NORMAL, "           Queue Depth (now/max)      : %" PRIu64 "/%" PRIu64 " (full %" PRIu64 " time(s))", Batch_Queue_Depth(), counters->queue_depth_max, counters->queue_full );
+            Sagan_Log(NORMAL, "           Queue Latency (avg/max)    : %" PRIu64 "/%" PRIu64 " usec", counters->queue_dequeued > 0 ? counters->queue_wait_usec / counters->queue_dequeued : 0, counters->queue_wait_usec_max );
 
             Sagan_Log(NORMAL, "           Thread Usage               : %d/%d (%.3f%%)", proc_running, config->max_processor_threads, CalcPct( proc_running, config->max_processor_threads ));
 
+            /* Per input breakdown,  only worth showing with more than one */
+
+            if ( counters->input_source_count > 1 )
+                {
+
+                    for (i = 0; i < counters->input_source_count; i++)
+                        {
+                            Sagan_Log(NORMAL, "           Input %-22s : %" PRIu64 "/%" PRIu64 "/%" PRIu64 " received/ignored/truncated", SaganInputSource[i].path, SaganInputSource[i].received, SaganInputSource[i].ignored, SaganInputSource[i].truncated );
+                        }
+                }
+
             /*
                         if (config->sagan_droplist_flag)
                             {
@@ -138,6 +158,7 @@ void Statistics( void )
 #ifdef HAVE_LIBMAXMINDDB
             Sagan_Log(NORMAL, "           GeoIP Hits:                : %" PRIu64 " (%.3f%%)", counters->geoip2_hit, CalcPct( counters->geoip2_hit, counters->events_received) );
             Sagan_Log(NORMAL, "           GeoIP Lookups:             : %" PRIu64 "", counters->geoip2_lookup);
+            Sagan_Log(NORMAL, "           GeoIP Cache Hits:          : %" PRIu64 " (%.3f%%)", counters->geoip2_cache_hit, CalcPct( counters->geoip2_cache_hit, counters->geoip2_lookup) );
             Sagan_Log(NORMAL, "           GeoIP Errors               : %" PRIu64 "", counters->geoip2_error);
 #
 
@@ -246,6 +267,24 @@ void Statistics( void )
             Sagan_Log(NORMAL, "           Total                      : %" PRIu64 "", counters->follow_flow_total);
             Sagan_Log(NORMAL, "           Dropped                    : %" PRIu64 " (%.3f%%)", counters->follow_flow_drop, CalcPct(counters->follow_flow_drop, counters->follow_flow_total));
 
+#ifdef HAVE_LIBHIREDIS
+
+            if ( config->redis_flag )
+                {
+                    Sagan_Log(NORMAL, "");
+                    Sagan_Log(NORMAL, "          -[ Sagan Redis Statistics ]-");
+                    Sagan_Log(NORMAL, "");
+                    Sagan_Log(NORMAL, "           Queue Depth (now/max)      : %" PRIu64 "/%" PRIu64 "", Redis_Writer_Queue_Depth(), counters->redis_writer_queue_max);
+                    Sagan_Log(NORMAL, "           Commands/Coalesced         : %" PRIu64 "/%" PRIu64 "", counters->redis_writer_commands, counters->redis_writer_coalesced);
+                    Sagan_Log(NORMAL, "           Round Trips                : %" PRIu64 " (%.3f commands each)", counters->redis_writer_batches, counters->redis_writer_batches > 0 ? (double)counters->redis_writer_commands / counters->redis_writer_batches : 0 );
+                    Sagan_Log(NORMAL, "           Round Trip (avg/max)       : %" PRIu64 "/%" PRIu64 " usec", counters->redis_writer_batches > 0 ? counters->redis_writer_rtt_usec / counters->redis_writer_batches : 0, counters->redis_writer_rtt_usec_max );
+                    Sagan_Log(NORMAL, "           Dropped                    : %" PRIu64 "", counters->redis_writer_threads_drop);
+                    Sagan_Log(NORMAL, "           Reader Lookups/Cached      : %" PRIu64 "/%" PRIu64 " (%.3f%%)", counters->redis_reader_lookups, counters->redis_reader_cache_hit, CalcPct(counters->redis_reader_cache_hit, counters->redis_reader_lookups));
+                    Sagan_Log(NORMAL, "           Reader Round Trips         : %" PRIu64 "", counters->redis_reader_round_trips);
+                }
+
+#endif
+
 #ifdef WITH_BLUEDOT
 
             if (config->bluedot_flag)
@@ -300,6 +339,9 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "          * Bluedot Combined Statistics *");
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          Lookup error count              : %" PRIu64 "", counters->bluedot_error_count);
+                    Sagan_Log(NORMAL, "          Cache entries evicted (LRU)     : %" PRIu64 "", counters->bluedot_cache_evicted);
+                    Sagan_Log(NORMAL, "          Miss-wait timeouts              : %" PRIu64 "", counters->bluedot_wait_timeout);
+                    Sagan_Log(NORMAL, "          Deferred rules run (dropped)    : %" PRIu64 " (%" PRIu64 ")", counters->bluedot_deferred, counters->bluedot_deferred_dropped);
                     Sagan_Log(NORMAL, "          Total query rate/per second     : %lu", bluedot_ip_total + bluedot_hash_total + bluedot_url_total + bluedot_filename_total);
 
 
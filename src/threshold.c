@@ -36,10 +36,16 @@
 #include "rules.h"
 #include "threshold.h"
 #include "ipc.h"
-
-pthread_mutex_t Thresh2_Mutex=PTHREAD_MUTEX_INITIALIZER;
+#include "ipc-index.h"
+#include "ipc-lock.h"
+#include "ipc-wheel.h"
+#include "util-time.h"
+#include "util-track.h"
 
 struct _Threshold2_IPC *Threshold2_IPC;
+struct _Sagan_IPC_Message *Threshold2_Message;
+struct _Sagan_IPC_Index *Threshold2_Index;
+struct _Sagan_IPC_Wheel *Threshold2_Wheel;
 struct _Sagan_IPC_Counters *counters_ipc;
 
 struct _SaganCounters *counters;
@@ -54,10 +60,6 @@ struct _SaganConfig *config;
 bool Threshold2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_dst,  uint32_t dst_port, char *username, char *syslog_message )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
     bool thresh_log_flag = false;
 
     uint64_t thresh_oldtime;
@@ -65,22 +67,22 @@ bool Threshold2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_d
 
     int i;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
     char src_tmp[MAXIP] = { 0 };
     char dst_tmp[MAXIP] = { 0 };
     char username_tmp[MAX_USERNAME_SIZE] = { 0 };
     uint32_t dst_port_tmp = 0;
     uint32_t src_port_tmp = 0;
 
-    char hash_string[128] = { 0 };
     char debug_string[64] = { 0 };
 
-    uint32_t hash;
+    struct _Sagan_Track_Key key;
 
-    current_time = atoi(timet);
+    uint64_t hash;
+    uint32_t stripe;
+
+    bool all = false;
+
+    current_time = Return_Epoch();
 
     username_tmp[0] = '\0';
 
@@ -109,123 +111,165 @@ bool Threshold2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_d
             dst_port_tmp = dst_port;
         }
 
-    snprintf(hash_string, sizeof(hash_string), "%s|%d|%s|%d|%s", src_tmp, src_port_tmp, dst_tmp, dst_port_tmp, username_tmp);
+    hash = Track_Key(&key, src_tmp, src_port_tmp, dst_tmp, dst_port_tmp, username_tmp);
+
+    /* One probe of the shared index instead of a walk over every entry.
+       Updating an entry only needs its stripe.  Adding one changes the
+       index,  so that takes the whole table and looks again */
 
-    hash = Djb2_Hash( hash_string );
+    stripe = (uint32_t)( hash >> 32 ) ^ (uint32_t)hash ^ (uint32_t)RuleBody[rule_position].s_sid;
 
-    for (i = 0; i < counters_ipc->thresh2_count; i++ )
+    IPC_Lock(THRESHOLD2, stripe);
+
+    i = IPC_Index_Find(Threshold2_Index, RuleBody[rule_position].s_sid, 0, hash);
+
+    if ( i < 0 )
         {
+            IPC_Unlock(THRESHOLD2, stripe);
+            IPC_Lock_All(THRESHOLD2);
 
-            if ( hash == Threshold2_IPC[i].hash && Threshold2_IPC[i].sid == RuleBody[rule_position].s_sid )
-                {
+            all = true;
+            i = IPC_Index_Find(Threshold2_Index, RuleBody[rule_position].s_sid, 0, hash);
+        }
+
+    /* The index only has the 64 bit hash.  If another tuple got there
+       first,  the new one takes the entry over and starts from scratch */
+
+    if ( i >= 0 && ( memcmp(&Threshold2_IPC[i].key, &key, sizeof(key)) || strcmp(Threshold2_IPC[i].username, username_tmp) ) )
+        {
+
+            Threshold2_IPC[i].key = key;
+            Threshold2_IPC[i].count = 0;
+            Threshold2_IPC[i].utime = current_time;
+
+            strlcpy(Threshold2_IPC[i].ip_src, src_tmp, sizeof(Threshold2_IPC[i].ip_src));
+            strlcpy(Threshold2_IPC[i].ip_dst, dst_tmp, sizeof(Threshold2_IPC[i].ip_dst));
+            strlcpy(Threshold2_IPC[i].username, username_tmp, sizeof(Threshold2_IPC[i].username));
+
+            Threshold2_IPC[i].src_port = src_port_tmp;
+            Threshold2_IPC[i].dst_port = dst_port_tmp;
+
+        }
 
-                    File_Lock(config->shm_thresh2);
-                    pthread_mutex_lock(&Thresh2_Mutex);
+    if ( i >= 0 )
+        {
 
-                    Threshold2_IPC[i].count++;
+            Threshold2_IPC[i].count++;
 
-                    /* Suppress */
+            /* Suppress */
 
 //		    if ( rulestruct[counters->rulecount].threshold2_type = 3 )
 //			    {
-                    thresh_oldtime = current_time - Threshold2_IPC[i].utime;
-                    Threshold2_IPC[i].utime = current_time;
+            thresh_oldtime = current_time - Threshold2_IPC[i].utime;
+            Threshold2_IPC[i].utime = current_time;
 //			    }
 
-                    strlcpy(Threshold2_IPC[i].syslog_message, syslog_message, sizeof(Threshold2_IPC[i].syslog_message));
-                    strlcpy(Threshold2_IPC[i].signature_msg, RuleBody[rule_position].s_msg, sizeof(Threshold2_IPC[i].signature_msg));
+            strlcpy(Threshold2_Message[i].syslog_message, syslog_message, sizeof(Threshold2_Message[i].syslog_message));
+            strlcpy(Threshold2_Message[i].signature_msg, RuleBody[rule_position].s_msg, sizeof(Threshold2_Message[i].signature_msg));
 
-                    if ( thresh_oldtime > RuleBody[rule_position].Threshold.threshold2_seconds )
-                        {
-                            Threshold2_IPC[i].count=1;
-                            Threshold2_IPC[i].utime = current_time;  /* Reset the time */
-                            thresh_log_flag = false;
-                        }
+            if ( thresh_oldtime > RuleBody[rule_position].Threshold.threshold2_seconds )
+                {
+                    Threshold2_IPC[i].count=1;
+                    Threshold2_IPC[i].utime = current_time;  /* Reset the time */
+                    thresh_log_flag = false;
+                }
 
-                    if ( RuleBody[rule_position].Threshold.threshold2_count < Threshold2_IPC[i].count )
+            if ( RuleBody[rule_position].Threshold.threshold2_count < Threshold2_IPC[i].count )
+                {
+                    thresh_log_flag = true;
+
+                    if ( debug->debuglimits )
                         {
-                            thresh_log_flag = true;
 
-                            if ( debug->debuglimits )
+                            if ( Threshold2_IPC[i].threshold2_method_src == true )
                                 {
+                                    strlcat(debug_string, "by_src ", sizeof(debug_string));
+                                }
 
-                                    if ( Threshold2_IPC[i].threshold2_method_src == true )
-                                        {
-                                            strlcat(debug_string, "by_src ", sizeof(debug_string));
-                                        }
-
-                                    if ( Threshold2_IPC[i].threshold2_method_dst == true )
-                                        {
-                                            strlcat(debug_string, "by_dst ", sizeof(debug_string));
-                                        }
-
-                                    if ( Threshold2_IPC[i].threshold2_method_username == true )
-                                        {
-                                            strlcat(debug_string, "by_username ", sizeof(debug_string));
-                                        }
-
-                                    if ( Threshold2_IPC[i].threshold2_method_srcport == true )
-                                        {
-                                            strlcat(debug_string, "by_srcport ", sizeof(debug_string));
-                                        }
+                            if ( Threshold2_IPC[i].threshold2_method_dst == true )
+                                {
+                                    strlcat(debug_string, "by_dst ", sizeof(debug_string));
+                                }
 
-                                    if ( Threshold2_IPC[i].threshold2_method_dstport == true )
-                                        {
-                                            strlcat(debug_string, "by_dstport ", sizeof(debug_string));
-                                        }
+                            if ( Threshold2_IPC[i].threshold2_method_username == true )
+                                {
+                                    strlcat(debug_string, "by_username ", sizeof(debug_string));
+                                }
 
-                                    Sagan_Log(NORMAL, "Threshold SID %" PRIu64 ". Tracking by %s[%d: Hash: %lu]", Threshold2_IPC[i].sid, debug_string, i, hash);
+                            if ( Threshold2_IPC[i].threshold2_method_srcport == true )
+                                {
+                                    strlcat(debug_string, "by_srcport ", sizeof(debug_string));
+                                }
 
+                            if ( Threshold2_IPC[i].threshold2_method_dstport == true )
+                                {
+                                    strlcat(debug_string, "by_dstport ", sizeof(debug_string));
                                 }
 
-                            counters->threshold_total++;
-                        }
+                            Sagan_Log(NORMAL, "Threshold SID %" PRIu64 ". Tracking by %s[%d: Hash: %lu]", Threshold2_IPC[i].sid, debug_string, i, hash);
 
-                    pthread_mutex_unlock(&Thresh2_Mutex);
-                    File_Unlock(config->shm_thresh2);
+                        }
 
-                    return(thresh_log_flag);
+                    __atomic_add_fetch(&counters->threshold_total, 1, __ATOMIC_SEQ_CST);
+                }
 
+            if ( all == true )
+                {
+                    IPC_Unlock_All(THRESHOLD2);
+                }
+            else
+                {
+                    IPC_Unlock(THRESHOLD2, stripe);
                 }
 
+            return(thresh_log_flag);
+
         }
 
-    /* If not found,  add it to the array */
+    /* Not found.  Drop the few entries that have come due on the expiry
+       wheel,  then add it.  If it's still full,  drop everything that has
+       expired */
+
+    Expire_IPC_Threshold2(current_time, IPC_WHEEL_RECLAIM);
 
-    if ( Clean_IPC_Object(THRESHOLD2) == 0 )
+    if ( counters_ipc->thresh2_count < config->max_threshold2 || Clean_IPC_Threshold2() == 0 )
         {
 
-            File_Lock(config->shm_thresh2);
-            pthread_mutex_lock(&Thresh2_Mutex);
+            i = counters_ipc->thresh2_count;
+
+            Threshold2_IPC[i].hash = hash;
+            Threshold2_IPC[i].key = key;
 
-            Threshold2_IPC[counters_ipc->thresh2_count].hash = hash;
+            Threshold2_IPC[i].count = 1;
+            Threshold2_IPC[i].utime = current_time;
+            Threshold2_IPC[i].expire = RuleBody[rule_position].Threshold.threshold2_seconds;
+            Threshold2_IPC[i].sid = RuleBody[rule_position].s_sid;
+            Threshold2_IPC[i].target_count =RuleBody[rule_position].Threshold.threshold2_count;
+            Threshold2_IPC[i].threshold2_method_src = RuleBody[rule_position].Threshold.threshold2_method_src;
+            Threshold2_IPC[i].threshold2_method_dst = RuleBody[rule_position].Threshold.threshold2_method_dst;
+            Threshold2_IPC[i].threshold2_method_username = RuleBody[rule_position].Threshold.threshold2_method_username;
 
-            Threshold2_IPC[counters_ipc->thresh2_count].count = 1;
-            Threshold2_IPC[counters_ipc->thresh2_count].utime = current_time;
-            Threshold2_IPC[counters_ipc->thresh2_count].expire = RuleBody[rule_position].Threshold.threshold2_seconds;
-            Threshold2_IPC[counters_ipc->thresh2_count].sid = RuleBody[rule_position].s_sid;
-            Threshold2_IPC[counters_ipc->thresh2_count].target_count =RuleBody[rule_position].Threshold.threshold2_count;
-            Threshold2_IPC[counters_ipc->thresh2_count].threshold2_method_src = RuleBody[rule_position].Threshold.threshold2_method_src;
-            Threshold2_IPC[counters_ipc->thresh2_count].threshold2_method_dst = RuleBody[rule_position].Threshold.threshold2_method_dst;
-            Threshold2_IPC[counters_ipc->thresh2_count].threshold2_method_username = RuleBody[rule_position].Threshold.threshold2_method_username;
+            strlcpy(Threshold2_IPC[i].ip_src, src_tmp, sizeof(Threshold2_IPC[i].ip_src));
+            Threshold2_IPC[i].src_port = src_port_tmp;
 
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].ip_src, src_tmp, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].ip_src));
-            Threshold2_IPC[counters_ipc->thresh2_count].src_port = src_port_tmp;
+            strlcpy(Threshold2_IPC[i].ip_dst, dst_tmp, sizeof(Threshold2_IPC[i].ip_dst));
+            Threshold2_IPC[i].dst_port = dst_port_tmp;
 
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].ip_dst, dst_tmp, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].ip_dst));
-            Threshold2_IPC[counters_ipc->thresh2_count].dst_port = dst_port_tmp;
+            strlcpy(Threshold2_IPC[i].username, username_tmp, sizeof(Threshold2_IPC[i].username));
 
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].username, username_tmp, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].username));
+            strlcpy(Threshold2_Message[i].syslog_message, syslog_message, sizeof(Threshold2_Message[i].syslog_message));
+            strlcpy(Threshold2_Message[i].signature_msg, RuleBody[rule_position].s_msg, sizeof(Threshold2_Message[i].signature_msg));
 
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].syslog_message, syslog_message, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].syslog_message));
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].signature_msg, RuleBody[rule_position].s_msg, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].signature_msg));
+            IPC_Index_Insert(Threshold2_Index, Threshold2_IPC[i].sid, 0, hash, i);
+
+            IPC_Wheel_Add(Threshold2_Wheel, i, current_time + RuleBody[rule_position].Threshold.threshold2_seconds + 1);
 
             counters_ipc->thresh2_count++;
 
-            pthread_mutex_unlock(&Thresh2_Mutex);
-            File_Unlock(config->shm_thresh2);
         }
 
+    IPC_Unlock_All(THRESHOLD2);
+
     return(false);
 
 }
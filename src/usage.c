@@ -77,6 +77,9 @@ void Usage(void)
     fprintf(stderr, "-f, --config [file]\tSagan configuration file to load.\n");
     fprintf(stderr, "-F, --file [file]\tFIFO over ride.  This reads a file in rather than reading\n");
     fprintf(stderr, "\t\t\tfrom a FIFO.  The file must be in the Sagan format!\n");
+    fprintf(stderr, "-R, --replay [file]\tReplay a file.  Like -F,  but the file is mmap'ed and read\n");
+    fprintf(stderr, "\t\t\tin parallel.  Prints lines/sec and rule timing at the end.\n");
+    fprintf(stderr, "-O, --ordered\t\tWith -R,  write alerts in the same order as the file.\n");
     fprintf(stderr, "-l, --log [file]\tsagan.log location [default: %s].\n", SAGANLOG );
     fprintf(stderr, "-Q, --quiet\t\tRun Sagan in 'quiet' mode (no console output)\n");
     fprintf(stderr, "\n");
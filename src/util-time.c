@@ -92,23 +92,53 @@ void CreateIsoTimeString (const struct timeval *ts, char *str, size_t size)
 }
 
 
+/* Broken down local time,  redone once a second per thread */
+
+static __thread uint64_t local_time_epoch = 0;
+static __thread struct tm local_time_tm;
+
 /************************************************
- * Returns current epoch time in uint64_t format
+ * Returns current epoch time in uint64_t format.
+ * Called per event,  so it reads the coarse
+ * (vDSO,  no system call) clock.
  ************************************************/
 
 uint64_t Return_Epoch( void )
 {
 
-    time_t t;
-    struct tm *now;
-    char timet[20] = { 0 };
+#ifdef CLOCK_REALTIME_COARSE
+
+    struct timespec ts;
+
+    if ( clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0 )
+        {
+            return( (uint64_t)ts.tv_sec );
+        }
+
+#endif
+
+    return( (uint64_t)time(NULL) );
 
+}
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+/****************************************************************************
+ * Return_Local_Time - Current local time (hour,  minute,  day of the week,
+ * etc).  localtime_r() takes the time zone lock,  so it is only called when
+ * the second changes.  The result belongs to the calling thread.
+ ****************************************************************************/
+
+struct tm *Return_Local_Time( void )
+{
+
+    uint64_t epoch = Return_Epoch();
+
+    if ( epoch != local_time_epoch )
+        {
+            Sagan_LocalTime( (time_t)epoch, &local_time_tm );
+            local_time_epoch = epoch;
+        }
 
-    return(atol(timet));
+    return( &local_time_tm );
 
 }
 
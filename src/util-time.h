@@ -25,6 +25,7 @@ void Return_Date( uint32_t, char *str, size_t size );
 void Return_Time( uint32_t, char *str, size_t size );
 void u32_Time_To_Human ( uint32_t, char *str, size_t size );
 uint64_t Return_Epoch( void );
+struct tm *Return_Local_Time( void );
 
 
 
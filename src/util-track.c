@@ -0,0 +1,158 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-track.c
+ *
+ * Builds the binary key threshold2 and after2 track by: the source and
+ * destination address bits,  ports and a hash of the username.  Replaces
+ * formatting them into a string and taking its 32 bit Djb2 hash,  which
+ * could merge unrelated sources.
+ *
+ * A rule usually thresholds on the same addresses as the rule before it,
+ * so each thread keeps the last addresses and username it converted.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sagan.h"
+#include "util-track.h"
+
+static __thread char track_ip_src[MAXIP];
+static __thread unsigned char track_ip_src_bits[MAXIPBIT];
+
+static __thread char track_ip_dst[MAXIP];
+static __thread unsigned char track_ip_dst_bits[MAXIPBIT];
+
+static __thread char track_username[MAX_USERNAME_SIZE];
+static __thread uint64_t track_username_hash = 0;
+
+/****************************************************************************
+ * Track_Hash - 64 bit FNV-1a of a string.  "seed" lets two independent
+ * hashes be taken of the same string
+ ****************************************************************************/
+
+uint64_t Track_Hash( const char *str, uint64_t seed )
+{
+
+    uint64_t hash = 14695981039346656037ULL ^ seed;
+
+    while ( *str != '\0' )
+        {
+            hash = ( hash ^ (unsigned char)*str++ ) * 1099511628211ULL;
+        }
+
+    return(hash);
+
+}
+
+/****************************************************************************
+ * Track_IP - Address bits for "ip".  IPv4 is stored v4-mapped
+ * (::ffff:a.b.c.d) so 1.2.3.4 and 102:304:: don't share a key.  Anything
+ * that isn't an address (a host name) gets 128 bits of hash instead,  so
+ * it still can't collide with other names.  "" (not tracked) is all zero.
+ ****************************************************************************/
+
+static void Track_IP( char *ip, char *last, unsigned char *last_bits )
+{
+
+    uint64_t hash[2];
+
+    if ( !strcmp(ip, last) )
+        {
+            return;
+        }
+
+    memset(last_bits, 0, MAXIPBIT);
+
+    if ( ip[0] != '\0' && inet_pton(AF_INET6, ip, last_bits) != 1 )
+        {
+
+            if ( inet_pton(AF_INET, ip, last_bits + 12) == 1 )
+                {
+                    last_bits[10] = 0xff;
+                    last_bits[11] = 0xff;
+                }
+            else
+                {
+                    hash[0] = Track_Hash(ip, 0);
+                    hash[1] = Track_Hash(ip, 0x9E3779B97F4A7C15ULL);
+                    memcpy(last_bits, hash, MAXIPBIT);
+                }
+        }
+
+    strlcpy(last, ip, MAXIP);
+
+}
+
+/****************************************************************************
+ * Track_Key - Fills "key" for a threshold2/after2 lookup and returns its
+ * 64 bit hash.  Empty strings and zero ports are fields the rule does not
+ * track by.
+ ****************************************************************************/
+
+uint64_t Track_Key( struct _Sagan_Track_Key *key, char *ip_src, uint32_t src_port, char *ip_dst, uint32_t dst_port, char *username )
+{
+
+    const unsigned char *p = (const unsigned char *)key;
+
+    uint64_t hash = 0x9E3779B97F4A7C15ULL;
+    uint64_t word = 0;
+    size_t i = 0;
+
+    Track_IP(ip_src, track_ip_src, track_ip_src_bits);
+    Track_IP(ip_dst, track_ip_dst, track_ip_dst_bits);
+
+    if ( strcmp(username, track_username) )
+        {
+            track_username_hash = username[0] == '\0' ? 0 : Track_Hash(username, 0);
+            strlcpy(track_username, username, sizeof(track_username));
+        }
+
+    memcpy(key->ip_src, track_ip_src_bits, MAXIPBIT);
+    memcpy(key->ip_dst, track_ip_dst_bits, MAXIPBIT);
+    key->src_port = src_port;
+    key->dst_port = dst_port;
+    key->username = track_username_hash;
+
+    /* The key is 48 bytes with no padding,  mix it a word at a time */
+
+    for ( i = 0; i < sizeof(struct _Sagan_Track_Key); i += sizeof(uint64_t) )
+        {
+            memcpy(&word, p + i, sizeof(uint64_t));
+
+            hash = ( hash ^ word ) * 0xFF51AFD7ED558CCDULL;
+            hash ^= hash >> 32;
+        }
+
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    return(hash);
+
+}
@@ -54,6 +54,7 @@
 #include "sagan-defs.h"
 #include "sagan-config.h"
 #include "lockfile.h"
+#include "util-time.h"
 
 #include "parsers/strstr-asm/strstr-hook.h"
 
@@ -212,11 +213,7 @@ void Sagan_Log (int type, const char *format,... )
     va_start(ap, format);
     char *chr="*";
     char curtime[64];
-    time_t t;
-    struct tm *now;
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  now);
+    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  Return_Local_Time());
 
     if ( type == ERROR )
         {
@@ -1301,10 +1298,9 @@ void Open_Log_File( bool state, int type )
 
 #if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
 
-void Set_Pipe_Size ( FILE *fd )
+void Set_Pipe_Size ( int fd_int )
 {
 
-    int fd_int;
     int current_fifo_size;
     int fd_results;
 
@@ -1312,7 +1308,6 @@ void Set_Pipe_Size ( FILE *fd )
     if ( config->sagan_fifo_size != 0 )
         {
 
-            fd_int = fileno(fd);
             current_fifo_size = fcntl(fd_int, F_GETPIPE_SZ);
 
             if ( current_fifo_size == config->sagan_fifo_size )
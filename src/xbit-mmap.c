@@ -26,6 +26,7 @@
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
@@ -35,6 +36,9 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "ipc.h"
+#include "ipc-index.h"
+#include "ipc-lock.h"
+#include "ipc-wheel.h"
 #include "xbit.h"
 #include "xbit-mmap.h"
 #include "rules.h"
@@ -49,8 +53,121 @@ struct _SaganConfig *config;
 
 struct _Sagan_IPC_Counters *counters_ipc;
 struct _Sagan_IPC_Xbit *Xbit_IPC;
+struct _Sagan_IPC_Message *Xbit_Message;
+struct _Sagan_IPC_Index *Xbit_Index;
+struct _Sagan_IPC_Wheel *Xbit_Wheel;
+
+/*****************************************************************************
+ * Xbit_Find_MMAP - The index is keyed by (name hash,  tracking hash).  Two
+ * xbits with the same key get revs 0,  1,  2...  so a lookup walks the revs
+ * until the name matches or a rev is missing.  Returns the xbit or -1.
+ * Caller holds the xbit's stripe or the whole table.
+ *****************************************************************************/
+
+static int Xbit_Find_MMAP( uint32_t name_hash, uint32_t hash, const char *name )
+{
+
+    uint32_t rev = 0;
+    int x = 0;
+
+    while ( ( x = IPC_Index_Find(Xbit_Index, name_hash, rev, hash) ) != -1 )
+        {
+
+            if ( !strcmp(Xbit_IPC[x].xbit_name, name) )
+                {
+                    return(x);
+                }
+
+            rev++;
+        }
+
+    return(-1);
+
+}
+
+/*****************************************************************************
+ * Xbit_Index_Add_MMAP - Indexes the xbit at "x" under the first free rev
+ * of its key.  Caller holds IPC_Lock_All(XBIT)
+ *****************************************************************************/
+
+void Xbit_Index_Add_MMAP( int x )
+{
+
+    uint32_t rev = 0;
+
+    while ( IPC_Index_Find(Xbit_Index, Xbit_IPC[x].xbit_name_hash, rev, Xbit_IPC[x].xbit_hash) != -1 )
+        {
+            rev++;
+        }
+
+    Xbit_IPC[x].xbit_rev = rev;
+    IPC_Index_Insert(Xbit_Index, Xbit_IPC[x].xbit_name_hash, rev, Xbit_IPC[x].xbit_hash, x);
+
+}
+
+/*****************************************************************************
+ * Xbit_Remove_MMAP - Drops the xbit at "x".  The last xbit is moved into
+ * the hole so the table stays dense for saganpeek.  "x" must already be
+ * off the expiry wheel.  Caller holds IPC_Lock_All(XBIT)
+ *****************************************************************************/
+
+void Xbit_Remove_MMAP( int x )
+{
+
+    int last = counters_ipc->xbit_count - 1;
+    int y = 0;
 
-pthread_mutex_t Xbit_Mutex=PTHREAD_MUTEX_INITIALIZER;
+    uint32_t name_hash = Xbit_IPC[x].xbit_name_hash;
+    uint32_t hash = Xbit_IPC[x].xbit_hash;
+    uint32_t rev = Xbit_IPC[x].xbit_rev;
+    uint32_t top = rev;
+
+    IPC_Index_Delete(Xbit_Index, name_hash, rev, hash);
+
+    /* Keep the revs of a colliding key without gaps.  The highest one
+       takes the rev that was freed */
+
+    while ( IPC_Index_Find(Xbit_Index, name_hash, top + 1, hash) != -1 )
+        {
+            top++;
+        }
+
+    if ( top != rev )
+        {
+            y = IPC_Index_Find(Xbit_Index, name_hash, top, hash);
+            IPC_Index_Delete(Xbit_Index, name_hash, top, hash);
+            IPC_Index_Insert(Xbit_Index, name_hash, rev, hash, y);
+            Xbit_IPC[y].xbit_rev = rev;
+        }
+
+    if ( x != last )
+        {
+            Xbit_IPC[x] = Xbit_IPC[last];
+            memcpy(&Xbit_Message[x], &Xbit_Message[last], sizeof(struct _Sagan_IPC_Message));
+            IPC_Index_Move(Xbit_Index, Xbit_IPC[x].xbit_name_hash, Xbit_IPC[x].xbit_rev, Xbit_IPC[x].xbit_hash, x);
+            IPC_Wheel_Move(Xbit_Wheel, last, x);
+        }
+
+    counters_ipc->xbit_count--;
+
+}
+
+/*****************************************************************************
+ * Xbit_Update_MMAP - (Re)sets the xbit at "x" from the rule.  Caller holds
+ * the xbit's stripe or the whole table.
+ *****************************************************************************/
+
+static void Xbit_Update_MMAP( int x, int rule_position, int r, uint64_t now, char *syslog_message )
+{
+
+    Xbit_IPC[x].xbit_expire = now + RuleBody[rule_position].Xbit.xbit_expire[r];
+    Xbit_IPC[x].expire = RuleBody[rule_position].Xbit.xbit_expire[r];
+    Xbit_IPC[x].sid = RuleBody[rule_position].s_sid;
+
+    strlcpy(Xbit_Message[x].syslog_message, syslog_message, sizeof(Xbit_Message[x].syslog_message));
+    strlcpy(Xbit_Message[x].signature_msg, RuleBody[rule_position].s_msg, sizeof(Xbit_Message[x].signature_msg));
+
+}
 
 /*************************************************/
 /* Xbit_Set_MMAP - Used to "set", "unset" a xbit */
@@ -62,115 +179,123 @@ void Xbit_Set_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char, char
     int r = 0;
     int x = 0;
 
-    bool xbit_match = false;
     uint32_t hash;
+    uint32_t name_hash;
+    uint64_t now = Return_Epoch();
 
-    if ( Clean_IPC_Object(XBIT) == 0 )
+    for (r = 0; r < RuleBody[rule_position].Xbit.xbit_count; r++)
         {
 
-            for (r = 0; r < RuleBody[rule_position].Xbit.xbit_count; r++)
+            if ( RuleBody[rule_position].Xbit.xbit_type[r] != XBIT_SET &&
+                    RuleBody[rule_position].Xbit.xbit_type[r] != XBIT_UNSET )
                 {
+                    continue;
+                }
 
-                    if ( RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_SET )
-                        {
-
-                            hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
-
-                            xbit_match = false;
+            hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
+            name_hash = RuleBody[rule_position].Xbit.xbit_name_hash[r];
 
-                            for ( x = 0; x < counters_ipc->xbit_count; x++ )
-                                {
+            /* Refreshing an xbit that is already set only needs its stripe.
+               The expiry wheel is left alone,  unless this would bring the
+               expire time forward */
 
-                                    if ( hash == Xbit_IPC[x].xbit_hash && RuleBody[rule_position].Xbit.xbit_name_hash[r] == Xbit_IPC[x].xbit_name_hash )
-                                        {
+            IPC_Lock(XBIT, hash ^ name_hash);
 
-                                            if ( debug->debugxbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Got an xbit match at %d.  Updating xbit '%s' [hash: %u]", __FILE__, __LINE__, x, Xbit_IPC[x].xbit_name, Xbit_IPC[x].xbit_hash);
-                                                }
+            x = Xbit_Find_MMAP(name_hash, hash, RuleBody[rule_position].Xbit.xbit_name[r]);
 
-                                            xbit_match = true;
+            if ( x != -1 && RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_SET &&
+                    now + RuleBody[rule_position].Xbit.xbit_expire[r] >= Xbit_IPC[x].xbit_expire )
+                {
 
-                                            File_Lock(config->shm_xbit);
-                                            pthread_mutex_lock(&Xbit_Mutex);
+                    if ( debug->debugxbit )
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] Got an xbit match at %d.  Updating xbit '%s' [hash: %u]", __FILE__, __LINE__, x, Xbit_IPC[x].xbit_name, Xbit_IPC[x].xbit_hash);
+                        }
 
-                                            strlcpy(Xbit_IPC[x].syslog_message, syslog_message, sizeof(Xbit_IPC[x].syslog_message));
-                                            strlcpy(Xbit_IPC[x].signature_msg, RuleBody[rule_position].s_msg, sizeof(Xbit_IPC[x].signature_msg));
-                                            Xbit_IPC[x].xbit_expire = Return_Epoch() + RuleBody[rule_position].Xbit.xbit_expire[r];
-                                            Xbit_IPC[x].expire = RuleBody[rule_position].Xbit.xbit_expire[r];
-                                            Xbit_IPC[x].sid = RuleBody[rule_position].s_sid;
-                                            Xbit_IPC[x].xbit_hash = hash;
-                                            Xbit_IPC[x].xbit_name_hash = RuleBody[rule_position].Xbit.xbit_name_hash[r];
-                                            File_Unlock(config->shm_xbit);
-                                            pthread_mutex_unlock(&Xbit_Mutex);
+                    Xbit_Update_MMAP(x, rule_position, r, now, syslog_message);
 
-                                        }
+                    IPC_Unlock(XBIT, hash ^ name_hash);
+                    continue;
+                }
 
-                                }
+            IPC_Unlock(XBIT, hash ^ name_hash);
 
+            /* Nothing to unset */
 
-                            /* No xbit to update, add one */
+            if ( x == -1 && RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_UNSET )
+                {
+                    continue;
+                }
 
-                            if ( xbit_match == false )
-                                {
+            /* Adding or removing changes the index,  lock the table and look
+               again */
 
-                                    File_Lock(config->shm_xbit);
-                                    pthread_mutex_lock(&Xbit_Mutex);
+            IPC_Lock_All(XBIT);
 
-                                    strlcpy(Xbit_IPC[counters_ipc->xbit_count].xbit_name, RuleBody[rule_position].Xbit.xbit_name[r], sizeof(Xbit_IPC[counters_ipc->xbit_count].xbit_name));
-                                    strlcpy(Xbit_IPC[counters_ipc->xbit_count].syslog_message, syslog_message, sizeof(Xbit_IPC[counters_ipc->xbit_count].syslog_message));
-                                    strlcpy(Xbit_IPC[counters_ipc->xbit_count].signature_msg, RuleBody[rule_position].s_msg, sizeof(Xbit_IPC[counters_ipc->xbit_count].signature_msg));
+            Expire_IPC_Xbit(now, IPC_WHEEL_RECLAIM);
 
-                                    Xbit_IPC[counters_ipc->xbit_count].xbit_expire = Return_Epoch() + RuleBody[rule_position].Xbit.xbit_expire[r];
-                                    Xbit_IPC[x].expire = RuleBody[rule_position].Xbit.xbit_expire[r];
-                                    Xbit_IPC[counters_ipc->xbit_count].sid = RuleBody[rule_position].s_sid;
-                                    Xbit_IPC[counters_ipc->xbit_count].xbit_hash = hash;
-                                    Xbit_IPC[counters_ipc->xbit_count].xbit_name_hash = RuleBody[rule_position].Xbit.xbit_name_hash[r];
+            x = Xbit_Find_MMAP(name_hash, hash, RuleBody[rule_position].Xbit.xbit_name[r]);
 
-                                    if ( debug->debugxbit )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s, line %d] Adding xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
-                                        }
+            /* UNSET */
 
-                                    counters_ipc->xbit_count++;
+            if ( RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_UNSET )
+                {
 
-                                    pthread_mutex_unlock(&Xbit_Mutex);
-                                    File_Unlock(config->shm_xbit);
+                    if ( x != -1 )
+                        {
 
+                            if ( debug->debugxbit )
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] Unsetting xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
                                 }
 
+                            IPC_Wheel_Remove(Xbit_Wheel, x);
+                            Xbit_Remove_MMAP(x);
                         }
 
-                    /* UNSET */
+                    IPC_Unlock_All(XBIT);
+                    continue;
+                }
 
-                    else if ( RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_UNSET )
-                        {
+            /* SET - No xbit to update, add one.  If the table is full,  drop
+               what has expired first */
 
-                            hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
+            if ( x == -1 )
+                {
 
-                            xbit_match = false;
+                    if ( counters_ipc->xbit_count >= config->max_xbits && Clean_IPC_Xbit() != 0 )
+                        {
+                            IPC_Unlock_All(XBIT);
+                            continue;
+                        }
 
-                            for ( x = 0; x < counters_ipc->xbit_count; x++ )
-                                {
+                    x = counters_ipc->xbit_count;
 
-                                    if ( hash == Xbit_IPC[x].xbit_hash && RuleBody[rule_position].Xbit.xbit_name_hash[r] == Xbit_IPC[x].xbit_name_hash )
-                                        {
+                    strlcpy(Xbit_IPC[x].xbit_name, RuleBody[rule_position].Xbit.xbit_name[r], sizeof(Xbit_IPC[x].xbit_name));
+                    Xbit_IPC[x].xbit_hash = hash;
+                    Xbit_IPC[x].xbit_name_hash = name_hash;
 
-                                            if ( debug->debugxbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Unsetting xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
-                                                }
+                    Xbit_Index_Add_MMAP(x);
 
-                                            Xbit_IPC[x].xbit_expire = 0;
+                    counters_ipc->xbit_count++;
 
-                                        }
+                    if ( debug->debugxbit )
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] Adding xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
+                        }
+                }
+            else
+                {
+                    IPC_Wheel_Remove(Xbit_Wheel, x);
+                }
 
-                                }
+            Xbit_Update_MMAP(x, rule_position, r, now, syslog_message);
+            IPC_Wheel_Add(Xbit_Wheel, x, Xbit_IPC[x].xbit_expire);
 
-                        }
+            IPC_Unlock_All(XBIT);
+
+        } /* for (r = 0; r < RuleBody[rule_position].Xbit.xbit_count; r++) */
 
-                } /* for (r = 0; r < RuleBody[rule_position].Xbit.xbit_count; r++) */
-        }
 }
 
 /**********************************************************/
@@ -185,77 +310,58 @@ bool Xbit_Condition_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char
     int xbit_isset = 0;
     int xbit_isnotset = 0;
 
-    bool xbit_match = false;
-
     uint32_t hash;
+    uint32_t name_hash;
+    uint64_t now = Return_Epoch();
 
     for (r = 0; r < RuleBody[rule_position].Xbit.xbit_count; r++)
         {
 
-            if ( RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_ISSET )
+            if ( RuleBody[rule_position].Xbit.xbit_type[r] != XBIT_ISSET &&
+                    RuleBody[rule_position].Xbit.xbit_type[r] != XBIT_ISNOTSET )
                 {
+                    continue;
+                }
 
-                    hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
-
-                    for ( x = 0; x < counters_ipc->xbit_count; x++ )
-                        {
-
-                            if ( hash == Xbit_IPC[x].xbit_hash &&
-                                    RuleBody[rule_position].Xbit.xbit_name_hash[r] == Xbit_IPC[x].xbit_name_hash &&
-                                    Xbit_IPC[x].xbit_expire != 0 )
-                                {
+            hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
+            name_hash = RuleBody[rule_position].Xbit.xbit_name_hash[r];
 
-                                    if ( Return_Epoch() < Xbit_IPC[x].xbit_expire )
-                                        {
+            IPC_Lock(XBIT, hash ^ name_hash);
 
-                                            if ( debug->debugxbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' found for 'isset' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
-                                                }
+            x = Xbit_Find_MMAP(name_hash, hash, RuleBody[rule_position].Xbit.xbit_name[r]);
 
-                                            xbit_isset++;
-                                            break;
+            /* Expired xbits stay in the table until they are reclaimed */
 
-                                        }
-                                }
-                        }
+            if ( x != -1 && now >= Xbit_IPC[x].xbit_expire )
+                {
+                    x = -1;
                 }
 
-            else if ( RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_ISNOTSET )
-                {
+            IPC_Unlock(XBIT, hash ^ name_hash);
 
-                    hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
+            if ( RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_ISSET && x != -1 )
+                {
 
-                    for ( x = 0; x < counters_ipc->xbit_count; x++ )
+                    if ( debug->debugxbit )
                         {
-
-                            if ( hash == Xbit_IPC[x].xbit_hash &&
-                                    RuleBody[rule_position].Xbit.xbit_name_hash[r] == Xbit_IPC[x].xbit_name_hash &&
-                                    Xbit_IPC[x].xbit_expire != 0 )
-                                {
-                                    if ( Return_Epoch() < Xbit_IPC[x].xbit_expire )
-                                        {
-
-                                            xbit_match = true;
-                                            break;
-                                        }
-                                }
+                            Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' found for 'isset' at %d [hash: %u]", __FILE__, __LINE__, RuleBody[rule_position].Xbit.xbit_name[r], x, hash);
                         }
 
-                    if ( xbit_match == false )
-                        {
+                    xbit_isset++;
+                }
 
-                            if ( debug->debugxbit )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' not found for 'isnotset'", __FILE__, __LINE__, RuleBody[rule_position].Xbit.xbit_name[r]);
-                                }
+            else if ( RuleBody[rule_position].Xbit.xbit_type[r] == XBIT_ISNOTSET && x == -1 )
+                {
 
-                            xbit_isnotset++;
+                    if ( debug->debugxbit )
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' not found for 'isnotset'", __FILE__, __LINE__, RuleBody[rule_position].Xbit.xbit_name[r]);
                         }
+
+                    xbit_isnotset++;
                 }
         }
 
-
     /* check counts for set/unset! return if == */
 
     if ( RuleBody[rule_position].Xbit.xbit_isset_count == xbit_isset &&
@@ -278,4 +384,3 @@ bool Xbit_Condition_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char
     return(false);
 
 }
-
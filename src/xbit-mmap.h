@@ -22,7 +22,8 @@
 
 void Xbit_Set_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char, char *syslog_message );
 bool Xbit_Condition_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char);
-void Clean_Xbit_MMAP(void);
+void Xbit_Remove_MMAP( int x );
+void Xbit_Index_Add_MMAP( int x );
 
 typedef struct _Sagan_IPC_Xbit _Sagan_IPC_Xbit;
 struct _Sagan_IPC_Xbit
@@ -32,8 +33,7 @@ struct _Sagan_IPC_Xbit
     uint32_t xbit_name_hash;
     uint64_t xbit_expire;
     int expire;
-    char syslog_message[MAX_SYSLOGMSG];
+    uint32_t xbit_rev;		/* Index rev,  tells apart xbits whose name and tracking hashes collide */
     uint64_t sid;
-    char signature_msg[MAX_SAGAN_MSG];
 
 };
@@ -49,13 +49,6 @@ struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
 
-struct _Sagan_Redis_Write *Sagan_Redis_Write;
-
-pthread_cond_t SaganRedisDoWork;
-pthread_mutex_t SaganRedisWorkMutex;
-
-int redis_msgslot;
-
 /*******************************************************/
 /* Xbit_Set_Redis - set/unset xbit in Redis (threaded) */
 /*******************************************************/
@@ -69,6 +62,7 @@ void Xbit_Set_Redis(int rule_position, char *ip_src_char, char *ip_dst_char, _Sa
     int i = 0;
 
     char tmp_ip[MAXIP] = { 0 };
+    char redis_key[128] = { 0 };
 
     char tmp_data[MAX_SYSLOGMSG*2] = { 0 };
 
@@ -87,7 +81,10 @@ void Xbit_Set_Redis(int rule_position, char *ip_src_char, char *ip_dst_char, _Sa
                             Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' set in Redis for %s for %d seconds", __FILE__, __LINE__, rulestruct[rule_position].xbit_name[r], tmp_ip, rulestruct[rule_position].xbit_expire[r]);
                         }
 
-                    if ( redis_msgslot < config->redis_max_writer_threads )
+                    /* Don't bother building the JSON if the queue is full.  This is
+                       only a hint,  Redis_Writer_Push() checks again */
+
+                    if ( Redis_Writer_Queue_Depth() < config->redis_max_writer_threads * REDIS_WRITER_BATCH )
                         {
 
                             jobj = json_object_new_object();
@@ -137,25 +134,25 @@ void Xbit_Set_Redis(int rule_position, char *ip_src_char, char *ip_dst_char, _Sa
                             snprintf(tmp_data, sizeof(tmp_data), "%s", json_object_to_json_string(jobj));
                             tmp_data[sizeof(tmp_data) - 1] = '\0';
 
-                            /* Send to redis */
-
-                            pthread_mutex_lock(&SaganRedisWorkMutex);
-
-                            strlcpy(Sagan_Redis_Write[redis_msgslot].command, "SET", sizeof(Sagan_Redis_Write[redis_msgslot].command));
-                            snprintf(Sagan_Redis_Write[redis_msgslot].key, sizeof(Sagan_Redis_Write[redis_msgslot].key), "%s:%s:%s:%s", REDIS_PREFIX, config->sagan_cluster_name, rulestruct[rule_position].xbit_name[r], tmp_ip);
+                            json_object_put(jobj);
 
-                            strlcpy(Sagan_Redis_Write[redis_msgslot].value, tmp_data, sizeof(Sagan_Redis_Write[redis_msgslot].value));
-                            Sagan_Redis_Write[redis_msgslot].expire = rulestruct[rule_position].xbit_expire[r];
+                            /* Send to redis */
 
-                            redis_msgslot++;
+                            snprintf(redis_key, sizeof(redis_key), "%s:%s:%s:%s", REDIS_PREFIX, config->sagan_cluster_name, rulestruct[rule_position].xbit_name[r], tmp_ip);
 
-                            pthread_cond_signal(&SaganRedisDoWork);
-                            pthread_mutex_unlock(&SaganRedisWorkMutex);
+                            if ( Redis_Writer_Push( "SET", redis_key, tmp_data, rulestruct[rule_position].xbit_expire[r] ) == false )
+                                {
+                                    Sagan_Log(WARN, "[%s, line %d] Redis 'writer' queue is full for 'set'.  Skipping!", __FILE__, __LINE__);
+                                }
+                            else
+                                {
+                                    Redis_Reader_Cache_Update( redis_key, true );
+                                }
 
                         }
                     else
                         {
-                            Sagan_Log(WARN, "[%s, line %d] Out of Redis 'writer' threads for 'set'.  Skipping!", __FILE__, __LINE__);
+                            Sagan_Log(WARN, "[%s, line %d] Redis 'writer' queue is full for 'set'.  Skipping!", __FILE__, __LINE__);
                             __atomic_add_fetch(&counters->redis_writer_threads_drop, 1, __ATOMIC_SEQ_CST);
                         }
 
@@ -171,25 +168,15 @@ void Xbit_Set_Redis(int rule_position, char *ip_src_char, char *ip_dst_char, _Sa
                             Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' for %s unset in Redis", __FILE__, __LINE__, rulestruct[rule_position].xbit_name[r], tmp_ip);
                         }
 
-                    if ( redis_msgslot < config->redis_max_writer_threads )
-                        {
-
-                            pthread_mutex_lock(&SaganRedisWorkMutex);
-
-                            strlcpy(Sagan_Redis_Write[redis_msgslot].command, "DEL", sizeof(Sagan_Redis_Write[redis_msgslot].command));
-                            snprintf(Sagan_Redis_Write[redis_msgslot].key, sizeof(Sagan_Redis_Write[redis_msgslot].key), "%s:%s:%s:%s", REDIS_PREFIX, config->sagan_cluster_name, rulestruct[rule_position].xbit_name[r], tmp_ip);
-                            Sagan_Redis_Write[redis_msgslot].value[0] = '\0';
-                            Sagan_Redis_Write[redis_msgslot].expire = 0;
+                    snprintf(redis_key, sizeof(redis_key), "%s:%s:%s:%s", REDIS_PREFIX, config->sagan_cluster_name, rulestruct[rule_position].xbit_name[r], tmp_ip);
 
-                            redis_msgslot++;
-
-                            pthread_cond_signal(&SaganRedisDoWork);
-                            pthread_mutex_unlock(&SaganRedisWorkMutex);
+                    if ( Redis_Writer_Push( "DEL", redis_key, "", 0 ) == false )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] Redis 'writer' queue is full for 'unset'.  Skipping!", __FILE__, __LINE__);
                         }
                     else
                         {
-                            Sagan_Log(WARN, "[%s, line %d] Out of Redis 'writer' threads for 'set'.  Skipping!", __FILE__, __LINE__);
-                            __atomic_add_fetch(&counters->redis_writer_threads_drop, 1, __ATOMIC_SEQ_CST);
+                            Redis_Reader_Cache_Update( redis_key, false );
                         }
                 }
         }
@@ -203,38 +190,61 @@ bool Xbit_Condition_Redis(int rule_position, char *ip_src_char, char *ip_dst_cha
 {
 
     int r;
-    char redis_command[64] = { 0 };
-    char redis_results[32] = { 0 };
+    int i;
+    int count = 0;
+
+    char redis_keys[MAX_XBITS][128];
+    int xbit_position[MAX_XBITS];
+    bool redis_results[MAX_XBITS];
+
     char tmp_ip[MAXIP] = { 0 };
-    bool xbit_match = false;
+
+    /* Gather every isset/isnotset key for the rule,  so they all go to
+       Redis in one round trip */
 
     for (r = 0; r < rulestruct[rule_position].xbit_count; r++)
         {
 
+            if ( rulestruct[rule_position].xbit_type[r] != XBIT_ISSET && rulestruct[rule_position].xbit_type[r] != XBIT_ISNOTSET )
+                {
+                    continue;
+                }
+
             Xbit_Return_Tracking_IP( rule_position, r, ip_src_char, ip_dst_char, tmp_ip, sizeof(tmp_ip));
 
-            snprintf(redis_command, sizeof(redis_command),
-                     "GET %s:%s:%s:%s", REDIS_PREFIX, config->sagan_cluster_name, rulestruct[rule_position].xbit_name[r], tmp_ip);
+            snprintf(redis_keys[count], sizeof(redis_keys[count]), "%s:%s:%s:%s", REDIS_PREFIX, config->sagan_cluster_name, rulestruct[rule_position].xbit_name[r], tmp_ip);
+
+            xbit_position[count] = r;
+            count++;
+        }
+
+    if ( count > 0 )
+        {
+            Redis_Reader_Exists( redis_keys, count, redis_results );
+        }
+
+    for (i = 0; i < count; i++)
+        {
 
-            Redis_Reader ( (char *)redis_command, redis_results, sizeof(redis_results) );
+            r = xbit_position[i];
 
-            if ( redis_results[0] == '\0' && rulestruct[rule_position].xbit_type[r] == XBIT_ISSET )
+            if ( redis_results[i] == false && rulestruct[rule_position].xbit_type[r] == XBIT_ISSET )
                 {
 
                     if ( debug->debugxbit )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' was not found IP address %s for isset. Returning false.", __FILE__, __LINE__, rulestruct[rule_position].xbit_name[r], tmp_ip);
+                            Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' was not found for %s for isset. Returning false.", __FILE__, __LINE__, rulestruct[rule_position].xbit_name[r], redis_keys[i]);
                         }
 
                     return(false);
                 }
 
-            else if ( redis_results[0] != '\0' && rulestruct[rule_position].xbit_type[r] == XBIT_ISNOTSET )
+            else if ( redis_results[i] == true && rulestruct[rule_position].xbit_type[r] == XBIT_ISNOTSET )
                 {
 
                     if ( debug->debugxbit )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' was found for IP address %s for isnotset. Returning false.", __FILE__, __LINE__, rulestruct[rule_position].xbit_name[r], tmp_ip);
+                            Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' was found for %s for isnotset. Returning false.", __FILE__, __LINE__, rulestruct[rule_position].xbit_name[r], redis_keys[i]);
                         }
 
 
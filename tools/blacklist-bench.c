@@ -0,0 +1,410 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* blacklist-bench.c
+ *
+ * Writes a blacklist file of random prefixes (IPv4 /16 - /32,  one in ten
+ * IPv6 /32 - /128),  loads it with Sagan_Blacklist_Load() and checks every
+ * Sagan_Blacklist_IPADDR() answer against the old linear loop:
+ * is_inrange() on each entry in turn.  The old loop is given correct
+ * masks,  Mask2Bit() would have turned /32 into /24.  Half the lookups
+ * are inside a prefix,  half are random.
+ *
+ * Run without arguments by "make check".  With -b it also times loading
+ * and lookups with 10k,  100k and 1M prefixes.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "../src/sagan.h"
+#include "../src/sagan-defs.h"
+#include "../src/sagan-config.h"
+#include "../src/parsers/parsers.h"
+#include "../src/processors/blacklist.h"
+
+#define CHECK_PREFIXES		5000
+#define CHECK_LOOKUPS		200000
+
+#define BENCH_LOOKUPS		100000
+#define BENCH_OLD_LOOKUPS	1000		/* The old loop is that slow */
+
+#define SEED			0x5a9a4ULL
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+
+/* What the old loop walked: address and mask,  the layout is_inrange()
+   expects */
+
+struct Old_Entry
+{
+    unsigned char ipbits[MAXIPBIT];
+    unsigned char maskbits[MAXIPBIT];
+};
+
+static struct Old_Entry *old_entry = NULL;
+static int old_count = 0;
+
+/****************************************************************************
+ * Random - xorshift64*,  so every run sees the same prefixes
+ ****************************************************************************/
+
+static uint64_t Random( uint64_t *state )
+{
+
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return( *state * 2685821657736338717ULL );
+}
+
+/****************************************************************************
+ * Now_Nsec - Monotonic clock in nanoseconds
+ ****************************************************************************/
+
+static uint64_t Now_Nsec( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/****************************************************************************
+ * Write_Prefixes - Writes "count" random prefixes to a temporary file,
+ * keeping each one for the old loop.  Returns the file name.
+ ****************************************************************************/
+
+static char *Write_Prefixes( int count, uint64_t *state )
+{
+
+    static char filename[] = "/tmp/blacklist-bench.XXXXXX";
+
+    char text[INET6_ADDRSTRLEN];
+    FILE *fp;
+    int fd;
+    int mask;
+    int i;
+    int b;
+
+    strlcpy(filename, "/tmp/blacklist-bench.XXXXXX", sizeof(filename));
+
+    if ( ( fd = mkstemp(filename) ) == -1 || ( fp = fdopen(fd, "w") ) == NULL )
+        {
+            perror("mkstemp");
+            exit(1);
+        }
+
+    old_entry = realloc(old_entry, count * sizeof(struct Old_Entry));
+
+    if ( old_entry == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    fprintf(fp, "# blacklist-bench\n");
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            struct Old_Entry *e = &old_entry[i];
+            uint64_t r = Random(state);
+            bool v6 = r % 10 == 0;
+
+            memset(e, 0, sizeof(struct Old_Entry));
+
+            for ( b = 0; b < ( v6 ? MAXIPBIT : 4 ); b++ )
+                {
+                    e->ipbits[b] = Random(state) & 0xff;
+                }
+
+            mask = v6 ? 32 + ( r >> 8 ) % 97 : 16 + ( r >> 8 ) % 17;
+
+            for ( b = 0; b < MAXIPBIT; b++ )
+                {
+                    e->maskbits[b] = mask >= ( b + 1 ) * 8 ? 0xff : mask <= b * 8 ? 0x00 : (unsigned char)( 0xff << ( 8 - ( mask - b * 8 ) ) );
+                }
+
+            inet_ntop(v6 ? AF_INET6 : AF_INET, e->ipbits, text, sizeof(text));
+
+            /* Host /32s without a mask,  as feeds usually have them */
+
+            if ( v6 == false && mask == 32 )
+                {
+                    fprintf(fp, "%s\n", text);
+                }
+            else
+                {
+                    fprintf(fp, "%s/%d\n", text, mask);
+                }
+        }
+
+    fclose(fp);
+
+    old_count = count;
+
+    return(filename);
+
+}
+
+/****************************************************************************
+ * Old_Lookup - The loop Sagan_Blacklist_IPADDR() used to run
+ ****************************************************************************/
+
+static bool Old_Lookup( unsigned char *ipaddr )
+{
+
+    int i;
+
+    for ( i = 0; i < old_count; i++ )
+        {
+
+            if ( is_inrange(ipaddr, (unsigned char *)&old_entry[i], 1) )
+                {
+                    return(true);
+                }
+        }
+
+    return(false);
+
+}
+
+/****************************************************************************
+ * Load - Loads "filename" the way sagan.c does and returns the seconds it
+ * took
+ ****************************************************************************/
+
+static double Load( const char *filename )
+{
+
+    uint64_t start;
+
+    /* Sagan_Blacklist_Load() strtok()s the list in place */
+
+    strlcpy(config->blacklist_files, filename, sizeof(config->blacklist_files));
+
+    start = Now_Nsec();
+
+    Sagan_Blacklist_Init();
+    Sagan_Blacklist_Load();
+
+    return( (double)( Now_Nsec() - start ) / 1e9 );
+
+}
+
+/****************************************************************************
+ * Lookup_Address - Inside a random prefix (host bits random) or anywhere
+ ****************************************************************************/
+
+static void Lookup_Address( uint64_t *state, unsigned char *ipaddr )
+{
+
+    struct Old_Entry *e;
+    uint64_t r = Random(state);
+    int b;
+
+    memset(ipaddr, 0, MAXIPBIT);
+
+    if ( r & 1 )
+        {
+
+            e = &old_entry[( r >> 1 ) % old_count];
+
+            for ( b = 0; b < MAXIPBIT; b++ )
+                {
+                    ipaddr[b] = ( e->ipbits[b] & e->maskbits[b] ) | ( Random(state) & ~e->maskbits[b] );
+                }
+
+            /* Keep IPv4 in the 4 byte form IP2Bit() gives */
+
+            if ( e->maskbits[4] == 0 && !memcmp(e->ipbits + 4, "\0\0\0\0\0\0\0\0\0\0\0\0", 12) )
+                {
+                    memset(ipaddr + 4, 0, MAXIPBIT - 4);
+                }
+
+            return;
+        }
+
+    for ( b = 0; b < ( r & 6 ? 4 : MAXIPBIT ); b++ )
+        {
+            ipaddr[b] = Random(state) & 0xff;
+        }
+
+}
+
+/****************************************************************************
+ * Check - Sagan_Blacklist_IPADDR() must agree with the old loop
+ ****************************************************************************/
+
+static int Check( void )
+{
+
+    unsigned char ipaddr[MAXIPBIT];
+    uint64_t state = SEED;
+    char *filename;
+    bool expect;
+    bool got;
+    int errors = 0;
+    int hits = 0;
+    int i;
+
+    filename = Write_Prefixes(CHECK_PREFIXES, &state);
+    Load(filename);
+    unlink(filename);
+
+    for ( i = 0; i < CHECK_LOOKUPS; i++ )
+        {
+
+            Lookup_Address(&state, ipaddr);
+
+            expect = Old_Lookup(ipaddr);
+            got = Sagan_Blacklist_IPADDR(ipaddr);
+
+            if ( got != expect )
+                {
+
+                    if ( errors < 10 )
+                        {
+                            char text[INET6_ADDRSTRLEN];
+
+                            inet_ntop(AF_INET6, ipaddr, text, sizeof(text));
+                            fprintf(stderr, "%s: got %d,  old loop says %d\n", text, got, expect);
+                        }
+
+                    errors++;
+                }
+
+            hits += expect;
+        }
+
+    printf("Blacklist: %d prefixes,  %d lookups (%d hits),  %d mismatch(es)\n", CHECK_PREFIXES, CHECK_LOOKUPS, hits, errors);
+
+    return(errors);
+
+}
+
+/****************************************************************************
+ * Bench - Load time and lookup time,  old loop and range table
+ ****************************************************************************/
+
+static void Bench( int prefixes )
+{
+
+    static unsigned char (*ipaddr)[MAXIPBIT] = NULL;
+
+    uint64_t state = SEED ^ prefixes;
+    uint64_t start;
+    uint64_t old_ns;
+    uint64_t new_ns;
+    uint64_t old_hits = 0;
+    uint64_t hits = 0;
+
+    double load;
+    char *filename;
+    int i;
+
+    filename = Write_Prefixes(prefixes, &state);
+    load = Load(filename);
+    unlink(filename);
+
+    ipaddr = realloc(ipaddr, BENCH_LOOKUPS * MAXIPBIT);
+
+    if ( ipaddr == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    for ( i = 0; i < BENCH_LOOKUPS; i++ )
+        {
+            Lookup_Address(&state, ipaddr[i]);
+        }
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_OLD_LOOKUPS; i++ )
+        {
+            old_hits += Old_Lookup(ipaddr[i]);
+        }
+
+    old_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_LOOKUPS; i++ )
+        {
+            hits += Sagan_Blacklist_IPADDR(ipaddr[i]);
+        }
+
+    new_ns = Now_Nsec() - start;
+
+    printf("%8d prefixes: load %.2f s,  lookup old loop %.2f us (%" PRIu64 "/%d hits),  range table %.3f us (%" PRIu64 "/%d hits)\n",
+           prefixes, load, (double)old_ns / BENCH_OLD_LOOKUPS / 1000, old_hits, BENCH_OLD_LOOKUPS,
+           (double)new_ns / BENCH_LOOKUPS / 1000, hits, BENCH_LOOKUPS);
+
+}
+
+int main( int argc, char **argv )
+{
+
+    int errors;
+
+    config = calloc(1, sizeof(struct _SaganConfig));
+    counters = calloc(1, sizeof(struct _SaganCounters));
+    debug = calloc(1, sizeof(struct _SaganDebug));
+
+    if ( config == NULL || counters == NULL || debug == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    config->sagan_log_stream = stderr;
+    config->quiet = true;
+
+    errors = Check();
+
+    if ( argc > 1 && !strcmp(argv[1], "-b") )
+        {
+            Bench(10000);
+            Bench(100000);
+            Bench(1000000);
+        }
+
+    return( errors == 0 ? 0 : 1 );
+}
@@ -0,0 +1,602 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* brointel-bench.c
+ *
+ * Writes a Bro intel file of random indicators across all nine types,
+ * loads it with Sagan_BroIntel_Load_File() and checks the hash set and the
+ * automaton against a plain loop over the indicators: memcmp() for
+ * addresses,  strstr() for the substring types and a whole hex token
+ * compare for hex hashes.  Messages are 150 byte lower case lines,  one
+ * in ten with an indicator in it.
+ *
+ * Run without arguments by "make check".  With -b it also times loading,
+ * Sagan_BroIntel_Scan() and Sagan_BroIntel_IPADDR() against the loop with
+ * 10k,  100k and 1M indicators.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/sagan.h"
+#include "../src/sagan-defs.h"
+#include "../src/sagan-config.h"
+#include "../src/parsers/parsers.h"
+#include "../src/processors/bro-intel.h"
+
+#define CHECK_INDICATORS	2000
+#define CHECK_MESSAGES		20000
+#define CHECK_ADDRESSES		100000
+
+#define BENCH_MESSAGES		100000
+#define BENCH_OLD_MESSAGES	50		/* The old loop is that slow */
+#define BENCH_ADDRESSES		100000
+#define BENCH_OLD_ADDRESSES	200
+
+#define MESSAGE_LENGTH		150
+
+#define SEED			0x5a9a4ULL
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+
+typedef struct Indicator Indicator;
+struct Indicator
+{
+    char value[80];
+    uint16_t type;
+    bool token;				/* Hex hash,  matched as a whole token */
+    unsigned char bits[MAXIPBIT];	/* Intel::ADDR */
+};
+
+static struct Indicator *indicator = NULL;
+static int indicator_count = 0;
+
+static volatile uint64_t bench_sink = 0;	/* Keeps the timed calls */
+
+/****************************************************************************
+ * Random - xorshift64*,  so every run sees the same indicators
+ ****************************************************************************/
+
+static uint64_t Random( uint64_t *state )
+{
+
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return( *state * 2685821657736338717ULL );
+}
+
+/****************************************************************************
+ * Now_Nsec - Monotonic clock in nanoseconds
+ ****************************************************************************/
+
+static uint64_t Now_Nsec( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/****************************************************************************
+ * Random_Hex - "length" random hex digits
+ ****************************************************************************/
+
+static void Random_Hex( uint64_t *state, char *out, int length )
+{
+
+    int i;
+
+    for ( i = 0; i < length; i++ )
+        {
+            out[i] = "0123456789abcdef"[Random(state) & 0xf];
+        }
+
+    out[length] = '\0';
+
+}
+
+/****************************************************************************
+ * Write_Indicators - Writes "count" random indicators,  every value
+ * different,  to a temporary file and keeps them for the loop.  Returns
+ * the file name.
+ ****************************************************************************/
+
+static char *Write_Indicators( int count, uint64_t *state )
+{
+
+    static char filename[] = "/tmp/brointel-bench.XXXXXX";
+
+    static const char *type_name[] = { "Intel::ADDR", "Intel::DOMAIN", "Intel::FILE_HASH", "Intel::URL",
+                                       "Intel::SOFTWARE", "Intel::EMAIL", "Intel::USER_NAME", "Intel::FILE_NAME",
+                                       "Intel::CERT_HASH"
+                                     };
+
+    FILE *fp;
+    int fd;
+    int i;
+    int t;
+
+    uint64_t r;
+
+    strlcpy(filename, "/tmp/brointel-bench.XXXXXX", sizeof(filename));
+
+    if ( ( fd = mkstemp(filename) ) == -1 || ( fp = fdopen(fd, "w") ) == NULL )
+        {
+            perror("mkstemp");
+            exit(1);
+        }
+
+    indicator = realloc(indicator, count * sizeof(struct Indicator));
+
+    if ( indicator == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    fprintf(fp, "#fields\tindicator\tindicator_type\tmeta.source\n");
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            struct Indicator *ind = &indicator[i];
+
+            memset(ind, 0, sizeof(struct Indicator));
+
+            r = Random(state);
+
+            /* ADDR 30%,  DOMAIN 20%,  FILE_HASH 15%,  URL 10%,  the rest 5% */
+
+            t = r % 20;
+            t = t < 6 ? 0 : t < 10 ? 1 : t < 13 ? 2 : t < 15 ? 3 : t - 11;
+
+            ind->type = 1 << t;
+
+            switch ( ind->type )
+                {
+
+                case BROINTEL_ADDR:
+
+                    /* Routable,  so the lookup isn't short circuited */
+
+                    ind->bits[0] = 11 + ( r >> 8 ) % 80;
+                    ind->bits[1] = r >> 16;
+                    ind->bits[2] = r >> 24;
+                    ind->bits[3] = r >> 32;
+                    snprintf(ind->value, sizeof(ind->value), "%u.%u.%u.%u", ind->bits[0], ind->bits[1], ind->bits[2], ind->bits[3]);
+                    break;
+
+                case BROINTEL_DOMAIN:
+                    snprintf(ind->value, sizeof(ind->value), "bad%dq.example.net", i);
+                    break;
+
+                case BROINTEL_URL:
+                    snprintf(ind->value, sizeof(ind->value), "http://mal%dq.example.org/x.php", i);
+                    break;
+
+                case BROINTEL_SOFTWARE:
+                    snprintf(ind->value, sizeof(ind->value), "evilscan/%dq", i);
+                    break;
+
+                case BROINTEL_EMAIL:
+                    snprintf(ind->value, sizeof(ind->value), "spam%dq@example.com", i);
+                    break;
+
+                case BROINTEL_USER_NAME:
+                    snprintf(ind->value, sizeof(ind->value), "intruder%dq", i);
+                    break;
+
+                case BROINTEL_FILE_NAME:
+                    snprintf(ind->value, sizeof(ind->value), "dropper%dq.exe", i);
+                    break;
+
+                case BROINTEL_FILE_HASH:
+                    Random_Hex(state, ind->value, ( r >> 8 ) % 3 == 0 ? 32 : ( r >> 8 ) % 3 == 1 ? 40 : 64);
+                    ind->token = true;
+                    break;
+
+                case BROINTEL_CERT_HASH:
+                    Random_Hex(state, ind->value, 40);
+                    ind->token = true;
+                    break;
+
+                }
+
+            fprintf(fp, "%s\t%s\tbrointel-bench\n", ind->value, type_name[t]);
+        }
+
+    fclose(fp);
+
+    indicator_count = count;
+
+    return(filename);
+
+}
+
+/****************************************************************************
+ * Load - Loads "filename" the way sagan.c does and returns the seconds it
+ * took
+ ****************************************************************************/
+
+static double Load( const char *filename )
+{
+
+    uint64_t start;
+
+    /* Sagan_BroIntel_Load_File() strtok()s the list in place */
+
+    strlcpy(config->brointel_files, filename, sizeof(config->brointel_files));
+
+    start = Now_Nsec();
+
+    Sagan_BroIntel_Init();
+    Sagan_BroIntel_Load_File();
+
+    return( (double)( Now_Nsec() - start ) / 1e9 );
+
+}
+
+/****************************************************************************
+ * Random_Message - Lower case words,  one message in ten with a random
+ * indicator in the middle
+ ****************************************************************************/
+
+static void Random_Message( uint64_t *state, char *message )
+{
+
+    uint64_t r = Random(state);
+    int length = 0;
+    int word;
+
+    while ( length < MESSAGE_LENGTH )
+        {
+
+            for ( word = 2 + Random(state) % 8; word > 0 && length < MESSAGE_LENGTH; word-- )
+                {
+                    message[length++] = 'a' + Random(state) % 26;
+                }
+
+            message[length++] = ' ';
+
+            if ( r % 10 == 0 && length > MESSAGE_LENGTH / 2 )
+                {
+                    length += snprintf(message + length, 80, "%s ", indicator[( r >> 8 ) % indicator_count].value);
+                    r = 1;
+                }
+        }
+
+    message[length] = '\0';
+
+}
+
+/****************************************************************************
+ * Old_Scan - One search per indicator
+ ****************************************************************************/
+
+static int Old_Scan( const char *message )
+{
+
+    const char *p;
+    size_t length;
+    int found = 0;
+    int i;
+
+    for ( i = 0; i < indicator_count; i++ )
+        {
+
+            if ( indicator[i].type == BROINTEL_ADDR )
+                {
+                    continue;
+                }
+
+            p = strstr(message, indicator[i].value);
+
+            if ( p == NULL )
+                {
+                    continue;
+                }
+
+            if ( indicator[i].token == false )
+                {
+                    found |= indicator[i].type;
+                    continue;
+                }
+
+            /* Hex hashes have to be a whole run of hex digits */
+
+            length = strlen(indicator[i].value);
+
+            for ( ; p != NULL; p = strstr(p + 1, indicator[i].value) )
+                {
+
+                    if ( ( p == message || strchr("0123456789abcdef", p[-1]) == NULL ) &&
+                            ( p[length] == '\0' || strchr("0123456789abcdef", p[length]) == NULL ) )
+                        {
+                            found |= indicator[i].type;
+                            break;
+                        }
+                }
+        }
+
+    return(found);
+
+}
+
+/****************************************************************************
+ * Old_IPADDR - One memcmp() per Intel::ADDR
+ ****************************************************************************/
+
+static bool Old_IPADDR( unsigned char *ip )
+{
+
+    int i;
+
+    if ( is_notroutable(ip) )
+        {
+            return(false);
+        }
+
+    for ( i = 0; i < indicator_count; i++ )
+        {
+
+            if ( indicator[i].type == BROINTEL_ADDR && !memcmp(indicator[i].bits, ip, MAXIPBIT) )
+                {
+                    return(true);
+                }
+        }
+
+    return(false);
+
+}
+
+/****************************************************************************
+ * Random_Address - A loaded address half the time
+ ****************************************************************************/
+
+static void Random_Address( uint64_t *state, unsigned char *ip )
+{
+
+    uint64_t r = Random(state);
+    struct Indicator *ind = &indicator[( r >> 1 ) % indicator_count];
+
+    memset(ip, 0, MAXIPBIT);
+
+    if ( ( r & 1 ) && ind->type == BROINTEL_ADDR )
+        {
+            memcpy(ip, ind->bits, MAXIPBIT);
+            return;
+        }
+
+    ip[0] = 11 + ( r >> 8 ) % 80;
+    ip[1] = r >> 16;
+    ip[2] = r >> 24;
+    ip[3] = r >> 32;
+
+}
+
+/****************************************************************************
+ * Check - The set and automaton must agree with the loop
+ ****************************************************************************/
+
+static int Check( void )
+{
+
+    char message[MESSAGE_LENGTH + 96];
+    unsigned char ip[MAXIPBIT];
+
+    uint64_t state = SEED;
+    char *filename;
+
+    int errors = 0;
+    int hits = 0;
+    int expect;
+    int got;
+    int i;
+
+    filename = Write_Indicators(CHECK_INDICATORS, &state);
+    Load(filename);
+    unlink(filename);
+
+    for ( i = 0; i < CHECK_MESSAGES; i++ )
+        {
+
+            Random_Message(&state, message);
+
+            expect = Old_Scan(message);
+            got = Sagan_BroIntel_Scan(message);
+
+            if ( got != expect )
+                {
+
+                    if ( errors < 10 )
+                        {
+                            fprintf(stderr, "\"%s\": got 0x%04x,  expected 0x%04x\n", message, got, expect);
+                        }
+
+                    errors++;
+                }
+
+            hits += expect != 0;
+        }
+
+    printf("Bro Intel scan: %d indicators,  %d messages (%d with a hit),  %d mismatch(es)\n", CHECK_INDICATORS, CHECK_MESSAGES, hits, errors);
+
+    hits = 0;
+
+    for ( i = 0; i < CHECK_ADDRESSES; i++ )
+        {
+
+            Random_Address(&state, ip);
+
+            expect = Old_IPADDR(ip);
+            got = Sagan_BroIntel_IPADDR(ip, "brointel-bench");
+
+            if ( got != expect )
+                {
+
+                    if ( errors < 10 )
+                        {
+                            fprintf(stderr, "%u.%u.%u.%u: got %d,  expected %d\n", ip[0], ip[1], ip[2], ip[3], got, expect);
+                        }
+
+                    errors++;
+                }
+
+            hits += expect;
+        }
+
+    printf("Bro Intel addresses: %d lookups (%d hits),  %d total mismatch(es)\n", CHECK_ADDRESSES, hits, errors);
+
+    return(errors);
+
+}
+
+/****************************************************************************
+ * Bench - Load,  scan and address lookup times,  loop and new tables
+ ****************************************************************************/
+
+static void Bench( int indicators )
+{
+
+    static char (*message)[MESSAGE_LENGTH + 96] = NULL;
+    static unsigned char (*ip)[MAXIPBIT] = NULL;
+
+    uint64_t state = SEED ^ indicators;
+    uint64_t start;
+    uint64_t scan_old_ns;
+    uint64_t scan_new_ns;
+    uint64_t addr_old_ns;
+    uint64_t addr_new_ns;
+
+    double load;
+    char *filename;
+    int i;
+
+    filename = Write_Indicators(indicators, &state);
+    load = Load(filename);
+    unlink(filename);
+
+    message = realloc(message, BENCH_MESSAGES * sizeof(*message));
+    ip = realloc(ip, BENCH_ADDRESSES * sizeof(*ip));
+
+    if ( message == NULL || ip == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    for ( i = 0; i < BENCH_MESSAGES; i++ )
+        {
+            Random_Message(&state, message[i]);
+        }
+
+    for ( i = 0; i < BENCH_ADDRESSES; i++ )
+        {
+            Random_Address(&state, ip[i]);
+        }
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_OLD_MESSAGES; i++ )
+        {
+            bench_sink += Old_Scan(message[i]);
+        }
+
+    scan_old_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_MESSAGES; i++ )
+        {
+            bench_sink += Sagan_BroIntel_Scan(message[i]);
+        }
+
+    scan_new_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_OLD_ADDRESSES; i++ )
+        {
+            bench_sink += Old_IPADDR(ip[i]);
+        }
+
+    addr_old_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ADDRESSES; i++ )
+        {
+            bench_sink += Sagan_BroIntel_IPADDR(ip[i], "brointel-bench");
+        }
+
+    addr_new_ns = Now_Nsec() - start;
+
+    printf("%8d indicators: load %.2f s,  scan loop %.1f us / new %.2f us,  address loop %.2f us / new %.3f us\n",
+           indicators, load,
+           (double)scan_old_ns / BENCH_OLD_MESSAGES / 1000, (double)scan_new_ns / BENCH_MESSAGES / 1000,
+           (double)addr_old_ns / BENCH_OLD_ADDRESSES / 1000, (double)addr_new_ns / BENCH_ADDRESSES / 1000);
+
+}
+
+int main( int argc, char **argv )
+{
+
+    int errors;
+
+    config = calloc(1, sizeof(struct _SaganConfig));
+    counters = calloc(1, sizeof(struct _SaganCounters));
+    debug = calloc(1, sizeof(struct _SaganDebug));
+
+    if ( config == NULL || counters == NULL || debug == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    config->sagan_log_stream = stderr;
+    config->quiet = true;
+
+    errors = Check();
+
+    if ( argc > 1 && !strcmp(argv[1], "-b") )
+        {
+            Bench(10000);
+            Bench(100000);
+            Bench(1000000);
+        }
+
+    return( errors == 0 ? 0 : 1 );
+}
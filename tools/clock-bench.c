@@ -0,0 +1,244 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* clock-bench.c
+ *
+ * Checks Return_Epoch() against time() and Return_Local_Time() against
+ * localtime_r(),  including from a second thread,  then (with -b) times
+ * them against the time(),  localtime(),  strftime() and atol() way the
+ * per event code used to read the clock.
+ *
+ * Run without arguments by "make check".
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../src/sagan.h"
+#include "../src/util-time.h"
+
+#define CHECK_ROUNDS	200000
+#define BENCH_ROUNDS	2000000
+
+/****************************************************************************
+ * Sagan_Log - util-time.c only logs on unknown time units
+ ****************************************************************************/
+
+void Sagan_Log (int type, const char *format,... )
+{
+
+    va_list ap;
+
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+
+    if ( type == ERROR )
+        {
+            exit(1);
+        }
+}
+
+/****************************************************************************
+ * Now_Nsec - Monotonic clock in nanoseconds
+ ****************************************************************************/
+
+static uint64_t Now_Nsec( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/****************************************************************************
+ * Check - Return_Epoch() may trail time() by one coarse clock tick,  never
+ * more than a second.  Return_Local_Time() must agree with localtime_r()
+ * for the epoch it was built from.
+ ****************************************************************************/
+
+static void *Check( void *arg )
+{
+
+    struct tm *tm;
+    struct tm expect;
+
+    uint64_t epoch;
+    time_t now;
+
+    int *errors = arg;
+    int i;
+
+    for ( i = 0; i < CHECK_ROUNDS && *errors < 10; i++ )
+        {
+
+            now = time(NULL);
+            epoch = Return_Epoch();
+
+            if ( epoch + 1 < (uint64_t)now || epoch > (uint64_t)now + 1 )
+                {
+                    fprintf(stderr, "Return_Epoch() %lu,  time() %lu\n", (unsigned long)epoch, (unsigned long)now);
+                    (*errors)++;
+                }
+
+            tm = Return_Local_Time();
+            epoch = Return_Epoch();
+            now = (time_t)epoch;
+
+            localtime_r(&now, &expect);
+
+            /* The second may have turned between the two calls */
+
+            if ( tm->tm_sec != expect.tm_sec )
+                {
+                    continue;
+                }
+
+            if ( tm->tm_min != expect.tm_min || tm->tm_hour != expect.tm_hour ||
+                    tm->tm_wday != expect.tm_wday || tm->tm_mday != expect.tm_mday ||
+                    tm->tm_year != expect.tm_year )
+                {
+                    fprintf(stderr, "Return_Local_Time() %02d:%02d:%02d,  localtime_r() %02d:%02d:%02d\n",
+                            tm->tm_hour, tm->tm_min, tm->tm_sec, expect.tm_hour, expect.tm_min, expect.tm_sec);
+                    (*errors)++;
+                }
+        }
+
+    return(NULL);
+}
+
+/****************************************************************************
+ * Bench - One call each way,  BENCH_ROUNDS times
+ ****************************************************************************/
+
+static void Bench( void )
+{
+
+    struct tm *tm;
+    time_t t;
+
+    char tmp[64];
+    uint64_t start;
+    uint64_t old_ns;
+    uint64_t new_ns;
+
+    volatile uint64_t sink = 0;
+    int i;
+
+    /* The epoch */
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            t = time(NULL);
+            tm = localtime(&t);
+            strftime(tmp, sizeof(tmp), "%s",  tm);
+            sink += atol(tmp);
+        }
+
+    old_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            sink += Return_Epoch();
+        }
+
+    new_ns = Now_Nsec() - start;
+
+    printf("Epoch,  time+localtime+strftime+atol: %.1f ns/call\n", (double)old_ns / BENCH_ROUNDS);
+    printf("Epoch,  Return_Epoch()               : %.1f ns/call\n", (double)new_ns / BENCH_ROUNDS);
+
+    /* Day of the week and HHMM,  like Check_Time() */
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            t = time(NULL);
+            tm = localtime(&t);
+            strftime(tmp, sizeof(tmp), "%H%M",  tm);
+            sink += atol(tmp) + tm->tm_wday;
+        }
+
+    old_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            tm = Return_Local_Time();
+            sink += tm->tm_hour * 100 + tm->tm_min + tm->tm_wday;
+        }
+
+    new_ns = Now_Nsec() - start;
+
+    printf("HHMM,   time+localtime+strftime+atol: %.1f ns/call\n", (double)old_ns / BENCH_ROUNDS);
+    printf("HHMM,   Return_Local_Time()          : %.1f ns/call\n", (double)new_ns / BENCH_ROUNDS);
+}
+
+int main( int argc, char **argv )
+{
+
+    pthread_t thread;
+
+    int errors = 0;
+    int thread_errors = 0;
+
+    /* Return_Local_Time() is per thread,  so check it from two at once */
+
+    if ( pthread_create(&thread, NULL, Check, &thread_errors) != 0 )
+        {
+            perror("pthread_create");
+            return(1);
+        }
+
+    Check(&errors);
+
+    pthread_join(thread, NULL);
+
+    errors += thread_errors;
+
+    printf("Return_Epoch() / Return_Local_Time(): %d rounds in 2 threads,  %d mismatch(es)\n", CHECK_ROUNDS, errors);
+
+    if ( argc > 1 && !strcmp(argv[1], "-b") )
+        {
+            Bench();
+        }
+
+    return( errors == 0 ? 0 : 1 );
+}
@@ -0,0 +1,425 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* reader-fuzz.c
+ *
+ * Feeds lines of random length through a FIFO (mkfifo(),  opened the way
+ * Sagan opens its input),  written in chunks of random size by a child,  and checks that the FIFO block reader (input-reader.c)
+ * hands every line back intact.  Lines longer than MAX_SYSLOGMSG - 1
+ * must come back cut at that length,  with nothing of their tail showing
+ * up as a line of its own.  The last line has no \n.
+ *
+ * Run without arguments by "make check".  With -b it also times how fast
+ * lines come out of the reader,  read(2) from the FIFO included.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "../src/sagan.h"
+#include "../src/sagan-defs.h"
+#include "../src/input-reader.h"
+
+#define FUZZ_LINES		100000
+#define FUZZ_SEED		0x5a9a4ULL
+#define FUZZ_MAX_CHUNK		70000
+
+#define BENCH_LINES		5000000
+
+/****************************************************************************
+ * Sagan_Log - input-reader.c only logs to abort
+ ****************************************************************************/
+
+void Sagan_Log (int type, const char *format,... )
+{
+
+    va_list ap;
+
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+
+    if ( type == ERROR )
+        {
+            exit(1);
+        }
+}
+
+/****************************************************************************
+ * Fuzz_Random - xorshift64,  so the writer and the reader can generate the
+ * same lines from the same seed
+ ****************************************************************************/
+
+static uint64_t Fuzz_Random( uint64_t *state )
+{
+
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return(*state);
+}
+
+/****************************************************************************
+ * Fuzz_Line - Line number "n".  Most lines are syslog sized,  some are
+ * empty,  some sit right at the MAX_SYSLOGMSG boundary and some are several
+ * times longer than it.
+ ****************************************************************************/
+
+static size_t Fuzz_Line( uint64_t n, char *buf )
+{
+
+    uint64_t state = ( n + 1 ) * 0x9e3779b97f4a7c15ULL;
+    size_t length;
+    size_t i;
+
+    switch ( Fuzz_Random(&state) % 16 )
+        {
+
+        case 0:
+            length = 0;
+            break;
+
+        case 1:
+            length = MAX_SYSLOGMSG - 3 + Fuzz_Random(&state) % 5;
+            break;
+
+        case 2:
+            length = MAX_SYSLOGMSG + Fuzz_Random(&state) % ( MAX_SYSLOGMSG * 6 );
+            break;
+
+        default:
+            length = 1 + Fuzz_Random(&state) % 600;
+            break;
+        }
+
+    for ( i = 0; i < length; i++ )
+        {
+            buf[i] = ' ' + Fuzz_Random(&state) % 95;
+        }
+
+    return(length);
+}
+
+/****************************************************************************
+ * Fuzz_Writer - Writes "lines" lines to "fd" in chunks of random size
+ ****************************************************************************/
+
+static void Fuzz_Writer( int fd, uint64_t lines )
+{
+
+    static char line[MAX_SYSLOGMSG * 8];
+    static char out[FUZZ_MAX_CHUNK * 2];
+
+    uint64_t state = FUZZ_SEED;
+    uint64_t n;
+
+    size_t used = 0;
+    size_t chunk = FUZZ_MAX_CHUNK;
+    size_t length;
+    size_t done;
+    size_t sent;
+    ssize_t rc;
+
+    for ( n = 0; n < lines; n++ )
+        {
+
+            length = Fuzz_Line(n, line);
+
+            /* The last line has no \n */
+
+            if ( n + 1 < lines )
+                {
+                    line[length++] = '\n';
+                }
+
+            for ( done = 0; done < length; )
+                {
+
+                    if ( used == 0 )
+                        {
+                            chunk = 1 + Fuzz_Random(&state) % FUZZ_MAX_CHUNK;
+                        }
+
+                    while ( done < length && used < chunk )
+                        {
+                            out[used++] = line[done++];
+                        }
+
+                    if ( used == chunk )
+                        {
+
+                            for ( sent = 0; sent < used; sent += rc )
+                                {
+
+                                    rc = write(fd, out + sent, used - sent);
+
+                                    if ( rc <= 0 )
+                                        {
+                                            _exit(1);
+                                        }
+                                }
+
+                            used = 0;
+                        }
+                }
+        }
+
+    if ( used > 0 && write(fd, out, used) != (ssize_t)used )
+        {
+            _exit(1);
+        }
+
+    close(fd);
+}
+
+/****************************************************************************
+ * Bench_Writer - Writes "lines" syslog sized lines,  64 KB at a time
+ ****************************************************************************/
+
+static void Bench_Writer( int fd, uint64_t lines )
+{
+
+    static char block[65536];
+
+    uint64_t state = FUZZ_SEED;
+    uint64_t per_block = 0;
+    uint64_t n;
+
+    size_t used = 0;
+    size_t length;
+    size_t sent;
+    ssize_t rc;
+
+    /* The same block over and over,  so the writer is not what is timed */
+
+    for (;;)
+        {
+
+            length = 40 + Fuzz_Random(&state) % 400;
+
+            if ( used + length + 1 > sizeof(block) )
+                {
+                    break;
+                }
+
+            memset(block + used, 'x', length);
+            block[used + length] = '\n';
+            used += length + 1;
+            per_block++;
+        }
+
+    for ( n = 0; n < lines; n += per_block )
+        {
+
+            for ( sent = 0; sent < used; sent += rc )
+                {
+
+                    rc = write(fd, block + sent, used - sent);
+
+                    if ( rc <= 0 )
+                        {
+                            _exit(1);
+                        }
+                }
+        }
+
+    close(fd);
+}
+
+/****************************************************************************
+ * Fuzz_Run - Reads "lines" lines back and compares them.  Returns the
+ * number of bad lines.
+ ****************************************************************************/
+
+static uint64_t Fuzz_Run( uint64_t lines, bool compare, double *seconds )
+{
+
+    static char expect[MAX_SYSLOGMSG * 8];
+
+    struct _Sagan_Input_Reader reader;
+    struct timespec start;
+    struct timespec end;
+
+    char dir[] = "/tmp/reader-fuzz.XXXXXX";
+    char fifo[64];
+
+    int fd;
+    pid_t pid;
+
+    uint64_t n = 0;
+    uint64_t errors = 0;
+    uint64_t truncated = 0;
+
+    size_t expect_length;
+    size_t length;
+    char *line;
+
+    if ( mkdtemp(dir) == NULL )
+        {
+            perror("mkdtemp");
+            exit(1);
+        }
+
+    snprintf(fifo, sizeof(fifo), "%s/fifo", dir);
+
+    if ( mkfifo(fifo, 0600) != 0 )
+        {
+            perror("mkfifo");
+            rmdir(dir);
+            exit(1);
+        }
+
+    pid = fork();
+
+    if ( pid == 0 )
+        {
+
+            if (( fd = open(fifo, O_WRONLY)) == -1 )
+                {
+                    _exit(1);
+                }
+
+            if ( compare == true )
+                {
+                    Fuzz_Writer(fd, lines);
+                }
+            else
+                {
+                    Bench_Writer(fd, lines);
+                }
+
+            _exit(0);
+        }
+
+    /* Blocks until the child opens its end */
+
+    if (( fd = open(fifo, O_RDONLY)) == -1 )
+        {
+            perror("open");
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            unlink(fifo);
+            rmdir(dir);
+            exit(1);
+        }
+
+    unlink(fifo);
+    rmdir(dir);
+
+    Input_Reader_Init(&reader, fd, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ( ( line = Input_Reader_Line(&reader, &length) ) != NULL )
+        {
+
+            if ( compare == true )
+                {
+
+                    expect_length = n < lines ? Fuzz_Line(n, expect) : 0;
+
+                    if ( expect_length > MAX_SYSLOGMSG - 1 )
+                        {
+                            expect_length = MAX_SYSLOGMSG - 1;
+                            truncated++;
+                        }
+
+                    if ( n >= lines || length != expect_length || strlen(line) != length ||
+                            memcmp(line, expect, length) )
+                        {
+
+                            if ( errors < 10 )
+                                {
+                                    fprintf(stderr, "Line %" PRIu64 ": got %zu bytes,  expected %zu\n", n, length, expect_length);
+                                }
+
+                            errors++;
+                        }
+                }
+
+            n++;
+        }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *seconds = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+
+    waitpid(pid, NULL, 0);
+    close(fd);
+
+    /* A last empty line without a \n is no line at all */
+
+    if ( compare == true && n != lines && !( n + 1 == lines && Fuzz_Line(lines - 1, expect) == 0 ) )
+        {
+            fprintf(stderr, "Read %" PRIu64 " lines,  expected %" PRIu64 "\n", n, lines);
+            errors++;
+        }
+
+    if ( compare == true && reader.truncated < truncated )
+        {
+            fprintf(stderr, "Reader counted %" PRIu64 " truncated lines,  expected at least %" PRIu64 "\n", reader.truncated, truncated);
+            errors++;
+        }
+
+    Input_Reader_Free(&reader);
+
+    return(errors);
+}
+
+int main( int argc, char **argv )
+{
+
+    uint64_t errors;
+    double seconds;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    errors = Fuzz_Run(FUZZ_LINES, true, &seconds);
+
+    printf("Input reader: %d lines in random chunks,  %" PRIu64 " bad line(s)\n", FUZZ_LINES, errors);
+
+    if ( argc > 1 && !strcmp(argv[1], "-b") )
+        {
+            Fuzz_Run(BENCH_LINES, false, &seconds);
+            printf("Input reader: about %d lines in %.2f seconds (%.0f lines/sec)\n", BENCH_LINES, seconds, BENCH_LINES / seconds);
+        }
+
+    return( errors == 0 ? 0 : 1 );
+}
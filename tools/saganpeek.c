@@ -48,6 +48,7 @@
 #include "../src/sagan-defs.h"
 #include "../src/flexbit-mmap.h"
 #include "../src/xbit-mmap.h"
+#include "../src/ipc.h"
 #include "../src/util-time.h"
 
 #include "../src/processors/track-clients.h"
@@ -146,6 +147,9 @@ int main(int argc, char **argv)
     struct _Sagan_Track_Clients_IPC *SaganTrackClients_ipc;
     struct _After2_IPC *After2_IPC;
     struct _Threshold2_IPC *Threshold2_IPC;
+    struct _Sagan_IPC_Message *After2_Message;
+    struct _Sagan_IPC_Message *Threshold2_Message;
+    struct _Sagan_IPC_Message *Xbit_Message;
 
     signed char c;
 
@@ -164,6 +168,7 @@ int main(int argc, char **argv)
     uint64_t thresh_oldtime;
     uint64_t after_oldtime;
     uint64_t flexbit_oldtime;
+    bool flexbit_active = false;
 
     /* For convert to IP string */
 
@@ -309,12 +314,16 @@ int main(int argc, char **argv)
                     exit(1);
                 }
 
-            if (( Threshold2_IPC = mmap(0, sizeof(_Threshold2_IPC) + (sizeof(_Threshold2_IPC) * counters_ipc->thresh2_count ) , PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+            /* Entries first,  then the last message for each (see ipc.h) */
+
+            if (( Threshold2_IPC = mmap(0, IPC_INDEX_OFFSET(sizeof(_Threshold2_IPC), counters_ipc->thresh2_max), PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
                 {
                     fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
                     exit(1);
                 }
 
+            Threshold2_Message = (struct _Sagan_IPC_Message *)( (char *)Threshold2_IPC + IPC_MESSAGE_OFFSET(sizeof(_Threshold2_IPC), counters_ipc->thresh2_max) );
+
             close(shm);
 
             if ( counters_ipc->thresh2_count >= 1 )
@@ -337,7 +346,7 @@ int main(int argc, char **argv)
 
                                     printf("Type: Threshold [%d].\n", i);
 
-                                    printf("Tracking hash: %u\n", Threshold2_IPC[i].hash);
+                                    printf("Tracking hash: %" PRIu64 "\n", Threshold2_IPC[i].hash);
 
                                     printf("Tracking by:");
 
@@ -394,8 +403,8 @@ int main(int argc, char **argv)
                                         }
 
 
-                                    printf("Signature: \"%s\" (%" PRIu64 ")\n", Threshold2_IPC[i].signature_msg, Threshold2_IPC[i].sid);
-                                    printf("Syslog Message: \"%s\"\n", Threshold2_IPC[i].syslog_message);
+                                    printf("Signature: \"%s\" (%" PRIu64 ")\n", Threshold2_Message[i].signature_msg, Threshold2_IPC[i].sid);
+                                    printf("Syslog Message: \"%s\"\n", Threshold2_Message[i].syslog_message);
                                     printf("Date added/modified: %s\n", time_buf);
                                     printf("Target Count: %" PRIu64 "\n", Threshold2_IPC[i].target_count);
                                     printf("Counter: %" PRIu64 "\n", Threshold2_IPC[i].count);
@@ -430,12 +439,14 @@ int main(int argc, char **argv)
                     exit(1);
                 }
 
-            if (( After2_IPC = mmap(0, sizeof(_After2_IPC) + (sizeof(_After2_IPC) * counters_ipc->after2_count ) , PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+            if (( After2_IPC = mmap(0, IPC_INDEX_OFFSET(sizeof(_After2_IPC), counters_ipc->after2_max), PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
                 {
                     fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
                     exit(1);
                 }
 
+            After2_Message = (struct _Sagan_IPC_Message *)( (char *)After2_IPC + IPC_MESSAGE_OFFSET(sizeof(_After2_IPC), counters_ipc->after2_max) );
+
             close(shm);
 
             if ( counters_ipc->after2_count >= 1 )
@@ -457,7 +468,7 @@ int main(int argc, char **argv)
 
                                     u32_Time_To_Human(After2_IPC[i].utime, time_buf, sizeof(time_buf));
 
-                                    printf("Tracking hash: %u\n", After2_IPC[i].hash);
+                                    printf("Tracking hash: %" PRIu64 "\n", After2_IPC[i].hash);
 
                                     printf("Tracking by:");
 
@@ -514,8 +525,8 @@ int main(int argc, char **argv)
                                         }
 
 
-                                    printf("Signature: \"%s\" (Signature ID: %" PRIu64 " Revision: %d)\n", After2_IPC[i].signature_msg, After2_IPC[i].sid, After2_IPC[i].rev);
-                                    printf("Syslog Message: \"%s\"\n", After2_IPC[i].syslog_message);
+                                    printf("Signature: \"%s\" (Signature ID: %" PRIu64 " Revision: %d)\n", After2_Message[i].signature_msg, After2_IPC[i].sid, After2_IPC[i].rev);
+                                    printf("Syslog Message: \"%s\"\n", After2_Message[i].syslog_message);
                                     printf("Date added/modified: %s\n", time_buf);
                                     printf("Counter: %" PRIu64 "\n", After2_IPC[i].count);
 
@@ -563,7 +574,12 @@ int main(int argc, char **argv)
                     for (i= 0; i < counters_ipc->flexbit_count; i++ )
                         {
 
-                            if ( flexbit_ipc[i].flexbit_state == 1 || all_flag == true )
+                            /* Sagan doesn't clear the state of an expired flexbit,  it
+                               only drops it from the table later */
+
+                            flexbit_active = flexbit_ipc[i].flexbit_state == 1 && current_time < flexbit_ipc[i].flexbit_expire;
+
+                            if ( flexbit_active == true || all_flag == true )
                                 {
 
                                     u32_Time_To_Human(flexbit_ipc[i].flexbit_expire, time_buf, sizeof(time_buf));
@@ -572,7 +588,7 @@ int main(int argc, char **argv)
                                     printf("Type: flexbit [%d].\n", i);
 
                                     printf("Xbit name: \"%s\"\n", flexbit_ipc[i].flexbit_name);
-                                    printf("State: %s\n", flexbit_ipc[i].flexbit_state == 1 ? "ACTIVE" : "INACTIVE");
+                                    printf("State: %s\n", flexbit_active == true ? "ACTIVE" : "INACTIVE");
                                     printf("IP: %s:%d -> %s:%d\n", flexbit_ipc[i].ip_src, flexbit_ipc[i].src_port, flexbit_ipc[i].ip_dst, flexbit_ipc[i].dst_port);
                                     printf("Signature: \"%s\" (Signature ID: %" PRIu64 ")\n", flexbit_ipc[i].signature_msg, flexbit_ipc[i].sid);
                                     printf("Expire Time: %s (%d seconds)\n", time_buf, flexbit_ipc[i].expire);
@@ -611,7 +627,7 @@ int main(int argc, char **argv)
                             exit(1);
                         }
 
-                    if (( xbit_ipc = mmap(0, sizeof(_Sagan_IPC_Xbit) + (sizeof(_Sagan_IPC_Xbit) * counters_ipc->xbit_count ) , PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+                    if (( xbit_ipc = mmap(0, IPC_INDEX_OFFSET(sizeof(_Sagan_IPC_Xbit), counters_ipc->xbit_max), PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
                         {
                             fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
                             exit(1);
@@ -619,6 +635,8 @@ int main(int argc, char **argv)
 
                     close(shm);
 
+                    Xbit_Message = (struct _Sagan_IPC_Message *)( (char *)xbit_ipc + IPC_MESSAGE_OFFSET(sizeof(_Sagan_IPC_Xbit), counters_ipc->xbit_max) );
+
                     if ( counters_ipc->xbit_count >= 1 )
                         {
 
@@ -644,7 +662,7 @@ int main(int argc, char **argv)
                                                 }
 
                                             printf("IP Hash: %u\n", xbit_ipc[i].xbit_hash);
-                                            printf("Signature: \"%s\" (Signature ID: %" PRIu64 ")\n", xbit_ipc[i].signature_msg, xbit_ipc[i].sid);
+                                            printf("Signature: \"%s\" (Signature ID: %" PRIu64 ")\n", Xbit_Message[i].signature_msg, xbit_ipc[i].sid);
                                             printf("Expire Time: %d\n", xbit_ipc[i].expire);
                                             printf("Expired at: ");
 
@@ -657,7 +675,7 @@ int main(int argc, char **argv)
                                                     printf("%s\n", time_buf);
                                                 }
 
-                                            printf("Syslog Message: \"%s\"\n\n", xbit_ipc[i].syslog_message );
+                                            printf("Syslog Message: \"%s\"\n\n", Xbit_Message[i].syslog_message );
 
                                         }
 
@@ -0,0 +1,327 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* stristr-bench.c
+ *
+ * Checks Sagan_stristr() against the way it used to work (copy the
+ * message,  lower case it,  strstr() it) and against strcasestr() on
+ * random haystacks and needles,  then (with -b) times all three on syslog
+ * sized lines.
+ *
+ * Run without arguments by "make check".
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <ctype.h>
+
+#include "../src/sagan-defs.h"
+#include "../src/parsers/strstr-asm/strstr-hook.h"
+
+#define CHECK_ROUNDS	500000
+#define BENCH_ROUNDS	2000000
+#define BENCH_LINES	64
+
+/* Letters on both sides of the case boundaries,  so folding mistakes show */
+
+static const char alphabet[] = "aAbBzZyY@[`{09 :-\x80\xc1\xda\xfa";
+
+/****************************************************************************
+ * Now_Nsec - Monotonic clock in nanoseconds
+ ****************************************************************************/
+
+static uint64_t Now_Nsec( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/****************************************************************************
+ * Random_String - Fills "buf" with "len" bytes from "alphabet"
+ ****************************************************************************/
+
+static void Random_String( char *buf, size_t len )
+{
+
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+        {
+            buf[i] = alphabet[ rand() % ( sizeof(alphabet) - 1 ) ];
+        }
+
+    buf[len] = '\0';
+}
+
+/****************************************************************************
+ * Lower_String - 'A' - 'Z' to lower case,  like the rule loader does
+ ****************************************************************************/
+
+static void Lower_String( char *buf )
+{
+
+    for ( ; *buf != '\0'; buf++ )
+        {
+            if ( *buf >= 'A' && *buf <= 'Z' )
+                {
+                    *buf |= 0x20;
+                }
+        }
+}
+
+/****************************************************************************
+ * Old_Stristr - Sagan_stristr() before it folded in place: the haystack
+ * (and needle) copied to the stack,  lower cased with tolower() and
+ * searched with Sagan_strstr().  It returned a pointer into its own copy,
+ * here it's turned back into one into "haystack".
+ ****************************************************************************/
+
+static char *Old_Stristr( const char *haystack, const char *needle, bool needle_lower )
+{
+
+    char haystack_string[MAX_SYSLOGMSG] = { 0 };
+    char needle_string[512] = { 0 };
+    char *p = NULL;
+    char *cur = NULL;
+
+    strncpy(haystack_string, haystack, sizeof(haystack_string) - 1);
+
+    for ( cur = haystack_string; *cur != '\0'; cur++ )
+        {
+            *cur = tolower(*cur);
+        }
+
+    strncpy(needle_string, needle, sizeof(needle_string) - 1);
+
+    if ( needle_lower == true )
+        {
+            for ( cur = needle_string; *cur != '\0'; cur++ )
+                {
+                    *cur = tolower(*cur);
+                }
+        }
+
+    p = Sagan_strstr(haystack_string, needle_string);
+
+    return( p == NULL ? NULL : (char *)haystack + ( p - haystack_string ) );
+}
+
+/****************************************************************************
+ * Check - Sagan_stristr() must return the same pointer as the old copy and
+ * lower case path and as strcasestr()
+ ****************************************************************************/
+
+static int Check( void )
+{
+
+    char haystack[512];
+    char needle[64];
+    char needle_lower[64];
+
+    size_t h_len;
+    size_t n_len;
+    size_t start;
+
+    char *expect;
+    char *got;
+
+    int errors = 0;
+    int i;
+
+    for ( i = 0; i < CHECK_ROUNDS; i++ )
+        {
+
+            h_len = rand() % 300;
+            Random_String(haystack, h_len);
+
+            n_len = 1 + rand() % 40;
+
+            /* Half of the needles are taken from the haystack,  with the
+               case of the letters flipped at random */
+
+            if ( rand() % 2 && n_len <= h_len )
+                {
+
+                    start = rand() % ( h_len - n_len + 1 );
+                    memcpy(needle, haystack + start, n_len);
+                    needle[n_len] = '\0';
+
+                    for ( start = 0; start < n_len; start++ )
+                        {
+                            if ( rand() % 2 && ( ( needle[start] | 0x20 ) >= 'a' && ( needle[start] | 0x20 ) <= 'z' ) )
+                                {
+                                    needle[start] ^= 0x20;
+                                }
+                        }
+                }
+            else
+                {
+                    Random_String(needle, n_len % 4 + 1);
+                }
+
+            strcpy(needle_lower, needle);
+            Lower_String(needle_lower);
+
+            expect = strcasestr(haystack, needle);
+
+            got = Old_Stristr(haystack, needle, true);
+
+            if ( got != expect )
+                {
+                    fprintf(stderr, "old path vs strcasestr(): \"%s\" in \"%s\": %ld != %ld\n", needle, haystack,
+                            got ? (long)(got - haystack) : -1L, expect ? (long)(expect - haystack) : -1L);
+                    errors++;
+                }
+
+            got = Sagan_stristr(haystack, needle, true);
+
+            if ( got != expect )
+                {
+                    fprintf(stderr, "needle_lower=true:  \"%s\" in \"%s\": %ld != %ld\n", needle, haystack,
+                            got ? (long)(got - haystack) : -1L, expect ? (long)(expect - haystack) : -1L);
+                    errors++;
+                }
+
+            got = Sagan_stristr(haystack, needle_lower, false);
+
+            if ( got != expect )
+                {
+                    fprintf(stderr, "needle_lower=false: \"%s\" in \"%s\": %ld != %ld\n", needle_lower, haystack,
+                            got ? (long)(got - haystack) : -1L, expect ? (long)(expect - haystack) : -1L);
+                    errors++;
+                }
+
+            if ( errors > 10 )
+                {
+                    break;
+                }
+        }
+
+    printf("Sagan_stristr() vs old path and strcasestr(): %d rounds,  %d mismatch(es)\n", i, errors);
+
+    return( errors == 0 ? 0 : 1 );
+}
+
+/****************************************************************************
+ * Bench - Times Sagan_stristr(),  the old copy and lower case path and
+ * strcasestr() on syslog sized lines.  Most needles miss,  which is the
+ * common case in the rule loop.
+ ****************************************************************************/
+
+static void Bench( void )
+{
+
+    static const char *words[] = { "sshd", "Accepted", "password", "for", "root", "from", "192.168.1.10",
+                                   "port", "22", "FAILED", "LOGIN", "session", "opened", "user", "kernel:", "DROP"
+                                 };
+
+    char lines[BENCH_LINES][1024];
+    char *needles[] = { "authentication failure", "invalid user", "accepted password", "segfault at" };
+
+    uint64_t start;
+    uint64_t sagan_ns;
+    uint64_t old_ns;
+    uint64_t libc_ns;
+
+    size_t len;
+    volatile uintptr_t sink = 0;
+
+    int i;
+    int j;
+
+    for ( i = 0; i < BENCH_LINES; i++ )
+        {
+
+            len = 0;
+
+            while ( len < 200 + (size_t)( rand() % 400 ) )
+                {
+                    len += snprintf(lines[i] + len, sizeof(lines[i]) - len, "%s ", words[ rand() % 16 ]);
+                }
+        }
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            sink += (uintptr_t)Sagan_stristr(lines[i % BENCH_LINES], needles[i % 4], false);
+        }
+
+    sagan_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            sink += (uintptr_t)Old_Stristr(lines[i % BENCH_LINES], needles[i % 4], false);
+        }
+
+    old_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            sink += (uintptr_t)strcasestr(lines[i % BENCH_LINES], needles[i % 4]);
+        }
+
+    libc_ns = Now_Nsec() - start;
+
+    for ( j = 0, len = 0; j < BENCH_LINES; j++ )
+        {
+            len += strlen(lines[j]);
+        }
+
+    printf("Average line length: %zu bytes,  %d calls each\n", len / BENCH_LINES, BENCH_ROUNDS);
+    printf("Sagan_stristr()           : %.1f ns/call\n", (double)sagan_ns / BENCH_ROUNDS);
+    printf("Copy+lower case+strstr()  : %.1f ns/call\n", (double)old_ns / BENCH_ROUNDS);
+    printf("strcasestr()              : %.1f ns/call\n", (double)libc_ns / BENCH_ROUNDS);
+}
+
+int main( int argc, char **argv )
+{
+
+    int ret;
+
+    srand(1);
+
+    ret = Check();
+
+    if ( argc > 1 && !strcmp(argv[1], "-b") )
+        {
+            Bench();
+        }
+
+    return(ret);
+}
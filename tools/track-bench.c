@@ -0,0 +1,395 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* track-bench.c
+ *
+ * Builds threshold2/after2 keys with Track_Key() for random tuples (IPv4,
+ * IPv6 and host names,  ports,  usernames) and checks that two tuples get
+ * the same key only if they are the same tuple,  and that the 64 bit hash
+ * doesn't collide.  IPv4 addresses must not share a key with the IPv6
+ * address made of the same bytes.  The old "src|sport|dst|dport|user"
+ * string and its 32 bit Djb2 hash are counted alongside.
+ *
+ * Run without arguments by "make check".  With -b it also times
+ * Track_Key() against snprintf() + Djb2_Hash().
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "../src/sagan.h"
+#include "../src/sagan-defs.h"
+#include "../src/sagan-config.h"
+#include "../src/util-track.h"
+
+#define CHECK_TUPLES		1000000
+#define BENCH_ROUNDS		5000000
+#define USERNAMES		64
+
+#define SEED			0x5a9a4ULL
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+
+typedef struct Tuple Tuple;
+struct Tuple
+{
+    char ip_src[MAXIP];
+    char ip_dst[MAXIP];
+    uint32_t src_port;
+    uint32_t dst_port;
+    char username[32];
+
+    uint64_t hash;
+    uint32_t djb2;
+    struct _Sagan_Track_Key key;
+};
+
+static struct Tuple *tuple = NULL;
+
+static volatile uint64_t bench_sink = 0;	/* Keeps the timed calls */
+
+/****************************************************************************
+ * Random - xorshift64*,  so every run sees the same tuples
+ ****************************************************************************/
+
+static uint64_t Random( uint64_t *state )
+{
+
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return( *state * 2685821657736338717ULL );
+}
+
+/****************************************************************************
+ * Now_Nsec - Monotonic clock in nanoseconds
+ ****************************************************************************/
+
+static uint64_t Now_Nsec( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/****************************************************************************
+ * Random_Address - Mostly IPv4,  some IPv6,  a few host names
+ ****************************************************************************/
+
+static void Random_Address( uint64_t *state, char *ip )
+{
+
+    uint64_t r = Random(state);
+
+    switch ( r % 20 )
+        {
+
+        case 0:
+            snprintf(ip, MAXIP, "2001:db8:%x:%x::%x", (unsigned)( r >> 8 ) & 0xffff, (unsigned)( r >> 24 ) & 0xffff, (unsigned)( r >> 40 ) & 0xffff);
+            break;
+
+        case 1:
+            snprintf(ip, MAXIP, "host%u.example.com", (unsigned)( r >> 8 ) & 0xfffff);
+            break;
+
+        default:
+            snprintf(ip, MAXIP, "%u.%u.%u.%u", (unsigned)( r >> 8 ) & 0xff, (unsigned)( r >> 16 ) & 0xff, (unsigned)( r >> 24 ) & 0xff, (unsigned)( r >> 32 ) & 0xff);
+            break;
+        }
+
+}
+
+/****************************************************************************
+ * Old_Hash - What Threshold2()/After2() used to key on
+ ****************************************************************************/
+
+static uint32_t Old_Hash( struct Tuple *t )
+{
+
+    char hash_string[128] = { 0 };
+
+    snprintf(hash_string, sizeof(hash_string), "%s|%d|%s|%d|%s", t->ip_src, t->src_port, t->ip_dst, t->dst_port, t->username);
+
+    return( Djb2_Hash(hash_string) );
+
+}
+
+/****************************************************************************
+ * Same_Tuple - The fields Track_Key() was given are all the same
+ ****************************************************************************/
+
+static bool Same_Tuple( struct Tuple *a, struct Tuple *b )
+{
+
+    return( !strcmp(a->ip_src, b->ip_src) && !strcmp(a->ip_dst, b->ip_dst) &&
+            a->src_port == b->src_port && a->dst_port == b->dst_port &&
+            !strcmp(a->username, b->username) );
+
+}
+
+/****************************************************************************
+ * Compare_Key/Compare_Hash/Compare_Djb2 - qsort() orders,  so equal keys
+ * and hashes end up next to each other
+ ****************************************************************************/
+
+static int Compare_Key( const void *a, const void *b )
+{
+
+    return( memcmp(&((const struct Tuple *)a)->key, &((const struct Tuple *)b)->key, sizeof(struct _Sagan_Track_Key)) );
+
+}
+
+static int Compare_Hash( const void *a, const void *b )
+{
+
+    uint64_t ha = ((const struct Tuple *)a)->hash;
+    uint64_t hb = ((const struct Tuple *)b)->hash;
+
+    return( ha < hb ? -1 : ha > hb );
+
+}
+
+static int Compare_Djb2( const void *a, const void *b )
+{
+
+    uint32_t ha = ((const struct Tuple *)a)->djb2;
+    uint32_t hb = ((const struct Tuple *)b)->djb2;
+
+    return( ha < hb ? -1 : ha > hb );
+
+}
+
+/****************************************************************************
+ * Check - Keys and hashes of CHECK_TUPLES random tuples
+ ****************************************************************************/
+
+static int Check( void )
+{
+
+    struct _Sagan_Track_Key key_v4;
+    struct _Sagan_Track_Key key_v6;
+
+    uint64_t state = SEED;
+    uint64_t hash_v4;
+    uint64_t hash_v6;
+
+    int errors = 0;
+    int hash_collisions = 0;
+    int djb2_collisions = 0;
+    int i;
+
+    /* The same 16 bytes as an IPv4 and an IPv6 address */
+
+    hash_v4 = Track_Key(&key_v4, "1.2.3.4", 0, "", 0, "");
+    hash_v6 = Track_Key(&key_v6, "102:304::", 0, "", 0, "");
+
+    if ( hash_v4 == hash_v6 || !memcmp(&key_v4, &key_v6, sizeof(key_v4)) )
+        {
+            fprintf(stderr, "1.2.3.4 and 102:304:: share a key\n");
+            errors++;
+        }
+
+    tuple = calloc(CHECK_TUPLES, sizeof(struct Tuple));
+
+    if ( tuple == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    for ( i = 0; i < CHECK_TUPLES; i++ )
+        {
+
+            struct Tuple *t = &tuple[i];
+
+            Random_Address(&state, t->ip_src);
+            Random_Address(&state, t->ip_dst);
+            t->src_port = 1024 + Random(&state) % 64512;
+            t->dst_port = Random(&state) % 4 ? 22 : 443;
+            snprintf(t->username, sizeof(t->username), "user%u", (unsigned)( Random(&state) % USERNAMES ));
+
+            /* Some rules don't track by every field */
+
+            if ( i % 7 == 0 )
+                {
+                    t->username[0] = '\0';
+                    t->src_port = 0;
+                }
+
+            t->hash = Track_Key(&t->key, t->ip_src, t->src_port, t->ip_dst, t->dst_port, t->username);
+            t->djb2 = Old_Hash(t);
+        }
+
+    /* Equal keys must be equal tuples */
+
+    qsort(tuple, CHECK_TUPLES, sizeof(struct Tuple), Compare_Key);
+
+    for ( i = 1; i < CHECK_TUPLES; i++ )
+        {
+
+            if ( !memcmp(&tuple[i].key, &tuple[i-1].key, sizeof(struct _Sagan_Track_Key)) )
+                {
+
+                    if ( !Same_Tuple(&tuple[i], &tuple[i-1]) )
+                        {
+
+                            if ( errors < 10 )
+                                {
+                                    fprintf(stderr, "%s|%u|%s|%u|%s and %s|%u|%s|%u|%s share a key\n",
+                                            tuple[i].ip_src, tuple[i].src_port, tuple[i].ip_dst, tuple[i].dst_port, tuple[i].username,
+                                            tuple[i-1].ip_src, tuple[i-1].src_port, tuple[i-1].ip_dst, tuple[i-1].dst_port, tuple[i-1].username);
+                                }
+
+                            errors++;
+                        }
+
+                    else if ( tuple[i].hash != tuple[i-1].hash )
+                        {
+                            fprintf(stderr, "The same key hashed twice gave two hashes\n");
+                            errors++;
+                        }
+                }
+        }
+
+    /* Different keys with the same hash.  At 1M keys a 64 bit hash should
+       have none */
+
+    qsort(tuple, CHECK_TUPLES, sizeof(struct Tuple), Compare_Hash);
+
+    for ( i = 1; i < CHECK_TUPLES; i++ )
+        {
+
+            if ( tuple[i].hash == tuple[i-1].hash && memcmp(&tuple[i].key, &tuple[i-1].key, sizeof(struct _Sagan_Track_Key)) )
+                {
+                    hash_collisions++;
+                }
+        }
+
+    qsort(tuple, CHECK_TUPLES, sizeof(struct Tuple), Compare_Djb2);
+
+    for ( i = 1; i < CHECK_TUPLES; i++ )
+        {
+
+            if ( tuple[i].djb2 == tuple[i-1].djb2 && !Same_Tuple(&tuple[i], &tuple[i-1]) )
+                {
+                    djb2_collisions++;
+                }
+        }
+
+    printf("Track_Key(): %d tuples,  %d 64 bit hash collision(s) (Djb2: %d),  %d error(s)\n",
+           CHECK_TUPLES, hash_collisions, djb2_collisions, errors);
+
+    return( errors + hash_collisions );
+
+}
+
+/****************************************************************************
+ * Bench - Track_Key() with the addresses of the last event (every rule
+ * after the first),  with a new source each time,  and the old snprintf()
+ * + Djb2
+ ****************************************************************************/
+
+static void Bench( void )
+{
+
+    struct _Sagan_Track_Key key;
+
+    uint64_t start;
+    uint64_t same_ns;
+    uint64_t new_ns;
+    uint64_t old_ns;
+
+    int i;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            bench_sink += Track_Key(&key, tuple[0].ip_src, tuple[0].src_port, tuple[0].ip_dst, tuple[0].dst_port, tuple[0].username);
+        }
+
+    same_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            bench_sink += Track_Key(&key, tuple[i % CHECK_TUPLES].ip_src, tuple[0].src_port, tuple[0].ip_dst, tuple[0].dst_port, tuple[0].username);
+        }
+
+    new_ns = Now_Nsec() - start;
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            bench_sink += Old_Hash(&tuple[i % CHECK_TUPLES]);
+        }
+
+    old_ns = Now_Nsec() - start;
+
+    printf("snprintf() + Djb2_Hash()   : %.1f ns\n", (double)old_ns / BENCH_ROUNDS);
+    printf("Track_Key(), same addresses: %.1f ns\n", (double)same_ns / BENCH_ROUNDS);
+    printf("Track_Key(), new source    : %.1f ns\n", (double)new_ns / BENCH_ROUNDS);
+
+}
+
+int main( int argc, char **argv )
+{
+
+    int errors;
+
+    config = calloc(1, sizeof(struct _SaganConfig));
+    counters = calloc(1, sizeof(struct _SaganCounters));
+    debug = calloc(1, sizeof(struct _SaganDebug));
+
+    if ( config == NULL || counters == NULL || debug == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    config->sagan_log_stream = stderr;
+    config->quiet = true;
+
+    errors = Check();
+
+    if ( argc > 1 && !strcmp(argv[1], "-b") )
+        {
+            Bench();
+        }
+
+    return( errors == 0 ? 0 : 1 );
+}
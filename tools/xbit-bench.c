@@ -0,0 +1,408 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* xbit-bench.c
+ *
+ * Runs random xbit set/unset/isset/isnotset calls through xbit-mmap.c on
+ * a heap copy of the shared xbit object and checks every isset/isnotset
+ * against a plain table of what should be set.  Half of the xbit names
+ * share one name hash,  so lookups have to tell them apart by name.  Then
+ * a batch of short lived xbits is left to expire and be reclaimed.
+ *
+ * Run without arguments by "make check".  With -b it also times the calls
+ * with many tracked addresses.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../src/sagan.h"
+#include "../src/sagan-defs.h"
+#include "../src/sagan-config.h"
+#include "../src/rules.h"
+#include "../src/ipc.h"
+#include "../src/ipc-index.h"
+#include "../src/ipc-lock.h"
+#include "../src/ipc-wheel.h"
+#include "../src/xbit.h"
+#include "../src/xbit-mmap.h"
+#include "../src/util-time.h"
+
+#define CHECK_NAMES		32
+#define CHECK_IPS		500
+#define CHECK_ROUNDS		400000
+#define CHECK_EXPIRE_IPS	200
+
+#define BENCH_IPS		2500
+#define BENCH_XBITS		50000
+#define BENCH_ROUNDS		2000000
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+struct RuleBody *RuleBody;
+
+struct _Sagan_IPC_Counters *counters_ipc;
+struct _Sagan_IPC_Xbit *Xbit_IPC;
+struct _Sagan_IPC_Message *Xbit_Message;
+struct _Sagan_IPC_Index *Xbit_Index;
+struct _Sagan_IPC_Wheel *Xbit_Wheel;
+
+static char (*ips)[MAXIP];
+static bool *expect;
+
+/****************************************************************************
+ * Expire_IPC_Xbit/Clean_IPC_Xbit - Same as ipc.c,  which would bring every
+ * other shared table in with it
+ ****************************************************************************/
+
+int Expire_IPC_Xbit( uint64_t utime, int limit )
+{
+
+    int i = 0;
+    int dropped = 0;
+
+    while ( dropped < limit && ( i = IPC_Wheel_Next(Xbit_Wheel, utime) ) != -1 )
+        {
+
+            if ( utime < Xbit_IPC[i].xbit_expire )
+                {
+                    IPC_Wheel_Add(Xbit_Wheel, i, Xbit_IPC[i].xbit_expire);
+                    continue;
+                }
+
+            Xbit_Remove_MMAP(i);
+            dropped++;
+
+        }
+
+    return(dropped);
+
+}
+
+bool Clean_IPC_Xbit( void )
+{
+
+    return( Expire_IPC_Xbit(Return_Epoch(), INT_MAX) == 0 );
+
+}
+
+/****************************************************************************
+ * Now_Nsec - Monotonic clock in nanoseconds
+ ****************************************************************************/
+
+static uint64_t Now_Nsec( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/****************************************************************************
+ * Setup - One rule per xbit name and a heap copy of the xbit object,  laid
+ * out like ipc.c lays out the mmap() file
+ ****************************************************************************/
+
+static void Setup( int names, int max_ips, int max_xbits, int expire )
+{
+
+    size_t object_size;
+    int i;
+
+    config = calloc(1, sizeof(struct _SaganConfig));
+    counters = calloc(1, sizeof(struct _SaganCounters));
+    debug = calloc(1, sizeof(struct _SaganDebug));
+    counters_ipc = calloc(1, sizeof(struct _Sagan_IPC_Counters));
+    RuleBody = calloc(names, sizeof(struct RuleBody));
+
+    ips = calloc(max_ips, MAXIP);
+    expect = calloc((size_t)names * max_ips, sizeof(bool));
+
+    if ( config == NULL || counters == NULL || debug == NULL || counters_ipc == NULL ||
+            RuleBody == NULL || ips == NULL || expect == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    config->sagan_log_stream = stderr;
+    config->quiet = true;
+    config->max_xbits = max_xbits;
+
+    object_size = IPC_WHEEL_OFFSET(sizeof(_Sagan_IPC_Xbit), config->max_xbits) + IPC_Wheel_Bytes(config->max_xbits);
+
+    if ( ( Xbit_IPC = calloc(1, object_size) ) == NULL )
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+
+    Xbit_Message = (struct _Sagan_IPC_Message *)( (char *)Xbit_IPC + IPC_MESSAGE_OFFSET(sizeof(_Sagan_IPC_Xbit), config->max_xbits) );
+    Xbit_Index = (struct _Sagan_IPC_Index *)( (char *)Xbit_IPC + IPC_INDEX_OFFSET(sizeof(_Sagan_IPC_Xbit), config->max_xbits) );
+    Xbit_Wheel = (struct _Sagan_IPC_Wheel *)( (char *)Xbit_IPC + IPC_WHEEL_OFFSET(sizeof(_Sagan_IPC_Xbit), config->max_xbits) );
+
+    IPC_Index_Init(Xbit_Index, config->max_xbits);
+    IPC_Wheel_Init(Xbit_Wheel, config->max_xbits, Return_Epoch());
+    IPC_Lock_Init(true);
+
+    for ( i = 0; i < names; i++ )
+        {
+
+            snprintf(RuleBody[i].Xbit.xbit_name[0], sizeof(RuleBody[i].Xbit.xbit_name[0]), "xbit.%d", i);
+
+            /* Odd names all collide on the name hash */
+
+            RuleBody[i].Xbit.xbit_name_hash[0] = i % 2 ? 0x5a9a4 : Djb2_Hash(RuleBody[i].Xbit.xbit_name[0]);
+            RuleBody[i].Xbit.xbit_direction[0] = 1;
+            RuleBody[i].Xbit.xbit_expire[0] = expire;
+            RuleBody[i].Xbit.xbit_count = 1;
+            RuleBody[i].s_sid = 5000000 + i;
+            strlcpy(RuleBody[i].s_msg, "xbit-bench", sizeof(RuleBody[i].s_msg));
+        }
+
+    for ( i = 0; i < max_ips; i++ )
+        {
+            snprintf(ips[i], MAXIP, "10.%d.%d.%d", ( i >> 16 ) & 0xff, ( i >> 8 ) & 0xff, i & 0xff);
+        }
+
+}
+
+/****************************************************************************
+ * Xbit_Op - Runs one xbit call for rule "name" and address "ip".  Returns
+ * the condition result for isset/isnotset.
+ ****************************************************************************/
+
+static bool Xbit_Op( int name, int ip, int type )
+{
+
+    struct Xbit *xbit = &RuleBody[name].Xbit;
+
+    xbit->xbit_type[0] = type;
+    xbit->xbit_isset_count = type == XBIT_ISSET;
+    xbit->xbit_isnotset_count = type == XBIT_ISNOTSET;
+
+    if ( type == XBIT_SET || type == XBIT_UNSET )
+        {
+            Xbit_Set_MMAP(name, ips[ip], ips[ip], "xbit-bench");
+            return(true);
+        }
+
+    return( Xbit_Condition_MMAP(name, ips[ip], ips[ip]) );
+
+}
+
+/****************************************************************************
+ * Check - Random calls against the table of what should be set
+ ****************************************************************************/
+
+static int Check( void )
+{
+
+    int errors = 0;
+    int set = 0;
+    int i;
+    int j;
+
+    int name;
+    int ip;
+    int type;
+
+    bool got;
+
+    for ( i = 0; i < CHECK_ROUNDS && errors < 10; i++ )
+        {
+
+            name = rand() % CHECK_NAMES;
+            ip = rand() % CHECK_IPS;
+            type = 1 + rand() % 4;
+
+            got = Xbit_Op(name, ip, type);
+
+            if ( type == XBIT_SET )
+                {
+                    expect[ name * CHECK_IPS + ip ] = true;
+                }
+
+            else if ( type == XBIT_UNSET )
+                {
+                    expect[ name * CHECK_IPS + ip ] = false;
+                }
+
+            else if ( got != ( expect[ name * CHECK_IPS + ip ] == ( type == XBIT_ISSET ) ) )
+                {
+                    fprintf(stderr, "%s for %s / %s returned %s\n", type == XBIT_ISSET ? "isset" : "isnotset",
+                            RuleBody[name].Xbit.xbit_name[0], ips[ip], got ? "true" : "false");
+                    errors++;
+                }
+        }
+
+    for ( j = 0; j < CHECK_NAMES * CHECK_IPS; j++ )
+        {
+            set += expect[j];
+        }
+
+    if ( counters_ipc->xbit_count != set )
+        {
+            fprintf(stderr, "%d xbits in the table,  expected %d\n", counters_ipc->xbit_count, set);
+            errors++;
+        }
+
+    printf("Xbit set/unset/isset/isnotset: %d rounds,  %d names,  %d addresses,  %d mismatch(es)\n",
+           i, CHECK_NAMES, CHECK_IPS, errors);
+
+    return(errors);
+
+}
+
+/****************************************************************************
+ * Check_Expire - Sets that expire in a second must stop matching and be
+ * reclaimed by later sets
+ ****************************************************************************/
+
+static int Check_Expire( void )
+{
+
+    int errors = 0;
+    int before;
+    int set;
+    int i;
+
+    before = counters_ipc->xbit_count;
+
+    for ( i = 0; i < CHECK_EXPIRE_IPS; i++ )
+        {
+            RuleBody[i % CHECK_NAMES].Xbit.xbit_expire[0] = 1;
+            Xbit_Op(i % CHECK_NAMES, CHECK_IPS + i, XBIT_SET);
+            RuleBody[i % CHECK_NAMES].Xbit.xbit_expire[0] = 3600;
+        }
+
+    sleep(3);
+
+    for ( i = 0; i < CHECK_EXPIRE_IPS; i++ )
+        {
+            if ( Xbit_Op(i % CHECK_NAMES, CHECK_IPS + i, XBIT_ISSET) == true )
+                {
+                    errors++;
+                }
+        }
+
+    /* Every set reclaims a few expired xbits */
+
+    for ( i = 0; i < CHECK_EXPIRE_IPS; i++ )
+        {
+            Xbit_Op(i % CHECK_NAMES, i % CHECK_IPS, XBIT_UNSET);
+            Xbit_Op(i % CHECK_NAMES, i % CHECK_IPS, XBIT_SET);
+            expect[ ( i % CHECK_NAMES ) * CHECK_IPS + ( i % CHECK_IPS ) ] = true;
+        }
+
+    for ( i = 0; i < CHECK_EXPIRE_IPS; i++ )
+        {
+            if ( Xbit_Op(i % CHECK_NAMES, i % CHECK_IPS, XBIT_ISSET) == false )
+                {
+                    errors++;
+                }
+        }
+
+    for ( i = 0, set = 0; i < CHECK_NAMES * CHECK_IPS; i++ )
+        {
+            set += expect[i];
+        }
+
+    printf("Xbit expiry: %d short lived xbits,  %d table entries before,  %d after,  %d mismatch(es)\n",
+           CHECK_EXPIRE_IPS, before + CHECK_EXPIRE_IPS, counters_ipc->xbit_count, errors);
+
+    if ( counters_ipc->xbit_count != set )
+        {
+            fprintf(stderr, "%d xbits in the table,  expected %d.  Expired xbits were not reclaimed\n", counters_ipc->xbit_count, set);
+            errors++;
+        }
+
+    return(errors);
+
+}
+
+/****************************************************************************
+ * Bench - Random calls over BENCH_IPS addresses
+ ****************************************************************************/
+
+static void Bench( void )
+{
+
+    uint64_t start;
+    uint64_t ns;
+
+    int i;
+
+    Setup(CHECK_NAMES, BENCH_IPS, BENCH_XBITS, 3600);
+
+    /* Random set/unset settles at about half the pairs set,  start there */
+
+    for ( i = 0; i < CHECK_NAMES * BENCH_IPS / 2; i++ )
+        {
+            Xbit_Op(rand() % CHECK_NAMES, rand() % BENCH_IPS, XBIT_SET);
+        }
+
+    start = Now_Nsec();
+
+    for ( i = 0; i < BENCH_ROUNDS; i++ )
+        {
+            Xbit_Op(rand() % CHECK_NAMES, rand() % BENCH_IPS, 1 + rand() % 4);
+        }
+
+    ns = Now_Nsec() - start;
+
+    printf("Xbit calls: %d addresses,  %d xbits set,  %.1f ns/call\n", BENCH_IPS, counters_ipc->xbit_count, (double)ns / BENCH_ROUNDS);
+
+}
+
+int main( int argc, char **argv )
+{
+
+    int errors = 0;
+
+    srand(1);
+
+    Setup(CHECK_NAMES, CHECK_IPS + CHECK_EXPIRE_IPS, CHECK_NAMES * ( CHECK_IPS + CHECK_EXPIRE_IPS ), 3600);
+
+    errors += Check();
+    errors += Check_Expire();
+
+    if ( argc > 1 && !strcmp(argv[1], "-b") )
+        {
+            Bench();
+        }
+
+    return( errors == 0 ? 0 : 1 );
+}